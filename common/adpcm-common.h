@@ -0,0 +1,181 @@
+// Kinetoscope: A Sega Genesis Video Player
+//
+// Copyright (c) 2024 Joey Parrish
+//
+// See MIT License in LICENSE.txt
+
+// Shared ADPCM code.
+//
+// With SEGAVIDEO_COMPRESSION_ADPCM, the audio of each chunk is stored as
+// 4-bit IMA ADPCM, two samples per byte, low nibble first.  The decoder state
+// starts over with each chunk, so that playback can start at any chunk.  The
+// chunk header still describes the decoded chunk, so its padding keeps the
+// 8-bit PCM samples aligned once they are expanded on the way to SRAM.
+//
+// This sits after the RLE or LZ decoder, and takes one decompressed chunk at a
+// time.  Call adpcm_reset() before each chunk.
+
+// Where we are in the chunk.
+typedef enum {
+  ADPCM_CHUNK_HEADER,  // collecting SegaVideoChunkHeader
+  ADPCM_PRE_PADDING,  // passing through the padding before the audio
+  ADPCM_AUDIO,  // expanding the audio
+  ADPCM_PASS_THROUGH,  // passing everything else (the frames) through as-is
+} AdpcmPhase;
+
+static AdpcmPhase _adpcm_phase = ADPCM_CHUNK_HEADER;
+// Bytes of the current phase still to come.
+static uint32_t _adpcm_remaining = sizeof(SegaVideoChunkHeader);
+// The chunk header, collected so that we can parse it.
+static uint8_t _adpcm_chunk_header[sizeof(SegaVideoChunkHeader)];
+// Decoder state.
+static int32_t _adpcm_predictor = 0;
+static int _adpcm_step_index = 0;
+
+static const uint16_t _adpcm_step_table[89] = {
+  7, 8, 9, 10, 11, 12, 13, 14, 16, 17, 19, 21, 23, 25, 28, 31, 34, 37, 41, 45,
+  50, 55, 60, 66, 73, 80, 88, 97, 107, 118, 130, 143, 157, 173, 190, 209, 230,
+  253, 279, 307, 337, 371, 408, 449, 494, 544, 598, 658, 724, 796, 876, 963,
+  1060, 1166, 1282, 1411, 1552, 1707, 1878, 2066, 2272, 2499, 2749, 3024, 3327,
+  3660, 4026, 4428, 4871, 5358, 5894, 6484, 7132, 7845, 8630, 9493, 10442,
+  11487, 12635, 13899, 15289, 16818, 18500, 20350, 22385, 24623, 27086, 29794,
+  32767,
+};
+
+static const int8_t _adpcm_index_table[8] = {
+  -1, -1, -1, -1, 2, 4, 6, 8,
+};
+
+#if !defined(MIN)
+# define MIN(a, b) ((a) < (b) ? (a) : (b))
+#endif
+
+// Decodes one nibble to a signed 8-bit sample.  The predictor has 16 bits of
+// precision, and the output keeps the top 8.
+static uint8_t _adpcm_decode_nibble(uint8_t nibble) {
+  int32_t step = _adpcm_step_table[_adpcm_step_index];
+  int32_t diff = step >> 3;
+  if (nibble & 1) diff += step >> 2;
+  if (nibble & 2) diff += step >> 1;
+  if (nibble & 4) diff += step;
+
+  if (nibble & 8) {
+    _adpcm_predictor -= diff;
+    if (_adpcm_predictor < -32768) _adpcm_predictor = -32768;
+  } else {
+    _adpcm_predictor += diff;
+    if (_adpcm_predictor > 32767) _adpcm_predictor = 32767;
+  }
+
+  _adpcm_step_index += _adpcm_index_table[nibble & 7];
+  if (_adpcm_step_index < 0) _adpcm_step_index = 0;
+  if (_adpcm_step_index > 88) _adpcm_step_index = 88;
+
+  return (uint8_t)(int8_t)(_adpcm_predictor >> 8);
+}
+
+// Expands ADPCM bytes to PCM in small batches.
+static void _adpcm_output_audio(const uint8_t* data, int bytes) {
+  uint8_t samples[64];
+  while (bytes) {
+    int batch = MIN(bytes, (int)sizeof(samples) / 2);
+    for (int i = 0; i < batch; ++i) {
+      samples[i * 2] = _adpcm_decode_nibble(data[i] & 0x0f);
+      samples[i * 2 + 1] = _adpcm_decode_nibble(data[i] >> 4);
+    }
+    ADPCM_WRITE(samples, batch * 2);
+    data += batch;
+    bytes -= batch;
+  }
+}
+
+// Moves to the next phase, skipping any that are empty.  Fields of the chunk
+// header are big-endian.
+static void _adpcm_next_phase() {
+  const uint8_t* h = _adpcm_chunk_header;
+  if (_adpcm_phase == ADPCM_CHUNK_HEADER) {
+    _adpcm_phase = ADPCM_PRE_PADDING;
+    _adpcm_remaining = ((uint32_t)h[8] << 8) | h[9];  // prePaddingBytes
+  } else if (_adpcm_phase == ADPCM_PRE_PADDING) {
+    // Samples are always a multiple of 256, so the halves divide evenly.
+    uint32_t samples = ((uint32_t)h[0] << 24) | ((uint32_t)h[1] << 16) |
+                       ((uint32_t)h[2] << 8) | h[3];
+    _adpcm_phase = ADPCM_AUDIO;
+    _adpcm_remaining = samples / 2;
+  } else {
+    _adpcm_phase = ADPCM_PASS_THROUGH;
+  }
+
+  if (!_adpcm_remaining && _adpcm_phase != ADPCM_PASS_THROUGH) {
+    _adpcm_next_phase();
+  }
+}
+
+/**
+ * Requires these macros:
+ *
+ * #define ADPCM_WRITE(buffer, size)
+ * #define ADPCM_FILL(data_byte, count)
+ */
+static void adpcm_write(const uint8_t* buffer, int bytes) {
+  while (bytes) {
+    if (_adpcm_phase == ADPCM_PASS_THROUGH) {
+      ADPCM_WRITE(buffer, bytes);
+      return;
+    }
+
+    int available = (int)MIN((uint32_t)bytes, _adpcm_remaining);
+    if (_adpcm_phase == ADPCM_CHUNK_HEADER) {
+      // The header goes through as-is, but we parse it, too.
+      int offset = sizeof(_adpcm_chunk_header) - _adpcm_remaining;
+      memcpy(_adpcm_chunk_header + offset, buffer, available);
+      ADPCM_WRITE(buffer, available);
+    } else if (_adpcm_phase == ADPCM_PRE_PADDING) {
+      ADPCM_WRITE(buffer, available);
+    } else {
+      _adpcm_output_audio(buffer, available);
+    }
+
+    buffer += available;
+    bytes -= available;
+    _adpcm_remaining -= available;
+    if (!_adpcm_remaining) {
+      _adpcm_next_phase();
+    }
+  }
+}
+
+// Equivalent to adpcm_write() with bytes copies of data_byte.
+static void adpcm_fill(uint8_t data_byte, int bytes) {
+  while (bytes) {
+    if (_adpcm_phase == ADPCM_PASS_THROUGH ||
+        _adpcm_phase == ADPCM_PRE_PADDING) {
+      // One bulk fill where we can.
+      int available = bytes;
+      if (_adpcm_phase == ADPCM_PRE_PADDING) {
+        available = (int)MIN((uint32_t)bytes, _adpcm_remaining);
+        _adpcm_remaining -= available;
+      }
+      ADPCM_FILL(data_byte, available);
+      bytes -= available;
+      if (_adpcm_phase == ADPCM_PRE_PADDING && !_adpcm_remaining) {
+        _adpcm_next_phase();
+      }
+      continue;
+    }
+
+    // Header or audio bytes have to be processed one batch at a time.
+    uint8_t batch[32];
+    int size = MIN(bytes, (int)sizeof(batch));
+    memset(batch, data_byte, size);
+    adpcm_write(batch, size);
+    bytes -= size;
+  }
+}
+
+static void adpcm_reset() {
+  _adpcm_phase = ADPCM_CHUNK_HEADER;
+  _adpcm_remaining = sizeof(SegaVideoChunkHeader);
+  _adpcm_predictor = 0;
+  _adpcm_step_index = 0;
+}
@@ -0,0 +1,195 @@
+// Kinetoscope: A Sega Genesis Video Player
+//
+// Copyright (c) 2024 Joey Parrish
+//
+// See MIT License in LICENSE.txt
+
+// Shared LZ code.
+//
+// The Kinetoscope LZ format is a byte-based sequence of commands, in the style
+// of LZ4.  Each command is:
+//
+//  token: the top 4 bits are a literal count, and the bottom 4 bits are a
+//      match length minus LZ_MIN_MATCH.
+//  literal count extension: only if the literal count in the token is 15.
+//      Each byte is added to the count, and a byte of 255 means another
+//      follows.
+//  literals: copied directly to the output
+//  match offset: 2 bytes, big-endian, 1 to LZ_WINDOW_SIZE - 1.  The match
+//      starts this many bytes back in the output.
+//  match length extension: only if the match length in the token is 15, in
+//      the same format as the literal count extension.
+//
+// The final command of a block may end after its literals.  Matches may
+// overlap the bytes they produce, so an offset of 1 repeats the last byte.
+//
+// We can't read back from SRAM, so we keep a window of recent output in RAM.
+//
+// An offset outside of that range means the data is corrupt.  lz_to_sram()
+// returns false for it, and ignores the rest of the input until lz_reset().
+
+#define LZ_MIN_MATCH 4
+#define LZ_WINDOW_SIZE (1 << 15)  // 32kB, more than one full frame
+
+typedef enum {
+  LZ_TOKEN,
+  LZ_LITERAL_COUNT,
+  LZ_LITERALS,
+  LZ_OFFSET_HIGH,
+  LZ_OFFSET_LOW,
+  LZ_MATCH_LENGTH,
+  LZ_ERROR,
+} LzState;
+
+static LzState _lz_state = LZ_TOKEN;
+// The literal count or match length being decoded or processed.
+static uint32_t _lz_literals = 0;
+static uint32_t _lz_match_length = 0;
+static uint32_t _lz_offset = 0;
+// Recent output, and the position of the next output byte in it.
+static uint8_t _lz_window[LZ_WINDOW_SIZE];
+static uint32_t _lz_window_pos = 0;
+
+#if !defined(MIN)
+# define MIN(a, b) ((a) < (b) ? (a) : (b))
+#endif
+
+// Outputs bytes and remembers them in the window.
+static void _lz_output_literals(const uint8_t* data, uint32_t bytes) {
+  SRAM_WRITE(data, bytes);
+  while (bytes) {
+    uint32_t size = MIN(bytes, LZ_WINDOW_SIZE - _lz_window_pos);
+    memcpy(_lz_window + _lz_window_pos, data, size);
+    _lz_window_pos = (_lz_window_pos + size) & (LZ_WINDOW_SIZE - 1);
+    data += size;
+    bytes -= size;
+  }
+}
+
+// Copies a match from the window to the output.
+static void _lz_output_match() {
+  uint32_t length = _lz_match_length;
+  uint32_t offset = _lz_offset;
+
+  if (offset == 1) {
+    // A run of one byte, as in RLE.  One bulk fill.
+    uint8_t data_byte = _lz_window[(_lz_window_pos - 1) & (LZ_WINDOW_SIZE - 1)];
+    SRAM_FILL(data_byte, length);
+    while (length) {
+      uint32_t size = MIN(length, LZ_WINDOW_SIZE - _lz_window_pos);
+      memset(_lz_window + _lz_window_pos, data_byte, size);
+      _lz_window_pos = (_lz_window_pos + size) & (LZ_WINDOW_SIZE - 1);
+      length -= size;
+    }
+    return;
+  }
+
+  while (length) {
+    // Copy in pieces that don't wrap around the window, then output them
+    // straight from the window.  Capping at the offset keeps each piece from
+    // reading bytes it writes, but once the window has wrapped, a long match
+    // from far back can still overlap the older bytes it replaces.  So use
+    // memmove().
+    uint32_t source = (_lz_window_pos - offset) & (LZ_WINDOW_SIZE - 1);
+    uint32_t size = MIN(length, offset);
+    size = MIN(size, LZ_WINDOW_SIZE - source);
+    size = MIN(size, LZ_WINDOW_SIZE - _lz_window_pos);
+    memmove(_lz_window + _lz_window_pos, _lz_window + source, size);
+    SRAM_WRITE(_lz_window + _lz_window_pos, size);
+    _lz_window_pos = (_lz_window_pos + size) & (LZ_WINDOW_SIZE - 1);
+    length -= size;
+  }
+}
+
+/**
+ * Requires these macros:
+ *
+ * #define SRAM_WRITE(buffer, size)
+ * #define SRAM_FILL(data_byte, count)
+ */
+static bool lz_to_sram(const uint8_t* buffer, int bytes) {
+  while (bytes) {
+    switch (_lz_state) {
+      case LZ_TOKEN: {
+        uint8_t token = *buffer++;
+        bytes--;
+        _lz_literals = token >> 4;
+        _lz_match_length = (token & 0x0f) + LZ_MIN_MATCH;
+        _lz_offset = 0;
+        _lz_state = (_lz_literals == 15) ? LZ_LITERAL_COUNT : LZ_LITERALS;
+        break;
+      }
+
+      case LZ_LITERAL_COUNT: {
+        uint8_t extension = *buffer++;
+        bytes--;
+        _lz_literals += extension;
+        if (extension != 255) {
+          _lz_state = LZ_LITERALS;
+        }
+        break;
+      }
+
+      case LZ_LITERALS: {
+        // Output literal bytes, as many as we have.  Some may be in the next
+        // buffer.
+        uint32_t size = MIN((uint32_t)bytes, _lz_literals);
+        _lz_output_literals(buffer, size);
+        buffer += size;
+        bytes -= size;
+        _lz_literals -= size;
+        if (!_lz_literals) {
+          _lz_state = LZ_OFFSET_HIGH;
+        }
+        break;
+      }
+
+      case LZ_OFFSET_HIGH:
+        _lz_offset = (uint32_t)*buffer++ << 8;
+        bytes--;
+        _lz_state = LZ_OFFSET_LOW;
+        break;
+
+      case LZ_OFFSET_LOW:
+        _lz_offset |= *buffer++;
+        bytes--;
+        if (!_lz_offset || _lz_offset >= LZ_WINDOW_SIZE) {
+          // Offset 0 would never finish the match, and larger ones would wrap
+          // around into stale data.
+          _lz_state = LZ_ERROR;
+          return false;
+        }
+        if (_lz_match_length == 15 + LZ_MIN_MATCH) {
+          _lz_state = LZ_MATCH_LENGTH;
+        } else {
+          _lz_output_match();
+          _lz_state = LZ_TOKEN;
+        }
+        break;
+
+      case LZ_MATCH_LENGTH: {
+        uint8_t extension = *buffer++;
+        bytes--;
+        _lz_match_length += extension;
+        if (extension != 255) {
+          _lz_output_match();
+          _lz_state = LZ_TOKEN;
+        }
+        break;
+      }
+
+      case LZ_ERROR:
+        // Already reported.  Drop the rest.
+        return true;
+    }
+  }
+  return true;
+}
+
+static void lz_reset() {
+  _lz_state = LZ_TOKEN;
+  _lz_literals = 0;
+  _lz_match_length = 0;
+  _lz_offset = 0;
+  _lz_window_pos = 0;
+}
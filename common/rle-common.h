@@ -28,15 +28,15 @@ static int _rle_output_literals(const uint8_t* data, int bytes, int needed) {
 }
 
 static void _rle_output_repeats(uint8_t data_byte, int repeats) {
-  for (int i = 0; i < repeats; ++i) {
-    SRAM_WRITE(&data_byte, 1);
-  }
+  // One bulk fill, rather than writing one byte at a time.
+  SRAM_FILL(data_byte, repeats);
 }
 
 /**
  * Requires these macros:
  *
  * #define SRAM_WRITE(buffer, size)
+ * #define SRAM_FILL(data_byte, count)
  */
 static void rle_to_sram(const uint8_t* buffer, int bytes) {
   if (!bytes) {
@@ -35,8 +35,11 @@
 
 #define VIDEO_CATALOG_FILENAME "catalog.bin"
 #define VIDEO_CATALOG_PATH VIDEO_SERVER_BASE_PATH VIDEO_CATALOG_FILENAME
+#define VIDEO_CATALOG_INDEX_FILENAME "catalog.idx"
+#define VIDEO_CATALOG_INDEX_PATH VIDEO_SERVER_BASE_PATH VIDEO_CATALOG_INDEX_FILENAME
 
 #define _STRINGIFY(X) #X
 #define STRINGIFY(X) _STRINGIFY(X)
 #define VIDEO_SERVER_BASE_URL VIDEO_SERVER_PROTOCOL "://" VIDEO_SERVER ":" STRINGIFY(VIDEO_SERVER_PORT) VIDEO_SERVER_BASE_PATH
 #define VIDEO_SERVER_CATALOG_URL VIDEO_SERVER_BASE_URL VIDEO_CATALOG_FILENAME
+#define VIDEO_SERVER_CATALOG_INDEX_URL VIDEO_SERVER_BASE_URL VIDEO_CATALOG_INDEX_FILENAME
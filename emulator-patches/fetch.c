@@ -7,9 +7,16 @@
 // Emulation of Kinetoscope video streaming hardware.
 // Separate implementation of fetching, with Curl+pthread for native and with
 // emscripten_fetch for web.
-// An emscripten build requires -s FETCH=1 at link time.
+// An emscripten build requires -s FETCH=1 -s FETCH_STREAMING=1 at link time.
+// Without FETCH_STREAMING, emscripten uses XHR, which can't stream data in
+// most browsers.
+//
+// Natively, one long-lived worker thread performs fetches in order from a
+// queue, with one curl handle, so that connections are kept alive between
+// fetches the way the firmware does.
 
 #if defined(__EMSCRIPTEN__)
+# include <emscripten.h>
 # include <emscripten/fetch.h>
 #else
 # include <curl/curl.h>
@@ -20,6 +27,11 @@
 # endif
 #endif
 
+#if !defined(_WIN32)
+// For clock_gettime and nanosleep.
+# include <time.h>
+#endif
+
 #include <stdint.h>
 #include <stdio.h>
 
@@ -36,90 +48,401 @@ typedef struct FetchContext {
   char* range;
   WriteCallback write_callback;
   DoneCallback done_callback;
+  // fetch_generation when this was requested; see fetch_cancel_all()
+  uint32_t generation;
+  // the next request in the queue
+  struct FetchContext* next;
+  // for fetch_simulate(): when the fetch started, the body bytes received so
+  // far, and the cost of writing them reported by fetch_add_cost_ns()
+  uint64_t start_ms;
+  uint64_t bytes;
+  uint64_t cost_ns;
+  // the result, held while a simulated fetch waits to finish
+  bool ok;
 } FetchContext;
 
-#if defined(__EMSCRIPTEN__)
-static void fetch_with_emscripten_success(emscripten_fetch_t* fetch) {
-  FetchContext* ctx = (FetchContext*)fetch->userData;
+// Incremented by fetch_cancel_all().  Fetches from an older generation are
+// cancelled, and never call their callbacks.
+static volatile uint32_t fetch_generation = 0;
 
-  int http_status = fetch->status;
-  printf("Kinetoscope: url = %s, http status = %d\n", ctx->url, http_status);
+// Network simulation, set by fetch_simulate().
+static bool fetch_sim_enabled = false;
+static uint32_t fetch_sim_bits_per_second = 0;  // 0 means unlimited
+static uint32_t fetch_sim_rtt_ms = 0;
 
-  bool ok = http_status == 200 || http_status == 206;
-  if (ok) {
-    ctx->write_callback((char*)fetch->data, fetch->numBytes, 1, ctx->user_ctx);
+// The fetch whose write callback is running now, for fetch_add_cost_ns().
+static FetchContext* fetch_delivering = NULL;
+
+// Current time in milliseconds.
+static uint64_t ms_now() {
+#if defined(_WIN32)
+  return GetTickCount64();
+#else
+  struct timespec tp;
+  int rv = clock_gettime(CLOCK_MONOTONIC, &tp);
+  if (rv != 0) {
+    rv = clock_gettime(CLOCK_REALTIME, &tp);
   }
+  if (rv != 0) {
+    fprintf(stderr, "Kinetoscope: failed to get clock!\n");
+    return (uint64_t)-1;
+  }
+  return (tp.tv_sec * 1000) + (tp.tv_nsec / 1e6);
+#endif
+}
+
+// Makes every fetch take at least as long as it would on a network with this
+// throughput and round-trip time.  Natively, data is delivered at that rate.
+// On the web, data arrives as fast as it really does, but the done callback
+// waits.  Either way, a slow network shows up as a fetch still in progress.
+static void fetch_simulate(uint32_t bits_per_second, uint32_t rtt_ms) {
+  fetch_sim_enabled = true;
+  fetch_sim_bits_per_second = bits_per_second;
+  fetch_sim_rtt_ms = rtt_ms;
+}
 
-  if (ctx->done_callback) {
-    ctx->done_callback(ok, ctx->user_ctx);
+// Called from a write callback to add the simulated time it takes to handle
+// the data, such as writing SRAM.  On the hardware, that happens on the other
+// core while the network keeps going, so a fetch takes as long as the slower
+// of the two.
+static void fetch_add_cost_ns(uint64_t ns) {
+  if (fetch_delivering) {
+    fetch_delivering->cost_ns += ns;
   }
+}
 
+// When a simulated fetch that has received this much should be done with it.
+static uint64_t fetch_sim_deadline_ms(const FetchContext* ctx) {
+  uint64_t network_ms = 0;
+  if (fetch_sim_bits_per_second) {
+    network_ms = ctx->bytes * 8 * 1000 / fetch_sim_bits_per_second;
+  }
+  uint64_t cost_ms = ctx->cost_ns / 1000000;
+  uint64_t busy_ms = network_ms > cost_ms ? network_ms : cost_ms;
+  return ctx->start_ms + fetch_sim_rtt_ms + busy_ms;
+}
+
+static void free_fetch_context(FetchContext* ctx) {
   if (ctx->range) {
     free(ctx->range);
   }
   free(ctx->url);
   free(ctx);
+}
+
+#if defined(__EMSCRIPTEN__)
+static bool http_status_ok(int http_status) {
+  return http_status == 200 || http_status == 206;
+}
+
+// With EMSCRIPTEN_FETCH_STREAM_DATA, each progress event carries only the
+// newest data, which is freed after we return.  Feeding it straight through
+// matches the hardware, and we never hold a whole chunk in the heap.
+static void fetch_with_emscripten_progress(emscripten_fetch_t* fetch) {
+  FetchContext* ctx = (FetchContext*)fetch->userData;
+
+  if (ctx->generation != fetch_generation || !fetch->numBytes ||
+      !http_status_ok(fetch->status)) {
+    return;
+  }
+
+  fetch_delivering = ctx;
+  ctx->write_callback((char*)fetch->data, fetch->numBytes, 1, ctx->user_ctx);
+  fetch_delivering = NULL;
+  ctx->bytes += fetch->numBytes;
+}
+
+static void fetch_with_emscripten_done(void* user_data) {
+  FetchContext* ctx = (FetchContext*)user_data;
+
+  if (ctx->generation != fetch_generation) {
+    printf("Kinetoscope: url = %s, cancelled\n", ctx->url);
+  } else if (ctx->done_callback) {
+    ctx->done_callback(ctx->ok, ctx->user_ctx);
+  }
+
+  free_fetch_context(ctx);
+}
+
+static void fetch_with_emscripten_success(emscripten_fetch_t* fetch) {
+  FetchContext* ctx = (FetchContext*)fetch->userData;
+
+  if (ctx->generation != fetch_generation) {
+    printf("Kinetoscope: url = %s, cancelled\n", ctx->url);
+    free_fetch_context(ctx);
+    emscripten_fetch_close(fetch);
+    return;
+  }
+
+  int http_status = fetch->status;
+  printf("Kinetoscope: url = %s, http status = %d\n", ctx->url, http_status);
+
+  // The data has already been written by fetch_with_emscripten_progress().
+  ctx->ok = http_status_ok(http_status);
   emscripten_fetch_close(fetch);
+
+  uint64_t now = ms_now();
+  uint64_t deadline = fetch_sim_enabled ? fetch_sim_deadline_ms(ctx) : now;
+  if (deadline > now) {
+    emscripten_async_call(fetch_with_emscripten_done, ctx, deadline - now);
+  } else {
+    fetch_with_emscripten_done(ctx);
+  }
 }
 
 static void fetch_with_emscripten_error(emscripten_fetch_t* fetch) {
   FetchContext* ctx = (FetchContext*)fetch->userData;
 
-  printf("Kinetoscope: url = %s, error!\n", ctx->url);
-  ctx->done_callback(/* ok= */ false, ctx->user_ctx);
+  if (ctx->generation != fetch_generation) {
+    printf("Kinetoscope: url = %s, cancelled\n", ctx->url);
+  } else {
+    printf("Kinetoscope: url = %s, error!\n", ctx->url);
+    if (ctx->done_callback) {
+      ctx->done_callback(/* ok= */ false, ctx->user_ctx);
+    }
+  }
 
-  free(ctx->url);
-  free(ctx);
+  free_fetch_context(ctx);
   emscripten_fetch_close(fetch);
 }
+
+static void fetch_init() {
+}
+
+static void fetch_cancel_all() {
+  // Everything runs on one thread, so no callback is running now.  Cancelled
+  // fetches still finish in the background, but their results are dropped.
+  fetch_generation++;
+}
+
+static void fetch_lock_callbacks() {
+  // Everything runs on one thread, so no callback can run meanwhile.
+}
+
+static void fetch_unlock_callbacks() {
+}
 #else
-static void fetch_with_curl_in_thread(void* thread_ctx) {
-  FetchContext* ctx = (FetchContext*)thread_ctx;
-  CURL* handle = curl_easy_init();
+# if defined(_WIN32)
+typedef CRITICAL_SECTION FetchMutex;
+typedef CONDITION_VARIABLE FetchCondition;
+#  define fetch_mutex_init(m) InitializeCriticalSection(m)
+#  define fetch_mutex_lock(m) EnterCriticalSection(m)
+#  define fetch_mutex_unlock(m) LeaveCriticalSection(m)
+#  define fetch_condition_init(c) InitializeConditionVariable(c)
+#  define fetch_condition_wait(c, m) SleepConditionVariableCS(c, m, INFINITE)
+#  define fetch_condition_signal(c) WakeConditionVariable(c)
+# else
+typedef pthread_mutex_t FetchMutex;
+typedef pthread_cond_t FetchCondition;
+#  define fetch_mutex_init(m) pthread_mutex_init(m, NULL)
+#  define fetch_mutex_lock(m) pthread_mutex_lock(m)
+#  define fetch_mutex_unlock(m) pthread_mutex_unlock(m)
+#  define fetch_condition_init(c) pthread_cond_init(c, NULL)
+#  define fetch_condition_wait(c, m) pthread_cond_wait(c, m)
+#  define fetch_condition_signal(c) pthread_cond_signal(c)
+# endif
+
+static struct {
+  // Guards the queue.
+  FetchMutex queue_lock;
+  FetchCondition queue_ready;
+  FetchContext* head;
+  FetchContext* tail;
+  // Held while calling back into the emulator, so that fetch_cancel_all() can
+  // wait for a callback in progress to finish.
+  FetchMutex callback_lock;
+  // Reused for every fetch, to keep connections alive.
+  CURL* handle;
+} fetch_worker;
+
+static bool fetch_cancelled(FetchContext* ctx) {
+  return ctx->generation != fetch_generation;
+}
+
+static void fetch_sleep_ms(uint32_t ms) {
+# if defined(_WIN32)
+  Sleep(ms);
+# else
+  struct timespec duration = { ms / 1000, (ms % 1000) * 1000000 };
+  nanosleep(&duration, NULL);
+# endif
+}
+
+// Holds the worker back until a simulated fetch has caught up with what it
+// has received.  Wakes up now and then, so that cancellation isn't delayed.
+static void fetch_sim_wait(FetchContext* ctx) {
+  if (!fetch_sim_enabled) {
+    return;
+  }
+
+  uint64_t deadline = fetch_sim_deadline_ms(ctx);
+  uint64_t now;
+  while (!fetch_cancelled(ctx) && (now = ms_now()) < deadline) {
+    uint64_t remaining = deadline - now;
+    fetch_sleep_ms(remaining < 10 ? remaining : 10);
+  }
+}
+
+static size_t fetch_write_with_curl(char* buffer, size_t n, size_t size,
+                                    void* curl_ctx) {
+  FetchContext* ctx = (FetchContext*)curl_ctx;
+  size_t written = 0;  // aborts the transfer, if cancelled
+
+  fetch_mutex_lock(&fetch_worker.callback_lock);
+  if (!fetch_cancelled(ctx)) {
+    fetch_delivering = ctx;
+    written = ctx->write_callback(buffer, n, size, ctx->user_ctx);
+    fetch_delivering = NULL;
+  }
+  fetch_mutex_unlock(&fetch_worker.callback_lock);
+
+  // Deliver no faster than the simulated network.
+  ctx->bytes += written;
+  fetch_sim_wait(ctx);
+
+  return written;
+}
+
+static int fetch_progress_with_curl(void* curl_ctx,
+                                    curl_off_t dltotal, curl_off_t dlnow,
+                                    curl_off_t ultotal, curl_off_t ulnow) {
+  // Non-zero aborts the transfer, even while it waits for data.
+  return fetch_cancelled((FetchContext*)curl_ctx);
+}
+
+static void fetch_with_curl(FetchContext* ctx) {
+  CURL* handle = fetch_worker.handle;
+  // This keeps open connections, and clears everything else.
+  curl_easy_reset(handle);
 
   curl_easy_setopt(handle, CURLOPT_URL, ctx->url);
-  curl_easy_setopt(handle, CURLOPT_WRITEFUNCTION, ctx->write_callback);
-  curl_easy_setopt(handle, CURLOPT_WRITEDATA, ctx->user_ctx);
-  curl_easy_setopt(handle, CURLOPT_FOLLOWLOCATION, 1);
+  curl_easy_setopt(handle, CURLOPT_WRITEFUNCTION, fetch_write_with_curl);
+  curl_easy_setopt(handle, CURLOPT_WRITEDATA, ctx);
+  curl_easy_setopt(handle, CURLOPT_XFERINFOFUNCTION, fetch_progress_with_curl);
+  curl_easy_setopt(handle, CURLOPT_XFERINFODATA, ctx);
+  curl_easy_setopt(handle, CURLOPT_NOPROGRESS, 0L);
+  curl_easy_setopt(handle, CURLOPT_FOLLOWLOCATION, 1L);
+  curl_easy_setopt(handle, CURLOPT_TCP_KEEPALIVE, 1L);
   if (ctx->range) {
     curl_easy_setopt(handle, CURLOPT_RANGE, ctx->range);
   }
 
+  ctx->start_ms = ms_now();
   CURLcode res = curl_easy_perform(handle);
   long http_status = 0;
   curl_easy_getinfo(handle, CURLINFO_RESPONSE_CODE, &http_status);
-  curl_easy_cleanup(handle);
 
-  printf("Kinetoscope: url = %s, CURLcode = %d, http status = %ld\n",
-         ctx->url, res, http_status);
-  if (res != CURLE_OK) {
-    printf("Curl error: %s\n", curl_easy_strerror(res));
+  // A small fetch still takes a round trip, and writing SRAM may outlast the
+  // network.
+  fetch_sim_wait(ctx);
+
+  fetch_mutex_lock(&fetch_worker.callback_lock);
+  if (fetch_cancelled(ctx)) {
+    printf("Kinetoscope: url = %s, cancelled\n", ctx->url);
+  } else {
+    printf("Kinetoscope: url = %s, CURLcode = %d, http status = %ld\n",
+           ctx->url, res, http_status);
+    if (res != CURLE_OK) {
+      printf("Curl error: %s\n", curl_easy_strerror(res));
+    }
+
+    bool ok = res == CURLE_OK && (http_status == 200 || http_status == 206);
+    if (ctx->done_callback) {
+      ctx->done_callback(ok, ctx->user_ctx);
+    }
   }
+  fetch_mutex_unlock(&fetch_worker.callback_lock);
+}
 
-  bool ok = res == CURLE_OK && (http_status == 200 || http_status == 206);
-  ctx->done_callback(ok, ctx->user_ctx);
+static void fetch_worker_loop() {
+  while (true) {
+    fetch_mutex_lock(&fetch_worker.queue_lock);
+    while (!fetch_worker.head) {
+      fetch_condition_wait(&fetch_worker.queue_ready,
+                           &fetch_worker.queue_lock);
+    }
+    FetchContext* ctx = fetch_worker.head;
+    fetch_worker.head = ctx->next;
+    if (!fetch_worker.head) {
+      fetch_worker.tail = NULL;
+    }
+    fetch_mutex_unlock(&fetch_worker.queue_lock);
 
-  if (ctx->range) {
-    free(ctx->range);
+    // Requests cancelled while queued are dropped without a connection.
+    if (!fetch_cancelled(ctx)) {
+      fetch_with_curl(ctx);
+    }
+    free_fetch_context(ctx);
   }
-  free(ctx->url);
-  free(ctx);
 }
 
 # if defined(_WIN32)
-static DWORD WINAPI fetch_with_curl_in_windows_thread(void* thread_ctx) {
-  fetch_with_curl_in_thread(thread_ctx);
+static DWORD WINAPI fetch_worker_windows_thread(void* thread_ctx) {
+  fetch_worker_loop();
   return 0;
 }
 # else
-static void* fetch_with_curl_in_pthread(void* thread_ctx) {
-  fetch_with_curl_in_thread(thread_ctx);
-  pthread_exit(NULL);
+static void* fetch_worker_pthread(void* thread_ctx) {
+  fetch_worker_loop();
   return NULL;
 }
 # endif
-#endif
 
+static void fetch_init() {
+  fetch_mutex_init(&fetch_worker.queue_lock);
+  fetch_condition_init(&fetch_worker.queue_ready);
+  fetch_mutex_init(&fetch_worker.callback_lock);
+  fetch_worker.head = NULL;
+  fetch_worker.tail = NULL;
+  fetch_worker.handle = curl_easy_init();
+
+# if defined(_WIN32)
+  CreateThread(/* security attributes= */ NULL,
+               /* default stack size= */ 0,
+               fetch_worker_windows_thread,
+               /* thread context= */ NULL,
+               /* creation flags= */ 0,
+               /* thread id output= */ NULL);
+# else
+  pthread_t thread;
+  pthread_create(&thread, NULL, fetch_worker_pthread, NULL);
+  pthread_detach(thread);
+# endif
+}
+
+static void fetch_enqueue(FetchContext* ctx) {
+  fetch_mutex_lock(&fetch_worker.queue_lock);
+  ctx->next = NULL;
+  if (fetch_worker.tail) {
+    fetch_worker.tail->next = ctx;
+  } else {
+    fetch_worker.head = ctx;
+  }
+  fetch_worker.tail = ctx;
+  fetch_condition_signal(&fetch_worker.queue_ready);
+  fetch_mutex_unlock(&fetch_worker.queue_lock);
+}
+
+// Cancels every fetch requested so far, whether queued or in progress.  Their
+// callbacks are never called, and none are still running once this returns.
+// Don't call this from a fetch callback.
+static void fetch_cancel_all() {
+  fetch_mutex_lock(&fetch_worker.callback_lock);
+  fetch_generation++;
+  fetch_mutex_unlock(&fetch_worker.callback_lock);
+}
+
+// Keeps fetch callbacks from running until fetch_unlock_callbacks(), so that
+// the emulator can check and update state they share.  Don't call this from a
+// fetch callback.
+static void fetch_lock_callbacks() {
+  fetch_mutex_lock(&fetch_worker.callback_lock);
+}
+
+static void fetch_unlock_callbacks() {
+  fetch_mutex_unlock(&fetch_worker.callback_lock);
+}
+#endif
 static void fetch_range_async(const char* url, size_t first_byte, size_t size,
                               WriteCallback write_callback,
                               DoneCallback done_callback,
@@ -129,6 +452,11 @@ static void fetch_range_async(const char* url, size_t first_byte, size_t size,
   ctx->url = strdup(url);
   ctx->write_callback = write_callback;
   ctx->done_callback = done_callback;
+  ctx->generation = fetch_generation;
+  ctx->start_ms = ms_now();
+  ctx->bytes = 0;
+  ctx->cost_ns = 0;
+  ctx->ok = false;
 
   if (size == (size_t)-1) {
     ctx->range = NULL;
@@ -151,7 +479,8 @@ static void fetch_range_async(const char* url, size_t first_byte, size_t size,
   emscripten_fetch_attr_init(&fetch_attributes);
 
   strcpy(fetch_attributes.requestMethod, "GET");
-  fetch_attributes.attributes = EMSCRIPTEN_FETCH_LOAD_TO_MEMORY;
+  fetch_attributes.attributes =
+      EMSCRIPTEN_FETCH_LOAD_TO_MEMORY | EMSCRIPTEN_FETCH_STREAM_DATA;
 
   const char* headers[] = { "Range", ctx->range, NULL };
   if (ctx->range) {
@@ -159,21 +488,12 @@ static void fetch_range_async(const char* url, size_t first_byte, size_t size,
   }
 
   fetch_attributes.userData = ctx;
+  fetch_attributes.onprogress = fetch_with_emscripten_progress;
   fetch_attributes.onsuccess = fetch_with_emscripten_success;
   fetch_attributes.onerror = fetch_with_emscripten_error;
 
   emscripten_fetch(&fetch_attributes, url);
 #else
-# if defined(_WIN32)
-  CreateThread(/* security attributes= */ NULL,
-               /* default stack size= */ 0,
-               fetch_with_curl_in_windows_thread,
-               /* thread context= */ NULL,
-               /* creation flags= */ 0,
-               /* thread id output= */ NULL);
-# else
-  pthread_t thread;
-  pthread_create(&thread, NULL, fetch_with_curl_in_pthread, ctx);
-# endif
+  fetch_enqueue(ctx);
 #endif
 }
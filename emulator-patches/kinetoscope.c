@@ -5,7 +5,7 @@
 // See MIT License in LICENSE.txt
 
 // Emulation of Kinetoscope video streaming hardware.
-// An emscripten build requires -s FETCH=1 at link time.
+// An emscripten build requires -s FETCH=1 -s FETCH_STREAMING=1 at link time.
 
 #if defined(_WIN32)
 // Enable Windows 10 APIs.  Must be defined before any headers are included.
@@ -21,21 +21,18 @@
 #include <unistd.h>
 
 #include "kinetoscope/software/player/inc/segavideo_format.h"
+#include "kinetoscope/software/player/inc/segavideo_stats.h"
 #include "kinetoscope/common/video-server.h"
 #include "kinetoscope/emulator-patches/fetch.c"
 
 #if defined(_WIN32)
 // Windows header for ntohs and ntohl.
 # include <winsock2.h>
-// For GetTickCount64.
-# include <windows.h>
 #else
 // Linux headers for ntohs and ntohl.
 # include <arpa/inet.h>
 # include <netinet/in.h>
 # include <signal.h>
-// For clock_gettime.
-# include <time.h>
 #endif
 
 #define CMD_ECHO        0x00
@@ -46,6 +43,11 @@
 #define CMD_GET_ERROR   0x05
 #define CMD_CONNECT_NET 0x06
 #define CMD_MARCH_TEST  0x07
+#define CMD_START_FAST  0x08
+#define CMD_AWAIT_FILL  0x09
+#define CMD_SEEK        0x0A
+#define CMD_GET_STATS   0x0B
+#define CMD_GET_THUMB   0x0C
 
 // NOTE: The addresses sent to us are all relative to the base of 0xA13000.
 // So we only check the offset from there.  All addresses are even because the
@@ -61,12 +63,42 @@
 
 #define SIMULATED_PROCESSING_DELAY 100  // milliseconds
 
+// Hardware timing simulation.  Off by default.  Set any of these environment
+// variables to enable it:
+//
+//   KINETOSCOPE_SIM_KBPS: network throughput in kilobits per second
+//       (default: unlimited)
+//   KINETOSCOPE_SIM_RTT_MS: network round-trip time (default: 0)
+//   KINETOSCOPE_SIM_SRAM_NS: time to write one byte of SRAM, after RLE or LZ
+//       expansion (default: SIMULATED_SRAM_NS_PER_BYTE)
+//
+// Then an encode or server that is too slow for the hardware underflows in the
+// emulator, too.
+// The firmware writes SRAM with a PIO state machine by default (SRAM_USE_PIO
+// in firmware/sram.h).  At 125MHz, firmware/sram.pio takes about 126 cycles
+// per 16-bit word, or about 504ns per byte.  That's counted from the program,
+// not measured; compare sram_write_pio in firmware/speed-tests.cc.  For the
+// bit-banged fallback, set KINETOSCOPE_SIM_SRAM_NS=1160.
+#define SIMULATED_SRAM_NS_PER_BYTE 504
+
 // SRAM regions.
 #define SRAM_BANK_0_OFFSET 0
 #define SRAM_BANK_1_OFFSET (1 << 20)  // 1MB
 #define SRAM_SIZE          (2 << 20)  // 2MB
 
+// Both emulators read cartridge memory as native 16-bit ints, so on
+// little-endian hosts, the bytes within each word of SRAM are swapped.  MSVC
+// doesn't define __BYTE_ORDER__, but every Windows target is little-endian.
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+# define SRAM_SWAP_BYTES 0
+#else
+# define SRAM_SWAP_BYTES 1
+#endif
+
+#define MAX_CATALOG_ENTRIES 127
+
 static void write_sram(const uint8_t* data, uint32_t size);
+static void fill_sram(uint8_t data, uint32_t size);
 static void reset_sram(int bank);
 
 // Macros to complete sram_march_test in sram-common.h
@@ -77,8 +109,23 @@ static void reset_sram(int bank);
 // Defines sram_march_test()
 #include "kinetoscope/common/sram-common.h"
 
-// Macros for rle-common.h
-#define SRAM_WRITE(buffer, size) write_sram(buffer, size)
+// Macros for adpcm-common.h
+#define ADPCM_WRITE(buffer, size) write_sram(buffer, size)
+#define ADPCM_FILL(data, size) fill_sram(data, size)
+
+// Defines adpcm_write()
+#include "kinetoscope/common/adpcm-common.h"
+
+// RLE and LZ output goes through the ADPCM decoder if the audio needs it.
+static void decoded_write(const uint8_t* data, uint32_t size);
+static void decoded_fill(uint8_t data, uint32_t size);
+
+// Macros for rle-common.h and lz-common.h
+#define SRAM_WRITE(buffer, size) decoded_write(buffer, size)
+#define SRAM_FILL(data, size) decoded_fill(data, size)
+
+// Defines lz_to_sram()
+#include "kinetoscope/common/lz-common.h"
 
 // Defines rle_to_sram()
 #include "kinetoscope/common/rle-common.h"
@@ -118,29 +165,99 @@ typedef struct kinetoscope_emulation_context_t {
   uint32_t chunk_num;
   // how many chunks are left
   uint32_t chunks_left;
+  // the chunk the Sega is playing, as tracked by CMD_FLIP_REGION
+  uint32_t playing_chunk_num;
+  // chunks packed into each SRAM bank, counting from origin_chunk_num, the
+  // chunk we started or seeked to; see segavideo_chunksPerRegion()
+  uint32_t chunks_per_bank;
+  uint32_t origin_chunk_num;
   // postition we read from next
   uint32_t video_url_start_byte;
   // whether the content is compressed or not
   bool compressed;
+  // whether the audio in each compressed chunk is ADPCM
+  bool adpcm_audio;
+  // whether compressed chunks use LZ instead of RLE
+  bool lz_chunks;
   // the header of the video we're starting
   SegaVideoHeader header;
   // the index of chunk offsets for compressed video
   SegaVideoIndex index;
 
+  // Catalog
+  // =======
+  // a copy of the catalog index sent to the Sega, to find headers in the
+  // catalog
+  struct {
+    SegaVideoCatalogIndex header;
+    SegaVideoCatalogEntry entries[MAX_CATALOG_ENTRIES];
+  } __attribute__((packed)) catalog_index;
+
   // Threading
   // =========
   // whether the thread is busy doing something right now
   volatile bool fetch_busy;
+  // whether the current start command returns after filling the first region
+  bool fast_start;
+  // whether a CMD_AWAIT_FILL is waiting on the current fetch
+  volatile bool awaiting_fill;
+
+  // Stats
+  // =====
+  // stats for CMD_GET_STATS, in native byte order until written
+  SegaVideoStats stats;
+  // when the current chunk fetch started and the last one completed
+  uint64_t chunk_start_ms;
+  uint64_t chunk_done_ms;
+  // SRAM offset when the current chunk fetch started
+  uint32_t chunk_sram_start;
+  // whether stats.minMarginMs has been set
+  bool margin_recorded;
+
+  // Simulation
+  // ==========
+  // simulated time to write each byte of SRAM during a fetch, or 0
+  uint32_t sim_sram_ns_per_byte;
 } kinetoscope_emulation_context_t;
 
 static kinetoscope_emulation_context_t kinetoscope;
 
-static void* fetch_thread(void* ignored_arg);
+// Reads an unsigned integer from the environment.  Sets *value and returns
+// true if the variable is set.
+static bool env_uint32(const char* name, uint32_t* value) {
+  const char* string = getenv(name);
+  if (!string || !*string) {
+    return false;
+  }
+  *value = (uint32_t)strtoul(string, NULL, 10);
+  return true;
+}
+
+static void simulation_init() {
+  uint32_t kbps = 0;
+  uint32_t rtt_ms = 0;
+  uint32_t sram_ns = SIMULATED_SRAM_NS_PER_BYTE;
+  bool enabled = env_uint32("KINETOSCOPE_SIM_KBPS", &kbps);
+  enabled = env_uint32("KINETOSCOPE_SIM_RTT_MS", &rtt_ms) || enabled;
+  enabled = env_uint32("KINETOSCOPE_SIM_SRAM_NS", &sram_ns) || enabled;
+
+  kinetoscope.sim_sram_ns_per_byte = 0;
+  if (!enabled) {
+    return;
+  }
+
+  printf("Kinetoscope: Simulating %u kbps, %u ms RTT, %u ns per SRAM byte\n",
+         kbps, rtt_ms, sram_ns);
+  fetch_simulate(kbps * 1000, rtt_ms);
+  kinetoscope.sim_sram_ns_per_byte = sram_ns;
+}
 
 void* kinetoscope_init() {
 #if !defined(__EMSCRIPTEN__)
   curl_global_init(CURL_GLOBAL_ALL);
 #endif
+  fetch_init();
+  simulation_init();
 
   kinetoscope.token = TOKEN_CONTROL_TO_SEGA;
   kinetoscope.error = 0;
@@ -149,6 +266,8 @@ void* kinetoscope_init() {
   kinetoscope.command_busy = false;
   kinetoscope.video_url = NULL;
   kinetoscope.fetch_busy = false;
+  kinetoscope.fast_start = false;
+  kinetoscope.awaiting_fill = false;
 
 #if 0
   // To test error handling, simulate no connection
@@ -159,24 +278,6 @@ void* kinetoscope_init() {
   return kinetoscope.sram_buffer;
 }
 
-// Current time in milliseconds.
-static uint64_t ms_now() {
-#if defined(_WIN32)
-  return GetTickCount64();
-#else
-  struct timespec tp;
-  int rv = clock_gettime(CLOCK_MONOTONIC, &tp);
-  if (rv != 0) {
-    rv = clock_gettime(CLOCK_REALTIME, &tp);
-  }
-  if (rv != 0) {
-    fprintf(stderr, "Kinetoscope: failed to get clock!\n");
-    return (uint64_t)-1;
-  }
-  return (tp.tv_sec * 1000) + (tp.tv_nsec / 1e6);
-#endif
-}
-
 static void reset_sram(int bank) {
   printf("Kinetoscope: Writing to bank %d\n", bank);
   kinetoscope.sram_offset = bank ? SRAM_BANK_1_OFFSET : SRAM_BANK_0_OFFSET;
@@ -193,13 +294,58 @@ static void write_sram(const uint8_t* data, uint32_t size) {
     return;
   }
 
-  for (size_t i = 0; i < size; i++) {
-    // XOR with 1 swaps every 2 bytes in the output.
-    // You wouldn't assume this to be necessary, but the emulated memory is
-    // accessed as big-endian 16-bit ints or something.
-    // TODO: Should this nonsense only happen for little-endian builds?
-    kinetoscope.sram_buffer[kinetoscope.sram_offset ^ 1] = data[i];
-    kinetoscope.sram_offset++;
+#if SRAM_SWAP_BYTES
+  uint8_t* output = kinetoscope.sram_buffer;
+  uint32_t offset = kinetoscope.sram_offset;
+  kinetoscope.sram_offset += size;
+
+  // An odd byte at either end is only half of a word.  XOR with 1 finds its
+  // place within the word.
+  if (size && (offset & 1)) {
+    output[offset ^ 1] = *data++;
+    offset++;
+    size--;
+  }
+
+  // Whole words in between, swapped two bytes at a time.  This loop is simple
+  // enough for the compiler to vectorize.
+  uint8_t* words = output + offset;
+  uint32_t words_size = size & ~1;
+  for (uint32_t i = 0; i < words_size; i += 2) {
+    words[i] = data[i + 1];
+    words[i + 1] = data[i];
+  }
+
+  if (size & 1) {
+    offset += words_size;
+    output[offset ^ 1] = data[words_size];
+  }
+#else
+  memcpy(kinetoscope.sram_buffer + kinetoscope.sram_offset, data, size);
+  kinetoscope.sram_offset += size;
+#endif
+}
+
+static void fill_sram(uint8_t data, uint32_t size) {
+  // Bytes within a word may be swapped (see SRAM_SWAP_BYTES above), but every
+  // byte is the same here, so only an odd byte at either end needs special
+  // care.
+  if (size && (kinetoscope.sram_offset & 1)) {
+    write_sram(&data, 1);
+    size--;
+  }
+
+  uint32_t words_size = size & ~1;
+  if (kinetoscope.sram_offset + words_size > SRAM_SIZE) {
+    // Let write_sram() report the overflow.
+    write_sram(&data, words_size);
+    return;
+  }
+  memset(kinetoscope.sram_buffer + kinetoscope.sram_offset, data, words_size);
+  kinetoscope.sram_offset += words_size;
+
+  if (size & 1) {
+    write_sram(&data, 1);
   }
 }
 
@@ -227,13 +373,40 @@ static void write_error_to_sram() {
   write_sram((const uint8_t*)kinetoscope.error_str, strlen(kinetoscope.error_str));
 }
 
+static void decoded_write(const uint8_t* data, uint32_t size) {
+  if (kinetoscope.adpcm_audio) {
+    adpcm_write(data, size);
+  } else {
+    write_sram(data, size);
+  }
+}
+
+static void decoded_fill(uint8_t data, uint32_t size) {
+  if (kinetoscope.adpcm_audio) {
+    adpcm_fill(data, size);
+  } else {
+    fill_sram(data, size);
+  }
+}
+
 // Writes HTTP data to SRAM.
 static size_t http_data_to_sram(char* data, size_t size, size_t n, void* ctx) {
-  if (kinetoscope.compressed) {
+  uint32_t sram_start = kinetoscope.sram_offset;
+
+  if (kinetoscope.compressed && kinetoscope.lz_chunks) {
+    if (!lz_to_sram((const uint8_t*)data, size * n)) {
+      // Corrupt data.  A short count aborts the transfer, failing the chunk.
+      return 0;
+    }
+  } else if (kinetoscope.compressed) {
     rle_to_sram((const uint8_t*)data, size * n);
   } else {
     write_sram((const uint8_t*)data, size * n);
   }
+
+  // The hardware writes every decoded byte, so expansion costs time.
+  uint32_t decoded_bytes = kinetoscope.sram_offset - sram_start;
+  fetch_add_cost_ns((uint64_t)decoded_bytes * kinetoscope.sim_sram_ns_per_byte);
   return size * n;
 }
 
@@ -268,8 +441,11 @@ static void fetch_range_to_sram(const char* url, bool compressed,
   kinetoscope.compressed = compressed;
 
   // This shouldn't be necessary, but in case of an incomplete compressed
-  // buffer being processed before this, reset the RLE decoder now.
+  // buffer being processed before this, reset the decoders now.  The LZ and
+  // ADPCM decoders start over with each chunk.
   rle_reset();
+  lz_reset();
+  adpcm_reset();
 
   fetch_range_async(url, first_byte, size,
                     http_data_to_sram,
@@ -277,12 +453,6 @@ static void fetch_range_to_sram(const char* url, bool compressed,
                     user_ctx);
 }
 
-static void fetch_to_sram(const char* url, bool compressed,
-                          DoneCallback done_callback,
-                          void* user_ctx) {
-  fetch_range_to_sram(url, compressed, 0, (size_t)-1, done_callback, user_ctx);
-}
-
 static void write_to_buffer_done(bool ok, void* user_ctx) {
   HttpBuffer* buffer = (HttpBuffer*)user_ctx;
   DoneCallback final_done_callback = buffer->final_done_callback;
@@ -310,8 +480,19 @@ static void fetch_to_buffer(const char* url, void* data, size_t size,
   fetch_range_to_buffer(url, data, 0, size, done_callback);
 }
 
+static void complete_command();
+
+// Interrupts the current fetch, as the firmware does.  Its callbacks never
+// run, so nothing is left waiting on it.
+static void interrupt_fetch() {
+  fetch_cancel_all();
+  kinetoscope.fetch_busy = false;
+  // The cancelled fetch will never complete a CMD_AWAIT_FILL.
+  kinetoscope.awaiting_fill = false;
+}
+
 static void stop_video() {
-  // TODO: interrupt HTTP transfers
+  interrupt_fetch();
 }
 
 static size_t next_chunk_size() {
@@ -323,14 +504,115 @@ static size_t next_chunk_size() {
   return size;
 }
 
+static void record_chunk_stats(size_t size) {
+  // We can't see inside curl or emscripten, so the whole fetch counts as body
+  // time, and SRAM writes are included in that.
+  SegaVideoChunkStats* chunk = &kinetoscope.stats.lastChunk;
+  SegaVideoChunkStats* total = &kinetoscope.stats.total;
+  kinetoscope.chunk_done_ms = ms_now();
+  memset(chunk, 0, sizeof(*chunk));
+  chunk->chunks = 1;
+  chunk->bytesFetched = size;
+  chunk->bytesDecoded = kinetoscope.sram_offset - kinetoscope.chunk_sram_start;
+  chunk->bodyMs = kinetoscope.chunk_done_ms - kinetoscope.chunk_start_ms;
+
+  total->chunks += chunk->chunks;
+  total->bytesFetched += chunk->bytesFetched;
+  total->bytesDecoded += chunk->bytesDecoded;
+  total->bodyMs += chunk->bodyMs;
+
+  uint32_t elapsed_ms = chunk->bodyMs ? chunk->bodyMs : 1;
+  uint32_t sample = (uint64_t)size * 1000 / elapsed_ms;
+  uint32_t throughput = kinetoscope.stats.throughput;
+  kinetoscope.stats.throughput =
+      throughput ? (throughput * 3 + sample) / 4 : sample;
+}
+
+static void record_margin(bool underflow) {
+  uint64_t now = ms_now();
+  int32_t margin = underflow ?
+      -(int32_t)(now - kinetoscope.chunk_start_ms) :
+      (int32_t)(now - kinetoscope.chunk_done_ms);
+  if (underflow) {
+    kinetoscope.stats.underflows++;
+  }
+  kinetoscope.stats.lastMarginMs = margin;
+  if (!kinetoscope.margin_recorded || margin < kinetoscope.stats.minMarginMs) {
+    kinetoscope.stats.minMarginMs = margin;
+  }
+  kinetoscope.margin_recorded = true;
+}
+
+static void write_chunk_stats_to_sram(const SegaVideoChunkStats* chunk) {
+  // All fields are uint32_t.
+  const uint32_t* fields = (const uint32_t*)chunk;
+  for (size_t i = 0; i < sizeof(*chunk) / sizeof(uint32_t); ++i) {
+    uint32_t value = htonl(fields[i]);
+    write_sram((const uint8_t*)&value, sizeof(value));
+  }
+}
+
+static void write_stats_to_sram() {
+  const SegaVideoStats* stats = &kinetoscope.stats;
+  reset_sram(0);
+  write_chunk_stats_to_sram(&stats->lastChunk);
+  write_chunk_stats_to_sram(&stats->total);
+  const uint32_t fields[] = {
+    stats->reconnects,
+    stats->underflows,
+    (uint32_t)stats->lastMarginMs,
+    (uint32_t)stats->minMarginMs,
+    stats->throughput,
+  };
+  for (size_t i = 0; i < sizeof(fields) / sizeof(fields[0]); ++i) {
+    uint32_t value = htonl(fields[i]);
+    write_sram((const uint8_t*)&value, sizeof(value));
+  }
+  uint16_t rendition = htons(stats->rendition);
+  write_sram((const uint8_t*)&rendition, sizeof(rendition));
+  // Nothing is read ahead here, since fetches go straight to SRAM.
+  uint32_t read_ahead = htonl(stats->readAheadHighWater);
+  write_sram((const uint8_t*)&read_ahead, sizeof(read_ahead));
+}
+
+// The slot a chunk occupies in the ring of SRAM banks, as the Sega sends it
+// with CMD_FLIP_REGION.
+static uint32_t chunk_slot(uint32_t chunk_num) {
+  return (chunk_num - kinetoscope.origin_chunk_num) %
+         (2 * kinetoscope.chunks_per_bank);
+}
+
+static void fetch_chunk_done(bool ok, void* user_ctx);
+
+static void fetch_next_chunk(void* user_ctx) {
+  kinetoscope.chunk_start_ms = ms_now();
+  kinetoscope.chunk_sram_start = kinetoscope.sram_offset;
+
+  fetch_range_to_sram(kinetoscope.video_url,
+                      kinetoscope.compressed,
+                      kinetoscope.video_url_start_byte,
+                      next_chunk_size(),
+                      fetch_chunk_done,
+                      user_ctx);
+}
+
 static void fetch_chunk_done(bool ok, void* user_ctx) {
   if (ok) {
     size_t size = next_chunk_size();
+    record_chunk_stats(size);
 
     kinetoscope.chunk_num++;
     kinetoscope.chunks_left--;
     kinetoscope.video_url_start_byte += size;
-    reset_sram(kinetoscope.chunk_num & 1);
+
+    uint32_t slot = chunk_slot(kinetoscope.chunk_num);
+    if (kinetoscope.chunks_left && slot % kinetoscope.chunks_per_bank) {
+      // The next chunk goes right after this one, in the same bank.  The
+      // whole bank is one fill.
+      fetch_next_chunk(user_ctx);
+      return;
+    }
+    reset_sram(slot >= kinetoscope.chunks_per_bank);
   } else {
     char buf[64];
     snprintf(buf, 64, "Failed to fetch video! (chunk %d)", kinetoscope.chunk_num);
@@ -339,6 +621,11 @@ static void fetch_chunk_done(bool ok, void* user_ctx) {
 
   kinetoscope.fetch_busy = false;
 
+  if (kinetoscope.awaiting_fill) {
+    kinetoscope.awaiting_fill = false;
+    complete_command();
+  }
+
   if (user_ctx) {
     DoneCallback continue_callback = (DoneCallback)user_ctx;
     continue_callback(ok, /* user_ctx= */ NULL);
@@ -353,15 +640,10 @@ static void fetch_chunk(DoneCallback done_callback) {
   }
 
   // Flag that we are busy fetching.  This simulates the firmware, which can
-  // only fetch one thing at a time.
+  // only fetch one thing at a time.  This fills every slot of the bank before
+  // calling done_callback.
   kinetoscope.fetch_busy = true;
-
-  fetch_range_to_sram(kinetoscope.video_url,
-                      kinetoscope.compressed,
-                      kinetoscope.video_url_start_byte,
-                      next_chunk_size(),
-                      fetch_chunk_done,
-                      /* user_ctx= */ done_callback);
+  fetch_next_chunk(/* user_ctx= */ done_callback);
 }
 
 static void complete_command() {
@@ -377,23 +659,35 @@ static void start_video_3(bool ok, void* user_ctx);
 static void start_video_4(bool ok, void* user_ctx);
 static void start_video_5(bool ok, void* user_ctx);
 
-static void start_video_async() {
-  // Look up the video URL.
-  uint16_t video_index = kinetoscope.arg;
-  if (video_index > 127) {
+// Where a video's header is in the catalog, according to the catalog index.
+// Returns false if the index doesn't have it.
+static bool catalog_header_offset(uint16_t video_index, size_t* offset) {
+  if (video_index >= ntohs(kinetoscope.catalog_index.header.numEntries) ||
+      video_index >= MAX_CATALOG_ENTRIES) {
     char buf[64];
     snprintf(buf, 64, "Invalid video index requested! (%d)", (int)video_index);
     report_error(buf);
+    return false;
+  }
+
+  *offset = ntohl(kinetoscope.catalog_index.entries[video_index].headerOffset);
+  return true;
+}
+
+static void start_video_async() {
+  // Look up the video URL.
+  uint16_t video_index = kinetoscope.arg;
+  size_t offset;
+  if (!catalog_header_offset(video_index, &offset)) {
     complete_command();
     return;
   }
 
   // Fetch the header from the appropriate section of the catalog.
   // This will have the relative URL of the full video.
-  const size_t header_size = sizeof(kinetoscope.header);
   fetch_range_to_buffer(VIDEO_SERVER_CATALOG_URL, &kinetoscope.header,
-                        /* first_byte= */ header_size * video_index,
-                        /* size= */ header_size,
+                        /* first_byte= */ offset,
+                        /* size= */ sizeof(kinetoscope.header),
                         start_video_0);
 }
 
@@ -446,15 +740,34 @@ static void start_video_1(bool ok, void* user_ctx) {
   // Manage compression.  If it's compressed, we're going to overwrite that
   // fact in memory before transferring the header data to SRAM.  We will
   // decompress it on the fly before the Sega sees it.
-  kinetoscope.compressed = kinetoscope.header.compression != 0;
+  uint16_t compression = ntohs(kinetoscope.header.compression);
+  uint16_t codec = compression & SEGAVIDEO_COMPRESSION_CODECS;
+  if (compression & ~(SEGAVIDEO_COMPRESSION_CODECS |
+                      SEGAVIDEO_COMPRESSION_ADPCM |
+                      SEGAVIDEO_COMPRESSION_SHORT_INDEX) ||
+      (compression && codec != SEGAVIDEO_COMPRESSION_RLE &&
+       codec != SEGAVIDEO_COMPRESSION_LZ)) {
+    char buf[64];
+    snprintf(buf, 64, "Unsupported compression! (0x%04X)", compression);
+    report_error(buf);
+    complete_command();
+    return;
+  }
+  kinetoscope.compressed = compression != 0;
+  kinetoscope.adpcm_audio = (compression & SEGAVIDEO_COMPRESSION_ADPCM) != 0;
+  kinetoscope.lz_chunks = codec == SEGAVIDEO_COMPRESSION_LZ;
   kinetoscope.header.compression = 0;
   printf("Video is%s compressed!\n", kinetoscope.compressed ? "" : " not");
 
   if (kinetoscope.compressed) {
-    // If it's compressed, fetch the chunk index to a buffer in memory.
+    // If it's compressed, fetch the chunk index to a buffer in memory.  A
+    // short index leaves the rest of the buffer as it was, which is never
+    // read.
+    uint32_t index_entries = segavideo_indexEntries(
+        compression, ntohl(kinetoscope.header.totalChunks));
     fetch_range_to_buffer(kinetoscope.video_url, &kinetoscope.index,
                           /* offset= */ sizeof(kinetoscope.header),
-                          /* size= */ sizeof(kinetoscope.index),
+                          /* size= */ index_entries * sizeof(uint32_t),
                           start_video_2);
   } else {
     // If it's not compressed, move on to the next step.
@@ -480,6 +793,15 @@ static void start_video_2(bool ok, void* user_ctx) {
   kinetoscope.chunk_size = ntohl(kinetoscope.header.chunkSize);
   kinetoscope.chunks_left = ntohl(kinetoscope.header.totalChunks);
   kinetoscope.chunk_num = 0;
+  kinetoscope.playing_chunk_num = 0;
+  kinetoscope.origin_chunk_num = 0;
+  kinetoscope.chunks_per_bank = segavideo_chunksPerRegion(
+      ntohs(kinetoscope.header.format), SRAM_BANK_SIZE_BYTES,
+      kinetoscope.chunk_size);
+
+  // Stats start over with each video.
+  memset(&kinetoscope.stats, 0, sizeof(kinetoscope.stats));
+  kinetoscope.margin_recorded = false;
 
   // Transfer the header from emulator memory to emulated SRAM.
   reset_sram(0);
@@ -489,7 +811,7 @@ static void start_video_2(bool ok, void* user_ctx) {
     kinetoscope.video_url_start_byte = kinetoscope.index.chunk_offset[0];
   }
 
-  // Fill the first region.
+  // Fill the first bank.
   fetch_chunk(start_video_3);
 }
 
@@ -500,7 +822,12 @@ static void start_video_3(bool ok, void* user_ctx) {
     return;
   }
 
-  if (kinetoscope.chunks_left) {
+  if (kinetoscope.chunks_left && kinetoscope.fast_start) {
+    // Fill the second region in the background, and return control to the
+    // Sega now.  The Sega will use CMD_AWAIT_FILL to know when it's done.
+    fetch_chunk(/* done_callback= */ NULL);
+    start_video_4(/* ok= */ true, /* user_ctx= */ NULL);
+  } else if (kinetoscope.chunks_left) {
     // Fill the second region as well.
     fetch_chunk(start_video_4);
   } else {
@@ -513,26 +840,114 @@ static void start_video_4(bool ok, void* user_ctx) {
 }
 
 static void flip_region() {
+  // The Sega sends this as it moves on to the next chunk, even at the end.
+  kinetoscope.playing_chunk_num++;
+
   if (!kinetoscope.chunks_left) {
     return;
   }
 
+  // The arg is the slot the Sega moved on to.  Only the first slot of a bank
+  // frees the other bank for refilling.
+  if (kinetoscope.arg % kinetoscope.chunks_per_bank) {
+    return;
+  }
+
+  record_margin(/* underflow= */ kinetoscope.fetch_busy);
+
   fetch_chunk(/* done_callback= */ NULL);
 }
 
+static void seek_video_0(bool ok, void* user_ctx);
+
+static void seek_video_async() {
+  // The arg is a signed number of chunks relative to the one playing.  Clamp
+  // to the video the same way the Sega does.
+  int total_chunks = ntohl(kinetoscope.header.totalChunks);
+  int target = (int)kinetoscope.playing_chunk_num + (int8_t)kinetoscope.arg;
+  if (target < 0) {
+    target = 0;
+  }
+  if (target > total_chunks - 1) {
+    target = total_chunks - 1;
+  }
+  printf("Kinetoscope: seeking to chunk %d\n", target);
+
+  kinetoscope.playing_chunk_num = target;
+  kinetoscope.chunk_num = target;
+  kinetoscope.origin_chunk_num = target;
+  kinetoscope.chunks_left = total_chunks - target;
+  if (kinetoscope.compressed) {
+    kinetoscope.video_url_start_byte = kinetoscope.index.chunk_offset[target];
+  } else {
+    kinetoscope.video_url_start_byte =
+        sizeof(kinetoscope.header) + target * kinetoscope.chunk_size;
+  }
+
+  // The target goes into the first slot of bank 0, and only chunk 0 follows
+  // the header.
+  reset_sram(0);
+  if (target == 0) {
+    write_sram((const uint8_t*)&kinetoscope.header,
+               sizeof(kinetoscope.header));
+  }
+
+  // Fill both regions again, starting here.
+  fetch_chunk(seek_video_0);
+}
+
+static void seek_video_0(bool ok, void* user_ctx) {
+  if (ok && kinetoscope.chunks_left) {
+    fetch_chunk(start_video_4);
+  } else {
+    start_video_4(/* ok= */ true, /* user_ctx= */ NULL);
+  }
+}
+
 static void get_video_list_0(bool ok, void* user_ctx);
 
 static void get_video_list_async() {
   printf("Kinetoscope: list\n");
 
-  reset_sram(0);
-  fetch_to_sram(VIDEO_SERVER_CATALOG_URL, /* compressed= */ false,
-                get_video_list_0, /* user_ctx= */ NULL);
+  // Thumbnails and the rest of each header come from the catalog later, one
+  // at a time.  Keep a copy of the index to find them.
+  memset(&kinetoscope.catalog_index, 0, sizeof(kinetoscope.catalog_index));
+  fetch_to_buffer(VIDEO_SERVER_CATALOG_INDEX_URL, &kinetoscope.catalog_index,
+                  sizeof(kinetoscope.catalog_index), get_video_list_0);
 }
 
 static void get_video_list_0(bool ok, void* user_ctx) {
   if (!ok) {
     report_error("Failed to download video catalog!");
+  } else {
+    // Anything past the end of the index is zero.
+    reset_sram(0);
+    write_sram((const uint8_t*)&kinetoscope.catalog_index,
+               sizeof(kinetoscope.catalog_index));
+  }
+
+  complete_command();
+}
+
+static void get_thumbnail_0(bool ok, void* user_ctx);
+
+static void get_thumbnail_async() {
+  size_t offset;
+  if (!catalog_header_offset(kinetoscope.arg, &offset)) {
+    complete_command();
+    return;
+  }
+
+  // Bank 0 still has the catalog index, so the header goes to bank 1.
+  reset_sram(1);
+  fetch_range_to_sram(VIDEO_SERVER_CATALOG_URL, /* compressed= */ false,
+                      offset, sizeof(SegaVideoHeader),
+                      get_thumbnail_0, /* user_ctx= */ NULL);
+}
+
+static void get_thumbnail_0(bool ok, void* user_ctx) {
+  if (!ok) {
+    report_error("Failed to download thumbnail!");
   }
 
   complete_command();
@@ -554,8 +969,11 @@ static void execute_command() {
     // command by returning control to the Sega.  get_video_list_async() will
     // eventually return control when its chain of callbacks terminates.
     return;
-  } else if (kinetoscope.command == CMD_START_VIDEO) {
-    printf("Kinetoscope: CMD_START_VIDEO\n");
+  } else if (kinetoscope.command == CMD_START_VIDEO ||
+             kinetoscope.command == CMD_START_FAST) {
+    printf("Kinetoscope: %s\n", kinetoscope.command == CMD_START_FAST ?
+           "CMD_START_FAST" : "CMD_START_VIDEO");
+    kinetoscope.fast_start = kinetoscope.command == CMD_START_FAST;
     start_video_async();
     // Because this command is async, don't fall through and complete the
     // command by returning control to the Sega.  start_video_async() will
@@ -576,6 +994,45 @@ static void execute_command() {
   } else if (kinetoscope.command == CMD_MARCH_TEST) {
     printf("Kinetoscope: CMD_MARCH_TEST\n");
     sram_march_test(kinetoscope.arg);
+  } else if (kinetoscope.command == CMD_SEEK) {
+    printf("Kinetoscope: CMD_SEEK\n");
+    if (kinetoscope.fetch_busy) {
+      interrupt_fetch();
+    }
+    seek_video_async();
+    // Because this command is async, don't fall through and complete the
+    // command by returning control to the Sega.  seek_video_async() will
+    // eventually return control when its chain of callbacks terminates.
+    return;
+  } else if (kinetoscope.command == CMD_GET_STATS) {
+    printf("Kinetoscope: CMD_GET_STATS\n");
+    // The stats go to bank 0, so not while a fetch may own it.
+    if (kinetoscope.fetch_busy) {
+      report_error("Can't get stats while streaming!");
+    } else {
+      write_stats_to_sram();
+    }
+  } else if (kinetoscope.command == CMD_GET_THUMB) {
+    printf("Kinetoscope: CMD_GET_THUMB\n");
+    get_thumbnail_async();
+    // Because this command is async, don't fall through and complete the
+    // command by returning control to the Sega.  get_thumbnail_async() will
+    // eventually return control when its chain of callbacks terminates.
+    return;
+  } else if (kinetoscope.command == CMD_AWAIT_FILL) {
+    printf("Kinetoscope: CMD_AWAIT_FILL\n");
+    // fetch_chunk_done() runs on the fetch thread, so hold off callbacks
+    // while we check.  Otherwise, both could complete the command, and the
+    // second would take control back from the Sega's next command.
+    fetch_lock_callbacks();
+    bool busy = kinetoscope.fetch_busy;
+    kinetoscope.awaiting_fill = busy;
+    fetch_unlock_callbacks();
+    if (busy) {
+      // fetch_chunk_done() will return control to the Sega, unless the fetch
+      // is cancelled first.
+      return;
+    }
   } else {
     report_error("Unrecognized command 0x%02X!", kinetoscope.command);
   }
@@ -0,0 +1,97 @@
+# Kinetoscope: A Sega Genesis Video Player
+#
+# Copyright (c) 2024 Joey Parrish
+#
+# See MIT License in LICENSE.txt
+
+# The Kinetoscope ADPCM format is 4-bit IMA ADPCM of signed 8-bit PCM, two
+# samples per byte, low nibble first.  The predictor has 16 bits of precision,
+# and the decoder outputs the top 8 bits.  Each block starts with a predictor
+# of 0 and a step index of 0, so there is no block header.
+#
+# The streaming firmware decodes this in common/adpcm-common.h, which must
+# match _decode_nibble() below exactly.
+
+
+STEP_TABLE = [
+  7, 8, 9, 10, 11, 12, 13, 14, 16, 17, 19, 21, 23, 25, 28, 31, 34, 37, 41, 45,
+  50, 55, 60, 66, 73, 80, 88, 97, 107, 118, 130, 143, 157, 173, 190, 209, 230,
+  253, 279, 307, 337, 371, 408, 449, 494, 544, 598, 658, 724, 796, 876, 963,
+  1060, 1166, 1282, 1411, 1552, 1707, 1878, 2066, 2272, 2499, 2749, 3024, 3327,
+  3660, 4026, 4428, 4871, 5358, 5894, 6484, 7132, 7845, 8630, 9493, 10442,
+  11487, 12635, 13899, 15289, 16818, 18500, 20350, 22385, 24623, 27086, 29794,
+  32767,
+]
+
+INDEX_TABLE = [ -1, -1, -1, -1, 2, 4, 6, 8 ]
+
+
+class _DecoderState(object):
+  predictor = 0
+  step_index = 0
+
+
+def _decode_nibble(state, nibble):
+  step = STEP_TABLE[state.step_index]
+  diff = step >> 3
+  if nibble & 1:
+    diff += step >> 2
+  if nibble & 2:
+    diff += step >> 1
+  if nibble & 4:
+    diff += step
+
+  if nibble & 8:
+    state.predictor = max(state.predictor - diff, -32768)
+  else:
+    state.predictor = min(state.predictor + diff, 32767)
+
+  state.step_index = min(max(state.step_index + INDEX_TABLE[nibble & 7], 0), 88)
+  return state.predictor >> 8
+
+
+def _encode_sample(state, sample):
+  # Pick the nibble that brings the decoder closest to the sample, scaled up to
+  # the predictor's precision.
+  target = sample << 8
+  step = STEP_TABLE[state.step_index]
+  delta = target - state.predictor
+
+  nibble = 0
+  if delta < 0:
+    nibble = 8
+    delta = -delta
+
+  # The standard IMA quantizer.
+  if delta >= step:
+    nibble |= 4
+    delta -= step
+  step >>= 1
+  if delta >= step:
+    nibble |= 2
+    delta -= step
+  step >>= 1
+  if delta >= step:
+    nibble |= 1
+
+  # Run the decoder so that our state tracks it exactly.
+  _decode_nibble(state, nibble)
+  return nibble
+
+
+def adpcm_compress(pcm):
+  # |pcm| is signed 8-bit samples, an even number of them.
+  assert len(pcm) % 2 == 0
+  state = _DecoderState()
+  output = bytearray(len(pcm) // 2)
+
+  for i in range(0, len(pcm), 2):
+    samples = [ pcm[i], pcm[i + 1] ]
+    # Convert from unsigned bytes to signed samples.
+    samples = [ s - 256 if s >= 128 else s for s in samples ]
+    low = _encode_sample(state, samples[0])
+    high = _encode_sample(state, samples[1])
+    output[i // 2] = low | (high << 4)
+
+  return bytes(output)
+
@@ -14,15 +14,24 @@ You can fit ~13.6s of audio+video in a 4MB ROM with 128kB left for the player.
 """
 
 import argparse
+import collections
+import concurrent.futures
+import contextlib
 import glob
+import hashlib
 import io
+import json
 import os
 import shutil
 import subprocess
 import sys
 import tempfile
+import threading
+import time
 
-from rle_encoder import rle_compress
+from adpcm_encoder import adpcm_compress
+from lz_encoder import lz_compress
+from rle_encoder import rle_compress, rle_compress_each
 
 
 # A "magic" string in the file header to identify it.
@@ -33,6 +42,12 @@ FILE_MAGIC = b"what nintendon't"
 # compatibility, we define a constant for the file format that is written into
 # the output file.
 FILE_FORMAT = 3
+# The same, but with delta frames.  See SegaVideoDeltaFrame.
+FILE_FORMAT_DELTA = 4
+# The same, but with deduplicated tiles.  See SegaVideoTilemapFrame.
+FILE_FORMAT_TILEMAP = 5
+# The same, but with RLE-compressed tiles.  See SegaVideoRleFrame.
+FILE_FORMAT_RLE = 6
 
 # Number of tiles (w, h) for fullscreen and thumbnail sizes.
 FULLSCREEN_TILES = (32, 28)
@@ -41,81 +56,490 @@ THUMBNAIL_TILES = (16, 14)
 # Maximum number of video index entries.
 SEGA_VIDEO_INDEX_MAX_ENTRIES = 36032
 
+# A --short-index is a multiple of this many entries, 256 bytes, to keep the
+# audio aligned.
+SEGA_VIDEO_INDEX_BLOCK_ENTRIES = 64
+
 # An index offset that indicates EOF.
 EOF_OFFSET = 0xffffffff
 
-# Compression constants.
+# An index offset that ends a --live video, after the end of the last chunk.
+LIVE_END_OFFSET = 0xfffffffe
+
+# Compression constants.  These are bits.
 COMPRESSION_NONE = 0
 COMPRESSION_RLE = 1
+COMPRESSION_ADPCM = 2
+COMPRESSION_LZ = 4
+COMPRESSION_LIVE = 8
+COMPRESSION_SHORT_INDEX = 16
+
+# Chunk codecs by name, for --compressed.
+COMPRESSION_CODECS = {
+  'rle': COMPRESSION_RLE,
+  'lz': COMPRESSION_LZ,
+}
+
+# Colors per palette.  There are 16, but color 0 is always transparent.
+MAX_COLORS = 15
+
+# Renditions are numbered from 1 and stored in one digit by the firmware.
+MAX_RENDITIONS = 9
+
+# Sizes within a frame.
+PALETTE_BYTES = 32
+TILE_BYTES = 32
+NUM_FULLSCREEN_TILES = FULLSCREEN_TILES[0] * FULLSCREEN_TILES[1]
+
+# Size of a fullscreen frame as raw RGB24 pixels, for --pipe-frames.
+FULLSCREEN_SIZE = (FULLSCREEN_TILES[0] * 8, FULLSCREEN_TILES[1] * 8)
+RAW_FRAME_BYTES = FULLSCREEN_SIZE[0] * FULLSCREEN_SIZE[1] * 3
+
+# With --pipe-frames, longer scenes are quantized in pieces of this many
+# frames, so that memory use stays bounded.  At 10 fps, this is 30 seconds, and
+# each copy of the raw frames is about 52MB.  Quantizing holds up to four
+# copies at once (the frames, the input to ffmpeg, its output, and the frames
+# split from that), so a piece peaks at about 200MB, times --jobs.  Each piece
+# gets its own palette, so the colors of a long scene may shift a little where
+# it is split.
+MAX_PIPED_SCENE_FRAMES = 300
+
+# With --live, the sound length isn't known until the end.  This is the most
+# that fits in the header, rounded down to the 256-byte alignment.
+MAX_LIVE_SOUND_LEN = (1 << 32) - 256
+
+# In delta frames, runs of changed tiles separated by this many unchanged tiles
+# or fewer are sent as one run.  Each run costs 4 bytes and one DMA transfer in
+# the player, and each unchanged tile costs 32 bytes.
+MAX_MERGED_GAP = 2
+
+# Each decoded chunk must fit in one bank of SRAM in the streaming hardware.
+SRAM_BANK_BYTES = 1 << 20
+
+# Buckets of the chunk size histogram in --profile.
+PROFILE_HISTOGRAM_BUCKETS = 8
+
+# Flip bits in a tilemap entry, as in SGDK's TILE_ATTR_FULL().
+TILE_HFLIP = 1 << 11
+TILE_VFLIP = 1 << 12
 
 def main(args):
   if args.generate_resource_file and args.compressed:
     print('--generate-resource-file and --compressed are mutually exclusive!')
     sys.exit(1)
 
-  with tempfile.TemporaryDirectory(prefix='encode_sega_video_') as tmp_dir:
-    print('Converting {} to {} at {} fps and {} Hz{}.'.format(
-        args.input, args.output, args.fps, args.sample_rate,
-        ' with compression' if args.compressed else ''))
-    print('Temporary files written to {}'.format(tmp_dir))
+  if args.renditions and not args.compressed:
+    print('--renditions requires --compressed!')
+    sys.exit(1)
 
-    # Create various folders within the overall temp dir.
-    fullcolor_dir = os.path.join(tmp_dir, 'fullcolor')
-    os.mkdir(fullcolor_dir)
+  if len(args.renditions) > MAX_RENDITIONS:
+    print('No more than {} renditions are supported!'.format(MAX_RENDITIONS))
+    sys.exit(1)
 
-    scenes_dir = os.path.join(tmp_dir, 'scenes')
-    os.mkdir(scenes_dir)
+  if args.jobs < 1:
+    print('--jobs must be at least 1!')
+    sys.exit(1)
 
-    quantized_scenes_dir = os.path.join(tmp_dir, 'quantized-scenes')
-    os.mkdir(quantized_scenes_dir)
+  if args.adpcm_audio and not args.compressed:
+    # Only the streaming firmware can decode ADPCM.
+    print('--adpcm-audio requires --compressed!')
+    sys.exit(1)
 
-    quantized_dir = os.path.join(tmp_dir, 'quantized')
-    os.mkdir(quantized_dir)
+  if args.delta_frames and args.dedup_tiles:
+    print('--delta-frames and --dedup-tiles are mutually exclusive!')
+    sys.exit(1)
 
-    sega_format_dir = os.path.join(tmp_dir, 'sega_format')
-    os.mkdir(sega_format_dir)
+  if args.rle_tiles and (args.delta_frames or args.dedup_tiles):
+    print('--rle-tiles, --delta-frames, and --dedup-tiles are mutually '
+          'exclusive!')
+    sys.exit(1)
 
-    thumb_dir = os.path.join(tmp_dir, 'thumb')
-    os.mkdir(thumb_dir)
+  if args.rle_tiles and not args.generate_resource_file:
+    # The player decodes these into RAM, so they only make sense in ROM.  A
+    # streamed video is compressed by the streamer instead.
+    print('--rle-tiles requires --generate-resource-file!')
+    sys.exit(1)
 
-    # Detect crop settings for the input video.
-    crop = detect_crop(args)
+  if args.delta_frames and not (args.compressed or
+                                args.generate_resource_file):
+    # Delta chunks vary in size, so the streamer needs the index that comes
+    # with compression.
+    print('--delta-frames requires --compressed or --generate-resource-file!')
+    sys.exit(1)
 
-    # Detect normalization settings for the input audio.
-    if args.filter_audio:
-      normalization = detect_normalization(args)
-    else:
-      normalization = None
+  if args.dedup_tiles and not (args.compressed or
+                               args.generate_resource_file):
+    # The same is true of deduplicated chunks.
+    print('--dedup-tiles requires --compressed or --generate-resource-file!')
+    sys.exit(1)
 
-    # Extract individual frames, reduced to the output framerate, and audio,
-    # resampled to the target sample rate and resolution.
-    extract_frames_and_audio(args, crop, normalization, fullcolor_dir, tmp_dir)
+  if args.live and not (args.compressed and args.pipe_frames):
+    # Only compressed video has an index to grow, and chunks must come out
+    # as soon as their frames do.
+    print('--live requires --compressed and --pipe-frames!')
+    sys.exit(1)
 
-    # Determine where scene changes are, to optimize the quantization process
-    # and improve color quality.
-    scenes = detect_scene_changes(args, fullcolor_dir)
+  if args.live and args.renditions:
+    print('--live and --renditions are mutually exclusive!')
+    sys.exit(1)
 
-    # Organize each scene's frames into a folder.
-    construct_scenes(fullcolor_dir, scenes_dir, scenes)
+  if args.short_index and not args.compressed:
+    print('--short-index requires --compressed!')
+    sys.exit(1)
 
-    # Quantize each scene.
-    quantize_scenes(args, scenes_dir, quantized_scenes_dir, scenes)
+  if args.short_index and args.live:
+    # A live index can't know how long it will grow.
+    print('--short-index and --live are mutually exclusive!')
+    sys.exit(1)
 
-    # Turn those scenes into a single sequence of frames again.
-    recombine_scenes(quantized_scenes_dir, quantized_dir)
+  for max_colors in args.renditions:
+    if max_colors < 1 or max_colors >= MAX_COLORS:
+      print('Renditions must have between 1 and {} colors!'.format(
+          MAX_COLORS - 1))
+      sys.exit(1)
 
-    # Encode each frame into Sega-formatted tiles.
-    encode_frames_to_tiles(quantized_dir, sega_format_dir)
+  with tempfile.TemporaryDirectory(prefix='encode_sega_video_') as tmp_dir:
+    print('Converting {} to {} at {} fps and {} Hz{}.'.format(
+        args.input, args.output, args.fps, args.sample_rate,
+        ' with {} compression'.format(args.compressed)
+            if args.compressed else ''))
+
+    # Each stage writes its outputs to a folder of the work dir, named for a
+    # hash of everything that went into it.  With a persistent --work-dir, a
+    # re-run reuses every stage whose inputs haven't changed.
+    work_dir = args.work_dir or tmp_dir
+    os.makedirs(work_dir, exist_ok=True)
+    profiler = Profiler(args.profile)
+    cache = StageCache(work_dir, profiler)
+    print('Temporary files written to {}'.format(work_dir))
+
+    if args.live:
+      # Nothing is known about a live input ahead of time, so there is no
+      # stage to cache.
+      generate_live_output(args, tmp_dir, profiler)
+      if args.profile:
+        profiler.report(args.output + '.profile.json')
+      return
+
+    input_options = [input_identity(args.input), args.start, args.end]
 
-    # Generate a thumbnail image.
-    generate_thumbnail(args, fullcolor_dir, thumb_dir)
+    # Detect crop settings for the input video.
+    crop = cache.run('crop', input_options,
+                     lambda _: detect_crop(args), [args.input]).result
 
-    # Generate the final output file.
-    generate_final_output(args, sega_format_dir, tmp_dir, thumb_dir)
+    # Detect normalization settings for the input audio.
+    if args.filter_audio:
+      normalization = cache.run('normalization', input_options,
+                                lambda _: detect_normalization(args),
+                                [args.input]).result
+    else:
+      normalization = None
+
+    extract_options = input_options + [
+      crop, normalization, args.fps, args.sample_rate,
+    ]
+
+    if args.pipe_frames:
+      # Only the audio goes to disk here.  Each rendition decodes the frames
+      # again, straight into quantization and tile packing.
+      audio = cache.run('audio', extract_options,
+          lambda output_dir: extract_frames_and_audio(
+              args, crop, normalization, None, output_dir), [args.input])
+      sound_dir = audio.output_dir
+      save_debug_audio(args, sound_dir)
+
+      # Determine where scene changes are, straight from the input.
+      scenes = cache.run('piped-scenes',
+          input_options + [crop, args.fps, args.scene_detection_threshold],
+          lambda _: detect_scene_changes_in_input(args, crop),
+          [args.input]).result
+
+      # Generate a thumbnail image.
+      thumb_dir = cache.run('piped-thumbnail',
+          [audio.key, crop, args.thumbnail_fraction, args.dithering],
+          lambda output_dir: generate_thumbnail_from_input(
+              args, crop, sound_dir, output_dir)).output_dir
+    else:
+      # Extract individual frames, reduced to the output framerate, and audio,
+      # resampled to the target sample rate and resolution.
+      frames = cache.run('frames', extract_options,
+          lambda output_dir: extract_frames_and_audio(
+              args, crop, normalization, output_dir, output_dir),
+          [args.input])
+      fullcolor_dir = sound_dir = frames.output_dir
+      profiler.count_frames('frames', fullcolor_dir, '*.png')
+      save_debug_audio(args, sound_dir)
+
+      # Determine where scene changes are, to optimize the quantization
+      # process and improve color quality.
+      scenes_stage = cache.run('scenes',
+          [frames.key, args.scene_detection_threshold],
+          lambda _: detect_scene_changes(args, fullcolor_dir),
+          [fullcolor_dir])
+      scenes = scenes_stage.result
+
+      # Organize each scene's frames into a folder.
+      scene_frames = cache.run('scene-frames', [scenes_stage.key],
+          lambda output_dir: construct_scenes(
+              fullcolor_dir, output_dir, scenes), [fullcolor_dir])
+      scenes_dir = scene_frames.output_dir
+
+      # Generate a thumbnail image.
+      thumb_dir = cache.run('thumbnail',
+          [frames.key, args.thumbnail_fraction, args.dithering],
+          lambda output_dir: generate_thumbnail(
+              args, fullcolor_dir, output_dir)).output_dir
+
+    # The main output comes first, followed by any lighter renditions for
+    # adaptive streaming.  These differ only in the number of colors per
+    # palette.  Fewer colors make for longer runs and smaller compressed
+    # chunks, while the chunk timing stays exactly the same.
+    all_colors = [MAX_COLORS] + args.renditions
+    for rendition, max_colors in enumerate(all_colors):
+      if rendition == 0:
+        output_path = args.output
+        renditions = len(args.renditions)
+      else:
+        output_path = '{}.{}'.format(args.output, rendition)
+        renditions = 0
+
+      if args.pipe_frames:
+        palette_dir = os.path.join(tmp_dir, 'palettes{}'.format(rendition))
+        os.mkdir(palette_dir)
+
+        # Quantize and encode each scene as it comes out of ffmpeg.  Nothing
+        # runs until the final output asks for frames.
+        frames = FrameSource(
+            pipe_frames_to_tiles(args, crop, scenes, max_colors, palette_dir))
+      else:
+        def quantize(output_dir):
+          quantized_scenes_dir = os.path.join(output_dir, 'scenes')
+          os.mkdir(quantized_scenes_dir)
+
+          quantized_dir = os.path.join(output_dir, 'frames')
+          os.mkdir(quantized_dir)
+
+          # Quantize each scene.
+          quantize_scenes(args, scenes_dir, quantized_scenes_dir, scenes,
+                          max_colors)
+
+          # Turn those scenes into a single sequence of frames again.
+          recombine_scenes(quantized_scenes_dir, quantized_dir)
+
+        quantized = cache.run('quantized',
+            [scene_frames.key, max_colors, args.dithering], quantize,
+            [scenes_dir])
+        quantized_dir = os.path.join(quantized.output_dir, 'frames')
+
+        # Encode each frame into Sega-formatted tiles.  Delta frames need the
+        # same palette for a whole scene, so that unchanged tiles are
+        # identical.
+        sega_format_dir = cache.run('tiles',
+            [quantized.key, args.delta_frames],
+            lambda output_dir: encode_frames_to_tiles(
+                args, quantized_dir, output_dir,
+                scenes if args.delta_frames else None),
+            [quantized_dir]).output_dir
+        profiler.count_frames('tiles', sega_format_dir, '*.bin')
+
+        frames = read_frame_files(sega_format_dir)
+
+      # Generate the final output file.  This is quick next to the stages
+      # above, so it always runs.
+      generate_final_output(args, frames, sound_dir, thumb_dir, output_path,
+                            renditions, profiler)
 
     if args.generate_resource_file:
       generate_resource_file(args)
 
+    if args.profile:
+      profiler.report(args.output + '.profile.json')
+
+
+def input_identity(path):
+  # Stands in for the contents of the input file, which would be slow to hash.
+  stat = os.stat(path)
+  return [os.path.abspath(path), stat.st_size, stat.st_mtime_ns]
+
+
+class StageCache(object):
+  # Runs each stage of the encoder in its own folder, unless a previous run
+  # with exactly the same inputs already finished it.
+
+  # Bump this when a stage's outputs change, to invalidate old work dirs.
+  VERSION = 1
+
+  def __init__(self, work_dir, profiler):
+    self.work_dir = work_dir
+    self.profiler = profiler
+
+  def run(self, name, inputs, function, input_paths=[]):
+    # Calls function(output_dir), which returns a result that can be stored
+    # as JSON.  The key of a stage goes into the inputs of any stage that
+    # depends on it.  The input paths are only measured for --profile.
+    key = hashlib.sha256(json.dumps(
+        [self.VERSION, name, inputs]).encode('utf-8')).hexdigest()[:16]
+    output_dir = os.path.join(self.work_dir, '{}-{}'.format(name, key))
+    # This goes next to the folder, so that stages can glob their inputs.
+    done_path = output_dir + '.json'
+
+    with self.profiler.stage(name) as stats:
+      if os.path.exists(done_path):
+        print('Reusing {} from {}'.format(name, output_dir))
+        with open(done_path, 'r') as f:
+          result = json.load(f)['result']
+        stats['cached'] += 1
+      else:
+        # Start over from anything left by an interrupted run.
+        if os.path.exists(output_dir):
+          shutil.rmtree(output_dir)
+        os.makedirs(output_dir)
+
+        result = function(output_dir)
+        with open(done_path, 'w') as f:
+          json.dump({'inputs': inputs, 'result': result}, f)
+
+        # Results are the same, cached or not.
+        result = json.loads(json.dumps(result))
+
+      if self.profiler.enabled:
+        stats['bytes_in'] += sum(map(path_size, input_paths))
+        stats['bytes_out'] += path_size(output_dir)
+
+    return StageOutput(result, output_dir, key)
+
+
+StageOutput = collections.namedtuple('StageOutput',
+                                     ['result', 'output_dir', 'key'])
+
+
+def path_size(path):
+  if not os.path.isdir(path):
+    return os.path.getsize(path)
+
+  size = 0
+  for folder, _, filenames in os.walk(path):
+    for filename in filenames:
+      size += os.path.getsize(os.path.join(folder, filename))
+  return size
+
+
+def cpu_time():
+  # Including child processes, where ffmpeg and --jobs workers spend theirs.
+  # Children are counted once they exit.
+  times = os.times()
+  return times.user + times.system + times.children_user + times.children_system
+
+
+class Profiler(object):
+  # Collects time and sizes per stage, and sizes per chunk, for --profile.
+  # Stages that run more than once, such as one per rendition, add up.
+
+  def __init__(self, enabled):
+    self.enabled = enabled
+    self.stages = collections.OrderedDict()
+    self.chunks = []
+
+  @contextlib.contextmanager
+  def stage(self, name):
+    stats = self.stages.setdefault(name, {
+      'runs': 0,
+      'cached': 0,
+      'wall_seconds': 0.0,
+      'cpu_seconds': 0.0,
+      'bytes_in': 0,
+      'bytes_out': 0,
+      'frames': 0,
+    })
+
+    start_wall = time.perf_counter()
+    start_cpu = cpu_time()
+    yield stats
+    stats['wall_seconds'] += time.perf_counter() - start_wall
+    stats['cpu_seconds'] += cpu_time() - start_cpu
+    stats['runs'] += 1
+
+  def count_frames(self, name, frame_dir, pattern):
+    if self.enabled:
+      self.stages[name]['frames'] += len(
+          glob.glob(os.path.join(frame_dir, pattern)))
+
+  def chunk(self, output_path, decoded_bytes, stored_bytes):
+    # Decoded bytes are what lands in SRAM, and stored bytes are what the
+    # streamer has to fetch.
+    self.chunks.append({
+      'output': output_path,
+      'decoded_bytes': decoded_bytes,
+      'stored_bytes': stored_bytes,
+      'ratio': stored_bytes / decoded_bytes if decoded_bytes else 0,
+    })
+
+  def histogram(self, key):
+    # Counts of chunks by size, in fractions of an SRAM bank.  The final
+    # bucket is for anything over the limit.
+    bucket_bytes = SRAM_BANK_BYTES // PROFILE_HISTOGRAM_BUCKETS
+    counts = [0] * (PROFILE_HISTOGRAM_BUCKETS + 1)
+    for chunk in self.chunks:
+      bucket = min((chunk[key] - 1) // bucket_bytes, PROFILE_HISTOGRAM_BUCKETS)
+      counts[max(bucket, 0)] += 1
+
+    histogram = []
+    for bucket, count in enumerate(counts):
+      histogram.append({
+        'min_bytes': bucket * bucket_bytes,
+        'max_bytes': (bucket + 1) * bucket_bytes
+            if bucket < PROFILE_HISTOGRAM_BUCKETS else None,
+        'chunks': count,
+      })
+    return histogram
+
+  def report(self, json_path):
+    for stats in self.stages.values():
+      stats['frames_per_second'] = (stats['frames'] / stats['wall_seconds']
+          if stats['frames'] and stats['wall_seconds'] else None)
+
+    print('')
+    row_format = '{:<16} {:>5} {:>6} {:>9} {:>9} {:>9} {:>9} {:>9}'
+    print(row_format.format(
+        'Stage', 'Runs', 'Cached', 'Wall s', 'CPU s', 'In MB', 'Out MB',
+        'Frames/s'))
+    row_format = row_format.replace('{:>9}', '{:>9.1f}', 4)
+    for name, stats in self.stages.items():
+      fps = stats['frames_per_second']
+      print(row_format.format(
+          name, stats['runs'], stats['cached'], stats['wall_seconds'],
+          stats['cpu_seconds'], stats['bytes_in'] / 1e6,
+          stats['bytes_out'] / 1e6, '{:.1f}'.format(fps) if fps else '-'))
+
+    decoded_histogram = self.histogram('decoded_bytes')
+    stored_histogram = self.histogram('stored_bytes')
+    if self.chunks:
+      ratios = [chunk['ratio'] for chunk in self.chunks]
+      print('')
+      print('{} chunks, compression ratio {:.3f} to {:.3f}.'.format(
+          len(self.chunks), min(ratios), max(ratios)))
+      print('Chunk sizes against the {} kB SRAM bank:'.format(
+          SRAM_BANK_BYTES // 1024))
+      print('{:>16} {:>9} {:>9}'.format('kB', 'Decoded', 'Stored'))
+      for decoded, stored in zip(decoded_histogram, stored_histogram):
+        if decoded['max_bytes'] is None:
+          label = 'over {}'.format(decoded['min_bytes'] // 1024)
+        else:
+          label = '{}-{}'.format(decoded['min_bytes'] // 1024,
+                                 decoded['max_bytes'] // 1024)
+        print('{:>16} {:>9} {:>9}'.format(
+            label, decoded['chunks'], stored['chunks']))
+
+    with open(json_path, 'w') as f:
+      json.dump({
+        'stages': self.stages,
+        'chunks': self.chunks,
+        'sram_bank_bytes': SRAM_BANK_BYTES,
+        'decoded_histogram': decoded_histogram,
+        'stored_histogram': stored_histogram,
+      }, f, indent=2)
+    print('Profile written to {}'.format(json_path))
+
 
 def run(debug, **kwargs):
   if debug:
@@ -123,6 +547,34 @@ def run(debug, **kwargs):
   return subprocess.run(**kwargs)
 
 
+def popen(debug, **kwargs):
+  if debug:
+    print('+ ' + ' '.join(kwargs['args']))
+  return subprocess.Popen(**kwargs)
+
+
+def run_jobs(jobs, function, tasks, use_processes=False):
+  # Calls function(*task) for each task, on up to |jobs| workers, and yields
+  # each result in order.  Each task writes its own output files, so the
+  # output is identical to running them one at a time.  Threads are enough to
+  # run ffmpeg, but Python work needs processes to use more than one core.
+  if jobs <= 1 or len(tasks) <= 1:
+    for task in tasks:
+      yield function(*task)
+    return
+
+  if use_processes:
+    executor = concurrent.futures.ProcessPoolExecutor(max_workers=jobs)
+  else:
+    executor = concurrent.futures.ThreadPoolExecutor(max_workers=jobs)
+
+  with executor:
+    # Only process pools make use of chunksize.  Small tasks go to each worker
+    # in batches to cut down on the overhead.
+    chunksize = max(1, len(tasks) // (jobs * 16))
+    yield from executor.map(function, *zip(*tasks), chunksize=chunksize)
+
+
 def detect_crop(args, skip_keyframes=True):
   rounding = 8  # round to a multiple of 8 pixels, the Sega tile size
 
@@ -236,7 +688,7 @@ def detect_normalization(args):
   return normalization
 
 
-def extract_frames_and_audio(args, crop, normalization, frame_dir, audio_dir):
+def video_filters(args, crop):
   # Notes on frame sizing:
   #  - SD analog display (NTSC) is 320x240.
   #  - The player sets the Genesis video processor's (VDP) resolution to
@@ -260,7 +712,24 @@ def extract_frames_and_audio(args, crop, normalization, frame_dir, audio_dir):
     # Scale it down to the VDP resolution, squishing the frame.
     'scale=256:224',
   ]
+  return filters
 
+
+def input_frames_args(args):
+  # ffmpeg input arguments to read the frames straight from the input, for
+  # --pipe-frames.  The subset is applied to the input, so that the output
+  # timestamps are free for filters to renumber.
+  ffmpeg_args = []
+  if args.start:
+    ffmpeg_args.extend(['-ss', str(args.start)])
+  if args.end:
+    ffmpeg_args.extend(['-t', str(args.end - args.start)])
+  ffmpeg_args.extend(['-i', args.input])
+  return ffmpeg_args
+
+
+def extract_frames_and_audio(args, crop, normalization, frame_dir, audio_dir):
+  # Without a frame_dir, only the audio is extracted.
   ffmpeg_args = [
     'ffmpeg',
     # Make less noise.
@@ -269,28 +738,56 @@ def extract_frames_and_audio(args, crop, normalization, frame_dir, audio_dir):
     '-stats',
     # Input.
     '-i', args.input,
-    # Video filters.
-    '-vf', ','.join(filters),
   ]
 
-  # Maybe subset the video output.
+  if frame_dir:
+    ffmpeg_args.extend([
+      # Video filters.
+      '-vf', ','.join(video_filters(args, crop)),
+    ])
+
+    # Maybe subset the video output.
+    if args.start:
+      ffmpeg_args.extend(['-ss', str(args.start)])
+    if args.end:
+      ffmpeg_args.extend(['-to', str(args.end)])
+
+    ffmpeg_args.extend([
+      # Output specifier for frames.
+      os.path.join(frame_dir, 'frame_%05d.png')
+    ])
+
+  ffmpeg_args.extend(audio_output_args(args, normalization))
+
+  # Apply the same subset to the audio output.
   if args.start:
     ffmpeg_args.extend(['-ss', str(args.start)])
   if args.end:
     ffmpeg_args.extend(['-to', str(args.end)])
 
+  temp_audio_file = os.path.join(audio_dir, 'sound.pcm')
   ffmpeg_args.extend([
-    # Output specifier for frames.
-    os.path.join(frame_dir, 'frame_%05d.png')
+    # Output specifier for audio.
+    temp_audio_file,
   ])
 
-  ffmpeg_args.extend([
+  if frame_dir:
+    print('Extracting video frames and audio...')
+  else:
+    print('Extracting audio...')
+  run(args.debug, check=True, args=ffmpeg_args)
+
+
+def audio_output_args(args, normalization):
+  # ffmpeg output arguments for audio in the format the player expects,
+  # filtered unless --no-filter-audio.
+  ffmpeg_args = [
     # Mix down to mono audio.
     '-ac', '1',
     # Encode as 8-bit signed raw PCM.
     '-acodec', 'pcm_s8',
     '-f', 's8',
-  ])
+  ]
 
   if args.filter_audio:
     # Audio filters.
@@ -322,45 +819,37 @@ def extract_frames_and_audio(args, crop, normalization, frame_dir, audio_dir):
       '-ar', str(args.sample_rate),
     ])
 
-  # Apply the same subset to the audio output.
-  if args.start:
-    ffmpeg_args.extend(['-ss', str(args.start)])
-  if args.end:
-    ffmpeg_args.extend(['-to', str(args.end)])
+  return ffmpeg_args
 
-  temp_audio_file = os.path.join(audio_dir, 'sound.pcm')
-  ffmpeg_args.extend([
-    # Output specifier for audio.
-    temp_audio_file,
-  ])
 
-  print('Extracting video frames and audio...')
-  run(args.debug, check=True, args=ffmpeg_args)
+def save_debug_audio(args, audio_dir):
+  if not args.debug_audio:
+    return
 
-  if args.debug_audio:
-    audio_debug_path_wav = os.path.join(args.output + '.wav')
-    audio_debug_path_pcm = os.path.join(args.output + '.pcm')
-    os.makedirs(os.path.dirname(audio_debug_path_wav), exist_ok=True)
+  temp_audio_file = os.path.join(audio_dir, 'sound.pcm')
+  audio_debug_path_wav = os.path.join(args.output + '.wav')
+  audio_debug_path_pcm = os.path.join(args.output + '.pcm')
+  os.makedirs(os.path.dirname(audio_debug_path_wav), exist_ok=True)
 
-    print('Saving extracted audio to {} and {}'.format(
-        audio_debug_path_pcm, audio_debug_path_wav))
+  print('Saving extracted audio to {} and {}'.format(
+      audio_debug_path_pcm, audio_debug_path_wav))
 
-    shutil.copy(temp_audio_file, audio_debug_path_pcm)
+  shutil.copy(temp_audio_file, audio_debug_path_pcm)
 
-    run(args.debug, check=True, args=[
-      'ffmpeg',
-      # Make less noise.
-      '-hide_banner', '-loglevel', 'error',
-      # Input.
-      '-f', 's8',
-      '-acodec', 'pcm_s8',
-      '-ac', '1',
-      '-ar', str(args.sample_rate),
-      '-i', audio_debug_path_pcm,
-      # Output.
-      '-acodec', 'pcm_u8',
-      '-y', audio_debug_path_wav,
-    ])
+  run(args.debug, check=True, args=[
+    'ffmpeg',
+    # Make less noise.
+    '-hide_banner', '-loglevel', 'error',
+    # Input.
+    '-f', 's8',
+    '-acodec', 'pcm_s8',
+    '-ac', '1',
+    '-ar', str(args.sample_rate),
+    '-i', audio_debug_path_pcm,
+    # Output.
+    '-acodec', 'pcm_u8',
+    '-y', audio_debug_path_wav,
+  ])
 
 
 def detect_scene_changes(args, frame_dir):
@@ -382,8 +871,43 @@ def detect_scene_changes(args, frame_dir):
   process = run(args.debug,
       check=True, capture_output=True, text=True, args=ffmpeg_args)
 
+  # The frame numbers are 1-based, so num_inputs is also the final frame number.
+  num_inputs = len(glob.glob(os.path.join(frame_dir, '*.png')))
+  return parse_scene_changes(process.stderr, num_inputs)
+
+
+def detect_scene_changes_in_input(args, crop):
+  # The same as detect_scene_changes(), but for --pipe-frames.  We don't know
+  # the number of frames yet, so the final scene ends at None.
+  print('Detecting scene changes...')
+
+  filters = video_filters(args, crop) + [
+    # Number the frames from 0 in PTS, as with PNGs at 1 fps.
+    'settb=1',
+    'setpts=N',
+    "select='gt(scene,{})'".format(args.scene_detection_threshold),
+    'showinfo',
+  ]
+
+  ffmpeg_args = [
+    'ffmpeg',
+    # Input.
+    *input_frames_args(args),
+    # Video filters.
+    '-vf', ','.join(filters),
+    # No output.
+    '-an', '-f', 'null', '-',
+  ]
+
+  process = run(args.debug,
+      check=True, capture_output=True, text=True, args=ffmpeg_args)
+
+  return parse_scene_changes(process.stderr, None)
+
+
+def parse_scene_changes(showinfo_output, final_frame):
   scene_change_frames = []
-  for line in process.stderr.split('\n'):
+  for line in showinfo_output.split('\n'):
     if 'pts:' in line:
       pts = int(line.split('pts:')[1].strip(' ').split(' ')[0])
       scene_change_frames.append(pts)
@@ -395,9 +919,7 @@ def detect_scene_changes(args, frame_dir):
     scenes.append((start_frame, end_frame))
     start_frame = end_frame + 1
 
-  # The frame numbers are 1-based, so num_inputs is also the final frame number.
-  num_inputs = len(glob.glob(os.path.join(frame_dir, '*.png')))
-  scenes.append((start_frame, num_inputs))
+  scenes.append((start_frame, final_frame))
 
   return scenes
 
@@ -423,7 +945,8 @@ def construct_scenes(input_dir, output_dir, scenes):
   print('')
 
 
-def quantize_scene(args, input_scene_dir, output_scene_dir, start_frame):
+def quantize_scene(args, input_scene_dir, output_scene_dir, start_frame,
+                   max_colors=MAX_COLORS):
   # Create an optimized palette first.
   output_pal_path = os.path.join(output_scene_dir, 'pal.png')
   ffmpeg_args = [
@@ -433,9 +956,9 @@ def quantize_scene(args, input_scene_dir, output_scene_dir, start_frame):
     # Input and starting frame number.
     '-start_number', str(start_frame),
     '-i', os.path.join(input_scene_dir, 'frame_%05d.png'),
-    # Compute an optimized 15-color palette (16 color palette, but color 0 is
-    # always treated as transparent).
-    '-vf', 'palettegen=max_colors=15',
+    # Compute an optimized palette of up to 15 colors (16 color palette, but
+    # color 0 is always treated as transparent).
+    '-vf', 'palettegen=max_colors={}'.format(max_colors),
     # Output a palette image.
     output_pal_path,
   ]
@@ -459,22 +982,26 @@ def quantize_scene(args, input_scene_dir, output_scene_dir, start_frame):
   run(args.debug, check=True, args=ffmpeg_args)
 
 
-def quantize_scenes(args, input_dir, output_dir, scenes):
+def quantize_scenes(args, input_dir, output_dir, scenes,
+                    max_colors=MAX_COLORS):
   scene_paths = sorted(glob.glob(os.path.join(input_dir, '*')))
-  scene_index = 0
+  tasks = []
 
-  while scene_index < len(scenes):
-    start_frame, end_frame = scenes[scene_index]
+  for scene_index, (start_frame, end_frame) in enumerate(scenes):
     input_scene_dir = scene_paths[scene_index]
     scene_name = os.path.basename(input_scene_dir)
 
     output_scene_dir = os.path.join(output_dir, scene_name)
     os.makedirs(output_scene_dir)
 
-    quantize_scene(args, input_scene_dir, output_scene_dir, start_frame)
+    tasks.append((args, input_scene_dir, output_scene_dir, start_frame,
+                  max_colors))
 
-    scene_index += 1
-    print('\rQuantized {} / {} scenes...'.format(scene_index, len(scenes)),
+  # Each scene is independent, so they can be quantized concurrently.
+  count = 0
+  for _ in run_jobs(args.jobs, quantize_scene, tasks):
+    count += 1
+    print('\rQuantized {} / {} scenes...'.format(count, len(scenes)),
           end='')
     if args.debug: print('')
 
@@ -491,24 +1018,226 @@ def recombine_scenes(input_dir, output_dir):
       shutil.move(input_frame, output_dir)
 
 
-def encode_frames_to_tiles(input_dir, output_dir):
-  all_inputs = glob.glob(os.path.join(input_dir, '*.ppm'))
-  count = 0
+def encode_batch_to_tiles(batch, output_dir, use_scene_palette):
+  # Runs in a worker process with --jobs.  Returns the number of frames.
+  palette = None
+  if use_scene_palette:
+    palette = scene_palette(batch)
 
-  for input_path in all_inputs:
+  for input_path in batch:
     input_filename = os.path.basename(input_path)
     output_filename = input_filename.replace('.ppm', '.bin')
     output_path = os.path.join(output_dir, output_filename)
 
-    ppm_to_sega_frame(input_path, output_path, FULLSCREEN_TILES)
+    ppm_to_sega_frame(input_path, output_path, FULLSCREEN_TILES, palette)
 
-    count += 1
+  return len(batch)
+
+
+def encode_frames_to_tiles(args, input_dir, output_dir, scenes=None):
+  all_inputs = sorted(glob.glob(os.path.join(input_dir, '*.ppm')))
+  count = 0
+
+  # By default, each frame gets its own palette.  With scenes, each scene gets
+  # one palette for all its frames, which were all quantized to the same
+  # colors anyway.
+  if scenes is None:
+    batches = [[input_path] for input_path in all_inputs]
+  else:
+    # Scene frame numbers are 1-based.
+    batches = [all_inputs[start_frame - 1:end_frame]
+               for start_frame, end_frame in scenes]
+
+  # Packing tiles is pure Python, so with --jobs, batches are spread across
+  # processes.
+  tasks = [(batch, output_dir, scenes is not None) for batch in batches]
+  for frames in run_jobs(args.jobs, encode_batch_to_tiles, tasks,
+                         use_processes=True):
+    count += frames
     print('\rConverted {} / {} frames to tiles...'.format(
           count, len(all_inputs)), end='')
   print('')
 
 
-def ppm_to_sega_frame(in_path, out_path, expected_tiles):
+def read_piped_scenes(pipe, scenes, max_frames=MAX_PIPED_SCENE_FRAMES):
+  # Reads raw frames from ffmpeg and yields them one scene at a time.  Long
+  # scenes are split into pieces of max_frames.
+  frame_num = 1
+  for start_frame, end_frame in scenes:
+    assert frame_num == start_frame
+    while end_frame is None or frame_num <= end_frame:
+      count = max_frames
+      if end_frame is not None:
+        count = min(count, end_frame - frame_num + 1)
+
+      frames = []
+      while len(frames) < count:
+        data = pipe.read(RAW_FRAME_BYTES)
+        if not data:
+          break
+        if len(data) != RAW_FRAME_BYTES:
+          raise RuntimeError('Truncated frame from ffmpeg!')
+        frames.append(data)
+
+      if frames:
+        yield frames
+      if len(frames) < count:
+        # The input ended early.
+        return
+      frame_num += count
+
+
+def quantize_piped_scene(args, frames, pal_path, max_colors):
+  # The same as quantize_scene(), but from and to raw frames in memory.  Only
+  # the palette is written to disk.
+  raw_input_args = [
+    '-f', 'rawvideo',
+    '-pix_fmt', 'rgb24',
+    '-s', '{}x{}'.format(*FULLSCREEN_SIZE),
+    '-i', '-',
+  ]
+  raw_frames = b''.join(frames)
+
+  ffmpeg_args = [
+    'ffmpeg',
+    # Make no noise, except on error.
+    '-hide_banner', '-loglevel', 'error', '-nostats',
+    # Input.
+    *raw_input_args,
+    # Compute an optimized palette, as in quantize_scene().
+    '-vf', 'palettegen=max_colors={}'.format(max_colors),
+    # Output a palette image.
+    pal_path,
+  ]
+  run(args.debug, check=True, input=raw_frames, args=ffmpeg_args)
+
+  ffmpeg_args = [
+    'ffmpeg',
+    # Make no noise, except on error.
+    '-hide_banner', '-loglevel', 'error', '-nostats',
+    # Input.
+    *raw_input_args,
+    # Palette.
+    '-i', pal_path,
+    # Use the optimized palette to quantize all the frames in the scene.
+    '-lavfi', 'paletteuse=dither={}'.format(args.dithering),
+    # Output raw frames again.
+    '-f', 'rawvideo', '-pix_fmt', 'rgb24', '-',
+  ]
+  process = run(args.debug, check=True, input=raw_frames,
+                stdout=subprocess.PIPE, args=ffmpeg_args)
+
+  quantized = process.stdout
+  assert len(quantized) == len(raw_frames)
+  return [quantized[offset:offset + RAW_FRAME_BYTES]
+          for offset in range(0, len(quantized), RAW_FRAME_BYTES)]
+
+
+def encode_piped_scene_to_tiles(frames, use_scene_palette):
+  # The same as encode_batch_to_tiles(), but returns the frames in memory.
+  palette = None
+  if use_scene_palette:
+    palette = frames_palette(frames)
+
+  width, height = FULLSCREEN_SIZE
+  return [rgb_to_sega_frame(width, height, data, FULLSCREEN_TILES, palette)
+          for data in frames]
+
+
+def pipe_frames_to_tiles(args, crop, scenes, max_colors, palette_dir):
+  # Yields each frame in Sega format, without any per-frame files.  One ffmpeg
+  # decodes raw frames into a pipe, and we quantize and encode them a scene at
+  # a time.  With --jobs, that many scenes are in memory at once.
+  ffmpeg_args = [
+    'ffmpeg',
+    # Make no noise, except on error.
+    '-hide_banner', '-loglevel', 'error', '-nostats',
+    # Input.
+    *input_frames_args(args),
+    # Video filters.
+    '-vf', ','.join(video_filters(args, crop)),
+    # Output raw frames to the pipe.
+    '-an', '-f', 'rawvideo', '-pix_fmt', 'rgb24', '-',
+  ]
+  process = popen(args.debug, stdout=subprocess.PIPE, args=ffmpeg_args)
+
+  def encode_batch(batch):
+    quantized = list(run_jobs(args.jobs, quantize_piped_scene, batch))
+    tasks = [(frames, args.delta_frames) for frames in quantized]
+    for encoded in run_jobs(args.jobs, encode_piped_scene_to_tiles, tasks,
+                            use_processes=True):
+      yield from encoded
+
+  try:
+    batch = []
+    for scene_index, frames in enumerate(
+        read_piped_scenes(process.stdout, scenes)):
+      pal_path = os.path.join(palette_dir,
+                              'scene_{:05d}.png'.format(scene_index))
+      batch.append((args, frames, pal_path, max_colors))
+      if len(batch) == args.jobs:
+        yield from encode_batch(batch)
+        batch = []
+    yield from encode_batch(batch)
+
+    process.stdout.close()
+    if process.wait():
+      raise subprocess.CalledProcessError(process.returncode, ffmpeg_args)
+  finally:
+    # We may stop early if the audio runs out first.
+    if process.poll() is None:
+      process.kill()
+      process.wait()
+
+
+def live_frames_to_tiles(args, pipe, palette_dir):
+  # The same as pipe_frames_to_tiles(), but for --live.  Scenes can't be
+  # detected ahead of time, so each chunk gets its own palette, and is
+  # quantized as soon as its frames arrive.
+  frames_per_chunk = args.fps * args.chunk_length
+  for chunk_index, frames in enumerate(
+      read_piped_scenes(pipe, [(1, None)], frames_per_chunk)):
+    pal_path = os.path.join(palette_dir,
+                            'chunk_{:05d}.png'.format(chunk_index))
+    quantized = quantize_piped_scene(args, frames, pal_path, MAX_COLORS)
+    yield from encode_piped_scene_to_tiles(quantized, args.delta_frames)
+
+
+class LiveAudio(object):
+  # Audio from the live ffmpeg, drained on a thread so that ffmpeg never
+  # blocks on it while we wait for video.  Like a file, read() returns fewer
+  # bytes than asked for only at the end.
+
+  def __init__(self, pipe):
+    self._data = bytearray()
+    self._ended = False
+    self._condition = threading.Condition()
+    self._thread = threading.Thread(target=self._drain, args=(pipe,),
+                                    daemon=True)
+    self._thread.start()
+
+  def _drain(self, pipe):
+    with pipe:
+      while True:
+        data = pipe.read1(65536)
+        with self._condition:
+          if not data:
+            self._ended = True
+          self._data.extend(data)
+          self._condition.notify()
+        if not data:
+          return
+
+  def read(self, size):
+    with self._condition:
+      self._condition.wait_for(
+          lambda: self._ended or len(self._data) >= size)
+      data = bytes(self._data[:size])
+      del self._data[:size]
+      return data
+
+
+def read_ppm(in_path):
   with open(in_path, 'rb') as f:
     data = f.read()
 
@@ -521,11 +1250,42 @@ def ppm_to_sega_frame(in_path, out_path, expected_tiles):
   header_size = len(b'\n'.join(header)) + 1 # final newline
 
   # Extract pixel data.
-  data = data[header_size:]
+  return width, height, data[header_size:]
+
+
+def scene_palette(input_paths):
+  return frames_palette(read_ppm(input_path)[2] for input_path in input_paths)
 
+
+def frames_palette(frames):
   # Entry 0 is always transparent when rendered.  We store black there.
-  # If another index is assigned black, that one will be opaque.
-  palette = [0x000]
+  colors = set()
+  for data in frames:
+    for data_index in range(0, len(data), 3):
+      r, g, b = data[data_index:data_index+3]
+      colors.add(rgb_to_sega_color(r, g, b))
+
+  colors.discard(0x000)
+  palette = [0x000] + sorted(colors)
+  assert len(palette) <= 16
+  return palette
+
+
+def ppm_to_sega_frame(in_path, out_path, expected_tiles, palette=None):
+  width, height, data = read_ppm(in_path)
+
+  with open(out_path, 'wb') as f:
+    f.write(rgb_to_sega_frame(width, height, data, expected_tiles, palette))
+
+
+def rgb_to_sega_frame(width, height, data, expected_tiles, palette=None):
+  if palette is None:
+    # Entry 0 is always transparent when rendered.  We store black there.
+    # If another index is assigned black, that one will be opaque.
+    palette = [0x000]
+    fixed_palette = False
+  else:
+    fixed_palette = True
 
   # Each tile is 8x8 pixels, 4 bit palette index per pixel.
   binary_tiles = b''
@@ -552,6 +1312,7 @@ def ppm_to_sega_frame(in_path, out_path, expected_tiles):
           if sega_color in palette:
             palette_index = palette.index(sega_color)
           else:
+            assert not fixed_palette
             palette_index = len(palette)
             palette.append(sega_color)
 
@@ -559,11 +1320,9 @@ def ppm_to_sega_frame(in_path, out_path, expected_tiles):
 
       binary_tiles += pack_tile(tile)
 
-  with open(out_path, 'wb') as f:
-    # SegaVideoFrameHeader contains the palette only
-    f.write(pack_palette(palette))
-    # Actual tile data follows
-    f.write(binary_tiles)
+  # SegaVideoFrameHeader contains the palette only, and the actual tile data
+  # follows.
+  return pack_palette(palette) + binary_tiles
 
 
 def rgb_to_sega_color(r, g, b):
@@ -601,16 +1360,171 @@ def patch_at_offset(f, patch_offset, value, size):
   f.seek(offset)
 
 
+class FrameSource(object):
+  # Frames in Sega format, in order, from files or straight from
+  # pipe_frames_to_tiles().  The total is None until the end with the latter.
+
+  def __init__(self, frames, total=None):
+    self._frames = iter(frames)
+    self._next = None
+    self.total = total
+    self.taken = 0
+
+  def has_more(self):
+    if self._next is None:
+      self._next = next(self._frames, None)
+    return self._next is not None
+
+  def take(self):
+    assert self.has_more()
+    frame = self._next
+    self._next = None
+    self.taken += 1
+    return frame
+
+  def close(self):
+    # Stops the pipeline, if any.
+    if hasattr(self._frames, 'close'):
+      self._frames.close()
+
+
+def read_frame_files(frame_dir):
+  frame_paths = sorted(glob.glob(os.path.join(frame_dir, '*.bin')))
+
+  def read_frames():
+    for frame_path in frame_paths:
+      with open(frame_path, 'rb') as frame_file:
+        yield frame_file.read()
+
+  return FrameSource(read_frames(), len(frame_paths))
+
+
 class ChunkWritingState(object):
   sound_file = None
   samples_per_chunk = 0
   frames_per_chunk = 0
-  frame_paths = []
+  frames = None  # a FrameSource
   chunk_size = 0
+  last_chunk_size = 0  # decoded, as the Sega will see it
   num_chunks = 0
   sound_len = 0  # bytes left to write
-  frame_count = 0  # frames left to write
-  frame_path_index = 0  # next index into frame_paths
+  delta_frames = False
+  adpcm_audio = False
+  dedup_tiles = False
+  rle_tiles = False
+  live = False
+
+
+def delta_frame(frame_data, bank):
+  # Convert a full frame to a SegaVideoDeltaFrame, relative to the tile set it
+  # will be loaded into.  |bank| holds the palette and tiles already in that
+  # set, or is empty, and is updated to match the new frame.
+  palette = frame_data[0:PALETTE_BYTES]
+  tiles = [
+    frame_data[PALETTE_BYTES + i * TILE_BYTES:
+               PALETTE_BYTES + (i + 1) * TILE_BYTES]
+    for i in range(NUM_FULLSCREEN_TILES)
+  ]
+
+  # A tile can be left in place only if it is identical and will be drawn
+  # with the same colors.  Palettes only change between scenes.
+  if bank.get('palette') == palette:
+    changed = [tiles[i] != bank['tiles'][i]
+               for i in range(NUM_FULLSCREEN_TILES)]
+  else:
+    changed = [True] * NUM_FULLSCREEN_TILES
+
+  # Group changed tiles into runs, merging runs with small gaps between them.
+  runs = []
+  for i in range(NUM_FULLSCREEN_TILES):
+    if not changed[i]:
+      continue
+    if runs and i - (runs[-1][0] + runs[-1][1]) <= MAX_MERGED_GAP:
+      runs[-1][1] = i + 1 - runs[-1][0]
+    else:
+      runs.append([i, 1])
+
+  num_tiles = sum(count for _, count in runs)
+
+  delta = palette
+  delta += len(runs).to_bytes(2, 'big')
+  delta += num_tiles.to_bytes(2, 'big')
+  for first_tile, count in runs:
+    delta += first_tile.to_bytes(2, 'big')
+    delta += count.to_bytes(2, 'big')
+  for first_tile, count in runs:
+    delta += b''.join(tiles[first_tile:first_tile + count])
+
+  bank['palette'] = palette
+  bank['tiles'] = tiles
+  return delta
+
+
+def hflip_tile(tile):
+  # Each row is 4 bytes of 2 pixels each.  Reverse the pixels in each row.
+  flipped = b''
+  for row in range(8):
+    row_bytes = tile[row * 4:(row + 1) * 4]
+    flipped += bytes(((b & 0x0f) << 4) | (b >> 4) for b in reversed(row_bytes))
+  return flipped
+
+
+def vflip_tile(tile):
+  # Reverse the order of the rows.
+  return b''.join(tile[row * 4:(row + 1) * 4] for row in reversed(range(8)))
+
+
+def tilemap_frame(frame_data):
+  # Convert a full frame to a SegaVideoTilemapFrame, storing each distinct
+  # tile once, and reusing it flipped where that matches.
+  palette = frame_data[0:PALETTE_BYTES]
+  tiles = []
+  tile_lookup = {}
+  tile_map = b''
+
+  for i in range(NUM_FULLSCREEN_TILES):
+    tile = frame_data[PALETTE_BYTES + i * TILE_BYTES:
+                      PALETTE_BYTES + (i + 1) * TILE_BYTES]
+
+    if tile not in tile_lookup:
+      # Register the new tile, then its flipped forms, without overriding the
+      # unflipped form of any tile already seen.
+      index = len(tiles)
+      tiles.append(tile)
+      hflipped = hflip_tile(tile)
+      vflipped = vflip_tile(tile)
+      for form, flags in [
+        (tile, 0),
+        (hflipped, TILE_HFLIP),
+        (vflipped, TILE_VFLIP),
+        (vflip_tile(hflipped), TILE_HFLIP | TILE_VFLIP),
+      ]:
+        tile_lookup.setdefault(form, index | flags)
+
+    tile_map += tile_lookup[tile].to_bytes(2, 'big')
+
+  frame = palette
+  frame += len(tiles).to_bytes(2, 'big')
+  frame += tile_map
+  frame += b''.join(tiles)
+  return frame
+
+
+def rle_frame(frame_data):
+  # Convert a full frame to a SegaVideoRleFrame, compressing each tile on its
+  # own, so that the player can decode any number of them at a time.
+  palette = frame_data[0:PALETTE_BYTES]
+  tiles = [
+    frame_data[PALETTE_BYTES + i * TILE_BYTES:
+               PALETTE_BYTES + (i + 1) * TILE_BYTES]
+    for i in range(NUM_FULLSCREEN_TILES)
+  ]
+
+  frame = palette + b''.join(rle_compress_each(tiles))
+  # Keep the next frame word-aligned.
+  if len(frame) % 2:
+    frame += bytes(1)
+  return frame
 
 
 def write_chunk(f, state):
@@ -618,7 +1532,9 @@ def write_chunk(f, state):
   start_of_chunk = f.tell()
   chunk_sound_size = min(state.sound_len, state.samples_per_chunk)
   f.write(chunk_sound_size.to_bytes(4, 'big'))
-  chunk_frame_count = min(state.frame_count, state.frames_per_chunk)
+  # We fill this in later, once we know how many frames are left.
+  chunk_frame_count = 0
+  chunk_frame_count_offset = f.tell()
   f.write(chunk_frame_count.to_bytes(2, 'big'))
   f.write(bytes(2))  # "unused1", formerly "finalChunk"
 
@@ -638,24 +1554,56 @@ def write_chunk(f, state):
   # Write audio:
   sound_data = state.sound_file.read(chunk_sound_size)
   if len(sound_data) < chunk_sound_size:
+    if state.live:
+      # The live input ended, so this is the last chunk.
+      state.sound_len = chunk_sound_size
     # Padding up to sound alignment requirements
     sound_data += bytes(chunk_sound_size - len(sound_data))
     assert len(sound_data) == chunk_sound_size
+  if state.adpcm_audio:
+    sound_data = adpcm_compress(sound_data)
   f.write(sound_data)
   state.sound_len -= chunk_sound_size
 
+  # With ADPCM, the chunk is stored with half-size audio, but the padding and
+  # chunk size are for the decoded chunk the Sega will see.
+  decoded_extra_bytes = chunk_sound_size - len(sound_data)
+
   # Write frames:
   chunk_frame_data_len = 0
-  for i in range(chunk_frame_count):
-    with open(state.frame_paths[state.frame_path_index], 'rb') as frame_file:
-      frame_data = frame_file.read()
-      f.write(frame_data)
-      chunk_frame_data_len += len(frame_data)
-    state.frame_count -= 1
-    state.frame_path_index += 1
+  # The player alternates between two tile sets.  Each chunk starts with both
+  # empty, so the first two frames are complete, and playback can start at any
+  # chunk.
+  banks = [{}, {}]
+  # RLE frames follow a table of their offsets, so they are collected first.
+  frame_file = io.BytesIO() if state.rle_tiles else f
+  frame_offsets = []
+  while (chunk_frame_count < state.frames_per_chunk and
+         state.frames.has_more()):
+    frame_data = state.frames.take()
+    if state.delta_frames:
+      frame_data = delta_frame(frame_data, banks[chunk_frame_count % 2])
+    elif state.dedup_tiles:
+      frame_data = tilemap_frame(frame_data)
+    elif state.rle_tiles:
+      frame_data = rle_frame(frame_data)
+    frame_offsets.append(frame_file.tell())
+    frame_file.write(frame_data)
+    chunk_frame_data_len += len(frame_data)
+    chunk_frame_count += 1
+
+  if state.rle_tiles:
+    # Offsets are from the start of the table, with one more for the end.
+    frame_offsets.append(frame_file.tell())
+    table_size = 4 * len(frame_offsets)
+    for offset in frame_offsets:
+      f.write((table_size + offset).to_bytes(4, 'big'))
+    f.write(frame_file.getvalue())
+
+  patch_at_offset(f, chunk_frame_count_offset, chunk_frame_count, 2)
 
   # Figure out the post-padding.
-  end_of_frames = f.tell()
+  end_of_frames = f.tell() + decoded_extra_bytes
   post_padding_remainder = end_of_frames % 256
   post_padding_bytes = 256 - post_padding_remainder if post_padding_remainder else 0
 
@@ -666,131 +1614,268 @@ def write_chunk(f, state):
   f.write(bytes(post_padding_bytes))
 
   # If this is the first chunk, record the size.
-  end_of_chunk = f.tell()
+  end_of_chunk = f.tell() + decoded_extra_bytes
+  state.last_chunk_size = end_of_chunk - start_of_chunk
   if state.chunk_size == 0:
-    state.chunk_size = end_of_chunk - start_of_chunk
+    state.chunk_size = state.last_chunk_size
 
   # Count chunks.
   state.num_chunks += 1
 
 
 def compress(compression, uncompressed):
+  # ADPCM audio was already written by write_chunk(), and live video is
+  # compressed like any other.  The index doesn't change the chunks, either.
+  compression &= ~(COMPRESSION_ADPCM | COMPRESSION_LIVE |
+                   COMPRESSION_SHORT_INDEX)
+
   if compression == COMPRESSION_NONE:
     return uncompressed
 
   if compression == COMPRESSION_RLE:
     return rle_compress(uncompressed)
 
+  if compression == COMPRESSION_LZ:
+    return lz_compress(uncompressed)
+
   raise RuntimeError('Unrecognized compression constant')
 
 
-def generate_final_output(args, frame_dir, sound_dir, thumb_dir):
-  print('Generating final output {}...'.format(args.output))
+def generate_final_output(args, frames, sound_dir, thumb_dir, output_path,
+                          renditions, profiler):
+  print('Generating final output {}...'.format(output_path))
 
   sound_path = os.path.join(sound_dir, 'sound.pcm')
-  raw_sound_len = os.path.getsize(sound_path)
+  with open(os.path.join(thumb_dir, 'thumb.segaframe'), 'rb') as thumb:
+    thumb_data = thumb.read()
+
+  with open(sound_path, 'rb') as sound_file:
+    write_output(args, frames, sound_file, os.path.getsize(sound_path),
+                 thumb_data, output_path, renditions, profiler)
+
+  print('Output complete.')
+
+
+def generate_live_output(args, tmp_dir, profiler):
+  # Encodes a live input as it plays, for --live.  Each chunk is published in
+  # the index as soon as it is written, so the output can be served while it
+  # grows.  One ffmpeg, paced to real time, writes frames to one pipe and
+  # audio to another.
+  print('Generating live output {}...'.format(args.output))
+
+  audio_read_fd, audio_write_fd = os.pipe()
+  ffmpeg_args = [
+    'ffmpeg',
+    # Make no noise, except on error.
+    '-hide_banner', '-loglevel', 'error', '-nostats',
+    # Read the input at its own rate, so that a file plays like a live feed.
+    '-re',
+    # Input.
+    *input_frames_args(args),
+    # Video filters.  A live input can't be scanned for a crop first.
+    '-vf', ','.join(video_filters(args, 'iw:ih:0:0')),
+    # Output raw frames to stdout.
+    '-an', '-f', 'rawvideo', '-pix_fmt', 'rgb24', 'pipe:1',
+    # Output audio to the other pipe, without normalization.
+    '-vn', *audio_output_args(args, 0), 'pipe:{}'.format(audio_write_fd),
+  ]
+  process = popen(args.debug, stdout=subprocess.PIPE,
+                  pass_fds=(audio_write_fd,), args=ffmpeg_args)
+  os.close(audio_write_fd)
+
+  palette_dir = os.path.join(tmp_dir, 'palettes')
+  os.mkdir(palette_dir)
+
+  try:
+    frames = FrameSource(live_frames_to_tiles(args, process.stdout,
+                                              palette_dir))
+    sound = LiveAudio(os.fdopen(audio_read_fd, 'rb'))
+    # There is no frame to choose a thumbnail from ahead of time.
+    thumb_data = bytes(PALETTE_BYTES +
+                       THUMBNAIL_TILES[0] * THUMBNAIL_TILES[1] * TILE_BYTES)
+    write_output(args, frames, sound, None, thumb_data, args.output, 0,
+                 profiler)
+  finally:
+    # The audio may run out before the frames do.
+    if process.poll() is None:
+      process.kill()
+    process.wait()
+
+  print('Output complete.')
+
+
+def write_output(args, frames, sound_file, raw_sound_len, thumb_data,
+                 output_path, renditions, profiler):
+  # Without raw_sound_len, this is a live video, written until the sound or
+  # the frames run out.
   state = ChunkWritingState()
+  state.live = raw_sound_len is None
 
-  # Pad sound up to a 256-byte multiple as required by the driver:
-  sound_remainder = raw_sound_len % 256
-  sound_padding = (256 - sound_remainder) if sound_remainder else 0
-  state.sound_len = raw_sound_len + sound_padding
+  if state.live:
+    state.sound_len = MAX_LIVE_SOUND_LEN
+  else:
+    # Pad sound up to a 256-byte multiple as required by the driver:
+    sound_remainder = raw_sound_len % 256
+    sound_padding = (256 - sound_remainder) if sound_remainder else 0
+    state.sound_len = raw_sound_len + sound_padding
   assert state.sound_len % 256 == 0
 
   # Compute chunk sizes
   state.samples_per_chunk = args.sample_rate * args.chunk_length
   state.frames_per_chunk = args.fps * args.chunk_length
 
-  # List all frames:
-  state.frame_paths = sorted(glob.glob(os.path.join(frame_dir, '*.bin')))
-  state.frame_count = len(state.frame_paths)
+  state.frames = frames
 
-  state.frame_path_index = 0
-
-  # Index of compressed chunk offsets.
-  index = [ EOF_OFFSET ] * SEGA_VIDEO_INDEX_MAX_ENTRIES
+  # Index of compressed chunk offsets.  A short one has room for as many
+  # chunks as there is sound for, plus the final entry for the total size.
+  index_entries = SEGA_VIDEO_INDEX_MAX_ENTRIES
+  if args.short_index:
+    max_chunks = -(-state.sound_len // state.samples_per_chunk)
+    blocks = max_chunks // SEGA_VIDEO_INDEX_BLOCK_ENTRIES + 1
+    index_entries = min(index_entries, blocks * SEGA_VIDEO_INDEX_BLOCK_ENTRIES)
+  index = [ EOF_OFFSET ] * index_entries
 
   # Create the output folder.
-  output_folder = os.path.dirname(args.output)
+  output_folder = os.path.dirname(output_path)
   if output_folder:
     os.makedirs(output_folder, exist_ok=True)
 
-  with open(sound_path, 'rb') as sound_file:
-    with open(args.output, 'wb') as f:
-      state.sound_file = sound_file
-      state.chunk_size = 0
-      state.num_chunks = 0
-
-      # Write SegaVideoHeader
-      f.write(FILE_MAGIC)
-      f.write(FILE_FORMAT.to_bytes(2, 'big'))
-      f.write(args.fps.to_bytes(2, 'big'))
-      f.write(args.sample_rate.to_bytes(2, 'big'))
-      f.write(state.frame_count.to_bytes(4, 'big'))
-      f.write(state.sound_len.to_bytes(4, 'big'))
-      chunk_size_offset = f.tell()
-      f.write(state.chunk_size.to_bytes(4, 'big'))
-      f.write(state.num_chunks.to_bytes(4, 'big'))
-
-      # Compute the title for the metadata, truncate/pad to 128 bytes including
-      # terminator.
-      title = os.path.splitext(os.path.basename(args.input))[0]
-      title = args.title or title
-      title = title.encode('utf-8')
-      title = (title + bytes(128))[0:127] + b'\0'
-      assert len(title) == 128
-      f.write(title)
-
-      f.write(bytes(128)) # relative URL, filled in for catalog later
-
-      compression = COMPRESSION_RLE if args.compressed else COMPRESSION_NONE
-      f.write(compression.to_bytes(2, 'big'))
-
-      f.write(bytes(696)) # Padding/unused
-
-      with open(os.path.join(thumb_dir, 'thumb.segaframe'), 'rb') as thumb:
-        f.write(thumb.read())
-      # End of SegaVideoHeader
-
+  with open(output_path, 'wb') as f:
+    state.sound_file = sound_file
+    state.chunk_size = 0
+    state.num_chunks = 0
+    state.delta_frames = args.delta_frames
+    state.adpcm_audio = args.adpcm_audio
+    state.dedup_tiles = args.dedup_tiles
+    state.rle_tiles = args.rle_tiles
+
+    # Write SegaVideoHeader
+    f.write(FILE_MAGIC)
+    if args.delta_frames:
+      file_format = FILE_FORMAT_DELTA
+    elif args.dedup_tiles:
+      file_format = FILE_FORMAT_TILEMAP
+    elif args.rle_tiles:
+      file_format = FILE_FORMAT_RLE
+    else:
+      file_format = FILE_FORMAT
+    f.write(file_format.to_bytes(2, 'big'))
+    f.write(args.fps.to_bytes(2, 'big'))
+    f.write(args.sample_rate.to_bytes(2, 'big'))
+    # We fill this in later, since piped frames aren't counted yet.
+    frame_count_offset = f.tell()
+    f.write((frames.total or 0).to_bytes(4, 'big'))
+    # The same for live sound.
+    sound_len_offset = f.tell()
+    f.write((0 if state.live else state.sound_len).to_bytes(4, 'big'))
+    chunk_size_offset = f.tell()
+    f.write(state.chunk_size.to_bytes(4, 'big'))
+    f.write(state.num_chunks.to_bytes(4, 'big'))
+
+    # Compute the title for the metadata, truncate/pad to 128 bytes including
+    # terminator.
+    title = os.path.splitext(os.path.basename(args.input))[0]
+    title = args.title or title
+    title = title.encode('utf-8')
+    title = (title + bytes(128))[0:127] + b'\0'
+    assert len(title) == 128
+    f.write(title)
+
+    f.write(bytes(128)) # relative URL, filled in for catalog later
+
+    compression = COMPRESSION_NONE
+    if args.compressed:
+      compression = COMPRESSION_CODECS[args.compressed]
+    if args.adpcm_audio:
+      compression |= COMPRESSION_ADPCM
+    if state.live:
+      compression |= COMPRESSION_LIVE
+    if args.short_index:
+      compression |= COMPRESSION_SHORT_INDEX
+    f.write(compression.to_bytes(2, 'big'))
+
+    # Number of lighter renditions, recomputed for the catalog later
+    f.write(renditions.to_bytes(2, 'big'))
+
+    f.write(bytes(694)) # Padding/unused
+
+    f.write(thumb_data)
+    # End of SegaVideoHeader
+
+    if args.compressed:
+      # Write SegaVideoIndex (empty for now, will rewrite later)
+      video_index_offset = f.tell()
+      for offset in index:
+        f.write(offset.to_bytes(4, 'big'))
+
+    while state.sound_len and frames.has_more():
+      start_of_chunk = f.tell()
+      frames_before = frames.taken
       if args.compressed:
-        # Write SegaVideoIndex (empty for now, will rewrite later)
-        video_index_offset = f.tell()
-        for offset in index:
-          f.write(offset.to_bytes(4, 'big'))
-
-      total_frames = state.frame_count
-      while state.sound_len and state.frame_count:
-        if args.compressed:
-          # Minus one here because we need the final entry for the total size.
-          if state.num_chunks >= SEGA_VIDEO_INDEX_MAX_ENTRIES - 1:
-            raise RuntimeError('Streaming index overflow!')
-          index[state.num_chunks] = f.tell()
+        # Minus one here because we need the final entry for the total size,
+        # and live video needs one more to mark the end.
+        max_chunks = len(index) - (2 if state.live else 1)
+        if state.num_chunks >= max_chunks:
+          raise RuntimeError('Streaming index overflow!')
+        index[state.num_chunks] = f.tell()
 
+        # With --pipe-frames, this is also where frames are quantized.
+        with profiler.stage('chunks') as stats:
           f2 = io.BytesIO()
           write_chunk(f2, state)
           f2.seek(0)
           uncompressed = f2.read()
+          stats['frames'] += frames.taken - frames_before
+          stats['bytes_out'] += len(uncompressed)
 
+        with profiler.stage('compression') as stats:
           compressed = compress(compression, uncompressed)
-          f.write(compressed)
-        else:
+          stats['bytes_in'] += len(uncompressed)
+          stats['bytes_out'] += len(compressed)
+        f.write(compressed)
+
+        if state.live:
+          # Publish the chunk by writing the entry after it, once the chunk
+          # itself is on disk for the server to find.
+          f.flush()
+          index[state.num_chunks] = f.tell()
+          patch_at_offset(f, video_index_offset + 4 * (state.num_chunks - 1),
+                          index[state.num_chunks - 1:state.num_chunks + 1], 4)
+          f.flush()
+      else:
+        with profiler.stage('chunks') as stats:
           write_chunk(f, state)
+          stats['frames'] += frames.taken - frames_before
+          stats['bytes_out'] += f.tell() - start_of_chunk
 
-        print('\rOutput {} / {} frames...'.format(
-            total_frames - state.frame_count, total_frames), end='')
+      profiler.chunk(output_path, state.last_chunk_size,
+                     f.tell() - start_of_chunk)
 
-      print('')
+      if frames.total is None:
+        print('\rOutput {} frames...'.format(frames.taken), end='')
+      else:
+        print('\rOutput {} / {} frames...'.format(
+            frames.taken, frames.total), end='')
 
-      # Seek back to the header to fill in these two fields.
-      patch_at_offset(f, chunk_size_offset, state.chunk_size, 4)
-      patch_at_offset(f, chunk_size_offset + 4, state.num_chunks, 4)
+    print('')
+    frames.close()
 
-      if args.compressed:
-        # Seek back to fill in the index.
-        index[state.num_chunks] = f.tell()
-        patch_at_offset(f, video_index_offset, index, 4)
+    # Seek back to the header to fill in these fields.
+    patch_at_offset(f, frame_count_offset, frames.total or frames.taken, 4)
+    patch_at_offset(f, chunk_size_offset, state.chunk_size, 4)
+    patch_at_offset(f, chunk_size_offset + 4, state.num_chunks, 4)
+    if state.live:
+      # Every live chunk has a full chunk of sound, padded at the end.
+      patch_at_offset(f, sound_len_offset,
+                      state.num_chunks * state.samples_per_chunk, 4)
 
-  print('Output complete.')
+    if args.compressed:
+      # Seek back to fill in the index.  This ends a live video, so it comes
+      # last.
+      index[state.num_chunks] = f.tell()
+      if state.live:
+        index[state.num_chunks + 1] = LIVE_END_OFFSET
+      patch_at_offset(f, video_index_offset, index, 4)
 
 
 def generate_resource_file(args):
@@ -819,6 +1904,25 @@ def generate_thumbnail(args, fullcolor_dir, thumb_dir):
   thumb_index = int(len(fullcolor_frames) * args.thumbnail_fraction)
   fullcolor_thumb_frame = fullcolor_frames[thumb_index]
 
+  make_thumbnail(args, ['-i', fullcolor_thumb_frame], [], thumb_dir)
+  print('Thumbnail generated from frame #{}.'.format(thumb_index + 1))
+
+
+def generate_thumbnail_from_input(args, crop, sound_dir, thumb_dir):
+  # The same as generate_thumbnail(), but for --pipe-frames.  There are no
+  # frames on disk to choose from, so we seek the input by time instead.  The
+  # audio tells us how long it is.
+  sound_path = os.path.join(sound_dir, 'sound.pcm')
+  duration = os.path.getsize(sound_path) / args.sample_rate
+  thumb_time = duration * args.thumbnail_fraction
+
+  input_args = ['-ss', str(args.start + thumb_time), '-i', args.input]
+  make_thumbnail(args, input_args, video_filters(args, crop), thumb_dir)
+  print('Thumbnail generated from frame #{}.'.format(
+      int(thumb_time * args.fps) + 1))
+
+
+def make_thumbnail(args, input_args, filters, thumb_dir):
   # Set up what quantize_scene expects for input and output.
   thumb_in_dir = os.path.join(thumb_dir, 'in')
   thumb_out_dir = os.path.join(thumb_dir, 'out')
@@ -836,10 +1940,11 @@ def generate_thumbnail(args, fullcolor_dir, thumb_dir):
     # Make no noise, except on error.
     '-hide_banner', '-loglevel', 'error', '-nostats',
     # Input.
-    '-i', fullcolor_thumb_frame,
+    *input_args,
     # Scale.
-    '-vf', 'scale=128:112',
-    # Output.
+    '-vf', ','.join(filters + ['scale=128:112']),
+    # Output one frame.
+    '-frames:v', '1',
     thumb_in,
   ]
   run(args.debug, check=True, args=ffmpeg_args)
@@ -850,8 +1955,6 @@ def generate_thumbnail(args, fullcolor_dir, thumb_dir):
   # Then convert to Sega format.
   ppm_to_sega_frame(thumb_out, sega_frame_out, THUMBNAIL_TILES)
 
-  print('Thumbnail generated from frame #{}.'.format(thumb_index + 1))
-
 
 if __name__ == '__main__':
   prog = os.path.basename(sys.argv[0])
@@ -880,8 +1983,12 @@ if __name__ == '__main__':
       action='store_true',
       help='Generate SGDK resource file for hard-coding a video into a ROM.')
   parser.add_argument('-z', '--compressed',
-      action='store_true',
-      help='Compress chunks.  Incompatible with embedded playback (-g).')
+      nargs='?',
+      const='rle',
+      choices=sorted(COMPRESSION_CODECS.keys()),
+      help='Compress chunks, with RLE by default, or with LZ for better'
+           ' compression of repeated tiles and near-static content.'
+           '  Incompatible with embedded playback (-g).')
   parser.add_argument('-t', '--title',
       help='Title to store in metadata.  Defaults to input filename.')
   parser.add_argument('-f', '--fps',
@@ -921,10 +2028,73 @@ if __name__ == '__main__':
            ' "none" for some content.'
            ' See https://ffmpeg.org/ffmpeg-filters.html#paletteuse for a full'
            ' list of options.')
+  parser.add_argument('--renditions',
+      type=lambda value: [int(x) for x in value.split(',') if x],
+      default=[],
+      help='Comma-separated color counts for lighter renditions, such as'
+           ' "7,3", for adaptive streaming.  Each is written next to the'
+           ' output with a suffix of ".1", ".2", etc.  Requires --compressed.')
+  parser.add_argument('--delta-frames',
+      action='store_true',
+      help='Store only the tiles that changed in each frame, with complete'
+           ' frames at the start of each chunk.  Much smaller for static'
+           ' content.  Requires --compressed or --generate-resource-file.')
+  parser.add_argument('--dedup-tiles',
+      action='store_true',
+      help='Store each distinct tile in a frame only once, flipped as needed,'
+           ' with a tilemap per frame.  Much smaller for flat backgrounds and'
+           ' letterboxing.  Requires --compressed or --generate-resource-file.'
+           ' Incompatible with --delta-frames.')
+  parser.add_argument('--rle-tiles',
+      action='store_true',
+      help='Compress each tile with RLE, for the player to decode.  Fits more'
+           ' video in a ROM, at the cost of CPU time on the Sega.  Requires'
+           ' --generate-resource-file.  Incompatible with --delta-frames and'
+           ' --dedup-tiles.')
+  parser.add_argument('--adpcm-audio',
+      action='store_true',
+      help='Store audio as 4-bit ADPCM, half the size of 8-bit PCM.'
+           ' The streaming hardware expands it back to PCM.'
+           ' Requires --compressed.')
   parser.add_argument('--no-filter-audio',
       dest='filter_audio',
       action='store_false',
       help='Skip audio filtering and normalization.')
+  parser.add_argument('-j', '--jobs',
+      type=int,
+      default=1,
+      help='Quantize scenes and pack tiles with this many workers at once.'
+           '  The output is identical for any number of jobs.')
+  parser.add_argument('--pipe-frames',
+      action='store_true',
+      help='Pipe frames from ffmpeg straight into quantization and tile'
+           ' packing, without a temporary file per frame.  Only the palette'
+           ' of each scene is written to disk, and memory use is bounded to'
+           ' about one scene per job.  Each rendition decodes the input'
+           ' again.')
+  parser.add_argument('--live',
+      action='store_true',
+      help='Encode a live input in real time, publishing each chunk as soon'
+           ' as it is written, so that the output can be streamed while it'
+           ' grows.  There is no crop, normalization, scene detection, or'
+           ' thumbnail.  Requires --compressed and --pipe-frames.')
+  parser.add_argument('--short-index',
+      action='store_true',
+      help='Size the chunk index to the video, instead of the fixed 144kB'
+           ' that can index 30 hours.  Short videos start sooner, but older'
+           ' firmware and emulators will reject them.  Requires --compressed.')
+  parser.add_argument('-w', '--work-dir',
+      help='Keep intermediate files in this folder, instead of a temporary'
+           ' one.  A later run with the same work dir skips any stage whose'
+           ' inputs and settings have not changed, so changing only the'
+           ' title, chunk length, or compression is quick.  Delete the'
+           ' folder to reclaim the space.')
+  parser.add_argument('--profile',
+      action='store_true',
+      help='Report wall time, CPU time, and bytes in and out for each stage,'
+           ' along with the size and compression ratio of each chunk.'
+           '  Printed as a table at the end, and written as JSON to the'
+           ' output path plus ".profile.json".')
   parser.add_argument('--debug',
       action='store_true',
       help='Print all ffmpeg commands.')
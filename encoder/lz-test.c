@@ -0,0 +1,128 @@
+// Kinetoscope: A Sega Genesis Video Player
+//
+// Copyright (c) 2024 Joey Parrish
+//
+// See MIT License in LICENSE.txt
+
+// Tests for the LZ decoder shared by the firmware and the emulator
+// (common/lz-common.h).
+//
+// Build and run with "make test" in this folder.
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+// Enough output to wrap around the decoder's window.
+#define MAX_DECODED_BYTES (1 << 17)
+
+// The decoder writes here instead of SRAM.
+static uint8_t decoded[MAX_DECODED_BYTES];
+static uint32_t decoded_bytes = 0;
+
+static void decoded_write(const uint8_t* buffer, uint32_t size) {
+  memcpy(decoded + decoded_bytes, buffer, size);
+  decoded_bytes += size;
+}
+
+static void decoded_fill(uint8_t data_byte, uint32_t count) {
+  memset(decoded + decoded_bytes, data_byte, count);
+  decoded_bytes += count;
+}
+
+#define SRAM_WRITE(buffer, size) decoded_write(buffer, size)
+#define SRAM_FILL(data_byte, count) decoded_fill(data_byte, count)
+#include "lz-common.h"
+
+// One tilemap frame: 32x28 tiles of 32 bytes, plus the 32-byte palette.
+#define FRAME_BYTES (32 * 28 * 32 + 32)
+
+static uint8_t expected[MAX_DECODED_BYTES];
+static uint32_t expected_bytes = 0;
+static uint8_t encoded[MAX_DECODED_BYTES];
+static uint32_t encoded_bytes = 0;
+
+static void encode_extension(uint32_t value) {
+  while (value >= 255) {
+    encoded[encoded_bytes++] = 255;
+    value -= 255;
+  }
+  encoded[encoded_bytes++] = value;
+}
+
+// Appends one command: literals from a simple generator, then a match.
+static void encode_command(uint32_t literals, uint32_t offset,
+                           uint32_t match_length) {
+  uint32_t literal_field = literals < 15 ? literals : 15;
+  uint32_t match_field = match_length - LZ_MIN_MATCH;
+  if (match_field > 15) match_field = 15;
+
+  encoded[encoded_bytes++] = (literal_field << 4) | match_field;
+  if (literal_field == 15) {
+    encode_extension(literals - 15);
+  }
+  for (uint32_t i = 0; i < literals; ++i) {
+    uint8_t value = (expected_bytes * 7 + (expected_bytes >> 8)) & 0xff;
+    encoded[encoded_bytes++] = value;
+    expected[expected_bytes++] = value;
+  }
+
+  encoded[encoded_bytes++] = offset >> 8;
+  encoded[encoded_bytes++] = offset & 0xff;
+  if (match_field == 15) {
+    encode_extension(match_length - 15 - LZ_MIN_MATCH);
+  }
+  for (uint32_t i = 0; i < match_length; ++i) {
+    expected[expected_bytes] = expected[expected_bytes - offset];
+    expected_bytes++;
+  }
+}
+
+// Decodes the encoded data in pieces of at most "split" bytes, and compares
+// it to the expected output.
+static bool check_decode(const char* name, uint32_t split) {
+  lz_reset();
+  decoded_bytes = 0;
+  for (uint32_t i = 0; i < encoded_bytes; i += split) {
+    uint32_t size = encoded_bytes - i < split ? encoded_bytes - i : split;
+    if (!lz_to_sram(encoded + i, size)) {
+      fprintf(stderr, "FAIL %s (split %u): decoder error\n", name, split);
+      return false;
+    }
+  }
+
+  if (decoded_bytes != expected_bytes ||
+      memcmp(decoded, expected, expected_bytes)) {
+    fprintf(stderr, "FAIL %s (split %u): wrong output\n", name, split);
+    return false;
+  }
+
+  printf("PASS %s (split %u)\n", name, split);
+  return true;
+}
+
+static void reset_test() {
+  expected_bytes = 0;
+  encoded_bytes = 0;
+}
+
+int main() {
+  int failures = 0;
+
+  // A long match one full frame back, after the window has wrapped.  The
+  // piece copied right after the wrap overlaps the bytes it reads from.
+  reset_test();
+  encode_command(LZ_WINDOW_SIZE + 1000, FRAME_BYTES, 2 * FRAME_BYTES);
+  failures += !check_decode("wrapped_full_frame_match", encoded_bytes);
+  failures += !check_decode("wrapped_full_frame_match", 1);
+
+  // Short matches that overlap the bytes they produce.
+  reset_test();
+  encode_command(10, 1, 100);
+  encode_command(3, 5, 1000);
+  failures += !check_decode("overlapping_matches", encoded_bytes);
+  failures += !check_decode("overlapping_matches", 1);
+
+  return failures ? 1 : 0;
+}
@@ -0,0 +1,103 @@
+# Kinetoscope: A Sega Genesis Video Player
+#
+# Copyright (c) 2024 Joey Parrish
+#
+# See MIT License in LICENSE.txt
+
+# The Kinetoscope LZ format is a byte-based sequence of commands, in the style
+# of LZ4.  See common/lz-common.h for the decoder and a full description.
+#
+# Each command is a token byte with a 4-bit literal count and a 4-bit match
+# length, literal bytes, a 2-byte big-endian match offset, and extension bytes
+# for counts and lengths that don't fit in 4 bits.
+
+
+# The shortest match worth encoding.  A match costs 3 bytes at minimum.
+MIN_MATCH = 4
+
+# Matches can reach this far back, which is the size of the decoder's window
+# minus one.  It's more than one full frame, so static tiles in one frame can
+# refer back to the same tiles in the frame before.
+MAX_OFFSET = (1 << 15) - 1
+
+# The 4-bit fields in the token max out here, and extension bytes follow.
+MAX_TOKEN_FIELD = 15
+
+# Like LZ4, skip ahead faster the longer we go without a match, which makes
+# incompressible data much faster to encode.
+SKIP_STRENGTH = 6
+
+
+def _encode_length(length):
+  # Extension bytes for a count that is MAX_TOKEN_FIELD or more.
+  output = bytearray()
+  length -= MAX_TOKEN_FIELD
+  while length >= 255:
+    output.append(255)
+    length -= 255
+  output.append(length)
+  return output
+
+
+def _encode_command(output, literals, match_length, offset):
+  literal_field = min(len(literals), MAX_TOKEN_FIELD)
+  match_field = 0
+  if offset:
+    match_field = min(match_length - MIN_MATCH, MAX_TOKEN_FIELD)
+
+  output.append((literal_field << 4) | match_field)
+  if literal_field == MAX_TOKEN_FIELD:
+    output += _encode_length(len(literals))
+  output += literals
+
+  if offset:
+    output += offset.to_bytes(2, 'big')
+    if match_field == MAX_TOKEN_FIELD:
+      output += _encode_length(match_length - MIN_MATCH)
+
+
+def lz_compress(block):
+  output = bytearray()
+  # The most recent position of each 4-byte sequence.
+  last_seen = {}
+
+  literal_start = 0
+  offset = 0
+  misses = 0
+  end = len(block) - MIN_MATCH + 1
+
+  while offset < end:
+    key = block[offset:offset + MIN_MATCH]
+    candidate = last_seen.get(key)
+    last_seen[key] = offset
+
+    if candidate is None or offset - candidate > MAX_OFFSET:
+      misses += 1
+      offset += 1 + (misses >> SKIP_STRENGTH)
+      continue
+
+    # Extend the match as far as it goes.  It may overlap the bytes it
+    # produces.
+    length = MIN_MATCH
+    while (offset + length < len(block) and
+           block[candidate + length] == block[offset + length]):
+      length += 1
+
+    _encode_command(output, block[literal_start:offset], length,
+                    offset - candidate)
+
+    # Remember a few positions inside the match, so that the next match can
+    # refer back to it.
+    match_end = offset + length
+    for position in range(offset + 1, min(match_end, end), 8):
+      last_seen[block[position:position + MIN_MATCH]] = position
+
+    offset = match_end
+    literal_start = offset
+    misses = 0
+
+  # The final command is literals only.
+  if literal_start < len(block):
+    _encode_command(output, block[literal_start:], 0, 0)
+
+  return bytes(output)
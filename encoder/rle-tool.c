@@ -0,0 +1,327 @@
+// Kinetoscope: A Sega Genesis Video Player
+//
+// Copyright (c) 2024 Joey Parrish
+//
+// See MIT License in LICENSE.txt
+
+// A native RLE tool for the encoder.
+//
+//   rle-tool compress < input > output
+//     Compresses one block, exactly as rle_compress() in rle_encoder.py does,
+//     but in linear time.  rle_encoder.py uses this automatically once built.
+//
+//   rle-tool verify video.segavideo
+//     Decodes every chunk of an RLE-compressed video with the same decoder as
+//     the firmware (common/rle-common.h), and checks that each one decodes to
+//     exactly the chunk described by its own headers.
+//
+// Build with "make" in this folder.
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "segavideo_format.h"
+
+// Keep these in sync with rle_encoder.py.
+#define MIN_REPEAT_FOR_COMPRESSION 8
+#define MAX_SIZE_FIELD 127
+#define TYPE_LITERAL 0x00
+#define TYPE_REPEAT 0x80
+
+// Decoded chunks must fit in one region of SRAM.
+#define MAX_DECODED_CHUNK_BYTES (1 << 20)
+
+// The decoder writes here instead of SRAM.
+static uint8_t decoded[MAX_DECODED_CHUNK_BYTES];
+static uint32_t decoded_bytes = 0;
+static bool decoded_overflow = false;
+
+static void decoded_write(const uint8_t* buffer, int size) {
+  if (decoded_bytes + size > sizeof(decoded)) {
+    decoded_overflow = true;
+    return;
+  }
+  memcpy(decoded + decoded_bytes, buffer, size);
+  decoded_bytes += size;
+}
+
+static void decoded_fill(uint8_t data_byte, int count) {
+  if (decoded_bytes + count > sizeof(decoded)) {
+    decoded_overflow = true;
+    return;
+  }
+  memset(decoded + decoded_bytes, data_byte, count);
+  decoded_bytes += count;
+}
+
+#define SRAM_WRITE(buffer, size) decoded_write(buffer, size)
+#define SRAM_FILL(data_byte, count) decoded_fill(data_byte, count)
+#include "rle-common.h"
+
+static uint8_t* read_all(FILE* f, size_t* size) {
+  size_t capacity = 1 << 20;
+  uint8_t* data = malloc(capacity);
+  *size = 0;
+
+  while (data) {
+    *size += fread(data + *size, 1, capacity - *size, f);
+    if (*size < capacity) {
+      break;
+    }
+    capacity *= 2;
+    data = realloc(data, capacity);
+  }
+
+  if (!data || ferror(f)) {
+    free(data);
+    return NULL;
+  }
+  return data;
+}
+
+static void flush_literals(const uint8_t* literals, size_t size,
+                           uint8_t* output, size_t* output_size) {
+  while (size) {
+    size_t block_size = size < MAX_SIZE_FIELD ? size : MAX_SIZE_FIELD;
+    output[(*output_size)++] = TYPE_LITERAL | block_size;
+    memcpy(output + *output_size, literals, block_size);
+    *output_size += block_size;
+    literals += block_size;
+    size -= block_size;
+  }
+}
+
+// Worst case, the output is one control byte per 127 literals larger.
+static size_t rle_compress(const uint8_t* block, size_t size,
+                           uint8_t* output) {
+  size_t output_size = 0;
+  size_t literal_start = 0;
+  size_t i = 0;
+
+  while (i < size) {
+    size_t end = i + 1;
+    while (end < size && block[end] == block[i]) {
+      end++;
+    }
+
+    size_t count = end - i;
+    if (count >= MIN_REPEAT_FOR_COMPRESSION) {
+      flush_literals(block + literal_start, i - literal_start,
+                     output, &output_size);
+
+      while (count) {
+        size_t repeat_count =
+            count < MAX_SIZE_FIELD ? count : MAX_SIZE_FIELD;
+        output[output_size++] = TYPE_REPEAT | repeat_count;
+        output[output_size++] = block[i];
+        count -= repeat_count;
+      }
+
+      literal_start = end;
+    }
+
+    i = end;
+  }
+
+  flush_literals(block + literal_start, size - literal_start,
+                 output, &output_size);
+  return output_size;
+}
+
+static int compress_main() {
+  size_t size;
+  uint8_t* block = read_all(stdin, &size);
+  if (!block) {
+    fprintf(stderr, "Failed to read input!\n");
+    return 1;
+  }
+
+  uint8_t* output = malloc(size + size / MAX_SIZE_FIELD + 1);
+  if (!output) {
+    fprintf(stderr, "Out of memory!\n");
+    return 1;
+  }
+
+  size_t output_size = rle_compress(block, size, output);
+  if (fwrite(output, 1, output_size, stdout) != output_size) {
+    fprintf(stderr, "Failed to write output!\n");
+    return 1;
+  }
+
+  free(block);
+  free(output);
+  return 0;
+}
+
+static uint16_t read_u16(const uint8_t* data) {
+  return ((uint16_t)data[0] << 8) | data[1];
+}
+
+static uint32_t read_u32(const uint8_t* data) {
+  return ((uint32_t)read_u16(data) << 16) | read_u16(data + 2);
+}
+
+// Returns the size of the frame at |data|, or 0 if it runs past |end|.
+static uint32_t frame_size(uint16_t format, const uint8_t* data,
+                           const uint8_t* end) {
+  uint32_t size;
+
+  if (format == SEGAVIDEO_HEADER_FORMAT_DELTA) {
+    if (end - data < (long)sizeof(SegaVideoDeltaFrame)) return 0;
+    const uint8_t* counts = data + offsetof(SegaVideoDeltaFrame, numRuns);
+    size = sizeof(SegaVideoDeltaFrame) +
+           read_u16(counts) * sizeof(SegaVideoTileRun) +
+           read_u16(counts + 2) * 32;
+  } else if (format == SEGAVIDEO_HEADER_FORMAT_TILEMAP) {
+    if (end - data < (long)sizeof(SegaVideoTilemapFrame)) return 0;
+    const uint8_t* count = data + offsetof(SegaVideoTilemapFrame, numTiles);
+    size = sizeof(SegaVideoTilemapFrame) + read_u16(count) * 32;
+  } else {
+    size = sizeof(SegaVideoFrame);
+  }
+
+  return (end - data < (long)size) ? 0 : size;
+}
+
+// Checks the decoded chunk against its own headers.  Returns an error message
+// or NULL.
+static const char* check_decoded_chunk(uint16_t format, bool adpcm) {
+  if (decoded_overflow) {
+    return "decoded chunk is larger than a region of SRAM";
+  }
+  if (_rle_pending_repeats || _rle_pending_literals) {
+    return "chunk ends in the middle of an RLE command";
+  }
+  if (decoded_bytes < sizeof(SegaVideoChunkHeader)) {
+    return "decoded chunk is too short for a chunk header";
+  }
+
+  const uint8_t* data = decoded;
+  const uint8_t* end = decoded + decoded_bytes;
+  uint32_t samples = read_u32(data);
+  uint16_t frames = read_u16(data + 4);
+  uint16_t pre_padding = read_u16(data + 8);
+  uint16_t post_padding = read_u16(data + 10);
+  data += sizeof(SegaVideoChunkHeader);
+
+  // ADPCM is expanded later, after the codec.
+  uint32_t audio_bytes = adpcm ? samples / 2 : samples;
+  if (end - data < (long)(pre_padding + audio_bytes)) {
+    return "decoded chunk is too short for its audio";
+  }
+  data += pre_padding + audio_bytes;
+
+  for (uint16_t i = 0; i < frames; ++i) {
+    uint32_t size = frame_size(format, data, end);
+    if (!size) {
+      return "decoded chunk is too short for its frames";
+    }
+    data += size;
+  }
+
+  if (end - data != post_padding) {
+    return "decoded chunk size does not match its headers";
+  }
+
+  return NULL;
+}
+
+static int verify_main(const char* path) {
+  FILE* f = fopen(path, "rb");
+  if (!f) {
+    perror(path);
+    return 1;
+  }
+
+  size_t size;
+  uint8_t* video = read_all(f, &size);
+  fclose(f);
+  if (!video) {
+    fprintf(stderr, "Failed to read %s!\n", path);
+    return 1;
+  }
+
+  if (size < sizeof(SegaVideoHeader) ||
+      memcmp(video, SEGAVIDEO_HEADER_MAGIC, 16)) {
+    fprintf(stderr, "%s is not a compressed video!\n", path);
+    return 1;
+  }
+
+  const uint8_t* header = video;
+  uint16_t format = read_u16(header + offsetof(SegaVideoHeader, format));
+  uint32_t total_chunks =
+      read_u32(header + offsetof(SegaVideoHeader, totalChunks));
+  uint16_t compression =
+      read_u16(header + offsetof(SegaVideoHeader, compression));
+
+  if ((compression & SEGAVIDEO_COMPRESSION_CODECS) !=
+      SEGAVIDEO_COMPRESSION_RLE) {
+    fprintf(stderr, "%s is not RLE-compressed!\n", path);
+    return 1;
+  }
+  bool adpcm = compression & SEGAVIDEO_COMPRESSION_ADPCM;
+
+  const uint8_t* index = video + sizeof(SegaVideoHeader);
+  uint32_t index_entries = segavideo_indexEntries(compression, total_chunks);
+  if (size < sizeof(SegaVideoHeader) + index_entries * sizeof(uint32_t)) {
+    fprintf(stderr, "%s is truncated!\n", path);
+    return 1;
+  }
+  if (total_chunks > index_entries - 1) {
+    fprintf(stderr, "%s has too many chunks!\n", path);
+    return 1;
+  }
+
+  int errors = 0;
+  for (uint32_t chunk = 0; chunk < total_chunks; ++chunk) {
+    // The entry after the final chunk holds the total size.
+    uint32_t start = read_u32(index + chunk * 4);
+    uint32_t end = read_u32(index + (chunk + 1) * 4);
+    if (start > end || end > size) {
+      fprintf(stderr, "Chunk %u: bad index entry\n", chunk);
+      errors++;
+      continue;
+    }
+
+    rle_reset();
+    decoded_bytes = 0;
+    decoded_overflow = false;
+    if (end > start) {
+      rle_to_sram(video + start, end - start);
+    }
+
+    const char* error = check_decoded_chunk(format, adpcm);
+    if (error) {
+      fprintf(stderr, "Chunk %u: %s\n", chunk, error);
+      errors++;
+    }
+  }
+
+  free(video);
+
+  if (errors) {
+    fprintf(stderr, "%d / %u chunks failed.\n", errors, total_chunks);
+    return 1;
+  }
+
+  printf("All %u chunks verified.\n", total_chunks);
+  return 0;
+}
+
+int main(int argc, char** argv) {
+  if (argc == 2 && !strcmp(argv[1], "compress")) {
+    return compress_main();
+  }
+  if (argc == 3 && !strcmp(argv[1], "verify")) {
+    return verify_main(argv[2]);
+  }
+
+  fprintf(stderr, "Usage:\n");
+  fprintf(stderr, "  %s compress < input > output\n", argv[0]);
+  fprintf(stderr, "  %s verify video.segavideo\n", argv[0]);
+  return 1;
+}
@@ -17,6 +17,7 @@
 
 
 import os
+import subprocess
 
 
 # How many repeated bytes we need to make compression worth it.  Anything more
@@ -34,6 +35,10 @@ MAX_SIZE_FIELD = 127
 TYPE_LITERAL = 0x00
 TYPE_REPEAT = 0x80
 
+# The native version of rle_compress(), if built.  See rle-tool.c.
+NATIVE_TOOL = os.path.join(os.path.dirname(os.path.abspath(__file__)),
+                           'rle-tool')
+
 
 def _count_repeats(block, offset):
   original_offset = offset
@@ -44,57 +49,73 @@ def _count_repeats(block, offset):
 
 
 def rle_compress(block):
+  if os.path.exists(NATIVE_TOOL):
+    # The same output, much faster.
+    process = subprocess.run([NATIVE_TOOL, 'compress'], check=True,
+                             input=bytes(block), stdout=subprocess.PIPE)
+    return process.stdout
+
+  return _rle_compress_python(block)
+
+
+def rle_compress_each(blocks):
+  # Compress each block on its own, so that each can be decoded on its own.
+  # These are small, like tiles, so the native tool would spend more time
+  # starting than compressing.  Repeated blocks are only compressed once.
+  compressed = {}
+  output = []
+  for block in blocks:
+    if block not in compressed:
+      compressed[block] = _rle_compress_python(block)
+    output.append(compressed[block])
+  return output
+
+
+def _rle_compress_python(block):
   # The compressed output.
-  output = b''
+  output = bytearray()
 
-  # A buffer of literals to be flushed later.
-  literals = b''
+  # Buffered literals to be flushed later, as block[literal_start:i].
+  literal_start = 0
 
-  def flush_buffered_literals():
-    # Take these from the outer scope
-    nonlocal literals, output
+  def flush_buffered_literals(literal_end):
+    # Take this from the outer scope
+    nonlocal output
 
-    offset = 0
-    while offset < len(literals):
+    offset = literal_start
+    while offset < literal_end:
       # Don't output more at once than fits in this size field
-      literal_block_size = min(len(literals) - offset, MAX_SIZE_FIELD)
-      literal_block = literals[offset:offset+literal_block_size]
-      offset += literal_block_size
+      literal_block_size = min(literal_end - offset, MAX_SIZE_FIELD)
 
       control_byte = TYPE_LITERAL | literal_block_size
-      output += control_byte.to_bytes(1, 'big')
-      output += literal_block
-
-    literals = b''
-
-  def compress_repeats(data, count):
-    # Take these from the outer scope
-    nonlocal output
+      output.append(control_byte)
+      output += block[offset:offset+literal_block_size]
+      offset += literal_block_size
 
+  def compress_repeats(data_byte, count):
     while count:
       # Don't output more at once than fits in this size field
       repeat_count = min(count, MAX_SIZE_FIELD)
       count -= repeat_count
 
       control_byte = TYPE_REPEAT | repeat_count
-      output += control_byte.to_bytes(1, 'big')
-      output += data
+      output.append(control_byte)
+      output.append(data_byte)
 
   i = 0
   while i < len(block):
     count = _count_repeats(block, i)
-    these_bytes = block[i:i+count]
-    i += count
 
-    if count < MIN_REPEAT_FOR_COMPRESSION:
-      # Buffer literals for later
-      literals += these_bytes
-    else:
+    if count >= MIN_REPEAT_FOR_COMPRESSION:
       # Flush buffered literals first
-      flush_buffered_literals()
+      flush_buffered_literals(i)
       # Compress repeated sequence
-      compress_repeats(these_bytes[0:1], count)
+      compress_repeats(block[i], count)
+      literal_start = i + count
+
+    # Otherwise, these stay buffered as literals for later.
+    i += count
 
   # Flush any remaining buffered literals
-  flush_buffered_literals()
-  return output
+  flush_buffered_literals(len(block))
+  return bytes(output)
@@ -0,0 +1 @@
+../common/adpcm-common.h
\ No newline at end of file
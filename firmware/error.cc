@@ -12,6 +12,7 @@
 #include <cstdio>
 
 #include "error.h"
+#include "log-ring.h"
 #include "registers.h"
 #include "sram.h"
 
@@ -26,8 +27,7 @@ void report_error(const char* format, ...) {
   vsnprintf(error_buffer, MAX_ERROR, format, args);
   va_end(args);
  
-  Serial.print("Error reported: ");
-  Serial.println(error_buffer);
+  log_printf("Error reported: %s", error_buffer);
 
   // Set a flag the Sega should notice and query later.
   flag_error();
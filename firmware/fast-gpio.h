@@ -85,6 +85,48 @@
 #define FAST_GET(PIN) (sio_hw->gpio_in & (1 << (PIN)))
 #define FAST_READ_MULTIPLE(MASK, SHIFT) ((sio_hw->gpio_in & (MASK)) >> SHIFT)
 
+#elif defined(KINETOSCOPE_HOST)  // Host build for profiling, see host/
+
+// Same pins as the RP2040, driving the mock cartridge logic in mock-gpio.cc.
+#define SRAM_PIN__WRITE_BANK_0  12
+#define SRAM_PIN__WRITE_BANK_1  13
+
+#define SRAM_PIN__ADDR_RESET    15
+#define SRAM_PIN__ADDR_CLOCK    20
+
+#define SRAM_PIN__DATA_NEXT_BIT 21
+#define SRAM_PIN__DATA_CLOCK    22
+#define SRAM_PIN__DATA_WRITE    14
+
+#define SYNC_PIN__CMD_READY     10
+#define SYNC_PIN__CMD_CLEAR     11
+#define SYNC_PIN__ERR_FLAGGED   27
+#define SYNC_PIN__ERR_SET       26
+
+#define REG_PIN__OE0             8
+#define REG_PIN__OE1             9
+
+#define REG_PIN__D0              0
+#define REG_PIN__D1              1
+#define REG_PIN__D2              2
+#define REG_PIN__D3              3
+#define REG_PIN__D4              4
+#define REG_PIN__D5              5
+#define REG_PIN__D6              6
+#define REG_PIN__D7              7
+
+#define REG_PIN__D_MASK    0x000000ff
+#define REG_PIN__D_SHIFT            0
+
+// The mock has no rise times to wait for.
+#define FAST_GPIO_DELAY() {}
+#define SRAM_GPIO_DELAY() {}
+
+#define FAST_CLEAR(PIN) mock_gpio_clear(PIN)
+#define FAST_SET(PIN) mock_gpio_set(PIN)
+#define FAST_GET(PIN) mock_gpio_get(PIN)
+#define FAST_READ_MULTIPLE(MASK, SHIFT) mock_gpio_read_multiple(MASK, SHIFT)
+
 #else
 
 #define SRAM_PIN__WRITE_BANK_0   0
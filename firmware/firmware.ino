@@ -9,13 +9,18 @@
 // can stream video from the Internet to the cartridge's shared banks of SRAM.
 
 #include <Arduino.h>
+#include <hardware/sync.h>
 
 #include "arduino_secrets.h"
 #include "error.h"
+#include "flash-cache.h"
 #include "http.h"
 #include "internet.h"
+#include "log-ring.h"
 #include "registers.h"
+#include "ring-buffer.h"
 #include "segavideo_format.h"
+#include "segavideo_stats.h"
 #include "speed-tests.h"
 #include "sram.h"
 #include "string-util.h"
@@ -38,10 +43,58 @@
 
 #define NETWORK_TIMEOUT_SECONDS 30
 
-// Macro required by rle-common.h:
-#define SRAM_WRITE(buffer, size) sram_write(buffer, size)
+// With CONNECT_AT_BOOT, the second core brings up the network as soon as the
+// hardware is ready, and opens a connection to the video server, all while the
+// Sega is still booting.  KINETOSCOPE_CMD_CONNECT_NET then only waits for that
+// to finish, and the first fetch reuses the connection.
+#if !defined(CONNECT_AT_BOOT)
+# define CONNECT_AT_BOOT 1
+#endif
+
+// If that fails, and CONNECT_NET comes within this long, the Sega gets the
+// error from boot right away.  After that, a cable may have been plugged in
+// since, so CONNECT_NET tries again.
+#define BOOT_NETWORK_ERROR_MAX_AGE_MS (10 * 1000)
+
+// Bytes written to SRAM for the current chunk, for stats.
+static uint32_t chunk_bytes_decoded = 0;
+
+// True if the audio in each chunk is ADPCM, to expand after RLE.
+static bool adpcm_audio = false;
+
+// Macros required by adpcm-common.h:
+#define ADPCM_WRITE(buffer, size) \
+    (chunk_bytes_decoded += (size), sram_write(buffer, size))
+#define ADPCM_FILL(data, size) \
+    (chunk_bytes_decoded += (size), sram_fill(data, size))
+#include "adpcm-common.h"
+
+// Where the RLE and LZ decoders send their output.
+static void decoded_write(const uint8_t* buffer, int size) {
+  if (adpcm_audio) {
+    adpcm_write(buffer, size);
+  } else {
+    ADPCM_WRITE(buffer, size);
+  }
+}
+
+static void decoded_fill(uint8_t data, int size) {
+  if (adpcm_audio) {
+    adpcm_fill(data, size);
+  } else {
+    ADPCM_FILL(data, size);
+  }
+}
+
+// Macros required by rle-common.h and lz-common.h:
+#define SRAM_WRITE(buffer, size) decoded_write(buffer, size)
+#define SRAM_FILL(data, size) decoded_fill(data, size)
+#include "lz-common.h"
 #include "rle-common.h"
 
+// True if chunks use the LZ codec instead of RLE.
+static bool lz_chunks = false;
+
 // Allocate a second 8kB stack for the second core.
 // https://github.com/earlephilhower/arduino-pico/blob/master/docs/multicore.rst
 bool core1_separate_stack = true;
@@ -50,38 +103,171 @@ bool core1_separate_stack = true;
 // Don't put two of these devices on the same network, y'all.
 static const uint8_t MAC_ADDR[] = { 0x98, 0x76, 0xB6, 0x12, 0xD4, 0x9E };
 
+#if !defined(KINETOSCOPE_HOST)
+// Handy for debugging on the device, though nothing calls it.  Left out of
+// the host build, which warns about unused functions.
 static void freeze() {
   while (true) { delay(1000 /* ms */); }
 }
+#endif
 
 // The second core waits on this variable before beginning its loop.
 static bool hardware_ready = false;
 
-// The second core uses these to receive commands from the first core.
+// The second core uses these to receive commands from the first core.  The
+// data it fetches comes back through the ring buffer in ring-buffer.h.
 static volatile bool second_core_idle = true;
 static volatile bool second_core_interrupt = false;
 static volatile bool fetch_okay = false;
 static int fetch_start_byte = 0;
 static int fetch_size = 0;
+// If fetch_next_size > 0, the request for this range of the same path will be
+// pipelined behind the current one.
+static int fetch_next_start_byte = 0;
+static int fetch_next_size = 0;
 static char fetch_path[MAX_PATH];
+// If not NULL, the fetch is conditional on the resource having changed.
+static const HttpValidators* fetch_validators = NULL;
 static http_data_callback fetch_callback = NULL;
 static uint8_t* fetch_buffer = NULL;
 static int fetch_buffer_size = 0;
-static SegaVideoIndex video_index;
+
+// Only the fields of the header before the padding are needed to start a
+// video, so that's all we cache from the catalog.
+#define CACHED_HEADER_SIZE offsetof(SegaVideoHeader, padding)
+// Enough for the menu on the Sega.
+#define MAX_CATALOG_ENTRIES 127
+static uint8_t catalog_cache[MAX_CATALOG_ENTRIES][CACHED_HEADER_SIZE];
+static bool catalog_cached[MAX_CATALOG_ENTRIES];
+// The catalog header being fetched, and how much of it has gone by so far.
+static uint8_t catalog_header[sizeof(SegaVideoHeader)];
+static int catalog_bytes_seen = 0;
+static SegaVideoHeader start_header;
+
+// The catalog index and each catalog header fetched are also kept in flash,
+// with the validators of the catalog index.  They are only used once the
+// server says the catalog index hasn't changed, which makes a catalog in flash
+// current until the next KINETOSCOPE_CMD_LIST_VIDEOS.
+#define FLASH_CATALOG_INDEX "/catalog.idx"
+#define FLASH_CATALOG_VALIDATORS "/catalog.validators"
+#define FLASH_CATALOG_HEADER "/catalog-%d.hdr"
+static bool catalog_in_flash = false;
+static HttpValidators catalog_validators;
+
+// A copy of the catalog index sent to the Sega, to find headers in the
+// catalog.
+#define MAX_CATALOG_INDEX_SIZE (sizeof(SegaVideoCatalogIndex) + \
+    MAX_CATALOG_ENTRIES * sizeof(SegaVideoCatalogEntry))
+static uint8_t catalog_index[MAX_CATALOG_INDEX_SIZE];
+static int catalog_index_bytes = 0;
+
+// Rather than fetch all of SegaVideoIndex up front, we fetch a window of this
+// many entries at a time as playback moves forward.  At 3s per chunk, this
+// covers over 3 minutes of video.
+#define INDEX_WINDOW_ENTRIES 64
+#define INDEX_MAX_ENTRIES SEGAVIDEO_INDEX_MAX_ENTRIES
+// How many entries the current video's index has.  Windows stop there.
+static int index_entries = 0;
+static uint32_t index_window[INDEX_WINDOW_ENTRIES];
+static int index_window_start = 0;
+static int index_window_entries = 0;
+
+// A live video grows as it plays.  A bank fill that gets ahead of the encoder
+// waits, and service_live() polls the index until the chunk is published.
+#define LIVE_POLL_INTERVAL_MS 200
+// Longer than any chunk, but shorter than the Sega waits for a command.
+#define LIVE_TIMEOUT_MS (20 * 1000)
+// Until a live video ends, the Sega is told it has this many chunks.
+#define LIVE_TOTAL_CHUNKS 0x7fffffff
+static bool live_waiting = false;
+static uint32_t live_wait_start_ms = 0;
+static uint32_t live_poll_ms = 0;
+
+typedef enum {
+  LIVE_READY,  // published, and can be fetched
+  LIVE_PENDING,  // not published yet
+  LIVE_ENDED,  // the stream ended before this chunk
+  LIVE_FAILED,  // couldn't fetch the index
+} LiveChunkState;
+
+// Owned by the first core.  True from the start of a fetch until the first core
+// has consumed all of its data from the ring buffer.
+static bool fetch_pending = false;
+
+// As soon as one bank is full, we start fetching the first chunk of the other,
+// while the Sega still plays it.  Until FLIP_REGION frees that bank, the data
+// waits in the ring buffer, and the second core stops once the ring is full.
+// A network stall in the meantime is absorbed, and what was buffered goes
+// straight to SRAM once the bank is free.
+static bool read_ahead_held = false;
 
 // Also read by speed tests
 bool network_connected = false;
+Client* network_client = NULL;
+// Set by the second core once it is done with the network at boot, whether or
+// not it connected.
+static volatile bool boot_network_done = !CONNECT_AT_BOOT;
+// Why it didn't connect, until that is reported, and when it gave up.
+static const char* boot_network_error = NULL;
+static uint32_t boot_network_error_ms = 0;
 
 static int chunk_size = 0;
 static int total_chunks = 0;
 static bool is_compressed = false;
+static bool is_live = false;
+// The chunk the Sega counts as its first, which follows the header in bank 0.
+// For live video, this is where we joined the stream.
+static int first_chunk_num = 0;
 static int next_chunk_num = 0;
 static int next_offset = 0;
 static int next_size = 0;
+// The chunk the Sega is playing, as tracked by FLIP_REGION.
+static int playing_chunk_num = 0;
+
+// Each SRAM bank holds a run of chunks_per_bank chunks in consecutive slots,
+// counting from origin_chunk_num, the chunk we started or seeked to.  The Sega
+// numbers the slots of both banks 0 to 2 * chunks_per_bank - 1, and sends the
+// slot it moves on to with FLIP_REGION.  See segavideo_chunksPerRegion().
+// A bank is released to the Sega as a whole, so we fill all of its slots in one
+// go.
+#define MAX_SLOTS (2 * SEGAVIDEO_MAX_CHUNKS_PER_REGION)
+static int chunks_per_bank = 1;
+static int origin_chunk_num = 0;
+// The chunk held by each slot, or -1 while it is empty or filling.
+static int slot_chunk[MAX_SLOTS];
+// The slot being filled now, and how many more chunks go into the same bank.
+static int filling_slot = -1;
+static int bank_chunks_left = 0;
+
+// Adaptive streaming.  Rendition 0 is the video in the catalog, and lighter
+// renditions with identical chunk timing live at its path plus ".1", ".2",
+// etc.  Because the Sega sees the decompressed chunks, which are the same size
+// in every rendition, we can switch between them at any chunk boundary.
+#define MAX_RENDITIONS 9
+static char video_path[MAX_PATH];
+static int num_renditions = 0;
+static int rendition = 0;
+// How long each chunk plays, so how long we have to fetch the next one.
+static int chunk_budget_ms = 0;
+// Measured from chunk fetches.  Kept between videos, since the network is the
+// same.  Zero until the first chunk is measured.
+static int throughput_bytes_per_second = 0;
+// The chunk fetch being measured, if any.
+static bool measuring_chunk = false;
+static uint32_t chunk_fetch_start_ms = 0;
+static bool chunk_read_ahead = false;
+
+// Stats for KINETOSCOPE_CMD_GET_STATS, in native byte order until written.
+static SegaVideoStats stream_stats;
+static uint32_t reconnects_at_start = 0;
+static uint32_t chunk_sram_us = 0;
+static uint32_t chunk_done_ms = 0;
+static bool margin_recorded = false;
 
 static void init_all_hardware() {
   registers_init();
   sram_init();
+  flash_cache_init();
 
   // Use LED as a primitive visual status.
   pinMode(LED_BUILTIN, OUTPUT);
@@ -90,31 +276,43 @@ static void init_all_hardware() {
   Serial.println("All hardware initialized.");
 }
 
-static void connect_network() {
-  // Prefer wired, fall back to WiFi if configured.
+// Returns NULL on success, or an error message for the Sega.  The caller
+// reports it, so that the Sega isn't flagged with an error it hasn't asked
+// about.
+static const char* connect_network() {
+  // Prefer wired, fall back to WiFi if configured.  WiFi associates while we
+  // wait on wired DHCP, so the fallback doesn't take another full timeout.
   Serial.println("Connecting to the network...");
-  Client* client = internet_init_wired(MAC_ADDR, NETWORK_TIMEOUT_SECONDS);
 
-  if (!client) {
-    Serial.println("Wired connection failed!");
-
-    bool has_wifi = false;
+  bool has_wifi = false;
 #if defined(ARDUINO_ARCH_RP2040)
-    has_wifi = rp2040.isPicoW();
+  has_wifi = rp2040.isPicoW();
 #endif
+  bool use_wifi = has_wifi && strlen(SECRET_WIFI_SSID);
+  if (use_wifi) {
+    internet_start_wifi(SECRET_WIFI_SSID, SECRET_WIFI_PASS);
+  }
+
+  Client* client = internet_init_wired(MAC_ADDR, NETWORK_TIMEOUT_SECONDS);
+  const char* error = NULL;
+
+  if (client) {
+    internet_stop_wifi();
+  } else {
+    Serial.println("Wired connection failed!");
 
     if (!has_wifi) {
       Serial.println("WiFi hardware not available!");
-      report_error("Wired connection failed and WiFi hardware not available!");
-    } else if (!strlen(SECRET_WIFI_SSID)) {
+      error = "Wired connection failed and WiFi hardware not available!";
+    } else if (!use_wifi) {
       Serial.println("WiFi not configured!");
-      report_error("Wired connection failed and WiFi not configured!");
+      error = "Wired connection failed and WiFi not configured!";
     } else {
       client = internet_init_wifi(SECRET_WIFI_SSID, SECRET_WIFI_PASS,
                                   NETWORK_TIMEOUT_SECONDS);
       if (!client) {
         Serial.println("WiFi connection failed!");
-        report_error("WiFi connection failed!");
+        error = "WiFi connection failed!";
       }
     }
   }
@@ -123,7 +321,9 @@ static void connect_network() {
     Serial.println("Failed to connect to the network!");
   }
   http_init(client);
+  network_client = client;
   network_connected = client != NULL;
+  return error;
 }
 
 // Also called by speed tests
@@ -134,6 +334,7 @@ bool http_sram_callback(const uint8_t* buffer, int bytes) {
   }
 
   sram_write(buffer, bytes);
+  chunk_bytes_decoded += bytes;
   return true;
 }
 
@@ -149,8 +350,59 @@ bool http_rle_sram_callback(const uint8_t* buffer, int bytes) {
 }
 
 // Also called by speed tests
+bool http_lz_sram_callback(const uint8_t* buffer, int bytes) {
+  // Check for interrupt.
+  if (second_core_interrupt) {
+    return false;
+  }
+
+  if (!lz_to_sram(buffer, bytes)) {
+    // Stop the fetch, which fails the chunk.
+    report_error("Corrupt LZ data!");
+    second_core_interrupt = true;
+    return false;
+  }
+  return true;
+}
+
+// Resets all decoders, not just RLE.
 void http_rle_reset() {
   rle_reset();
+  lz_reset();
+  adpcm_reset();
+}
+
+// Keep a catalog header as it goes by.
+static void cache_catalog_data(const uint8_t* buffer, int bytes) {
+  int consumed = min(bytes, (int)sizeof(catalog_header) - catalog_bytes_seen);
+  if (consumed > 0) {
+    memcpy(catalog_header + catalog_bytes_seen, buffer, consumed);
+  }
+  catalog_bytes_seen += bytes;
+}
+
+static bool http_catalog_callback(const uint8_t* buffer, int bytes) {
+  // Check for interrupt.
+  if (second_core_interrupt) {
+    return false;
+  }
+
+  cache_catalog_data(buffer, bytes);
+  sram_write(buffer, bytes);
+  return true;
+}
+
+static bool http_catalog_index_callback(const uint8_t* buffer, int bytes) {
+  // Check for interrupt.
+  if (second_core_interrupt) {
+    return false;
+  }
+
+  int to_copy = min(bytes, (int)MAX_CATALOG_INDEX_SIZE - catalog_index_bytes);
+  memcpy(catalog_index + catalog_index_bytes, buffer, to_copy);
+  catalog_index_bytes += to_copy;
+  sram_write(buffer, bytes);
+  return true;
 }
 
 static bool http_buffer_callback(const uint8_t* buffer, int bytes) {
@@ -167,8 +419,10 @@ static bool http_buffer_callback(const uint8_t* buffer, int bytes) {
 }
 
 // Expects fetch_callback and any necessary globals for it to be set in advance.
-static bool fetch_generic(const char* path, int start_byte, int size) {
-  if (!second_core_idle) {
+static bool fetch_generic(const char* path, int start_byte, int size,
+                          int next_start_byte = 0, int next_size = 0,
+                          const HttpValidators* validators = NULL) {
+  if (fetch_pending) {
     report_error("Command conflict! Busy!");
     return false;
   }
@@ -178,8 +432,14 @@ static bool fetch_generic(const char* path, int start_byte, int size) {
   }
   fetch_start_byte = start_byte;
   fetch_size = size;
+  fetch_next_start_byte = next_start_byte;
+  fetch_next_size = next_size;
+  fetch_validators = validators;
 
+  fetch_pending = true;
   second_core_idle = false;
+  // Wake the second core.
+  __sev();
   return true;
 }
 
@@ -193,22 +453,947 @@ static bool fetch_into_buffer(void* buffer, const char* path,
 
 static bool fetch_into_sram(const char* path, int start_byte = 0,
                             int size = MAX_FETCH_SIZE,
-                            bool decompress = false) {
-  fetch_callback = decompress ? http_rle_sram_callback : http_sram_callback;
-  return fetch_generic(path, start_byte, size);
+                            bool decompress = false,
+                            int next_start_byte = 0, int next_size = 0) {
+  if (!decompress) {
+    fetch_callback = http_sram_callback;
+  } else if (lz_chunks) {
+    fetch_callback = http_lz_sram_callback;
+  } else {
+    fetch_callback = http_rle_sram_callback;
+  }
+  if (decompress && !fetch_pending) {
+    // Each chunk decompresses on its own, even after an interrupted fetch.
+    http_rle_reset();
+  }
+  return fetch_generic(path, start_byte, size, next_start_byte, next_size);
+}
+
+static void add_chunk_stats(SegaVideoChunkStats* total,
+                            const SegaVideoChunkStats* chunk) {
+  total->chunks += chunk->chunks;
+  total->bytesFetched += chunk->bytesFetched;
+  total->bytesDecoded += chunk->bytesDecoded;
+  total->headerMs += chunk->headerMs;
+  total->bodyMs += chunk->bodyMs;
+  total->ringWaitMs += chunk->ringWaitMs;
+  total->sramMs += chunk->sramMs;
+  total->shortReads += chunk->shortReads;
+}
+
+// Called on the first core when a chunk fetch completes.  The second core is
+// idle, so its stats are stable.
+static void record_chunk_stats() {
+  const HttpStats* http_stats = http_get_stats();
+  SegaVideoChunkStats* chunk = &stream_stats.lastChunk;
+
+  chunk_done_ms = millis();
+  chunk->chunks = 1;
+  chunk->bytesFetched = http_stats->body_bytes;
+  chunk->bytesDecoded = chunk_bytes_decoded;
+  chunk->headerMs = http_stats->header_ms;
+  chunk->bodyMs = http_stats->body_ms;
+  chunk->ringWaitMs = http_stats->ring_wait_ms;
+  chunk->sramMs = chunk_sram_us / 1000;
+  chunk->shortReads = http_stats->short_reads;
+  add_chunk_stats(&stream_stats.total, chunk);
+
+  stream_stats.reconnects = http_stats->reconnects - reconnects_at_start;
+}
+
+// Called on FLIP_REGION, when the Sega starts on the chunk we fetched last.
+static void record_margin(bool underflow) {
+  int32_t margin = underflow ?
+      -(int32_t)(millis() - chunk_fetch_start_ms) :
+      (int32_t)(millis() - chunk_done_ms);
+  if (underflow) {
+    stream_stats.underflows++;
+  }
+  stream_stats.lastMarginMs = margin;
+  if (!margin_recorded || margin < stream_stats.minMarginMs) {
+    stream_stats.minMarginMs = margin;
+  }
+  margin_recorded = true;
+}
+
+static void write_words_to_sram(const uint32_t* words, int count) {
+  for (int i = 0; i < count; ++i) {
+    uint32_t value = htonl(words[i]);
+    sram_write((const uint8_t*)&value, sizeof(value));
+  }
+}
+
+static void write_chunk_stats_to_sram(const SegaVideoChunkStats* chunk) {
+  const uint32_t fields[] = {
+    chunk->chunks,
+    chunk->bytesFetched,
+    chunk->bytesDecoded,
+    chunk->headerMs,
+    chunk->bodyMs,
+    chunk->ringWaitMs,
+    chunk->sramMs,
+    chunk->shortReads,
+  };
+  write_words_to_sram(fields, sizeof(fields) / sizeof(fields[0]));
+}
+
+// Write the stats to SRAM, big-endian like everything else the Sega reads.
+static void write_stats_to_sram() {
+  stream_stats.throughput = throughput_bytes_per_second;
+  stream_stats.rendition = rendition;
+  stream_stats.readAheadHighWater = ring_high_water();
+
+  sram_start_bank(0);
+  write_chunk_stats_to_sram(&stream_stats.lastChunk);
+  write_chunk_stats_to_sram(&stream_stats.total);
+  const uint32_t fields[] = {
+    stream_stats.reconnects,
+    stream_stats.underflows,
+    (uint32_t)stream_stats.lastMarginMs,
+    (uint32_t)stream_stats.minMarginMs,
+    stream_stats.throughput,
+  };
+  write_words_to_sram(fields, sizeof(fields) / sizeof(fields[0]));
+  uint16_t value = htons(stream_stats.rendition);
+  sram_write((const uint8_t*)&value, sizeof(value));
+  const uint32_t read_ahead = stream_stats.readAheadHighWater;
+  write_words_to_sram(&read_ahead, 1);
+  sram_flush_and_release_bank();
+}
+
+static bool continue_bank_fill();
+static void start_read_ahead();
+
+// Runs on the first core.  Consumes fetched data from the ring buffer while the
+// second core continues to read from the network, so that network and SRAM
+// time overlap.  Completes the fetch once both cores are done with it.  Returns
+// false if there was nothing to do yet.
+//
+// This consumes at most one slot per call, so that loop() can take a command
+// from the Sega between slots instead of waiting for the whole ring.
+static bool service_fetch() {
+  if (!fetch_pending || read_ahead_held) {
+    return false;
+  }
+
+  // Check this before reading.  Everything the second core committed before
+  // going idle is then visible below, so an empty ring means we're done.
+  bool producer_done = __atomic_load_n(&second_core_idle, __ATOMIC_ACQUIRE);
+
+  int bytes;
+  const uint8_t* data = ring_read_slot(&bytes);
+  if (data) {
+    // The callbacks return false on interrupt, in which case the second core
+    // is stopping, too.
+    uint32_t start_us = micros();
+    bool ok = fetch_callback(data, bytes);
+    chunk_sram_us += micros() - start_us;
+    if (ok) {
+      ring_release();
+    } else {
+      ring_discard();
+    }
+
+    if (ring_read_slot(&bytes)) {
+      return true;
+    }
+  }
+
+  if (!producer_done) {
+    return data != NULL;
+  }
+
+  // The fetch is done.
+  fetch_pending = false;
+  bool chunk_fetch = filling_slot >= 0;
+
+  if (measuring_chunk && fetch_okay) {
+    record_chunk_stats();
+
+    uint32_t elapsed_ms = chunk_done_ms - chunk_fetch_start_ms;
+    if (chunk_read_ahead) {
+      // Most of this fetch may have waited on its bank, so only count the
+      // second core's time on the network.
+      const HttpStats* http_stats = http_get_stats();
+      elapsed_ms = http_stats->header_ms + http_stats->body_ms -
+                   http_stats->ring_wait_ms;
+    }
+    elapsed_ms = max(elapsed_ms, (uint32_t)1);
+
+    // Smooth out the measurements so one slow chunk doesn't cause a switch.
+    // Count what the server sent, since the final chunk may be short.
+    int sample =
+        (int64_t)http_get_stats()->body_bytes * 1000 / elapsed_ms;
+    if (throughput_bytes_per_second) {
+      throughput_bytes_per_second =
+          (throughput_bytes_per_second * 3 + sample) / 4;
+    } else {
+      throughput_bytes_per_second = sample;
+    }
+  }
+  measuring_chunk = false;
+
+  // The rest of a bank fill.  We keep the bank until its last slot is full.
+  if (!continue_bank_fill()) {
+    sram_flush_and_release_bank();
+    if (chunk_fetch && fetch_okay) {
+      start_read_ahead();
+    }
+  }
+
+  return true;
 }
 
+// A read-ahead fetch doesn't count, since it can't finish until FLIP_REGION.
 static bool await_fetch() {
-  while (!second_core_idle) { delay(1 /* ms */); }
+  while (fetch_pending && !read_ahead_held) {
+    // The second core sends an event when it commits to the ring or goes idle.
+    if (!service_fetch()) {
+      __wfe();
+    }
+  }
   return fetch_okay;
 }
 
+// Where a video's header is in the catalog, according to the catalog index.
+// Returns -1 if the index doesn't have it.
+static int catalog_header_offset(int video_num) {
+  const SegaVideoCatalogIndex* index =
+      (const SegaVideoCatalogIndex*)catalog_index;
+  int entries_size = catalog_index_bytes - (int)sizeof(SegaVideoCatalogIndex);
+  if (video_num < 0 ||
+      video_num >= (int)ntohs(index->numEntries) ||
+      video_num >= entries_size / (int)sizeof(SegaVideoCatalogEntry)) {
+    report_error("Invalid video index requested! (%d)", video_num);
+    return -1;
+  }
+
+  const SegaVideoCatalogEntry* entries =
+      (const SegaVideoCatalogEntry*)(index + 1);
+  return ntohl(entries[video_num].headerOffset);
+}
+
+static void flash_header_name(char* name, int video_num) {
+  snprintf(name, MAX_PATH, FLASH_CATALOG_HEADER, video_num);
+}
+
+// Reads a video's whole catalog header from flash into catalog_header, if the
+// catalog in flash is current.  Also caches its leading fields in RAM.
+// Returns false if it isn't there.
+static bool load_flash_header(int video_num) {
+  if (!catalog_in_flash) {
+    return false;
+  }
+
+  char name[MAX_PATH];
+  flash_header_name(name, video_num);
+  if (flash_cache_read(name, catalog_header, sizeof(catalog_header)) !=
+      (int)sizeof(catalog_header)) {
+    return false;
+  }
+
+  memcpy(catalog_cache[video_num], catalog_header, CACHED_HEADER_SIZE);
+  catalog_cached[video_num] = true;
+  return true;
+}
+
+// Get the leading fields of a video's header into start_header, from the
+// catalog cache if possible.  Returns false on failure.
+static bool load_start_header(int video_num) {
+  int offset = catalog_header_offset(video_num);
+  if (offset < 0) {
+    return false;
+  }
+
+  if (catalog_cached[video_num]) {
+    memcpy(&start_header, catalog_cache[video_num], CACHED_HEADER_SIZE);
+    return true;
+  }
+
+  if (load_flash_header(video_num)) {
+    memcpy(&start_header, catalog_header, CACHED_HEADER_SIZE);
+    return true;
+  }
+
+  // Not cached, so fetch it from the catalog.
+  if (!fetch_into_buffer(&start_header, VIDEO_CATALOG_PATH, offset,
+                         CACHED_HEADER_SIZE) ||
+      !await_fetch()) {
+    return false;
+  }
+
+  memcpy(catalog_cache[video_num], &start_header, CACHED_HEADER_SIZE);
+  catalog_cached[video_num] = true;
+  return true;
+}
+
+// Write a video's whole catalog header to bank 1, for the Sega to draw its
+// thumbnail.  Bank 0 still has the catalog index.  The leading fields are
+// cached on the way, to start the video later.
+static void get_thumbnail(int video_num) {
+  int offset = catalog_header_offset(video_num);
+  if (offset < 0) {
+    return;
+  }
+
+  if (load_flash_header(video_num)) {
+    sram_start_bank(1);
+    sram_write(catalog_header, sizeof(catalog_header));
+    sram_flush_and_release_bank();
+    return;
+  }
+
+  catalog_bytes_seen = 0;
+  sram_start_bank(1);
+  fetch_callback = http_catalog_callback;
+  if (!fetch_generic(VIDEO_CATALOG_PATH, offset, sizeof(SegaVideoHeader)) ||
+      !await_fetch() ||
+      catalog_bytes_seen != (int)sizeof(catalog_header)) {
+    return;
+  }
+
+  memcpy(catalog_cache[video_num], catalog_header, CACHED_HEADER_SIZE);
+  catalog_cached[video_num] = true;
+
+  // Next time, this comes from flash.
+  if (catalog_in_flash) {
+    char name[MAX_PATH];
+    flash_header_name(name, video_num);
+    flash_cache_write(name, catalog_header, sizeof(catalog_header));
+  }
+}
+
+// Pull the catalog index into SRAM.  Thumbnails and the rest of each header
+// come from the catalog later, one at a time.  If the catalog index in flash is
+// still current, it comes from there, and so do the headers.
+static void list_videos() {
+  log_printf("Fetching video list...");
+  memset(catalog_cached, 0, sizeof(catalog_cached));
+  catalog_index_bytes = 0;
+  catalog_in_flash = false;
+
+  int flash_bytes = flash_cache_read(FLASH_CATALOG_INDEX, catalog_index,
+                                     MAX_CATALOG_INDEX_SIZE);
+  bool conditional = flash_bytes > 0 &&
+      flash_cache_read(FLASH_CATALOG_VALIDATORS, &catalog_validators,
+                       sizeof(catalog_validators)) ==
+      (int)sizeof(catalog_validators);
+
+  sram_start_bank(0);
+  // Also keeps a copy of the index, to find headers in the catalog.
+  fetch_callback = http_catalog_index_callback;
+  if (!fetch_generic(VIDEO_CATALOG_INDEX_PATH, 0, MAX_CATALOG_INDEX_SIZE,
+                     0, 0, conditional ? &catalog_validators : NULL) ||
+      !await_fetch()) {
+    catalog_index_bytes = 0;
+    return;
+  }
+
+  if (http_not_modified()) {
+    // Nothing came from the network, so the flash copy goes to SRAM instead.
+    log_printf("Catalog unchanged.");
+    catalog_index_bytes = flash_bytes;
+    sram_start_bank(0);
+    sram_write(catalog_index, catalog_index_bytes);
+    sram_flush_and_release_bank();
+    catalog_in_flash = true;
+    log_printf("Done.");
+    return;
+  }
+
+  // A new catalog.  The old headers may not match it, so drop them all.
+  for (int i = 0; i < MAX_CATALOG_ENTRIES; ++i) {
+    char name[MAX_PATH];
+    flash_header_name(name, i);
+    flash_cache_remove(name);
+  }
+
+  // Without validators, we could never tell if the catalog changed.
+  memcpy(&catalog_validators, http_get_validators(),
+         sizeof(catalog_validators));
+  if (catalog_validators.etag[0] || catalog_validators.last_modified[0]) {
+    catalog_in_flash =
+        flash_cache_write(FLASH_CATALOG_INDEX, catalog_index,
+                          catalog_index_bytes) &&
+        flash_cache_write(FLASH_CATALOG_VALIDATORS, &catalog_validators,
+                          sizeof(catalog_validators));
+  }
+  log_printf("Done.");
+}
+
+// Fetches index entries starting at first_entry.  Returns false on failure.
+static bool fetch_index_window(int first_entry) {
+  int entries = min(INDEX_WINDOW_ENTRIES, index_entries - first_entry);
+  if (!fetch_into_buffer(index_window, fetch_path,
+                         sizeof(SegaVideoHeader) +
+                         first_entry * sizeof(uint32_t),
+                         entries * sizeof(uint32_t)) ||
+      !await_fetch()) {
+    index_window_entries = 0;
+    return false;
+  }
+
+  for (int i = 0; i < entries; ++i) {
+    index_window[i] = ntohl(index_window[i]);
+  }
+  index_window_start = first_entry;
+  index_window_entries = entries;
+  return true;
+}
+
+// Checks whether a chunk of a live video is published yet: whether the index
+// entry after it is written.  Fetches the index again from chunk_num, unless
+// the window already says so.
+static LiveChunkState live_chunk_state(int chunk_num) {
+  int entry = chunk_num + 1 - index_window_start;
+  if (entry < 1 || entry >= index_window_entries ||
+      index_window[entry] == SEGA_CHUNK_OFFSET_EOF) {
+    if (!fetch_index_window(chunk_num)) {
+      return LIVE_FAILED;
+    }
+    entry = 1;
+  }
+
+  if (index_window[entry] == SEGA_CHUNK_OFFSET_LIVE_END) {
+    return LIVE_ENDED;
+  }
+  if (index_window[entry] == SEGA_CHUNK_OFFSET_EOF) {
+    return LIVE_PENDING;
+  }
+  return LIVE_READY;
+}
+
+// Joins a live video at the newest chunk published, which puts playback
+// about two chunks behind the encoder.  If the stream is already over, plays
+// the recording from the start instead, like any other video.  Sets
+// first_chunk_num, and total_chunks if the stream is over.  Returns false on
+// failure.
+static bool find_live_edge() {
+  // Chunks are published in order, so binary search for the newest one.
+  int low = 0;
+  int high = INDEX_MAX_ENTRIES - 2;
+  while (low < high) {
+    int mid = low + (high - low + 1) / 2;
+    LiveChunkState state = live_chunk_state(mid);
+    if (state == LIVE_FAILED) {
+      return false;
+    }
+    if (state == LIVE_READY) {
+      low = mid;
+    } else {
+      high = mid - 1;
+    }
+  }
+
+  LiveChunkState following = live_chunk_state(low + 1);
+  if (following == LIVE_FAILED) {
+    return false;
+  }
+  if (following == LIVE_ENDED) {
+    log_printf("Live video already ended.");
+    is_live = false;
+    total_chunks = low + 1;
+    first_chunk_num = 0;
+  } else {
+    log_printf("Joining live video at chunk %d", low);
+    first_chunk_num = low;
+  }
+  return true;
+}
+
+// Computes next_size for next_chunk_num, fetching more of the index if needed.
+// Returns false on failure.
+static bool compute_next_size() {
+  if (!is_compressed) {
+    next_size = chunk_size;
+    return true;
+  }
+
+  // Chunk N runs from index entry N to N+1.
+  int window_end = index_window_start + index_window_entries;
+  if (next_chunk_num < index_window_start ||
+      next_chunk_num + 1 >= window_end) {
+    if (!fetch_index_window(next_chunk_num)) {
+      return false;
+    }
+  }
+
+  int entry = next_chunk_num - index_window_start;
+  next_size = index_window[entry + 1] - index_window[entry];
+  return true;
+}
+
+// Returns the size of the chunk after next_chunk_num, if we know it without
+// going to the network, or 0 if not.
+static int peek_following_size() {
+  int following = next_chunk_num + 1;
+  if (following >= total_chunks) {
+    return 0;
+  }
+
+  if (!is_compressed) {
+    return chunk_size;
+  }
+
+  int entry = following - index_window_start;
+  if (entry < 0 || entry + 1 >= index_window_entries ||
+      index_window[entry + 1] >= SEGA_CHUNK_OFFSET_LIVE_END) {
+    // Not in the window, or not published yet.
+    return 0;
+  }
+  return index_window[entry + 1] - index_window[entry];
+}
+
+// Starts fetching chunk next_chunk_num into SRAM, and pipelines the request for
+// the chunk after it, if possible.  Expects next_offset and next_size to be
+// set, and the SRAM bank to be started.
+static bool fetch_next_chunk() {
+  if (!fetch_into_sram(fetch_path, next_offset, next_size, is_compressed,
+                       next_offset + next_size, peek_following_size())) {
+    return false;
+  }
+
+  // Measure this for choose_rendition() and stats.
+  measuring_chunk = true;
+  chunk_fetch_start_ms = millis();
+  chunk_bytes_decoded = 0;
+  chunk_sram_us = 0;
+  chunk_read_ahead = read_ahead_held;
+  return true;
+}
+
+// Switch the video path to the given rendition.  Each has its own index, so
+// this drops the index window.
+static void set_rendition(int new_rendition) {
+  rendition = new_rendition;
+  copy_string(fetch_path, video_path, MAX_PATH);
+  if (rendition) {
+    char suffix[3] = { '.', (char)('0' + rendition), '\0' };
+    concatenate_string(fetch_path, suffix, MAX_PATH);
+  }
+  index_window_start = 0;
+  index_window_entries = 0;
+}
+
+// Computes next_offset for next_chunk_num.  Expects compute_next_size() to have
+// succeeded first, so that the index window covers next_chunk_num.
+static void compute_next_offset() {
+  if (is_compressed) {
+    next_offset = index_window[next_chunk_num - index_window_start];
+  } else {
+    next_offset = sizeof(SegaVideoHeader) + sizeof(SegaVideoIndex) +
+                  next_chunk_num * chunk_size;
+  }
+}
+
+// Computes next_size and next_offset for next_chunk_num, but first picks the
+// rendition to fetch it from.  Steps down to a lighter rendition if
+// the chunk would take most of its playback time to fetch at the measured
+// throughput, and back up when there is plenty of room.  Returns false on
+// failure.
+static bool choose_rendition() {
+  if (!compute_next_size()) {
+    return false;
+  }
+
+  if (!num_renditions || !throughput_bytes_per_second) {
+    compute_next_offset();
+    return true;
+  }
+
+  int predicted_ms =
+      (int64_t)next_size * 1000 / throughput_bytes_per_second;
+  int new_rendition = rendition;
+  if (predicted_ms > chunk_budget_ms * 3 / 4) {
+    new_rendition = min(rendition + 1, num_renditions);
+  } else if (predicted_ms < chunk_budget_ms / 4) {
+    // A heavier rendition may be up to twice the size, so only step up when
+    // that would still fit comfortably.
+    new_rendition = max(rendition - 1, 0);
+  }
+
+  if (new_rendition != rendition) {
+    log_printf("Switching to rendition %d", new_rendition);
+    set_rendition(new_rendition);
+    if (!compute_next_size()) {
+      return false;
+    }
+  }
+
+  // Offsets differ between renditions, so always recompute this.
+  compute_next_offset();
+  return true;
+}
+
+static int chunk_slot(int chunk_num) {
+  return (chunk_num - origin_chunk_num) % (2 * chunks_per_bank);
+}
+
+// Starts fetching next_chunk_num into the next slot of the bank being filled.
+static bool fetch_into_slot() {
+  if (!fetch_next_chunk()) {
+    return false;
+  }
+  filling_slot = chunk_slot(next_chunk_num);
+  next_chunk_num++;
+  next_offset += next_size;
+  return true;
+}
+
+// The start of bank 0, before first_chunk_num.
+static void write_start_header() {
+  // Only the cached fields of the header matter to the Sega.  The thumbnail
+  // is only for the menu, so zero that out along with the padding.
+  sram_write((const uint8_t*)&start_header, CACHED_HEADER_SIZE);
+  sram_fill(0, sizeof(SegaVideoHeader) - CACHED_HEADER_SIZE);
+  // NOTE: Always omit the video index in SRAM!
+}
+
+// A live video ended just before next_chunk_num.  The Sega was never told the
+// length, so an empty chunk in the bank it moves on to next ends playback.
+static void end_live_video(int bank) {
+  log_printf("Live video ended after %d chunks.", next_chunk_num);
+  total_chunks = next_chunk_num;
+
+  sram_start_bank(bank);
+  if (next_chunk_num == first_chunk_num) {
+    write_start_header();
+  }
+  sram_fill(0, sizeof(SegaVideoChunkHeader));
+  sram_flush_and_release_bank();
+}
+
+// Starts filling the bank that next_chunk_num goes into, with up to
+// chunks_per_bank chunks.  The rest of them are fetched by
+// continue_bank_fill() as each one completes.  Returns false on failure.
+// For live video, this may instead set live_waiting, and service_live() will
+// call this again later.  With read_ahead, the Sega still plays the bank, and
+// release_read_ahead() starts it later.
+static bool start_bank_fill(bool read_ahead = false) {
+  int slot = chunk_slot(next_chunk_num);
+  int bank = slot / chunks_per_bank;
+
+  if (is_live) {
+    LiveChunkState state = live_chunk_state(next_chunk_num);
+    if (state == LIVE_PENDING) {
+      if (!live_waiting) {
+        live_wait_start_ms = millis();
+      }
+      live_waiting = true;
+      live_poll_ms = millis();
+      return true;
+    }
+
+    live_waiting = false;
+    if (state == LIVE_FAILED) {
+      return false;
+    }
+    if (state == LIVE_ENDED) {
+      end_live_video(bank);
+      return true;
+    }
+  }
+
+  int count = min(chunks_per_bank, total_chunks - next_chunk_num);
+
+  // For compressed video, this may fetch a window of the index.  That must
+  // come before we start writing to SRAM, so the window has to cover the
+  // whole bank.  The rendition is chosen once per bank.
+  if (!choose_rendition()) {
+    return false;
+  }
+  if (is_compressed &&
+      next_chunk_num + count >= index_window_start + index_window_entries) {
+    if (!fetch_index_window(next_chunk_num)) {
+      return false;
+    }
+    compute_next_offset();
+  }
+
+  for (int i = 0; i < chunks_per_bank; ++i) {
+    slot_chunk[bank * chunks_per_bank + i] = -1;
+  }
+
+  if (read_ahead) {
+    read_ahead_held = true;
+  } else {
+    sram_start_bank(bank);
+    if (next_chunk_num == first_chunk_num) {
+      write_start_header();
+    }
+  }
+
+  bank_chunks_left = count - 1;
+  if (!fetch_into_slot()) {
+    read_ahead_held = false;
+    sram_flush_and_release_bank();
+    return false;
+  }
+  return true;
+}
+
+// True if the bank the Sega just entered at |slot| holds every chunk it will
+// play there, and isn't still being filled.  The Sega only waits for the fill
+// it knows about, so it can enter a bank early.  A held read-ahead fetch is for
+// the other bank.
+static bool bank_ready(int slot) {
+  if (!read_ahead_held && (fetch_pending || bank_chunks_left)) {
+    return false;
+  }
+
+  int count = min(chunks_per_bank, total_chunks - playing_chunk_num);
+  for (int i = 0; i < count; ++i) {
+    if (slot_chunk[slot + i] != playing_chunk_num + i) {
+      return false;
+    }
+  }
+  return true;
+}
+
+// Called when a bank fill is done, to start on the next one early.  Only if
+// the Sega hasn't played the other bank yet, since fill_banks() fills it
+// otherwise.  A live bank fill may have to poll for its chunk, so it waits for
+// its bank.
+static void start_read_ahead() {
+  if (is_live || next_chunk_num >= total_chunks) {
+    return;
+  }
+
+  int bank = chunk_slot(next_chunk_num) / chunks_per_bank;
+  if (slot_chunk[bank * chunks_per_bank] < playing_chunk_num) {
+    return;
+  }
+
+  start_bank_fill(/* read_ahead= */ true);
+}
+
+// FLIP_REGION freed the bank of the read-ahead fetch.  Whatever the ring
+// buffered by now goes to SRAM in service_fetch().
+static void release_read_ahead() {
+  read_ahead_held = false;
+  sram_start_bank(filling_slot / chunks_per_bank);
+  // Margins count from here, where the fetch would start without read-ahead.
+  chunk_fetch_start_ms = millis();
+}
+
+// Called from service_fetch() when a chunk fetch is done.  Marks its slot full
+// and starts on the next slot of the same bank, if any.  Returns false when
+// the bank is done and should be released to the Sega.
+static bool continue_bank_fill() {
+  if (filling_slot < 0) {
+    // Not a chunk fetch.
+    return false;
+  }
+  if (!fetch_okay) {
+    filling_slot = -1;
+    return false;
+  }
+
+  slot_chunk[filling_slot] = next_chunk_num - 1;
+  filling_slot = -1;
+  if (!bank_chunks_left) {
+    return false;
+  }
+  bank_chunks_left--;
+
+  // start_bank_fill() made sure this is in the index window already, in the
+  // same rendition, so no fetch is needed.
+  return compute_next_size() && fetch_into_slot();
+}
+
+// Polls for the chunk a live bank fill is waiting on, and starts the fill once
+// it is published.  Returns false if the stream stalled or the fill failed.
+static bool service_live() {
+  if (!live_waiting || fetch_pending ||
+      millis() - live_poll_ms < LIVE_POLL_INTERVAL_MS) {
+    return true;
+  }
+
+  if (millis() - live_wait_start_ms > LIVE_TIMEOUT_MS) {
+    live_waiting = false;
+    report_error("Live video stalled!");
+    return false;
+  }
+
+  return start_bank_fill();
+}
+
+// Like await_fetch(), but for a bank fill, which may first have to wait for a
+// live video to catch up.
+static bool await_fill() {
+  while (live_waiting) {
+    if (!service_live()) {
+      return false;
+    }
+  }
+  return await_fetch();
+}
+
+// Fill both SRAM banks, starting from next_chunk_num in the first slot of bank
+// 0.  Chunk 0 goes after the header.  Normally, this fills both banks before
+// returning.  In fast mode, this returns as soon as the first bank is full,
+// and the other continues to fill in the background.
+static void fill_banks(bool fast) {
+  filling_slot = -1;
+  for (int i = 0; i < MAX_SLOTS; ++i) {
+    slot_chunk[i] = -1;
+  }
+
+  if (!start_bank_fill() || !await_fill()) {
+    return;
+  }
+
+  if (next_chunk_num >= total_chunks) {
+    return;
+  }
+
+  if (!start_bank_fill()) {
+    return;
+  }
+
+  if (!fast) {
+    await_fill();
+  }
+}
+
+// Start streaming a video.  In fast mode, this returns as soon as bank 0 is
+// full, and bank 1 continues to fill in the background.  The Sega can then send
+// KINETOSCOPE_CMD_AWAIT_FILL to find out when bank 1 is ready.
+static void start_video(uint8_t arg, bool fast) {
+  log_printf("Starting video %d%s", arg, fast ? " (fast)" : "");
+
+  // Get the appropriate header, usually from the catalog cache.
+  if (!load_start_header(arg)) {
+    return;
+  }
+
+  // Construct the URL of the video.
+  copy_string(video_path, VIDEO_SERVER_BASE_PATH, MAX_PATH);
+  concatenate_string(video_path, start_header.relative_url, MAX_PATH);
+
+  // Start streaming.
+  chunk_size = ntohl(start_header.chunkSize);
+  total_chunks = ntohl(start_header.totalChunks);
+  uint16_t compression = ntohs(start_header.compression);
+  is_compressed = compression != 0;
+  is_live = (compression & SEGAVIDEO_COMPRESSION_LIVE) != 0;
+  adpcm_audio = (compression & SEGAVIDEO_COMPRESSION_ADPCM) != 0;
+  lz_chunks = (compression & SEGAVIDEO_COMPRESSION_LZ) != 0;
+  uint16_t codec = compression & SEGAVIDEO_COMPRESSION_CODECS;
+  if (compression & ~(SEGAVIDEO_COMPRESSION_CODECS |
+                      SEGAVIDEO_COMPRESSION_ADPCM |
+                      SEGAVIDEO_COMPRESSION_LIVE |
+                      SEGAVIDEO_COMPRESSION_SHORT_INDEX) ||
+      (compression && codec != SEGAVIDEO_COMPRESSION_RLE &&
+       codec != SEGAVIDEO_COMPRESSION_LZ)) {
+    report_error("Unsupported compression! (0x%04X)", compression);
+    return;
+  }
+  index_entries = segavideo_indexEntries(compression, total_chunks);
+  chunks_per_bank = segavideo_chunksPerRegion(
+      ntohs(start_header.format), SRAM_BANK_SIZE_BYTES, chunk_size);
+
+  // Renditions only apply to compressed video, where chunk sizes vary.  The
+  // encoder doesn't make them for live video.
+  num_renditions = 0;
+  if (is_compressed && !is_live) {
+    num_renditions = min((int)ntohs(start_header.renditions), MAX_RENDITIONS);
+  }
+  chunk_budget_ms = (int64_t)ntohl(start_header.totalSamples) * 1000 /
+                    ntohs(start_header.sampleRate) / max(total_chunks, 1);
+  // Stats start over with each video.
+  memset(&stream_stats, 0, sizeof(stream_stats));
+  ring_reset_high_water();
+  margin_recorded = false;
+  reconnects_at_start = http_get_stats()->reconnects;
+
+  // Start from the full rendition.  If earlier videos measured the network as
+  // too slow for it, choose_rendition() steps down from there.
+  set_rendition(0);
+
+  // Since we decompress it in firmware, the Sega sees it as uncompressed.
+  start_header.compression = 0;
+
+  first_chunk_num = 0;
+  live_waiting = false;
+  if (is_live) {
+    total_chunks = LIVE_TOTAL_CHUNKS;
+    if (!find_live_edge()) {
+      return;
+    }
+    // The Sega plays until it finds an empty chunk, or this many.  Its first
+    // chunk is first_chunk_num.
+    start_header.totalChunks = htonl(total_chunks);
+  }
+
+  next_chunk_num = first_chunk_num;
+  playing_chunk_num = first_chunk_num;
+  origin_chunk_num = first_chunk_num;
+  fill_banks(fast);
+}
+
+// Interrupt any fetch in progress and drop whatever it left in the ring.
+static void stop_fetch() {
+  // A live bank fill waiting for the encoder has nothing in flight yet.
+  live_waiting = false;
+
+  if (!second_core_idle) {
+    // Interrupt any download in progress, and wake the second core if it's
+    // waiting for a free slot in the ring.
+    second_core_interrupt = true;
+    __sev();
+    // Wait for recognition of the interrupt.  The second core sends an event
+    // when it goes idle.
+    while (!second_core_idle || second_core_interrupt) {
+      __wfe();
+    }
+  }
+  if (fetch_pending) {
+    // Drop whatever the second core left in the ring.
+    ring_discard();
+    sram_flush_and_release_bank();
+    fetch_pending = false;
+    read_ahead_held = false;
+    measuring_chunk = false;
+    filling_slot = -1;
+    bank_chunks_left = 0;
+  }
+}
+
+// Other fetches can't wait for a read-ahead fetch, so drop it.  The next
+// FLIP_REGION fetches that chunk again, as it would have without read-ahead.
+static void cancel_read_ahead() {
+  if (read_ahead_held) {
+    int chunk_num = next_chunk_num - 1;
+    stop_fetch();
+    next_chunk_num = chunk_num;
+  }
+}
+
+// Jump by a signed number of chunks relative to the one the Sega is playing,
+// then refill both banks from there, with the target in the first slot.  The
+// Sega clamps the target to the video the same way, so both sides agree on
+// where playback continues.  The Sega's first chunk is first_chunk_num.
+static void seek_video(int8_t delta) {
+  int target = playing_chunk_num + delta;
+  if (target < first_chunk_num) {
+    target = first_chunk_num;
+  }
+  if (target > total_chunks - 1) {
+    target = total_chunks - 1;
+  }
+
+  log_printf("Seeking to chunk %d", target);
+
+  stop_fetch();
+  next_chunk_num = target;
+  playing_chunk_num = target;
+  origin_chunk_num = target;
+  fill_banks(/* fast= */ false);
+}
+
 static void process_command(uint8_t command, uint8_t arg) {
-  Serial.print("Command ");
-  Serial.print(command);
-  Serial.print(" arg 0x");
-  Serial.print(arg < 0x10 ? "0" : "");
-  Serial.println(arg, HEX);
+  log_printf("Command %d arg 0x%02X", command, arg);
 
   switch (command) {
     case KINETOSCOPE_CMD_ECHO:
@@ -219,122 +1404,65 @@ static void process_command(uint8_t command, uint8_t arg) {
       break;
 
     case KINETOSCOPE_CMD_LIST_VIDEOS:
-      // Pull video list into SRAM.
-      Serial.println("Fetching video list...");
-      sram_start_bank(0);
-      if (fetch_into_sram(VIDEO_CATALOG_PATH) && await_fetch()) {
-        Serial.println("Done.");
-      }
+      cancel_read_ahead();
+      list_videos();
       break;
 
-    case KINETOSCOPE_CMD_START_VIDEO:
-      Serial.print("Starting video ");
-      Serial.println(arg);
-
-      // Get the appropriate header from the catalog.
-      SegaVideoHeader header;
-      if (!fetch_into_buffer(&header, VIDEO_CATALOG_PATH, arg * sizeof(header),
-                             sizeof(header)) ||
-          !await_fetch()) {
-        break;
-      }
-
-      // Construct the URL of the video.
-      copy_string(fetch_path, VIDEO_SERVER_BASE_PATH, MAX_PATH);
-      concatenate_string(fetch_path, header.relative_url, MAX_PATH);
-
-      // Start streaming.
-      chunk_size = ntohl(header.chunkSize);
-      total_chunks = ntohl(header.totalChunks);
-      is_compressed = header.compression != 0;
-
-      // Since we decompress it in firmware, the Sega sees it as uncompressed.
-      header.compression = 0;
-
-      if (is_compressed) {
-        // Fetch the index into memory, only if compressed.
-        if (!fetch_into_buffer(&video_index, fetch_path, sizeof(header),
-                               sizeof(video_index)) ||
-            !await_fetch()) {
-          break;
-        }
-
-        // Pre-byteswap the whole index.
-        for (int i = 0; i < sizeof(video_index) / 4; ++i) {
-          video_index.chunk_offset[i] = ntohl(video_index.chunk_offset[i]);
-        }
-      }
+    case KINETOSCOPE_CMD_GET_THUMB:
+      cancel_read_ahead();
+      get_thumbnail(arg);
+      break;
 
-      // Fill both SRAM banks before returning.
-      sram_start_bank(0);
-      sram_write((const uint8_t*)&header, sizeof(header));
-      // NOTE: Always omit the video index in SRAM!
-      next_chunk_num = 0;
+    case KINETOSCOPE_CMD_START_VIDEO:
+      cancel_read_ahead();
+      start_video(arg, /* fast= */ false);
+      break;
 
-      if (is_compressed) {
-        next_offset = video_index.chunk_offset[next_chunk_num];
-        next_size = video_index.chunk_offset[next_chunk_num + 1] - next_offset;
-      } else {
-        next_offset = sizeof(header) + sizeof(video_index);
-        next_size = chunk_size;
-      }
-      if (!fetch_into_sram(fetch_path, next_offset, next_size, is_compressed) ||
-          !await_fetch()) {
-        break;
-      }
-      next_chunk_num++;
-      next_offset += next_size;
-
-      if (total_chunks != 1) {
-        sram_start_bank(1);
-        if (is_compressed) {
-          next_size =
-              video_index.chunk_offset[next_chunk_num + 1] - next_offset;
-        } else {
-          next_size = chunk_size;
-        }
-        if (!fetch_into_sram(fetch_path, next_offset, next_size,
-                             is_compressed) ||
-            !await_fetch()) {
-          break;
-        }
-        next_chunk_num++;
-        next_offset += next_size;
-      }
+    case KINETOSCOPE_CMD_START_FAST:
+      cancel_read_ahead();
+      start_video(arg, /* fast= */ true);
       break;
 
     case KINETOSCOPE_CMD_STOP_VIDEO:
-      if (!second_core_idle) {
-        // Stop streaming.  Interrupt any download in progress.
-        second_core_interrupt = true;
-        // Wait for recognition of the interrupt.
-        while (!second_core_idle || second_core_interrupt) {
-          delay(1 /* ms */);
-        }
-      }
+      // Stop streaming.
+      stop_fetch();
       break;
 
     case KINETOSCOPE_CMD_FLIP_REGION:
-      if (next_chunk_num >= total_chunks) {
-        // Nothing to do.  EOF.
+      // The Sega sends this as it moves on to the next chunk, even at the end.
+      // The arg is the slot it moved on to.
+      playing_chunk_num++;
+
+      if (playing_chunk_num < total_chunks &&
+          (arg >= 2 * chunks_per_bank ||
+           arg != chunk_slot(playing_chunk_num))) {
+        report_error("Region out of sync! (slot %d)", arg);
         break;
       }
 
-      if (!second_core_idle) {
-        report_error("Buffer underflow!  Internet too slow?");
+      // Only the first slot of a bank frees the other bank.  A read-ahead
+      // fetch may already have the last chunk.
+      if (arg % chunks_per_bank != 0 ||
+          (next_chunk_num >= total_chunks && !read_ahead_held)) {
         break;
       }
 
-      // Start filling the next SRAM bank.  Don't wait for completion.
-      sram_start_bank(next_chunk_num & 1);
-      if (is_compressed) {
-        next_size = video_index.chunk_offset[next_chunk_num + 1] - next_offset;
+      {
+        bool underflow = !bank_ready(arg);
+        record_margin(underflow);
+        if (underflow) {
+          report_error("Buffer underflow!  Internet too slow?");
+          break;
+        }
+      }
+
+      // Start filling the other SRAM bank, or let the read-ahead fetch into
+      // it.  Don't wait for completion.
+      if (read_ahead_held) {
+        release_read_ahead();
       } else {
-        next_size = chunk_size;
+        start_bank_fill();
       }
-      fetch_into_sram(fetch_path, next_offset, next_size, is_compressed);
-      next_chunk_num++;
-      next_offset += next_size;
       break;
 
     case KINETOSCOPE_CMD_GET_ERROR:
@@ -343,8 +1471,21 @@ static void process_command(uint8_t command, uint8_t arg) {
       break;
 
     case KINETOSCOPE_CMD_CONNECT_NET:
+      // The network may still be coming up in the background.  If that
+      // failed recently, tell the Sega why.  Otherwise, try again.
+      while (!boot_network_done) {
+        __wfe();
+      }
       if (!network_connected) {
-        connect_network();
+        const char* error = boot_network_error;
+        boot_network_error = NULL;
+        if (!error ||
+            millis() - boot_network_error_ms > BOOT_NETWORK_ERROR_MAX_AGE_MS) {
+          error = connect_network();
+        }
+        if (error) {
+          report_error("%s", error);
+        }
       }
       break;
 
@@ -352,6 +1493,27 @@ static void process_command(uint8_t command, uint8_t arg) {
       sram_march_test(arg);
       break;
 
+    case KINETOSCOPE_CMD_SEEK:
+      seek_video((int8_t)arg);
+      break;
+
+    case KINETOSCOPE_CMD_GET_STATS:
+      // Write streaming stats to SRAM so the ROM software can show them.  They
+      // go to bank 0, so not while a fetch may own it.  A held read-ahead is
+      // still pending, too.
+      if (fetch_pending) {
+        report_error("Can't get stats while streaming!");
+      } else {
+        write_stats_to_sram();
+      }
+      break;
+
+    case KINETOSCOPE_CMD_AWAIT_FILL:
+      // Drain whatever is left of the current fetch, so the Sega knows the
+      // bank is ready when this command completes.
+      await_fill();
+      break;
+
     default: {
       report_error("Unrecognized command 0x%02X!", command);
       break;
@@ -359,7 +1521,7 @@ static void process_command(uint8_t command, uint8_t arg) {
   }
 
   clear_cmd();
-  Serial.println("Command complete.");
+  log_printf("Command complete.");
 }
 
 // Setup and loop for the first core.  This core will initialize all hardware
@@ -376,7 +1538,10 @@ void setup() {
   while (!Serial) { delay(1); }
 
   // Automatically connect to the network to run speed tests.
-  connect_network();
+  const char* error = connect_network();
+  if (error) {
+    report_error("%s", error);
+  }
 
   // Run tests.
   run_tests();
@@ -387,7 +1552,18 @@ void setup() {
 }
 
 void loop() {
-  if (!is_cmd_set()) {
+  // Keep draining any fetch the last command left running, and keep polling
+  // for a live chunk the last command is waiting on.
+  bool busy = service_fetch();
+  service_live();
+
+  if (!take_cmd()) {
+    // Print logs only when there is nothing more urgent to do.  Otherwise,
+    // sleep until the next command interrupt or an event from the second core.
+    // Nothing wakes us for a live poll, so don't sleep through one.
+    if (!busy && !log_service() && !live_waiting) {
+      __wfe();
+    }
     return;
   }
 
@@ -403,33 +1579,49 @@ void loop() {
 void setup1() {
   // Wait for the first core to finish initializing the hardware.
   while (!hardware_ready) { delay(1 /* ms */); }
+
+#if CONNECT_AT_BOOT
+  // Nothing is fetched until the Sega connects, so the network is ours until
+  // then.  If this fails, CONNECT_NET reports the error.
+  if (!network_connected) {
+    boot_network_error = connect_network();
+    boot_network_error_ms = millis();
+  }
+  if (network_connected && !http_connect(VIDEO_SERVER, VIDEO_SERVER_PORT)) {
+    log_printf("Failed to connect to %s at boot.", VIDEO_SERVER);
+  }
+  boot_network_done = true;
+  // Wake the first core, if CONNECT_NET is waiting on this.
+  __sev();
+#endif
 }
 
 void loop1() {
   if (second_core_idle) {
+    // The first core sends an event when it starts a fetch.
+    __wfe();
     return;
   }
 
-  // Begin requested transfer.  The callback will check for interrupts via
-  // second_core_interrupt.  The http library will report an error to the Sega
-  // if it fails.
+  // Begin requested transfer.  The data goes into the ring buffer for the
+  // first core to consume with fetch_callback.  The http library will check
+  // for interrupts via second_core_interrupt, and will report an error to the
+  // Sega if it fails.
 #ifdef DEBUG
-  Serial.print("Fetching ");
-  Serial.print(fetch_path);
-  Serial.print(" at ");
-  Serial.println(fetch_start_byte);
+  log_printf("Fetching %s at %d", fetch_path, fetch_start_byte);
 #endif
 
   digitalWrite(LED_BUILTIN, HIGH);
-  fetch_okay = http_fetch(VIDEO_SERVER, VIDEO_SERVER_PORT, fetch_path,
-                          fetch_start_byte, fetch_size, fetch_callback);
-  // It's fine to do this, even if fetch_callback != http_sram_callback.
-  // This way, SRAM is always flushed even when the first core doesn't await
-  // the fetch.
-  sram_flush_and_release_bank();
+  fetch_okay = http_fetch_into_ring(VIDEO_SERVER, VIDEO_SERVER_PORT, fetch_path,
+                                    fetch_start_byte, fetch_size,
+                                    fetch_next_start_byte, fetch_next_size,
+                                    fetch_validators, &second_core_interrupt);
+  // The first core flushes SRAM once it has drained the ring.
   digitalWrite(LED_BUILTIN, LOW);
 
   // Clear state.
   second_core_interrupt = false;
   second_core_idle = true;
+  // Wake the first core, if it's waiting on this.
+  __sev();
 }
@@ -0,0 +1,77 @@
+// Kinetoscope: A Sega Genesis Video Player
+//
+// Copyright (c) 2024 Joey Parrish
+//
+// See MIT License in LICENSE.txt
+
+// Firmware that runs on the microcontroller inside the cartridge.
+// The microcontroller accepts commands from the player in the Sega ROM, and
+// can stream video from the Internet to the cartridge's shared banks of SRAM.
+
+// This is a cache of small files in the microcontroller's flash, in LittleFS.
+
+#include <Arduino.h>
+#include <LittleFS.h>
+
+#include "flash-cache.h"
+#include "log-ring.h"
+
+// New contents are written here first, then renamed into place.
+#define TEMP_NAME "/cache.tmp"
+
+static bool mounted = false;
+
+void flash_cache_init() {
+  // The filesystem is formatted on the first boot, or if it is corrupt.
+  mounted = LittleFS.begin();
+  if (!mounted) {
+    log_printf("Flash cache unavailable.");
+  }
+}
+
+int flash_cache_read(const char* name, void* buffer, int max_size) {
+  if (!mounted) {
+    return -1;
+  }
+
+  File file = LittleFS.open(name, "r");
+  if (!file) {
+    return -1;
+  }
+
+  int size = file.size();
+  int bytes_read = -1;
+  if (size <= max_size) {
+    bytes_read = file.read((uint8_t*)buffer, size);
+  }
+  file.close();
+  return bytes_read == size ? size : -1;
+}
+
+bool flash_cache_write(const char* name, const void* data, int size) {
+  if (!mounted) {
+    return false;
+  }
+
+  File file = LittleFS.open(TEMP_NAME, "w");
+  if (!file) {
+    return false;
+  }
+
+  bool ok = (int)file.write((const uint8_t*)data, size) == size;
+  file.close();
+
+  // LittleFS renames atomically, replacing the old file.
+  if (!ok || !LittleFS.rename(TEMP_NAME, name)) {
+    log_printf("Failed to cache %s in flash.", name);
+    LittleFS.remove(TEMP_NAME);
+    return false;
+  }
+  return true;
+}
+
+void flash_cache_remove(const char* name) {
+  if (mounted && LittleFS.exists(name)) {
+    LittleFS.remove(name);
+  }
+}
@@ -0,0 +1,33 @@
+// Kinetoscope: A Sega Genesis Video Player
+//
+// Copyright (c) 2024 Joey Parrish
+//
+// See MIT License in LICENSE.txt
+
+// Firmware that runs on the microcontroller inside the cartridge.
+// The microcontroller accepts commands from the player in the Sega ROM, and
+// can stream video from the Internet to the cartridge's shared banks of SRAM.
+
+// This is a cache of small files in the microcontroller's flash, in LittleFS.
+// It survives power cycles, so what we fetched last time can be revalidated
+// instead of fetched again.  Writes pause the other core, so only write while
+// it is idle.  Without a filesystem, nothing is ever cached.
+
+#ifndef _KINETOSCOPE_FLASH_CACHE_H
+#define _KINETOSCOPE_FLASH_CACHE_H
+
+// Mount the filesystem, formatting it if needed.  Call once at boot.
+void flash_cache_init();
+
+// Read a whole cached file into buffer.  Returns its size, or -1 if it isn't
+// cached or doesn't fit.
+int flash_cache_read(const char* name, void* buffer, int max_size);
+
+// Replace a cached file.  Either the old or the new contents survive a power
+// cut, never a mix.  Returns false on failure, such as a full filesystem.
+bool flash_cache_write(const char* name, const void* data, int size);
+
+// Drop a cached file, if it exists.
+void flash_cache_remove(const char* name);
+
+#endif // _KINETOSCOPE_FLASH_CACHE_H
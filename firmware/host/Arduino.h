@@ -0,0 +1,73 @@
+// Kinetoscope: A Sega Genesis Video Player
+//
+// Copyright (c) 2024 Joey Parrish
+//
+// See MIT License in LICENSE.txt
+
+// Host build of the firmware, for profiling and testing on a PC.
+//
+// This is the small part of the Arduino API that the firmware uses.  Pins are
+// backed by the mock in mock-gpio.h.
+
+#ifndef _KINETOSCOPE_HOST_ARDUINO_H
+#define _KINETOSCOPE_HOST_ARDUINO_H
+
+#include <arpa/inet.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+
+#include <algorithm>
+
+#include "mock-gpio.h"
+
+typedef unsigned int uint;
+
+using std::max;
+using std::min;
+
+#define LOW 0
+#define HIGH 1
+
+#define INPUT 0
+#define OUTPUT 1
+#define INPUT_PULLDOWN 2
+
+#define RISING 3
+
+#define LED_BUILTIN 25
+
+// Time since boot, wrapping like the 32-bit counters on the microcontroller.
+uint32_t millis();
+uint32_t micros();
+void delay(uint32_t ms);
+
+void pinMode(int pin, int mode);
+void digitalWrite(int pin, int value);
+int digitalRead(int pin);
+
+#define digitalPinToInterrupt(pin) (pin)
+void attachInterrupt(int pin, void (*callback)(), int mode);
+
+// Serial output goes to stdout.
+class HardwareSerial {
+ public:
+  void begin(unsigned long baud) {}
+  explicit operator bool() const { return true; }
+
+  void print(const char* str) { fputs(str, stdout); }
+  void print(long value) { printf("%ld", value); }
+  void print(unsigned long value) { printf("%lu", value); }
+  void print(int value) { print((long)value); }
+  void print(unsigned int value) { print((unsigned long)value); }
+
+  template <typename T> void println(T value) { print(value); println(); }
+  void println() { fputs("\n", stdout); fflush(stdout); }
+};
+
+extern HardwareSerial Serial;
+
+#endif // _KINETOSCOPE_HOST_ARDUINO_H
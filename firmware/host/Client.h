@@ -0,0 +1,29 @@
+// Kinetoscope: A Sega Genesis Video Player
+//
+// Copyright (c) 2024 Joey Parrish
+//
+// See MIT License in LICENSE.txt
+
+// Host build of the firmware, for profiling and testing on a PC.
+//
+// The parts of the Arduino Client interface that http.cc uses.  As on the
+// microcontroller, read() doesn't wait for data, and returns -1 if there is
+// none yet.
+
+#ifndef _KINETOSCOPE_HOST_CLIENT_H
+#define _KINETOSCOPE_HOST_CLIENT_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+class Client {
+ public:
+  virtual ~Client() {}
+  virtual int connect(const char* host, uint16_t port) = 0;
+  virtual size_t write(const uint8_t* buffer, size_t size) = 0;
+  virtual int read(uint8_t* buffer, size_t size) = 0;
+  virtual uint8_t connected() = 0;
+  virtual void stop() = 0;
+};
+
+#endif // _KINETOSCOPE_HOST_CLIENT_H
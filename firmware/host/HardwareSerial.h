@@ -0,0 +1,9 @@
+// Kinetoscope: A Sega Genesis Video Player
+//
+// Copyright (c) 2024 Joey Parrish
+//
+// See MIT License in LICENSE.txt
+
+// Host build of the firmware, for profiling and testing on a PC.
+
+#include "Arduino.h"
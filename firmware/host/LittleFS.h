@@ -0,0 +1,46 @@
+// Kinetoscope: A Sega Genesis Video Player
+//
+// Copyright (c) 2024 Joey Parrish
+//
+// See MIT License in LICENSE.txt
+
+// Host build of the firmware, for profiling and testing on a PC.
+//
+// The parts of the LittleFS interface that flash-cache.cc uses, backed by
+// files in the folder named by KINETOSCOPE_HOST_FLASH.  Without it, there is
+// no filesystem, and nothing is cached.
+
+#ifndef _KINETOSCOPE_HOST_LITTLEFS_H
+#define _KINETOSCOPE_HOST_LITTLEFS_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+class File {
+ public:
+  explicit File(FILE* file = NULL) : file_(file) {}
+
+  explicit operator bool() const { return file_ != NULL; }
+
+  size_t size();
+  size_t read(uint8_t* buffer, size_t size);
+  size_t write(const uint8_t* buffer, size_t size);
+  void close();
+
+ private:
+  FILE* file_;
+};
+
+class LittleFSClass {
+ public:
+  bool begin();
+  File open(const char* path, const char* mode);
+  bool exists(const char* path);
+  bool remove(const char* path);
+  bool rename(const char* from, const char* to);
+};
+
+extern LittleFSClass LittleFS;
+
+#endif // _KINETOSCOPE_HOST_LITTLEFS_H
@@ -0,0 +1,19 @@
+// Kinetoscope: A Sega Genesis Video Player
+//
+// Copyright (c) 2024 Joey Parrish
+//
+// See MIT License in LICENSE.txt
+
+// Host build of the firmware, for profiling and testing on a PC.
+//
+// Events between cores, as on the RP2040.  __sev() wakes every core waiting in
+// __wfe(), and a core that hasn't waited since the last event doesn't wait at
+// all.
+
+#ifndef _KINETOSCOPE_HOST_HARDWARE_SYNC_H
+#define _KINETOSCOPE_HOST_HARDWARE_SYNC_H
+
+void __sev();
+void __wfe();
+
+#endif // _KINETOSCOPE_HOST_HARDWARE_SYNC_H
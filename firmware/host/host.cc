@@ -0,0 +1,337 @@
+// Kinetoscope: A Sega Genesis Video Player
+//
+// Copyright (c) 2024 Joey Parrish
+//
+// See MIT License in LICENSE.txt
+
+// Host build of the firmware, for profiling and testing on a PC.
+//
+// Each core of the microcontroller is a thread running setup() and loop(), or
+// setup1() and loop1(), as it would on the RP2040.  The main thread plays the
+// part of the Sega, and sends the commands given on the command line:
+//
+//   kinetoscope-host [--dump FOLDER] COMMAND[:ARG] ...
+//
+// Commands:
+//   echo:ARG, list, thumb:VIDEO, start:VIDEO, fast:VIDEO, stop, flip:SLOT,
+//   error, connect, march:PASS, seek:DELTA, stats, await
+//   play: flip through the rest of the video as fast as the banks fill
+//
+// For example, to stream all of video 0 under perf:
+//
+//   perf record ./kinetoscope-host connect list start:0 play stats
+//
+// With --dump, every bank the firmware fills is written to FOLDER, to compare
+// with what the emulator or the encoder produced.
+
+#include <Arduino.h>
+#include <hardware/sync.h>
+#include <pico/platform.h>
+
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+#include <unistd.h>
+
+#include "mock-gpio.h"
+#include "registers.h"
+#include "segavideo_format.h"
+#include "segavideo_stats.h"
+#include "sram.h"
+
+// From firmware.ino.
+extern void setup();
+extern void loop();
+extern void setup1();
+extern void loop1();
+
+// A command that doesn't finish in this long is stuck.
+#define COMMAND_TIMEOUT_MS (60 * 1000)
+
+HardwareSerial Serial;
+
+static const auto boot_time = std::chrono::steady_clock::now();
+
+static uint64_t elapsed_us() {
+  return std::chrono::duration_cast<std::chrono::microseconds>(
+      std::chrono::steady_clock::now() - boot_time).count();
+}
+
+uint32_t millis() {
+  return elapsed_us() / 1000;
+}
+
+uint32_t micros() {
+  return elapsed_us();
+}
+
+void delay(uint32_t ms) {
+  std::this_thread::sleep_for(std::chrono::milliseconds(ms));
+}
+
+static thread_local unsigned int core_num = 0;
+
+unsigned int get_core_num() {
+  return core_num;
+}
+
+static std::mutex event_mutex;
+static std::condition_variable event_condition;
+static uint64_t event_count = 0;
+static thread_local uint64_t events_seen = 0;
+
+void __sev() {
+  std::lock_guard<std::mutex> lock(event_mutex);
+  event_count++;
+  event_condition.notify_all();
+}
+
+void __wfe() {
+  std::unique_lock<std::mutex> lock(event_mutex);
+  // Like any interrupt on the RP2040, the timeout keeps a missed event from
+  // hanging a core.
+  event_condition.wait_for(lock, std::chrono::milliseconds(10),
+                           [] { return event_count != events_seen; });
+  events_seen = event_count;
+}
+
+static volatile bool firmware_ready = false;
+
+static void run_core0() {
+  core_num = 0;
+  setup();
+  firmware_ready = true;
+  while (true) {
+    loop();
+  }
+}
+
+static void run_core1() {
+  core_num = 1;
+  setup1();
+  while (true) {
+    loop1();
+  }
+}
+
+// What the Sega knows about the video playing.  See the player ROM.
+static struct {
+  int total_chunks;
+  int chunks_per_bank;
+  int playing_chunk_num;
+  int origin_chunk_num;
+} sega;
+
+static uint32_t read_u32(const uint8_t* data) {
+  return ntohl(*(const uint32_t*)data);
+}
+
+static uint16_t read_u16(const uint8_t* data) {
+  return ntohs(*(const uint16_t*)data);
+}
+
+// Sends one command and waits for it.  Returns false if the firmware flagged
+// an error, after printing it.
+static bool send_command(uint8_t command, uint8_t arg) {
+  mock_sega_send_command(command, arg);
+
+  uint32_t start_ms = millis();
+  while (mock_sega_command_busy()) {
+    if (millis() - start_ms > COMMAND_TIMEOUT_MS) {
+      fprintf(stderr, "Sega: command 0x%02X timed out!\n", command);
+      return false;
+    }
+    std::this_thread::sleep_for(std::chrono::microseconds(100));
+  }
+
+  if (!mock_sega_error_flagged()) {
+    return true;
+  }
+
+  mock_sega_clear_error();
+  mock_sega_send_command(KINETOSCOPE_CMD_GET_ERROR, 0);
+  while (mock_sega_command_busy()) {
+    std::this_thread::sleep_for(std::chrono::microseconds(100));
+  }
+  fprintf(stderr, "Sega: error: %.256s\n", (const char*)mock_sram_bank(0));
+  return false;
+}
+
+static void read_video_header() {
+  const uint8_t* header = mock_sram_bank(0);
+  uint16_t format = read_u16(header + offsetof(SegaVideoHeader, format));
+  uint32_t chunk_size =
+      read_u32(header + offsetof(SegaVideoHeader, chunkSize));
+  sega.total_chunks =
+      read_u32(header + offsetof(SegaVideoHeader, totalChunks));
+  sega.chunks_per_bank = segavideo_chunksPerRegion(
+      format, SRAM_BANK_SIZE_BYTES, chunk_size);
+  sega.playing_chunk_num = 0;
+  sega.origin_chunk_num = 0;
+}
+
+static bool flip_region() {
+  sega.playing_chunk_num++;
+  int slot = (sega.playing_chunk_num - sega.origin_chunk_num) %
+             (2 * sega.chunks_per_bank);
+  return send_command(KINETOSCOPE_CMD_FLIP_REGION, slot);
+}
+
+// True if the bank about to be played starts with an empty chunk, which is how
+// the firmware ends a live video.
+static bool next_bank_empty() {
+  int next_slot = sega.playing_chunk_num + 1 - sega.origin_chunk_num;
+  int bank = (next_slot / sega.chunks_per_bank) % 2;
+  const uint8_t* chunk = mock_sram_bank(bank);
+  return !read_u32(chunk + offsetof(SegaVideoChunkHeader, samples)) &&
+         !read_u16(chunk + offsetof(SegaVideoChunkHeader, frames));
+}
+
+// Plays to the end, waiting on each bank to fill before moving into it.
+static bool play() {
+  while (sega.playing_chunk_num < sega.total_chunks) {
+    int next_slot = (sega.playing_chunk_num + 1 - sega.origin_chunk_num) %
+                    sega.chunks_per_bank;
+    if (next_slot == 0 &&
+        sega.playing_chunk_num + 1 < sega.total_chunks) {
+      if (!send_command(KINETOSCOPE_CMD_AWAIT_FILL, 0)) {
+        return false;
+      }
+      if (next_bank_empty()) {
+        break;
+      }
+    }
+    if (!flip_region()) {
+      return false;
+    }
+  }
+  return true;
+}
+
+static bool seek(int8_t delta) {
+  int target = sega.playing_chunk_num + delta;
+  target = max(0, min(target, sega.total_chunks - 1));
+  sega.playing_chunk_num = target;
+  sega.origin_chunk_num = target;
+  return send_command(KINETOSCOPE_CMD_SEEK, (uint8_t)delta);
+}
+
+static void print_chunk_stats(const char* name, const uint8_t* data) {
+  printf("Sega: %s: %u chunks, %u bytes fetched, %u decoded, "
+         "header %u ms, body %u ms, ring wait %u ms, SRAM %u ms, "
+         "%u short reads\n", name,
+         read_u32(data), read_u32(data + 4), read_u32(data + 8),
+         read_u32(data + 12), read_u32(data + 16), read_u32(data + 20),
+         read_u32(data + 24), read_u32(data + 28));
+}
+
+static bool get_stats() {
+  if (!send_command(KINETOSCOPE_CMD_GET_STATS, 0)) {
+    return false;
+  }
+
+  const uint8_t* stats = mock_sram_bank(0);
+  print_chunk_stats("last chunk",
+                    stats + offsetof(SegaVideoStats, lastChunk));
+  print_chunk_stats("total", stats + offsetof(SegaVideoStats, total));
+  printf("Sega: %u reconnects, %u underflows, min margin %d ms, "
+         "%u bytes/s, rendition %u, read-ahead max %u bytes\n",
+         read_u32(stats + offsetof(SegaVideoStats, reconnects)),
+         read_u32(stats + offsetof(SegaVideoStats, underflows)),
+         (int32_t)read_u32(stats + offsetof(SegaVideoStats, minMarginMs)),
+         read_u32(stats + offsetof(SegaVideoStats, throughput)),
+         read_u16(stats + offsetof(SegaVideoStats, rendition)),
+         read_u32(stats + offsetof(SegaVideoStats, readAheadHighWater)));
+  return true;
+}
+
+static bool run_command(const char* name, int arg) {
+  if (!strcmp(name, "echo")) {
+    return send_command(KINETOSCOPE_CMD_ECHO, arg);
+  } else if (!strcmp(name, "list")) {
+    return send_command(KINETOSCOPE_CMD_LIST_VIDEOS, 0);
+  } else if (!strcmp(name, "thumb")) {
+    return send_command(KINETOSCOPE_CMD_GET_THUMB, arg);
+  } else if (!strcmp(name, "start") || !strcmp(name, "fast")) {
+    bool fast = !strcmp(name, "fast");
+    if (!send_command(fast ? KINETOSCOPE_CMD_START_FAST :
+                             KINETOSCOPE_CMD_START_VIDEO, arg)) {
+      return false;
+    }
+    read_video_header();
+    return true;
+  } else if (!strcmp(name, "stop")) {
+    return send_command(KINETOSCOPE_CMD_STOP_VIDEO, 0);
+  } else if (!strcmp(name, "flip")) {
+    sega.playing_chunk_num++;
+    return send_command(KINETOSCOPE_CMD_FLIP_REGION, arg);
+  } else if (!strcmp(name, "error")) {
+    bool ok = send_command(KINETOSCOPE_CMD_GET_ERROR, 0);
+    printf("Sega: error: %.256s\n", (const char*)mock_sram_bank(0));
+    return ok;
+  } else if (!strcmp(name, "connect")) {
+    return send_command(KINETOSCOPE_CMD_CONNECT_NET, 0);
+  } else if (!strcmp(name, "march")) {
+    return send_command(KINETOSCOPE_CMD_MARCH_TEST, arg);
+  } else if (!strcmp(name, "seek")) {
+    return seek(arg);
+  } else if (!strcmp(name, "stats")) {
+    return get_stats();
+  } else if (!strcmp(name, "await")) {
+    return send_command(KINETOSCOPE_CMD_AWAIT_FILL, 0);
+  } else if (!strcmp(name, "play")) {
+    return play();
+  }
+
+  fprintf(stderr, "Unknown command: %s\n", name);
+  return false;
+}
+
+int main(int argc, char** argv) {
+  int first_command = 1;
+  if (argc > 2 && !strcmp(argv[1], "--dump")) {
+    mock_sram_set_dump_folder(argv[2]);
+    first_command = 3;
+  }
+
+  if (first_command >= argc) {
+    fprintf(stderr, "Usage: %s [--dump FOLDER] COMMAND[:ARG] ...\n",
+            argv[0]);
+    return 1;
+  }
+
+  std::thread(run_core0).detach();
+  std::thread(run_core1).detach();
+  while (!firmware_ready) {
+    delay(1);
+  }
+
+  uint64_t start_us = elapsed_us();
+  int status = 0;
+  for (int i = first_command; i < argc && !status; ++i) {
+    char name[32];
+    snprintf(name, sizeof(name), "%s", argv[i]);
+    char* colon = strchr(name, ':');
+    int arg = 0;
+    if (colon) {
+      *colon = '\0';
+      arg = strtol(colon + 1, NULL, 0);
+    }
+
+    printf("Sega: %s\n", argv[i]);
+    if (!run_command(name, arg)) {
+      status = 1;
+    }
+  }
+
+  // Let the first core print the rest of its logs.
+  delay(100);
+  printf("Sega: done in %.3f s\n", (elapsed_us() - start_us) / 1e6);
+  mock_gpio_print_summary();
+  fflush(stdout);
+
+  // The cores never return, so don't wait for them.
+  _exit(status);
+}
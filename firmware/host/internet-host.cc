@@ -0,0 +1,146 @@
+// Kinetoscope: A Sega Genesis Video Player
+//
+// Copyright (c) 2024 Joey Parrish
+//
+// See MIT License in LICENSE.txt
+
+// Host build of the firmware, for profiling and testing on a PC.
+//
+// The network is a plain POSIX socket.  Set KINETOSCOPE_HOST_SERVER to
+// "host:port" to connect there instead of the server the firmware asks for,
+// such as a local copy of the videos.  The Host header is unchanged.
+
+#include <Arduino.h>
+#include <Client.h>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+
+#include "internet.h"
+
+class SocketClient : public Client {
+ public:
+  int connect(const char* host, uint16_t port) override {
+    stop();
+
+    char host_buffer[256];
+    const char* server = getenv("KINETOSCOPE_HOST_SERVER");
+    if (server && *server) {
+      snprintf(host_buffer, sizeof(host_buffer), "%s", server);
+      char* colon = strrchr(host_buffer, ':');
+      if (colon) {
+        *colon = '\0';
+        port = strtoul(colon + 1, NULL, 10);
+      }
+      host = host_buffer;
+    }
+
+    char port_string[8];
+    snprintf(port_string, sizeof(port_string), "%u", port);
+
+    struct addrinfo hints;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    struct addrinfo* addresses = NULL;
+    if (getaddrinfo(host, port_string, &hints, &addresses)) {
+      return 0;
+    }
+
+    for (struct addrinfo* a = addresses; a && fd_ < 0; a = a->ai_next) {
+      fd_ = socket(a->ai_family, a->ai_socktype, a->ai_protocol);
+      if (fd_ < 0) {
+        continue;
+      }
+      if (::connect(fd_, a->ai_addr, a->ai_addrlen)) {
+        close(fd_);
+        fd_ = -1;
+      }
+    }
+    freeaddrinfo(addresses);
+
+    if (fd_ < 0) {
+      return 0;
+    }
+
+    // As with setNoDelay() on WiFi.  Reads never wait, as on the
+    // microcontroller.
+    int one = 1;
+    setsockopt(fd_, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    fcntl(fd_, F_SETFL, fcntl(fd_, F_GETFL) | O_NONBLOCK);
+    eof_ = false;
+    return 1;
+  }
+
+  size_t write(const uint8_t* buffer, size_t size) override {
+    size_t written = 0;
+    while (fd_ >= 0 && written < size) {
+      ssize_t result = send(fd_, buffer + written, size - written,
+                            MSG_NOSIGNAL);
+      if (result > 0) {
+        written += result;
+      } else if (result < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+        struct pollfd p = { fd_, POLLOUT, 0 };
+        poll(&p, 1, /* timeout_ms= */ 100);
+      } else {
+        eof_ = true;
+        break;
+      }
+    }
+    return written;
+  }
+
+  int read(uint8_t* buffer, size_t size) override {
+    if (fd_ < 0 || eof_) {
+      return -1;
+    }
+
+    ssize_t result = recv(fd_, buffer, size, 0);
+    if (result > 0) {
+      return result;
+    }
+    if (result == 0 || (errno != EAGAIN && errno != EWOULDBLOCK)) {
+      eof_ = true;
+    }
+    return -1;
+  }
+
+  uint8_t connected() override {
+    return fd_ >= 0 && !eof_;
+  }
+
+  void stop() override {
+    if (fd_ >= 0) {
+      close(fd_);
+      fd_ = -1;
+    }
+    eof_ = false;
+  }
+
+ private:
+  int fd_ = -1;
+  bool eof_ = false;
+};
+
+static SocketClient socket_client;
+
+Client* internet_init_wired(const uint8_t* mac, unsigned int timeout_seconds) {
+  Serial.println("Host network ready.");
+  return &socket_client;
+}
+
+Client* internet_init_wifi(const char* ssid, const char* password,
+                           unsigned int timeout_seconds) {
+  return NULL;
+}
+
+void internet_start_wifi(const char* ssid, const char* password) {}
+
+void internet_stop_wifi() {}
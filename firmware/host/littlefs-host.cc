@@ -0,0 +1,84 @@
+// Kinetoscope: A Sega Genesis Video Player
+//
+// Copyright (c) 2024 Joey Parrish
+//
+// See MIT License in LICENSE.txt
+
+// Host build of the firmware, for profiling and testing on a PC.
+//
+// LittleFS, backed by a folder.  Paths from the firmware start with "/", and
+// go under the folder as they are.
+
+#include <LittleFS.h>
+
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+LittleFSClass LittleFS;
+
+static char root[256];
+
+static void host_path(char* buffer, size_t size, const char* path) {
+  snprintf(buffer, size, "%s%s", root, path);
+}
+
+size_t File::size() {
+  struct stat st;
+  return fstat(fileno(file_), &st) ? 0 : st.st_size;
+}
+
+size_t File::read(uint8_t* buffer, size_t size) {
+  return fread(buffer, 1, size, file_);
+}
+
+size_t File::write(const uint8_t* buffer, size_t size) {
+  return fwrite(buffer, 1, size, file_);
+}
+
+void File::close() {
+  if (file_) {
+    fclose(file_);
+    file_ = NULL;
+  }
+}
+
+bool LittleFSClass::begin() {
+  const char* folder = getenv("KINETOSCOPE_HOST_FLASH");
+  if (!folder || !*folder) {
+    return false;
+  }
+
+  snprintf(root, sizeof(root), "%s", folder);
+  mkdir(root, 0755);
+  struct stat st;
+  return !stat(root, &st) && S_ISDIR(st.st_mode);
+}
+
+File LittleFSClass::open(const char* path, const char* mode) {
+  char buffer[512];
+  host_path(buffer, sizeof(buffer), path);
+  // Always binary, like flash.
+  return File(fopen(buffer, !strcmp(mode, "w") ? "wb" : "rb"));
+}
+
+bool LittleFSClass::exists(const char* path) {
+  char buffer[512];
+  host_path(buffer, sizeof(buffer), path);
+  return !access(buffer, F_OK);
+}
+
+bool LittleFSClass::remove(const char* path) {
+  char buffer[512];
+  host_path(buffer, sizeof(buffer), path);
+  return !unlink(buffer);
+}
+
+bool LittleFSClass::rename(const char* from, const char* to) {
+  char from_buffer[512];
+  char to_buffer[512];
+  host_path(from_buffer, sizeof(from_buffer), from);
+  host_path(to_buffer, sizeof(to_buffer), to);
+  return !::rename(from_buffer, to_buffer);
+}
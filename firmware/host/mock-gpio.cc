@@ -0,0 +1,206 @@
+// Kinetoscope: A Sega Genesis Video Player
+//
+// Copyright (c) 2024 Joey Parrish
+//
+// See MIT License in LICENSE.txt
+
+// Host build of the firmware, for profiling and testing on a PC.
+//
+// Mock GPIO.  See mock-gpio.h.
+
+#include <Arduino.h>
+#include <hardware/sync.h>
+
+#include <atomic>
+
+#include "fast-gpio.h"
+#include "mock-gpio.h"
+#include "registers.h"
+
+// Output pin levels, as last set by the firmware.
+static int pin_level[MOCK_GPIO_NUM_PINS];
+// Rising and falling edges seen on each output pin.
+static uint64_t pin_edges[MOCK_GPIO_NUM_PINS];
+
+// The flip-flops between the Sega and the firmware.  The Sega sets the command
+// token and clears the error flag, and the firmware does the opposite.
+static std::atomic<bool> command_token(false);
+static std::atomic<bool> error_flag(false);
+static uint8_t registers[2];
+static void (*command_interrupt)() = NULL;
+
+// The SRAM write path: a word address counter and a 16-bit shift register,
+// shared by both banks.  A bank's write enable decides which one is written.
+static uint32_t sram_address = 0;
+static uint16_t sram_shift = 0;
+static uint8_t sram_banks[2][MOCK_SRAM_BANK_BYTES];
+// The end of what was written to each bank since it was last released.
+static uint32_t sram_bank_end[2];
+static uint64_t sram_words_written = 0;
+static uint64_t sram_banks_released = 0;
+static const char* dump_folder = NULL;
+
+static void dump_bank(int bank) {
+  if (!dump_folder) {
+    return;
+  }
+
+  char path[1024];
+  snprintf(path, sizeof(path), "%s/%04llu-bank%d.bin", dump_folder,
+           (unsigned long long)sram_banks_released, bank);
+  FILE* f = fopen(path, "wb");
+  if (!f) {
+    perror(path);
+    return;
+  }
+  fwrite(sram_banks[bank], 1, sram_bank_end[bank], f);
+  fclose(f);
+}
+
+static void sram_write_word() {
+  for (int bank = 0; bank < 2; ++bank) {
+    int bank_pin = bank ? SRAM_PIN__WRITE_BANK_1 : SRAM_PIN__WRITE_BANK_0;
+    if (!pin_level[bank_pin]) {
+      continue;
+    }
+
+    // The address counter wraps around within the bank.
+    uint32_t offset = (sram_address * 2) % MOCK_SRAM_BANK_BYTES;
+    sram_banks[bank][offset] = sram_shift >> 8;
+    sram_banks[bank][offset + 1] = sram_shift & 0xff;
+    if (offset + 2 > sram_bank_end[bank]) {
+      sram_bank_end[bank] = offset + 2;
+    }
+  }
+  sram_words_written++;
+}
+
+static void on_rising_edge(int pin) {
+  if (pin == SRAM_PIN__ADDR_CLOCK) {
+    sram_address++;
+  } else if (pin == SRAM_PIN__DATA_CLOCK) {
+    sram_shift = (sram_shift << 1) | (pin_level[SRAM_PIN__DATA_NEXT_BIT] & 1);
+  }
+}
+
+static void on_falling_edge(int pin) {
+  if (pin == SRAM_PIN__ADDR_RESET) {
+    sram_address = 0;
+  } else if (pin == SRAM_PIN__DATA_WRITE) {
+    sram_write_word();
+  } else if (pin == SRAM_PIN__WRITE_BANK_0 || pin == SRAM_PIN__WRITE_BANK_1) {
+    int bank = pin == SRAM_PIN__WRITE_BANK_1;
+    dump_bank(bank);
+    sram_bank_end[bank] = 0;
+    sram_banks_released++;
+  } else if (pin == SYNC_PIN__CMD_CLEAR) {
+    command_token.store(false, std::memory_order_release);
+  } else if (pin == SYNC_PIN__ERR_SET) {
+    error_flag.store(true, std::memory_order_release);
+  }
+}
+
+static void set_level(int pin, int level) {
+  level = level ? 1 : 0;
+  if (pin_level[pin] == level) {
+    return;
+  }
+
+  pin_level[pin] = level;
+  pin_edges[pin]++;
+  if (level) {
+    on_rising_edge(pin);
+  } else {
+    on_falling_edge(pin);
+  }
+}
+
+void mock_gpio_set(int pin) {
+  set_level(pin, 1);
+}
+
+void mock_gpio_clear(int pin) {
+  set_level(pin, 0);
+}
+
+int mock_gpio_get(int pin) {
+  if (pin == SYNC_PIN__CMD_READY) {
+    return command_token.load(std::memory_order_acquire);
+  }
+  if (pin == SYNC_PIN__ERR_FLAGGED) {
+    return error_flag.load(std::memory_order_acquire);
+  }
+  return pin_level[pin];
+}
+
+uint32_t mock_gpio_read_multiple(uint32_t mask, int shift) {
+  // The output-enable pins are active low, and select one register.
+  uint32_t data = 0;
+  if (!pin_level[REG_PIN__OE0]) {
+    data = registers[0];
+  } else if (!pin_level[REG_PIN__OE1]) {
+    data = registers[1];
+  }
+  return ((data << REG_PIN__D_SHIFT) & mask) >> shift;
+}
+
+void pinMode(int pin, int mode) {}
+
+void digitalWrite(int pin, int value) {
+  set_level(pin, value);
+}
+
+int digitalRead(int pin) {
+  return mock_gpio_get(pin);
+}
+
+void attachInterrupt(int pin, void (*callback)(), int mode) {
+  if (pin == SYNC_PIN__CMD_READY && mode == RISING) {
+    command_interrupt = callback;
+  }
+}
+
+void mock_sega_send_command(uint8_t command, uint8_t arg) {
+  registers[KINETOSCOPE_REG_CMD] = command;
+  registers[KINETOSCOPE_REG_ARG] = arg;
+  command_token.store(true, std::memory_order_release);
+
+  // The rising edge of the token interrupts the first core.
+  if (command_interrupt) {
+    command_interrupt();
+  }
+  __sev();
+}
+
+bool mock_sega_command_busy() {
+  return command_token.load(std::memory_order_acquire);
+}
+
+bool mock_sega_error_flagged() {
+  return error_flag.load(std::memory_order_acquire);
+}
+
+void mock_sega_clear_error() {
+  error_flag.store(false, std::memory_order_release);
+}
+
+const uint8_t* mock_sram_bank(int bank) {
+  return sram_banks[bank];
+}
+
+void mock_sram_set_dump_folder(const char* path) {
+  dump_folder = path;
+}
+
+void mock_gpio_print_summary() {
+  printf("SRAM: %llu words written, %llu bank fills\n",
+         (unsigned long long)sram_words_written,
+         (unsigned long long)sram_banks_released);
+  printf("Pin edges:");
+  for (int pin = 0; pin < MOCK_GPIO_NUM_PINS; ++pin) {
+    if (pin_edges[pin]) {
+      printf(" %d=%llu", pin, (unsigned long long)pin_edges[pin]);
+    }
+  }
+  printf("\n");
+}
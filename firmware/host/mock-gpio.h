@@ -0,0 +1,48 @@
+// Kinetoscope: A Sega Genesis Video Player
+//
+// Copyright (c) 2024 Joey Parrish
+//
+// See MIT License in LICENSE.txt
+
+// Host build of the firmware, for profiling and testing on a PC.
+//
+// Mock GPIO.  This models the cartridge logic on the other end of the pins:
+// the address counter and data shift register in front of each SRAM bank, the
+// command and error flip-flops, and the two registers the Sega writes.  It
+// counts pulses on every pin, and captures everything written to SRAM.
+
+#ifndef _KINETOSCOPE_HOST_MOCK_GPIO_H
+#define _KINETOSCOPE_HOST_MOCK_GPIO_H
+
+#include <stdint.h>
+
+#define MOCK_GPIO_NUM_PINS 32
+#define MOCK_SRAM_BANK_BYTES (1 << 20)
+
+// Used by fast-gpio.h.
+void mock_gpio_set(int pin);
+void mock_gpio_clear(int pin);
+int mock_gpio_get(int pin);
+uint32_t mock_gpio_read_multiple(uint32_t mask, int shift);
+
+// The Sega's side of the registers and sync token.
+
+// Writes both registers and sets the command token, as the Sega does.
+void mock_sega_send_command(uint8_t command, uint8_t arg);
+// True until the firmware clears the command token.
+bool mock_sega_command_busy();
+// The error flag, which the Sega clears after reading the error.
+bool mock_sega_error_flagged();
+void mock_sega_clear_error();
+
+// SRAM as the Sega sees it, in big-endian words.
+const uint8_t* mock_sram_bank(int bank);
+
+// Each time a bank is released, it is written to this folder, if set, as
+// "NNNN-bankB.bin", up to its last byte written.
+void mock_sram_set_dump_folder(const char* path);
+
+// Prints pulse counts and SRAM totals.
+void mock_gpio_print_summary();
+
+#endif // _KINETOSCOPE_HOST_MOCK_GPIO_H
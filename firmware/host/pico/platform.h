@@ -0,0 +1,15 @@
+// Kinetoscope: A Sega Genesis Video Player
+//
+// Copyright (c) 2024 Joey Parrish
+//
+// See MIT License in LICENSE.txt
+
+// Host build of the firmware, for profiling and testing on a PC.
+
+#ifndef _KINETOSCOPE_HOST_PICO_PLATFORM_H
+#define _KINETOSCOPE_HOST_PICO_PLATFORM_H
+
+// Each core is a thread.  This is 0 or 1, as on the RP2040.
+unsigned int get_core_num();
+
+#endif // _KINETOSCOPE_HOST_PICO_PLATFORM_H
@@ -16,22 +16,29 @@
 // throughput (more than 2x faster in my tests over a fast, wired connection).
 // The down side to this HTTP client implementation is that the parsing is very
 // hacky and limited.  For our purposes, though, we only care about the content
-// length and no other header.  So it should be fine.
+// length and the validators for revalidating a cache.  So it should be fine.
 
 #include <Arduino.h>
-#include <HardwareSerial.h>
+#include <hardware/sync.h>
 
 #include "error.h"
 #include "http.h"
+#include "log-ring.h"
+#include "ring-buffer.h"
 #include "string-util.h"
 
 #define DEFAULT_PORT 80
 
 #define MAX_READ 8192
 #define MAX_SERVER 256
+#define MAX_PIPELINED_PATH 256
 
 #define CONTENT_LENGTH_HEADER "Content-Length: "
 #define CONTENT_LENGTH_HEADER_LENGTH 16
+#define ETAG_HEADER "ETag: "
+#define ETAG_HEADER_LENGTH 6
+#define LAST_MODIFIED_HEADER "Last-Modified: "
+#define LAST_MODIFIED_HEADER_LENGTH 15
 #define HTTP_RESPONSE_HEADER_LENGTH 9  // "HTTP/1.1 "
 #define MIN_RESPONSE_LENGTH (HTTP_RESPONSE_HEADER_LENGTH + 3)
 
@@ -53,6 +60,21 @@ static char request_buffer[1024];
 static char response_buffer[1024];
 static uint8_t read_buffer[MAX_READ];
 
+// A request already sent on the current connection, ahead of the fetch that
+// needs it.  With HTTP/1.1 pipelining, the server sends its response as soon
+// as the previous one is done, so the link doesn't sit idle for an RTT between
+// fetches.
+static bool pipelined = false;
+static char pipelined_path[MAX_PIPELINED_PATH];
+static int pipelined_start_byte = 0;
+static int pipelined_size = 0;
+
+static HttpStats stats = {0};
+static bool ever_connected = false;
+
+static HttpValidators response_validators;
+static bool response_not_modified = false;
+
 void http_init(Client* network_client) {
   client = network_client;
   current_server[0] = '\0';
@@ -78,36 +100,70 @@ static inline bool need_new_connection(const char* server, int port) {
 static void close_connection() {
   client->stop();
   current_server[0] = '\0';
+  // Any response to a pipelined request is gone with the connection.
+  pipelined = false;
 }
 
-static inline void connect_if_needed(const char* server, int port) {
+// A warm connection, opened ahead of any fetch, doesn't count as the first.
+// So if it goes idle and is replaced, that isn't counted as a reconnect.
+static inline void connect_if_needed(const char* server, int port,
+                                     bool warm = false) {
   if (!need_new_connection(server, port)) {
 #ifdef DEBUG
-    Serial.print("Reusing connection to ");
-    Serial.println(server);
+    log_printf("Reusing connection to %s", server);
 #endif
+    // The first fetch on a warm connection makes it the first.
+    ever_connected = ever_connected || !warm;
     return;
   }
 
 #ifdef DEBUG
-  Serial.print("Creating new connection to ");
-  Serial.println(server);
+  log_printf("Creating new connection to %s", server);
 #endif
 
   close_connection();
 
   client->connect(server, port);
+  if (ever_connected) {
+    stats.reconnects++;
+  }
+  ever_connected = ever_connected || !warm;
 
   copy_string(current_server, server, MAX_SERVER);
   current_port = port;
 }
 
+bool http_connect(const char* server, uint16_t port) {
+  if (!port) {
+    port = DEFAULT_PORT;
+  }
+
+  connect_if_needed(server, port, /* warm= */ true);
+  if (!client->connected()) {
+    close_connection();
+    return false;
+  }
+  return true;
+}
+
 static inline void write_request(const char* server, uint16_t port,
-                                 const char* path, int start_byte, int size) {
+                                 const char* path, int start_byte, int size,
+                                 const HttpValidators* validators = NULL) {
   // Compute the Range header.
   snprintf(range_value, sizeof(range_value), "bytes=%d-%d",
            start_byte, start_byte + size - 1);
 
+  // The ETag is the better validator, so the date is only a fallback.
+  const char* condition_name = "";
+  const char* condition_value = "";
+  if (validators && validators->etag[0]) {
+    condition_name = "If-None-Match: ";
+    condition_value = validators->etag;
+  } else if (validators && validators->last_modified[0]) {
+    condition_name = "If-Modified-Since: ";
+    condition_value = validators->last_modified;
+  }
+
   int request_size = snprintf(
       request_buffer, sizeof(request_buffer),
       "GET %s HTTP/1.1\r\n"
@@ -115,123 +171,147 @@ static inline void write_request(const char* server, uint16_t port,
       "User-Agent: Kinetoscope/1.0\r\n"
       "Connection: keep-alive\r\n"
       "Range: %s\r\n"
+      "%s%s%s"
       "\r\n",
-      path, server, range_value);
+      path, server, range_value,
+      condition_name, condition_value, condition_name[0] ? "\r\n" : "");
 
 #ifdef DEBUG
-  Serial.println(request_buffer);
+  log_printf("%s", request_buffer);
 #endif
 
   client->write((const uint8_t*)request_buffer, request_size);
 }
 
+// Parse one line of the response headers, not including the line terminator.
+// The first line is the status line.
+static inline void parse_header_line(const char* line, int length,
+                                     bool status_line,
+                                     HeaderData* header_data) {
+  if (status_line) {
+    if (length < MIN_RESPONSE_LENGTH) {
+      return;
+    }
+
+    char status_code_buf[4];
+    memcpy(status_code_buf, line + HTTP_RESPONSE_HEADER_LENGTH, 3);
+    status_code_buf[3] = '\0';
+    header_data->status_code = strtol(status_code_buf, NULL, 10);
+    return;
+  }
+
+  // The only other headers we care about are Content-Length and the
+  // validators.
+  if (length > CONTENT_LENGTH_HEADER_LENGTH &&
+      !strncasecmp(line, CONTENT_LENGTH_HEADER,
+                   CONTENT_LENGTH_HEADER_LENGTH)) {
+    // The line is terminated by \r or \n, either of which stops strtol.
+    header_data->body_length =
+        strtol(line + CONTENT_LENGTH_HEADER_LENGTH, NULL, 10);
+  } else if (length > ETAG_HEADER_LENGTH &&
+             !strncasecmp(line, ETAG_HEADER, ETAG_HEADER_LENGTH)) {
+    copy_string(response_validators.etag, line + ETAG_HEADER_LENGTH,
+                min(length - ETAG_HEADER_LENGTH + 1, HTTP_MAX_VALIDATOR));
+  } else if (length > LAST_MODIFIED_HEADER_LENGTH &&
+             !strncasecmp(line, LAST_MODIFIED_HEADER,
+                          LAST_MODIFIED_HEADER_LENGTH)) {
+    copy_string(response_validators.last_modified,
+                line + LAST_MODIFIED_HEADER_LENGTH,
+                min(length - LAST_MODIFIED_HEADER_LENGTH + 1,
+                    HTTP_MAX_VALIDATOR));
+  }
+}
+
 static inline bool read_response_headers(HeaderData* header_data) {
+  header_data->status_code = -1;
+  header_data->body_length = -1;
+  header_data->body_start = NULL;
+  header_data->body_start_length = -1;
+  response_validators.etag[0] = '\0';
+  response_validators.last_modified[0] = '\0';
+
+  // Each line is parsed once, as soon as its terminator arrives, rather than
+  // re-scanning the whole buffer after every read.
   int num_read = 0;
+  int scanned = 0;
+  int line_start = 0;
   bool end_of_headers = false;
-  while (client->connected() && !end_of_headers) {
+  while (client->connected() && !end_of_headers &&
+         num_read < (int)sizeof(response_buffer)) {
     int last_read = client->read(
         (uint8_t*)response_buffer + num_read,
         sizeof(response_buffer) - num_read);
-    if (last_read >= 0) {
+    if (last_read > 0) {
       num_read += last_read;
     }
-    response_buffer[num_read] = '\0';
 
-    // NOTE: Although compliant servers are supposed to send \r\n as a line
-    // terminator, compliant clients may ignore the \r and accept \n only.
-    // Android's com.phlox.simpleserver, which I used briefly during testing,
-    // only replies with \n, so we take care here to tolerate that.
-    end_of_headers = strstr(response_buffer, "\r\n\r\n") != NULL ||
-                     strstr(response_buffer, "\n\n") != NULL;
-  }
+    for (; scanned < num_read; ++scanned) {
+      if (response_buffer[scanned] != '\n') {
+        continue;
+      }
 
-  if (num_read < MIN_RESPONSE_LENGTH) {
-    Serial.println("Failed!  Did not find status code!");
-    return false;
-  }
+      // NOTE: Although compliant servers are supposed to send \r\n as a line
+      // terminator, compliant clients may ignore the \r and accept \n only.
+      // Android's com.phlox.simpleserver, which I used briefly during
+      // testing, only replies with \n, so we take care here to tolerate that.
+      int line_length = scanned - line_start;
+      if (line_length && response_buffer[scanned - 1] == '\r') {
+        line_length--;
+      }
 
-  if (!end_of_headers) {
-    Serial.println("Failed!  Did not find end of headers!");
-    return false;
+      if (line_length == 0) {
+        // End of headers.  Save the location and length of the body bytes we
+        // have in buffer.
+        end_of_headers = true;
+        header_data->body_start = (const uint8_t*)response_buffer + scanned + 1;
+        header_data->body_start_length = num_read - (scanned + 1);
+        break;
+      }
+
+      parse_header_line(response_buffer + line_start, line_length,
+                        /* status_line= */ line_start == 0, header_data);
+      line_start = scanned + 1;
+    }
   }
 
 #ifdef DEBUG
-  Serial.println(response_buffer);
+  log_printf("%.*s", num_read, response_buffer);
 #endif
 
-  char status_code_buf[4];
-  memcpy(status_code_buf, response_buffer + HTTP_RESPONSE_HEADER_LENGTH, 3);
-  status_code_buf[3] = '\0';
-  header_data->status_code = strtol(status_code_buf, NULL, 10);
-
-  if (header_data->status_code <= 0 || header_data->status_code < 100) {
-    Serial.print("Failed!  Invalid status code ");
-    Serial.println(header_data->status_code);
+  if (num_read < MIN_RESPONSE_LENGTH) {
+    log_printf("Failed!  Did not find status code!");
     return false;
   }
 
-  header_data->body_length = -1;
-  header_data->body_start = NULL;
-  header_data->body_start_length = -1;
-
-  int this_header_starts = -1;
-  int body_bytes_in_first_buffer = 0;
-
-  // Scan through the buffer looking for the body length and the end of the
-  // headers.  See also NOTE above about line endings.
-  for (int i = 0; i < num_read - 1; ++i) {
-    if (response_buffer[i] == '\n') {
-      if (this_header_starts > 0) {
-        // Parse one more header, looking for Content-Length.
-        if (!strncasecmp(
-            response_buffer + this_header_starts,
-            CONTENT_LENGTH_HEADER,
-            CONTENT_LENGTH_HEADER_LENGTH)) {
-          const char* value_starts =
-              response_buffer + this_header_starts +
-              CONTENT_LENGTH_HEADER_LENGTH;
-          header_data->body_length = strtol(value_starts, NULL, 10);
-        }
-      }
-
-      this_header_starts = i + 1;
-    }
-
-    if (i < num_read - 3 &&
-        response_buffer[i    ] == '\r' &&
-        response_buffer[i + 1] == '\n' &&
-        response_buffer[i + 2] == '\r' &&
-        response_buffer[i + 3] == '\n') {
-      // End of headers (compliant, DOS style line termination).
-      // Save the location and length of the body bytes we have in buffer, then
-      // quit the loop.
-      header_data->body_start = (const uint8_t*)response_buffer + i + 4;
-      header_data->body_start_length = num_read - (i + 4);
-      break;
-    } else if (response_buffer[i    ] == '\n' &&
-               response_buffer[i + 1] == '\n') {
-      // End of headers.  Save the location and length of the body bytes we
-      // have in buffer, then quit the loop.
-      header_data->body_start = (const uint8_t*)response_buffer + i + 2;
-      header_data->body_start_length = num_read - (i + 2);
-      break;
-    }
+  if (!end_of_headers) {
+    log_printf("Failed!  Did not find end of headers!");
+    return false;
   }
 
-  if (header_data->body_start == NULL) {
-    Serial.println("Failed!  Did not find end of headers!");
+  if (header_data->status_code < 100) {
+    log_printf("Failed!  Invalid status code %d", header_data->status_code);
     return false;
   }
 
+  if (header_data->status_code == 304) {
+    // Never has a body, with or without Content-Length.
+    header_data->body_length = 0;
+  }
+
   if (header_data->body_length < 0) {
-    Serial.println("Failed!  Did not find body length!");
+    log_printf("Failed!  Did not find body length!");
     return false;
   }
 
   return true;
 }
 
-static inline bool check_status_code(int status_code) {
+static inline bool check_status_code(int status_code, bool conditional) {
+  // The copy we already have is still good.
+  if (status_code == 304 && conditional) {
+    return true;
+  }
+
   // Since we sent a Range header, "200 OK" means the server ignored it.
   if (status_code == 200) {
     report_error("Request failed! Range not supported?");
@@ -255,8 +335,12 @@ static inline bool check_status_code(int status_code) {
   return true;
 }
 
-bool http_fetch(const char* server, uint16_t port, const char* path,
-                int start_byte, int size, http_data_callback callback) {
+// Sends the request and reads the response headers.  On success, returns the
+// header data and clamps *size to the body length, which is 0 for "304 Not
+// Modified".
+static bool begin_fetch(const char* server, uint16_t port, const char* path,
+                        int start_byte, int* size, HeaderData* header_data,
+                        const HttpValidators* validators = NULL) {
   if (!client) {
     report_error("No internet connection!");
     return false;
@@ -265,34 +349,58 @@ bool http_fetch(const char* server, uint16_t port, const char* path,
   if (!port) {
     port = DEFAULT_PORT;
   }
-  connect_if_needed(server, port);
 
-  write_request(server, port, path, start_byte, size);
+  stats.header_ms = 0;
+  stats.body_ms = 0;
+  stats.ring_wait_ms = 0;
+  stats.short_reads = 0;
+  stats.body_bytes = 0;
+  response_not_modified = false;
+  uint32_t start_ms = millis();
+
+  if (pipelined && !validators && !need_new_connection(server, port) &&
+      !strcmp(path, pipelined_path) &&
+      start_byte == pipelined_start_byte &&
+      *size == pipelined_size) {
+    // Already requested.  The response is on its way, or already here.
+#ifdef DEBUG
+    log_printf("Using pipelined request.");
+#endif
+    pipelined = false;
+  } else {
+    if (pipelined) {
+      // We asked for something else.  Rather than read and discard the
+      // response, start over with a fresh connection.
+      close_connection();
+    }
 
-  HeaderData header_data;
-  if (!read_response_headers(&header_data)) {
+    connect_if_needed(server, port);
+    write_request(server, port, path, start_byte, *size, validators);
+  }
+
+  if (!read_response_headers(header_data)) {
     report_error("Failed to read HTTP headers!");
     close_connection();
     return false;
   }
+  stats.header_ms = millis() - start_ms;
 
 #ifdef DEBUG
-  Serial.print("HTTP status code: ");
-  Serial.println(header_data.status_code);
+  log_printf("HTTP status code: %d", header_data->status_code);
 #endif
 
   // Calls report_error() on failure
-  if (!check_status_code(header_data.status_code)) {
+  if (!check_status_code(header_data->status_code, validators != NULL)) {
     close_connection();
     return false;
   }
+  response_not_modified = header_data->status_code == 304;
 
 #ifdef DEBUG
-  Serial.print("HTTP body length: ");
-  Serial.println(header_data.body_length);
+  log_printf("HTTP body length: %d", header_data->body_length);
 #endif
 
-  if (header_data.body_length < 0) {
+  if (header_data->body_length < 0) {
     report_error("Unexpected zero-length response!");
     close_connection();
     return false;
@@ -300,17 +408,50 @@ bool http_fetch(const char* server, uint16_t port, const char* path,
 
   // Can't read more than the body length.  If it's smaller than the buffer,
   // limit ourselves to that.
-  if (header_data.body_length < size) {
-    size = header_data.body_length;
+  if (header_data->body_length < *size) {
+    *size = header_data->body_length;
+  }
+
+  // Body bytes beyond the size wouldn't belong to this response.
+  if (header_data->body_start_length > *size) {
+    header_data->body_start_length = *size;
+  }
+
+  return true;
+}
+
+// Send the request for the next fetch now, while this one's body is still
+// being read on the same connection.
+static inline void pipeline_request(const char* server, uint16_t port,
+                                    const char* path,
+                                    int start_byte, int size) {
+  if (!port) {
+    port = DEFAULT_PORT;
+  }
+
+  write_request(server, port, path, start_byte, size);
+  copy_string(pipelined_path, path, MAX_PIPELINED_PATH);
+  pipelined_start_byte = start_byte;
+  pipelined_size = size;
+  pipelined = true;
+}
+
+bool http_fetch(const char* server, uint16_t port, const char* path,
+                int start_byte, int size, http_data_callback callback) {
+  HeaderData header_data;
+  // Calls report_error() on failure
+  if (!begin_fetch(server, port, path, start_byte, &size, &header_data)) {
+    return false;
   }
 
+  uint32_t body_start_ms = millis();
   int bytes_left = size;
 
   // Copy the body bytes found in the header buffer.
   if (header_data.body_start_length) {
     bool ok = callback(header_data.body_start, header_data.body_start_length);
     if (!ok) {
-      Serial.println("Transfer interrupted.");
+      log_printf("Transfer interrupted.");
       close_connection();
       return false;
     }
@@ -323,12 +464,12 @@ bool http_fetch(const char* server, uint16_t port, const char* path,
     int read_request_size = bytes_left > MAX_READ ? MAX_READ : bytes_left;
     int bytes_read = client->read(read_buffer, read_request_size);
 
-#if 0
     if (bytes_read > 0 && bytes_read < read_request_size) {
-      Serial.print("Short read: ");
-      Serial.println(bytes_read);
-    }
+      stats.short_reads++;
+#if 0
+      log_printf("Short read: %d", bytes_read);
 #endif
+    }
 
     if (bytes_read <= 0) {
       delay(1);
@@ -337,12 +478,121 @@ bool http_fetch(const char* server, uint16_t port, const char* path,
 
     bool ok = callback(read_buffer, bytes_read);
     if (!ok) {
-      Serial.println("Transfer interrupted.");
+      log_printf("Transfer interrupted.");
       close_connection();
       return false;
     }
     bytes_left -= bytes_read;
   }
 
+  stats.body_ms = millis() - body_start_ms;
+  stats.body_bytes = size;
   return true;
 }
+
+bool http_fetch_into_ring(const char* server, uint16_t port, const char* path,
+                          int start_byte, int size,
+                          int next_start_byte, int next_size,
+                          const HttpValidators* validators,
+                          volatile bool* interrupt) {
+  HeaderData header_data;
+  // Calls report_error() on failure
+  if (!begin_fetch(server, port, path, start_byte, &size, &header_data,
+                   validators)) {
+    return false;
+  }
+
+  if (next_size > 0 && !response_not_modified) {
+    pipeline_request(server, port, path, next_start_byte, next_size);
+  }
+
+  uint32_t body_start_ms = millis();
+  int bytes_left = size;
+
+  // The body bytes found in the header buffer go into the first slot, and the
+  // rest of that slot is filled from the network as usual.
+  const uint8_t* pending = header_data.body_start;
+  int pending_length = header_data.body_start_length;
+
+  bool waiting = false;
+  uint32_t wait_start_ms = 0;
+
+  while (bytes_left) {
+    uint8_t* slot = ring_write_slot();
+    if (!slot) {
+      // Full.  Wait for the consumer to drain a slot.
+      if (!waiting) {
+        waiting = true;
+        wait_start_ms = millis();
+      }
+      if (*interrupt) {
+        log_printf("Transfer interrupted.");
+        close_connection();
+        return false;
+      }
+      // A read-ahead may wait here until the next FLIP_REGION, so sleep
+      // instead of spinning.  The consumer sends an event when it frees a
+      // slot, and so does an interrupt.
+      __wfe();
+      continue;
+    }
+
+    if (waiting) {
+      waiting = false;
+      stats.ring_wait_ms += millis() - wait_start_ms;
+    }
+
+    int slot_bytes = 0;
+    if (pending_length > 0) {
+      memcpy(slot, pending, pending_length);
+      slot_bytes = pending_length;
+      bytes_left -= pending_length;
+      pending_length = 0;
+    }
+
+    // Fill the slot as much as the network allows right now, without waiting
+    // for it to be full.  Handing over partial slots keeps the consumer busy.
+    while (bytes_left && slot_bytes < RING_SLOT_SIZE) {
+      int read_request_size = min(bytes_left, RING_SLOT_SIZE - slot_bytes);
+      int bytes_read = client->read(slot + slot_bytes, read_request_size);
+      if (bytes_read > 0 && bytes_read < read_request_size) {
+        stats.short_reads++;
+      }
+      if (bytes_read <= 0) {
+        if (slot_bytes) {
+          break;
+        }
+
+        if (*interrupt) {
+          log_printf("Transfer interrupted.");
+          close_connection();
+          return false;
+        }
+
+        delay(1);
+        continue;
+      }
+
+      slot_bytes += bytes_read;
+      bytes_left -= bytes_read;
+    }
+
+    ring_commit(slot_bytes);
+  }
+
+  stats.body_ms = millis() - body_start_ms;
+  stats.body_bytes = size;
+  return true;
+}
+
+const HttpStats* http_get_stats() {
+  return &stats;
+}
+
+const HttpValidators* http_get_validators() {
+  return &response_validators;
+}
+
+bool http_not_modified() {
+  return response_not_modified;
+}
@@ -16,10 +16,55 @@
 
 typedef bool (*http_data_callback)(const uint8_t* buffer, int bytes);
 
+// Timing and counters for the most recent fetch.  Times are in milliseconds.
+typedef struct HttpStats {
+  uint32_t header_ms;  // sending the request and reading the headers
+  uint32_t body_ms;  // reading the body, including ring_wait_ms
+  uint32_t ring_wait_ms;  // waiting on the consumer of the ring buffer
+  uint32_t short_reads;  // reads that returned less than requested
+  uint32_t body_bytes;  // body bytes received, which may be fewer than asked
+  uint32_t reconnects;  // connections opened after the first, since boot
+} HttpStats;
+
+// What identifies the version of a resource, from the ETag and Last-Modified
+// response headers.  Either may be empty.
+#define HTTP_MAX_VALIDATOR 64
+typedef struct HttpValidators {
+  char etag[HTTP_MAX_VALIDATOR];
+  char last_modified[HTTP_MAX_VALIDATOR];
+} HttpValidators;
+
 void http_init(Client* network_client);
 
+// Opens the persistent connection ahead of the first fetch, so that the fetch
+// doesn't wait on DNS and the TCP handshake.  Returns false on failure, in
+// which case the next fetch tries again.
+bool http_connect(const char* server, uint16_t port);
+
 // Reports error messages through error.h and returns false on failure
 bool http_fetch(const char* server, uint16_t port, const char* path,
                 int start_byte, int size, http_data_callback callback);
 
+// Like http_fetch, but reads the body directly into the ring buffer in
+// ring-buffer.h instead of calling back, so that another core can consume it
+// while the network read continues.  Stops early if *interrupt becomes true.
+// If next_size > 0, the request for the next fetch from the same path is sent
+// ahead of time (pipelined), and a later fetch of exactly that range skips the
+// round trip.  If validators is not NULL, the request is conditional on the
+// resource having changed since, and "304 Not Modified" succeeds with no body.
+// Reports error messages through error.h and returns false on failure
+bool http_fetch_into_ring(const char* server, uint16_t port, const char* path,
+                          int start_byte, int size,
+                          int next_start_byte, int next_size,
+                          const HttpValidators* validators,
+                          volatile bool* interrupt);
+
+// Stats for the most recent fetch.  Only valid between fetches.
+const HttpStats* http_get_stats();
+
+// Validators from the most recent response, and whether it was "304 Not
+// Modified".  Only valid between fetches.
+const HttpValidators* http_get_validators();
+bool http_not_modified();
+
 #endif // _KINETOSCOPE_HTTP_H
@@ -23,16 +23,34 @@ static int status = WL_IDLE_STATUS;
 
 static WiFiClient wifi_client;
 
-Client* internet_init_wifi(const char* ssid, const char* password,
-                           unsigned int timeout_seconds) {
+// True from internet_start_wifi() until we are done waiting on it.
+static bool started = false;
+
+void internet_start_wifi(const char* ssid, const char* password) {
   Serial.print("Attempting to connect to SSID: ");
   Serial.println(ssid);
 
   if (password && *password) {
-    WiFi.begin(ssid, password);
+    WiFi.beginNoBlock(ssid, password);
   } else {
-    WiFi.begin(ssid);
+    WiFi.beginNoBlock(ssid);
+  }
+  started = true;
+}
+
+void internet_stop_wifi() {
+  if (started) {
+    WiFi.disconnect();
+    started = false;
   }
+}
+
+Client* internet_init_wifi(const char* ssid, const char* password,
+                           unsigned int timeout_seconds) {
+  if (!started) {
+    internet_start_wifi(ssid, password);
+  }
+  started = false;
 
   long timeout_ms = timeout_seconds * 1000L;
   long start_ms = millis();
@@ -62,9 +80,14 @@ Client* internet_init_wifi(const char* ssid, const char* password,
 
 #else
 
-// Stub for boards without WiFi.
-Client* internet_init_wifi(const char* ssid, const char* password) {
+// Stubs for boards without WiFi.
+Client* internet_init_wifi(const char* ssid, const char* password,
+                           unsigned int timeout_seconds) {
   return NULL;
 }
 
+void internet_start_wifi(const char* ssid, const char* password) {}
+
+void internet_stop_wifi() {}
+
 #endif
@@ -13,9 +13,17 @@
 #ifndef _KINETOSCOPE_INTERNET_H
 
 // Password can be blank or null if there is no authentication required.
+// Waits for a connection started by internet_start_wifi(), or starts one.
 Client* internet_init_wifi(const char* ssid, const char* password,
                            unsigned int timeout_seconds);
 
+// Starts connecting to WiFi without waiting, so that it can associate while we
+// try the wired connection.
+void internet_start_wifi(const char* ssid, const char* password);
+
+// Drops a WiFi connection started above, if we don't need it after all.
+void internet_stop_wifi();
+
 Client* internet_init_wired(const uint8_t* mac, unsigned int timeout_seconds);
 
 #endif // _KINETOSCOPE_INTERNET_H
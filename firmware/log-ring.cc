@@ -0,0 +1,80 @@
+// Kinetoscope: A Sega Genesis Video Player
+//
+// Copyright (c) 2024 Joey Parrish
+//
+// See MIT License in LICENSE.txt
+
+// Firmware that runs on the microcontroller inside the cartridge.
+// The microcontroller accepts commands from the player in the Sega ROM, and
+// can stream video from the Internet to the cartridge's shared banks of SRAM.
+
+// This is a deferred log.
+
+#include <Arduino.h>
+#include <pico/platform.h>
+
+#include <cstdarg>
+#include <cstdio>
+
+#include "log-ring.h"
+
+static_assert((LOG_NUM_LINES & (LOG_NUM_LINES - 1)) == 0,
+              "LOG_NUM_LINES must be a power of two");
+
+#define LOG_LINE_MASK (LOG_NUM_LINES - 1)
+#define LOG_NUM_CORES 2
+
+// As in ring-buffer.cc, each side owns one free-running count, and the
+// release/acquire pairs hand lines over between cores.  The logging core
+// writes head and dropped, and the first core writes tail.
+typedef struct LogRing {
+  char lines[LOG_NUM_LINES][LOG_LINE_SIZE];
+  uint32_t head;
+  uint32_t tail;
+  uint32_t dropped;
+  uint32_t dropped_reported;
+} LogRing;
+
+static LogRing log_rings[LOG_NUM_CORES];
+
+void log_printf(const char* format, ...) {
+  LogRing* ring = &log_rings[get_core_num()];
+  uint32_t head = ring->head;  // Only written by this side.
+  uint32_t tail = __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE);
+  if (head - tail >= LOG_NUM_LINES) {
+    __atomic_store_n(&ring->dropped, ring->dropped + 1, __ATOMIC_RELEASE);
+    return;
+  }
+
+  va_list args;
+  va_start(args, format);
+  vsnprintf(ring->lines[head & LOG_LINE_MASK], LOG_LINE_SIZE, format, args);
+  va_end(args);
+
+  __atomic_store_n(&ring->head, head + 1, __ATOMIC_RELEASE);
+}
+
+bool log_service() {
+  for (int i = 0; i < LOG_NUM_CORES; ++i) {
+    LogRing* ring = &log_rings[i];
+
+    uint32_t dropped = __atomic_load_n(&ring->dropped, __ATOMIC_ACQUIRE);
+    if (dropped != ring->dropped_reported) {
+      Serial.print("(Dropped log messages: ");
+      Serial.print(dropped - ring->dropped_reported);
+      Serial.println(")");
+      ring->dropped_reported = dropped;
+      return true;
+    }
+
+    uint32_t tail = ring->tail;  // Only written by this side.
+    uint32_t head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+    if (head != tail) {
+      Serial.println(ring->lines[tail & LOG_LINE_MASK]);
+      __atomic_store_n(&ring->tail, tail + 1, __ATOMIC_RELEASE);
+      return true;
+    }
+  }
+
+  return false;
+}
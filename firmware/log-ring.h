@@ -0,0 +1,35 @@
+// Kinetoscope: A Sega Genesis Video Player
+//
+// Copyright (c) 2024 Joey Parrish
+//
+// See MIT License in LICENSE.txt
+
+// Firmware that runs on the microcontroller inside the cartridge.
+// The microcontroller accepts commands from the player in the Sega ROM, and
+// can stream video from the Internet to the cartridge's shared banks of SRAM.
+
+// This is a deferred log.  Writing to Serial can block for milliseconds, so
+// messages are formatted into a ring in RAM instead, and printed later by the
+// first core when it has nothing more urgent to do.  Each core has its own
+// ring, so either core can log without locks.  If a ring is full, messages
+// are dropped and counted.
+
+#ifndef _KINETOSCOPE_LOG_RING_H
+#define _KINETOSCOPE_LOG_RING_H
+
+#include <Arduino.h>
+
+// Must be a power of two.
+#define LOG_NUM_LINES 32
+// Longer messages are truncated.
+#define LOG_LINE_SIZE 128
+
+// Format a message and add it to the ring of the calling core.
+void log_printf(const char* format, ...)
+    __attribute__((format(printf, 1, 2)));
+
+// Print the oldest message waiting in either ring, if any.  Returns true if
+// something was printed.  Only call this from the first core.
+bool log_service();
+
+#endif // _KINETOSCOPE_LOG_RING_H
@@ -0,0 +1 @@
+../common/lz-common.h
\ No newline at end of file
@@ -19,6 +19,13 @@
 
 #include "fast-gpio.h"
 
+// Set by the interrupt, cleared by take_cmd().
+static volatile bool cmd_ready = false;
+
+static void on_cmd_ready() {
+  cmd_ready = true;
+}
+
 void registers_init() {
   // Set modes on register and sync pins.
   pinMode(REG_PIN__D0, INPUT_PULLDOWN);
@@ -45,12 +52,27 @@ void registers_init() {
   FAST_SET(REG_PIN__OE1);
 
   clear_cmd();
+
+  attachInterrupt(digitalPinToInterrupt(SYNC_PIN__CMD_READY), on_cmd_ready,
+                  RISING);
+  // In case the Sega sent something before the interrupt was attached.
+  cmd_ready = is_cmd_set();
 }
 
 int is_cmd_set() {
   return FAST_GET(SYNC_PIN__CMD_READY);
 }
 
+bool take_cmd() {
+  if (!cmd_ready) {
+    return false;
+  }
+
+  // No new edge can come until clear_cmd(), so this can't miss one.
+  cmd_ready = false;
+  return true;
+}
+
 void clear_cmd() {
   FAST_PULSE_ACTIVE_LOW(SYNC_PIN__CMD_CLEAR);
 }
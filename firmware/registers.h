@@ -26,15 +26,25 @@
 #define KINETOSCOPE_CMD_LIST_VIDEOS 0x01  // Writes video list to SRAM
 #define KINETOSCOPE_CMD_START_VIDEO 0x02  // Begins streaming to SRAM
 #define KINETOSCOPE_CMD_STOP_VIDEO  0x03  // Stops streaming
-#define KINETOSCOPE_CMD_FLIP_REGION 0x04  // Switch SRAM banks for streaming
+#define KINETOSCOPE_CMD_FLIP_REGION 0x04  // Next chunk, arg is its SRAM slot
 #define KINETOSCOPE_CMD_GET_ERROR   0x05  // Load error information into SRAM
 #define KINETOSCOPE_CMD_CONNECT_NET 0x06  // Connect/reconnect to the network
 #define KINETOSCOPE_CMD_MARCH_TEST  0x07  // Perform a march test on SRAM
+#define KINETOSCOPE_CMD_START_FAST  0x08  // Like START_VIDEO, after bank 0
+#define KINETOSCOPE_CMD_AWAIT_FILL  0x09  // Completes when SRAM fill is done
+#define KINETOSCOPE_CMD_SEEK        0x0A  // Seeks by arg chunks (signed)
+#define KINETOSCOPE_CMD_GET_STATS   0x0B  // Load streaming stats into SRAM
+#define KINETOSCOPE_CMD_GET_THUMB   0x0C  // Load a catalog header into bank 1
 
 void registers_init();
 
 int is_cmd_set();
 
+// Returns true once for each new command, as flagged by an interrupt on the
+// rising edge of the sync token.  The interrupt also wakes a core waiting in
+// __wfe().  The command stays set until clear_cmd().
+bool take_cmd();
+
 void clear_cmd();
 
 void flag_error();
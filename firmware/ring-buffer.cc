@@ -0,0 +1,92 @@
+// Kinetoscope: A Sega Genesis Video Player
+//
+// Copyright (c) 2024 Joey Parrish
+//
+// See MIT License in LICENSE.txt
+
+// Firmware that runs on the microcontroller inside the cartridge.
+// The microcontroller accepts commands from the player in the Sega ROM, and
+// can stream video from the Internet to the cartridge's shared banks of SRAM.
+
+// This is a ring of fixed-size buffers for passing data between cores.
+
+#include <hardware/sync.h>
+
+#include "ring-buffer.h"
+
+static_assert((RING_NUM_SLOTS & (RING_NUM_SLOTS - 1)) == 0,
+              "RING_NUM_SLOTS must be a power of two");
+
+#define RING_SLOT_MASK (RING_NUM_SLOTS - 1)
+
+static uint8_t ring_data[RING_NUM_SLOTS][RING_SLOT_SIZE];
+static int ring_bytes[RING_NUM_SLOTS];
+
+// Free-running counts of slots committed (written only by the producer) and
+// released (written only by the consumer).  The difference is the number of
+// filled slots.  The release/acquire pairs make sure slot contents are visible
+// to the other core before the index that hands them over.
+static uint32_t ring_head = 0;
+static uint32_t ring_tail = 0;
+
+// Written only by the producer, which owns the sizes of all filled slots.
+static int ring_max_bytes = 0;
+
+uint8_t* ring_write_slot() {
+  uint32_t head = ring_head;  // Only written by this side.
+  uint32_t tail = __atomic_load_n(&ring_tail, __ATOMIC_ACQUIRE);
+  if (head - tail >= RING_NUM_SLOTS) {
+    return NULL;
+  }
+  return ring_data[head & RING_SLOT_MASK];
+}
+
+void ring_commit(int bytes) {
+  uint32_t head = ring_head;
+  ring_bytes[head & RING_SLOT_MASK] = bytes;
+
+  // The consumer may release slots meanwhile, so this can overcount by what it
+  // just released.
+  uint32_t tail = __atomic_load_n(&ring_tail, __ATOMIC_ACQUIRE);
+  int filled = 0;
+  for (uint32_t i = tail; i != head + 1; ++i) {
+    filled += ring_bytes[i & RING_SLOT_MASK];
+  }
+  if (filled > ring_max_bytes) {
+    __atomic_store_n(&ring_max_bytes, filled, __ATOMIC_RELAXED);
+  }
+
+  __atomic_store_n(&ring_head, head + 1, __ATOMIC_RELEASE);
+  // Wake the consumer, if it's waiting in __wfe().
+  __sev();
+}
+
+const uint8_t* ring_read_slot(int* bytes) {
+  uint32_t tail = ring_tail;  // Only written by this side.
+  uint32_t head = __atomic_load_n(&ring_head, __ATOMIC_ACQUIRE);
+  if (head == tail) {
+    return NULL;
+  }
+  *bytes = ring_bytes[tail & RING_SLOT_MASK];
+  return ring_data[tail & RING_SLOT_MASK];
+}
+
+void ring_release() {
+  __atomic_store_n(&ring_tail, ring_tail + 1, __ATOMIC_RELEASE);
+  // Wake the producer, if it's waiting in __wfe() for a free slot.
+  __sev();
+}
+
+void ring_discard() {
+  __atomic_store_n(&ring_tail, __atomic_load_n(&ring_head, __ATOMIC_ACQUIRE),
+                   __ATOMIC_RELEASE);
+  __sev();
+}
+
+int ring_high_water() {
+  return __atomic_load_n(&ring_max_bytes, __ATOMIC_RELAXED);
+}
+
+void ring_reset_high_water() {
+  __atomic_store_n(&ring_max_bytes, 0, __ATOMIC_RELAXED);
+}
@@ -0,0 +1,55 @@
+// Kinetoscope: A Sega Genesis Video Player
+//
+// Copyright (c) 2024 Joey Parrish
+//
+// See MIT License in LICENSE.txt
+
+// Firmware that runs on the microcontroller inside the cartridge.
+// The microcontroller accepts commands from the player in the Sega ROM, and
+// can stream video from the Internet to the cartridge's shared banks of SRAM.
+
+// This is a ring of fixed-size buffers for passing data between cores.
+// There must be exactly one producer (the second core, reading from the
+// network) and one consumer (the first core, writing to SRAM).  Each side
+// owns one index, so no locks are needed.
+//
+// The ring is also the read-ahead buffer: the first chunk of the next bank is
+// fetched into it while the Sega still plays that bank.  Its size is how much
+// of a network stall it can absorb.
+
+#ifndef _KINETOSCOPE_RING_BUFFER_H
+
+#include <Arduino.h>
+
+// Must be a power of two.  Override this in EXTRA_FLAGS to trade RAM for
+// read-ahead.
+#ifndef RING_NUM_SLOTS
+# define RING_NUM_SLOTS 8
+#endif
+#define RING_SLOT_SIZE 8192
+
+// Producer: returns a free slot of RING_SLOT_SIZE bytes to fill, or NULL if
+// the ring is full.
+uint8_t* ring_write_slot();
+
+// Producer: hand the slot from ring_write_slot() to the consumer.
+void ring_commit(int bytes);
+
+// Consumer: returns the oldest filled slot and its size, or NULL if the ring
+// is empty.
+const uint8_t* ring_read_slot(int* bytes);
+
+// Consumer: return the slot from ring_read_slot() to the producer.  Wakes
+// the producer if it's waiting for a free slot.
+void ring_release();
+
+// Consumer: drop all filled slots.
+void ring_discard();
+
+// The most bytes the ring held at once, since the last reset.
+int ring_high_water();
+
+// Only while the producer is idle.
+void ring_reset_high_water();
+
+#endif // _KINETOSCOPE_RING_BUFFER_H
@@ -0,0 +1 @@
+../software/player/inc/segavideo_stats.h
\ No newline at end of file
@@ -5,10 +5,24 @@
 // See MIT License in LICENSE.txt
 
 // Microcontroller function speed tests.
+//
+// Each benchmark case runs several iterations, timed with time_us_64(), and
+// prints one line over Serial, so that results can be compared between
+// firmware builds.  For example:
+//
+//   BENCH name=gpio_pulse status=ok iterations=10 ops=1000000 bytes=0
+//       min_us=75120 median_us=75124 max_us=75131
+//
+// (All on one line.)  "ops" and "bytes" are per iteration, so ns per op is
+// median_us * 1000 / ops, and bytes per second is bytes * 1000000 / median_us.
+// A case that can't run prints "status=skipped", and a case that fails prints
+// "status=failed".  The whole run is bracketed by BENCH_BEGIN and BENCH_END.
 
 #include <Arduino.h>
 #include <HardwareSerial.h>
 
+#include <hardware/timer.h>
+
 #include "fast-gpio.h"
 #include "http.h"
 #include "registers.h"
@@ -18,12 +32,12 @@
 
 #define RLE_VIDEO   "Never%20Gonna%20Give%20You%20Up.segavideo.rle"
 
-// 3s chunk of audio+video data, at default settings, without main headers
-#define ABOUT_3S_VIDEO_AUDIO_BYTES 901376
-
 // A safe buffer size for these tests.
 #define BUFFER_SIZE 100 * 1024
 
+// The most iterations any case can run.
+#define MAX_ITERATIONS 16
+
 // Explicitly unrolled loop for 10 repeated statements.
 #define X10(a) { a; a; a; a; a;  a; a; a; a; a; }
 // Explicitly unrolled loop for 100 repeated statements.
@@ -36,50 +50,140 @@
 // (1M unrolled).
 #define X1M(a) { for (int i = 0; i < 1'000; ++i) { X1k(a); } }
 
-static long test_fast_gpio_speed() {
+// Linked from firmware.ino:
+extern bool http_sram_callback(const uint8_t* buffer, int bytes);
+extern bool http_rle_sram_callback(const uint8_t* buffer, int bytes);
+extern void http_rle_reset();
+extern bool network_connected;
+extern Client* network_client;
+
+// Runs one iteration of a benchmark.  Sets the time taken and the number of
+// bytes processed, and returns false on failure.
+typedef bool (*benchmark_function)(uint64_t* elapsed_us, uint32_t* bytes);
+
+typedef struct BenchmarkCase {
+  const char* name;
+  benchmark_function run;
+  int iterations;
+  uint32_t ops;  // operations per iteration, for per-op timing
+  bool needs_network;
+} BenchmarkCase;
+
+static bool bench_fast_gpio(uint64_t* elapsed_us, uint32_t* bytes) {
   // ~75 ns per pulse
-  long start = millis();
+  uint64_t start = time_us_64();
   X1M(FAST_PULSE_ACTIVE_LOW(SYNC_PIN__CMD_CLEAR));
-  long end = millis();
-  return end - start;
+  *elapsed_us = time_us_64() - start;
+  *bytes = 0;
+  return true;
 }
 
-static long test_sync_token_read_speed() {
+static bool bench_sync_token_read(uint64_t* elapsed_us, uint32_t* bytes) {
   // ~86 ns per read
-  long start = millis();
+  uint64_t start = time_us_64();
   X1M(is_cmd_set());
-  long end = millis();
-  return end - start;
+  *elapsed_us = time_us_64() - start;
+  *bytes = 0;
+  return true;
 }
 
-static long test_sync_token_clear_speed() {
+static bool bench_sync_token_clear(uint64_t* elapsed_us, uint32_t* bytes) {
   // ~122 ns per clear
-  long start = millis();
+  uint64_t start = time_us_64();
   X1M(clear_cmd());
-  long end = millis();
-  return end - start;
+  *elapsed_us = time_us_64() - start;
+  *bytes = 0;
+  return true;
 }
 
-static long test_register_read_speed() {
+static bool bench_register_read(uint64_t* elapsed_us, uint32_t* bytes) {
   // ~1543 ns per read
-  long start = millis();
+  uint64_t start = time_us_64();
   X1M(read_register(i & 3));
-  long end = millis();
-  return end - start;
+  *elapsed_us = time_us_64() - start;
+  *bytes = 0;
+  return true;
 }
 
-static long test_sram_speed() {
+static bool bench_sram_write(uint64_t* elapsed_us, uint32_t* bytes) {
+  // Bit-bang:
   // 100kB: ~116ms
   // 1MB: ~1160ms
   // 3s video+audio: ~1020ms
   // Rather than allocate a buffer, just write out 100kB of instructions.
-  uint8_t* buffer = (uint8_t*)main;
-  long start = millis();
+  const uint8_t* buffer = (const uint8_t*)main;
+  uint64_t start = time_us_64();
   sram_start_bank(0);
   sram_write(buffer, BUFFER_SIZE);
   sram_flush_and_release_bank();
-  long end = millis();
-  return end - start;
+  *elapsed_us = time_us_64() - start;
+  *bytes = BUFFER_SIZE;
+  return true;
+}
+
+#if defined(SRAM_USE_PIO)
+static bool bench_sram_write_bit_bang(uint64_t* elapsed_us, uint32_t* bytes) {
+  sram_set_pio_enabled(false);
+  bool ok = bench_sram_write(elapsed_us, bytes);
+  sram_set_pio_enabled(true);
+  return ok;
+}
+#endif
+
+// One input buffer's worth of RLE data for the decoder tests.
+#define RLE_TEST_BUFFER_SIZE 8192
+static uint8_t rle_test_buffer[RLE_TEST_BUFFER_SIZE];
+
+// Fills rle_test_buffer with maximum-length runs of one kind.  Returns the
+// number of input bytes used, and the number they decode to.
+static int fill_rle_test_buffer(bool repeats, int* decoded_bytes) {
+  *decoded_bytes = 0;
+  int i = 0;
+  if (repeats) {
+    // Control byte for 127 repeats, then the byte to repeat.
+    while (i + 2 <= RLE_TEST_BUFFER_SIZE) {
+      rle_test_buffer[i++] = 0xff;
+      rle_test_buffer[i++] = 0x55;
+      *decoded_bytes += 127;
+    }
+  } else {
+    // Control byte for 127 literals, then the literals.
+    while (i + 128 <= RLE_TEST_BUFFER_SIZE) {
+      rle_test_buffer[i++] = 0x7f;
+      for (int j = 0; j < 127; ++j) {
+        rle_test_buffer[i++] = j;
+      }
+      *decoded_bytes += 127;
+    }
+  }
+  return i;
+}
+
+static bool bench_rle_decode(bool repeats,
+                             uint64_t* elapsed_us, uint32_t* bytes) {
+  int decoded_bytes;
+  int input_bytes = fill_rle_test_buffer(repeats, &decoded_bytes);
+  // Decode about as much data as bench_sram_write writes.
+  int passes = BUFFER_SIZE / decoded_bytes;
+
+  http_rle_reset();
+  uint64_t start = time_us_64();
+  sram_start_bank(0);
+  for (int i = 0; i < passes; ++i) {
+    http_rle_sram_callback(rle_test_buffer, input_bytes);
+  }
+  sram_flush_and_release_bank();
+  *elapsed_us = time_us_64() - start;
+  *bytes = passes * decoded_bytes;
+  return true;
+}
+
+static bool bench_rle_decode_literals(uint64_t* elapsed_us, uint32_t* bytes) {
+  return bench_rle_decode(/* repeats= */ false, elapsed_us, bytes);
+}
+
+static bool bench_rle_decode_repeats(uint64_t* elapsed_us, uint32_t* bytes) {
+  return bench_rle_decode(/* repeats= */ true, elapsed_us, bytes);
 }
 
 static uint8_t* http_local_buffer = NULL;
@@ -89,93 +193,271 @@ static bool http_local_buffer_callback(const uint8_t* buffer, int bytes) {
   return true;
 }
 
-// Linked from firmware.ino:
-extern bool http_sram_callback(const uint8_t* buffer, int bytes);
-extern bool http_rle_sram_callback(const uint8_t* buffer, int bytes);
-extern void http_rle_reset();
-extern bool network_connected;
+// The first chunk of RLE_VIDEO, found by fetch_first_chunk_location().
+static int first_chunk_offset = 0;
+static int first_chunk_size = 0;
 
-static long test_rle_download_speed(int offset, int size) {
-  // (Effective) 2.5Mbps minimum required
-  // (Effective) ~5.1 Mbps (after decompression)
-  http_rle_reset();
-  long start = millis();
-  sram_start_bank(0);
+static bool fetch_first_chunk_location() {
+  if (first_chunk_size) {
+    return true;
+  }
+
+  uint32_t minimal_index[2];
+  http_local_buffer = (uint8_t*)minimal_index;
   if (!http_fetch(VIDEO_SERVER,
                   VIDEO_SERVER_PORT,
                   VIDEO_SERVER_BASE_PATH RLE_VIDEO,
-                  offset,
-                  size,
-                  http_rle_sram_callback)) {
-    Serial.println("Fetch failed!");
+                  sizeof(SegaVideoHeader),
+                  sizeof(minimal_index),
+                  http_local_buffer_callback)) {
+    return false;
   }
-  sram_flush_and_release_bank();
-  long end = millis();
-  return end - start;
-}
-
-void run_tests() {
-  long ms;
 
-  ms = test_fast_gpio_speed();
-  Serial.print(ms);
-  Serial.println(" ns avg per GPIO pulse.");  // 1Mx pulses, ms => ns
-
-  ms = test_sync_token_read_speed();
-  Serial.print(ms);
-  Serial.println(" ns avg per sync token read.");  // 1Mx reads, ms => ns
+  // The first entry is where the chunks start, whatever the index size.
+  first_chunk_offset = ntohl(minimal_index[0]);
+  first_chunk_size = ntohl(minimal_index[1]) - ntohl(minimal_index[0]);
+  return true;
+}
 
-  ms = test_sync_token_clear_speed();
-  Serial.print(ms);
-  Serial.println(" ns avg per sync token clear.");  // 1Mx reads, ms => ns
+// A compressed chunk is too big to keep in RAM, so the real-data decoder test
+// uses the beginning of one.  Unlike the synthetic tests, this is a realistic
+// mix of runs and literals.
+#define RLE_SAMPLE_SIZE (16 * 1024)
+static uint8_t rle_sample_buffer[RLE_SAMPLE_SIZE];
+static int rle_sample_size = 0;
+static int rle_sample_decoded_size = 0;
 
-  ms = test_register_read_speed();
-  Serial.print(ms);
-  Serial.println(" ns avg per register read.");  // 1Mx reads, ms => ns
+// Count the decoded size of the sample without writing it anywhere.
+static int count_rle_decoded_size(const uint8_t* buffer, int bytes) {
+  int decoded = 0;
+  int i = 0;
+  while (i < bytes) {
+    uint8_t control = buffer[i++];
+    int count = control & 0x7f;
+    if (control & 0x80) {
+      i += 1;
+    } else {
+      // The sample may end partway through the literals.
+      count = min(count, bytes - i);
+      i += count;
+    }
+    decoded += count;
+  }
+  return decoded;
+}
 
-  ms = test_sram_speed();
-  Serial.print(ms);
-  Serial.print(" ms to write ");
-  Serial.print(BUFFER_SIZE);
-  Serial.println(" bytes to SRAM");
+static bool bench_rle_decode_real(uint64_t* elapsed_us, uint32_t* bytes) {
+  if (!rle_sample_size) {
+    if (!fetch_first_chunk_location()) {
+      return false;
+    }
 
-  if (!network_connected) {
-    Serial.println("No network, skipping network tests.");
-  } else {
-    Serial.println("Beginning RLE network tests.");
-    uint32_t minimal_index[2];
-    http_local_buffer = (uint8_t*)minimal_index;
+    rle_sample_size = min(first_chunk_size, RLE_SAMPLE_SIZE);
+    http_local_buffer = rle_sample_buffer;
     if (!http_fetch(VIDEO_SERVER,
                     VIDEO_SERVER_PORT,
                     VIDEO_SERVER_BASE_PATH RLE_VIDEO,
-                    sizeof(SegaVideoHeader),
-                    sizeof(minimal_index),
+                    first_chunk_offset,
+                    rle_sample_size,
                     http_local_buffer_callback)) {
-      Serial.println("Index fetch failed!");
-      return;
+      rle_sample_size = 0;
+      return false;
     }
+    rle_sample_decoded_size =
+        count_rle_decoded_size(rle_sample_buffer, rle_sample_size);
+  }
+
+  // Decode about as much data as bench_sram_write writes.  The sample may
+  // end in the middle of a run, so reset the decoder on each pass.
+  int passes = max(1, BUFFER_SIZE / rle_sample_decoded_size);
+
+  uint64_t start = time_us_64();
+  sram_start_bank(0);
+  for (int i = 0; i < passes; ++i) {
+    http_rle_reset();
+    http_rle_sram_callback(rle_sample_buffer, rle_sample_size);
+  }
+  sram_flush_and_release_bank();
+  *elapsed_us = time_us_64() - start;
+  *bytes = passes * rle_sample_decoded_size;
+  return true;
+}
+
+// A Client that answers every request with the same canned response, so that
+// HTTP request formatting and response header parsing can be timed without
+// the network.
+static const char canned_response[] =
+    "HTTP/1.1 206 Partial Content\r\n"
+    "Server: SimpleHTTP/0.6 Python/3.11.2\r\n"
+    "Date: Mon, 01 Jan 2024 00:00:00 GMT\r\n"
+    "Content-Type: application/octet-stream\r\n"
+    "Content-Range: bytes 0-15/1048576\r\n"
+    "Content-Length: 16\r\n"
+    "Last-Modified: Mon, 01 Jan 2024 00:00:00 GMT\r\n"
+    "Connection: keep-alive\r\n"
+    "\r\n"
+    "0123456789abcdef";
 
-    int offset = sizeof(SegaVideoHeader) + sizeof(SegaVideoIndex);
-    int compressed_chunk_size =
-        ntohl(minimal_index[1]) - ntohl(minimal_index[0]);
-    Serial.print("Detected compressed chunk size: ");
-    Serial.println(compressed_chunk_size);
-
-    for (int i = 0; i < 10; i++) {
-      ms = test_rle_download_speed(offset, compressed_chunk_size);
-      float compressed_bits = compressed_chunk_size * 8.0;
-      float final_bits = ABOUT_3S_VIDEO_AUDIO_BYTES * 8.0;
-      float seconds = ms / 1000.0;
-      float mbps = compressed_bits / seconds / 1024.0 / 1024.0;
-      float effective_mbps = final_bits / seconds / 1024.0 / 1024.0;
-      Serial.print(ms);
-      Serial.print(" ms to stream ~3s RLE video to SRAM (");
-      Serial.print(mbps);
-      Serial.print(" Mbps, effectively ");
-      Serial.print(effective_mbps);
-      Serial.println(" Mbps vs 2.50 Mbps minimum)");
+class CannedResponseClient : public Client {
+ public:
+  virtual int connect(IPAddress ip, uint16_t port) { return reset(); }
+  virtual int connect(const char* host, uint16_t port) { return reset(); }
+  // Each request starts the response over.
+  virtual size_t write(uint8_t byte) { reset(); return 1; }
+  virtual size_t write(const uint8_t* buffer, size_t size) {
+    reset();
+    return size;
+  }
+  virtual int available() { return sizeof(canned_response) - 1 - position; }
+  virtual int read() {
+    return available() ? (uint8_t)canned_response[position++] : -1;
+  }
+  virtual int read(uint8_t* buffer, size_t size) {
+    int bytes = min((int)size, available());
+    memcpy(buffer, canned_response + position, bytes);
+    position += bytes;
+    return bytes;
+  }
+  virtual int peek() {
+    return available() ? (uint8_t)canned_response[position] : -1;
+  }
+  virtual void flush() {}
+  virtual void stop() {}
+  virtual uint8_t connected() { return 1; }
+  virtual operator bool() { return true; }
+
+ private:
+  int position = 0;
+
+  int reset() {
+    position = 0;
+    return 1;
+  }
+};
+
+static CannedResponseClient canned_response_client;
+
+// Discards the body.
+static bool http_discard_callback(const uint8_t* buffer, int bytes) {
+  return true;
+}
+
+static bool bench_http_header_parse(uint64_t* elapsed_us, uint32_t* bytes) {
+  http_init(&canned_response_client);
+  bool ok = true;
+  uint64_t start = time_us_64();
+  for (int i = 0; ok && i < 100; ++i) {
+    ok = http_fetch("canned.local", 80, "/canned", 0, 16,
+                    http_discard_callback);
+  }
+  *elapsed_us = time_us_64() - start;
+  *bytes = 100 * (sizeof(canned_response) - 1);
+  // Put back the real network client.
+  http_init(network_client);
+  return ok;
+}
+
+static bool bench_rle_chunk_fetch(uint64_t* elapsed_us, uint32_t* bytes) {
+  // (Effective) 2.5Mbps minimum required
+  // (Effective) ~5.1 Mbps (after decompression)
+  if (!fetch_first_chunk_location()) {
+    return false;
+  }
+
+  http_rle_reset();
+  uint64_t start = time_us_64();
+  sram_start_bank(0);
+  bool ok = http_fetch(VIDEO_SERVER,
+                       VIDEO_SERVER_PORT,
+                       VIDEO_SERVER_BASE_PATH RLE_VIDEO,
+                       first_chunk_offset,
+                       first_chunk_size,
+                       http_rle_sram_callback);
+  sram_flush_and_release_bank();
+  *elapsed_us = time_us_64() - start;
+  // Report network bytes.  The effective rate after decompression is about
+  // twice this.
+  *bytes = first_chunk_size;
+  return ok;
+}
+
+static const BenchmarkCase benchmark_cases[] = {
+  { "gpio_pulse", bench_fast_gpio, 10, 1'000'000, false },
+  { "sync_token_read", bench_sync_token_read, 10, 1'000'000, false },
+  { "sync_token_clear", bench_sync_token_clear, 10, 1'000'000, false },
+  { "register_read", bench_register_read, 10, 1'000'000, false },
+#if defined(SRAM_USE_PIO)
+  { "sram_write_bit_bang", bench_sram_write_bit_bang, 10, 1, false },
+  { "sram_write_pio", bench_sram_write, 10, 1, false },
+#else
+  { "sram_write_bit_bang", bench_sram_write, 10, 1, false },
+#endif
+  // Long runs should decode much faster than literals.
+  { "rle_decode_literals", bench_rle_decode_literals, 10, 1, false },
+  { "rle_decode_repeats", bench_rle_decode_repeats, 10, 1, false },
+  { "http_header_parse", bench_http_header_parse, 10, 100, false },
+  { "rle_decode_real", bench_rle_decode_real, 10, 1, true },
+  { "rle_chunk_fetch", bench_rle_chunk_fetch, 5, 1, true },
+};
+
+static void sort_samples(uint64_t* samples, int count) {
+  // Insertion sort.  There are only a handful.
+  for (int i = 1; i < count; ++i) {
+    uint64_t value = samples[i];
+    int j = i - 1;
+    for (; j >= 0 && samples[j] > value; --j) {
+      samples[j + 1] = samples[j];
+    }
+    samples[j + 1] = value;
+  }
+}
+
+static void print_field(const char* name, uint64_t value) {
+  Serial.print(" ");
+  Serial.print(name);
+  Serial.print("=");
+  Serial.print((unsigned long)value);
+}
+
+static void run_benchmark(const BenchmarkCase* bench) {
+  Serial.print("BENCH name=");
+  Serial.print(bench->name);
+
+  if (bench->needs_network && !network_connected) {
+    Serial.println(" status=skipped reason=no_network");
+    return;
+  }
+
+  uint64_t samples[MAX_ITERATIONS];
+  int iterations = min(bench->iterations, MAX_ITERATIONS);
+  uint32_t bytes = 0;
+  for (int i = 0; i < iterations; ++i) {
+    if (!bench->run(&samples[i], &bytes)) {
+      Serial.print(" status=failed iteration=");
+      Serial.println(i);
+      return;
     }
   }
 
-  Serial.println("\n");
+  sort_samples(samples, iterations);
+
+  Serial.print(" status=ok");
+  print_field("iterations", iterations);
+  print_field("ops", bench->ops);
+  print_field("bytes", bytes);
+  print_field("min_us", samples[0]);
+  print_field("median_us", samples[iterations / 2]);
+  print_field("max_us", samples[iterations - 1]);
+  Serial.println();
+}
+
+void run_tests() {
+  Serial.println("BENCH_BEGIN");
+
+  int num_cases = sizeof(benchmark_cases) / sizeof(benchmark_cases[0]);
+  for (int i = 0; i < num_cases; ++i) {
+    run_benchmark(&benchmark_cases[i]);
+  }
+
+  Serial.println("BENCH_END\n");
 }
@@ -13,6 +13,25 @@
 #include "fast-gpio.h"
 #include "sram.h"
 
+#if defined(SRAM_USE_PIO)
+# include <hardware/dma.h>
+# include <hardware/gpio.h>
+# include <hardware/pio.h>
+
+# include "sram.pio.h"
+
+// The PIO program drives these with SET, so they must be consecutive.
+static_assert(SRAM_PIN__DATA_NEXT_BIT == SRAM_PIN__ADDR_CLOCK + 1,
+              "PIO SET pins must be consecutive");
+static_assert(SRAM_PIN__DATA_CLOCK == SRAM_PIN__ADDR_CLOCK + 2,
+              "PIO SET pins must be consecutive");
+
+// Writes smaller than this go straight into the FIFO from the CPU, since
+// setting up DMA costs more than it saves.  The RLE decoder makes many of
+// these.
+# define SRAM_PIO_MIN_DMA_BYTES 32
+#endif
+
 // Macros to complete sram_march_test in sram-common.h
 #define SRAM_MARCH_TEST_START(bank) sram_start_bank(bank)
 #define SRAM_MARCH_TEST_DATA(offset, data) sram_write(&data, 1)
@@ -24,6 +43,21 @@
 static int leftover = -1;
 static int active_bank_pin = -1;
 
+#if defined(SRAM_USE_PIO)
+static PIO sram_pio = NULL;
+static uint sram_sm = 0;
+static int sram_dma_channel = -1;
+// Copies a buffer, or repeats a single byte (sram_dma_fill_byte).
+static dma_channel_config sram_dma_copy_config;
+static dma_channel_config sram_dma_fill_config;
+static uint8_t sram_dma_fill_byte = 0;
+static bool pio_enabled = false;
+
+// True if an odd number of bytes has gone to the state machine, which is then
+// waiting mid-word for the next byte.  This is the PIO version of "leftover".
+static bool pio_odd_byte = false;
+#endif
+
 // Explicitly unrolled loop for 16 bits of data.
 #define X16(a) { a; a; a; a; a; a; a; a; a; a; a; a; a; a; a; a; }
 static inline void sram_write_word(uint16_t word_data) {
@@ -46,6 +80,169 @@ static inline void sram_write_word(uint16_t word_data) {
   FAST_PULSE_ACTIVE_HIGH(SRAM_PIN__ADDR_CLOCK);
 }
 
+#if defined(SRAM_USE_PIO)
+static bool sram_pio_claim(PIO pio) {
+  if (!pio_can_add_program(pio, &sram_shifter_program)) {
+    return false;
+  }
+
+  int sm = pio_claim_unused_sm(pio, /* required= */ false);
+  if (sm < 0) {
+    return false;
+  }
+
+  sram_pio = pio;
+  sram_sm = sm;
+  return true;
+}
+
+static void sram_pio_init() {
+  // The WiFi chip may already be using one of these.
+  if (!sram_pio_claim(pio0) && !sram_pio_claim(pio1)) {
+    Serial.println("No PIO available for SRAM!  Falling back to bit-bang.");
+    sram_pio = NULL;
+    return;
+  }
+
+  uint offset = pio_add_program(sram_pio, &sram_shifter_program);
+  pio_sm_config c = sram_shifter_program_get_default_config(offset);
+  sm_config_set_set_pins(&c, SRAM_PIN__ADDR_CLOCK, 3);
+  sm_config_set_sideset_pins(&c, SRAM_PIN__DATA_WRITE);
+  // MSB first, autopull each byte.
+  sm_config_set_out_shift(&c, /* shift_right= */ false,
+                          /* autopull= */ true, /* pull_threshold= */ 8);
+  sm_config_set_fifo_join(&c, PIO_FIFO_JOIN_TX);
+  // Full speed.  Pulse widths are set by delays in the program.
+  sm_config_set_clkdiv(&c, 1.0);
+
+  // Same idle state as the bit-bang path: write (active low) disabled, the
+  // rest low.
+  uint32_t pin_mask = (1u << SRAM_PIN__ADDR_CLOCK) |
+                      (1u << SRAM_PIN__DATA_NEXT_BIT) |
+                      (1u << SRAM_PIN__DATA_CLOCK) |
+                      (1u << SRAM_PIN__DATA_WRITE);
+  pio_sm_set_pins_with_mask(sram_pio, sram_sm,
+                            1u << SRAM_PIN__DATA_WRITE, pin_mask);
+  pio_sm_set_pindirs_with_mask(sram_pio, sram_sm, pin_mask, pin_mask);
+  pio_sm_init(sram_pio, sram_sm, offset, &c);
+
+  sram_dma_channel = dma_claim_unused_channel(/* required= */ true);
+  dma_channel_config dc = dma_channel_get_default_config(sram_dma_channel);
+  channel_config_set_transfer_data_size(&dc, DMA_SIZE_8);
+  channel_config_set_read_increment(&dc, true);
+  channel_config_set_write_increment(&dc, false);
+  channel_config_set_dreq(&dc, pio_get_dreq(sram_pio, sram_sm, true));
+  sram_dma_copy_config = dc;
+
+  channel_config_set_read_increment(&dc, false);
+  sram_dma_fill_config = dc;
+}
+
+// Byte-wide writes to the FIFO are replicated across all 32 bits, so the state
+// machine sees each byte in the top byte, the same as pio_sm_put(byte << 24).
+static void sram_pio_dma(const dma_channel_config* config,
+                         const uint8_t *data, int num_bytes) {
+  dma_channel_configure(sram_dma_channel, config,
+                        &sram_pio->txf[sram_sm],
+                        data,
+                        num_bytes,
+                        true);  // start now
+  // The caller may reuse the buffer as soon as we return.  The state machine
+  // is the bottleneck here, so this mostly waits on the last few bytes in the
+  // FIFO.
+  dma_channel_wait_for_finish_blocking(sram_dma_channel);
+
+  if (num_bytes & 1) {
+    pio_odd_byte = !pio_odd_byte;
+  }
+}
+
+static void sram_pio_write(const uint8_t *data, int num_bytes) {
+  if (num_bytes >= SRAM_PIO_MIN_DMA_BYTES) {
+    sram_pio_dma(&sram_dma_copy_config, data, num_bytes);
+    return;
+  }
+
+  for (int i = 0; i < num_bytes; ++i) {
+    // With a left shift, the state machine reads from the top byte.
+    pio_sm_put_blocking(sram_pio, sram_sm, ((uint32_t)data[i]) << 24);
+  }
+
+  if (num_bytes & 1) {
+    pio_odd_byte = !pio_odd_byte;
+  }
+}
+
+static void sram_pio_fill(uint8_t data, int num_bytes) {
+  if (num_bytes >= SRAM_PIO_MIN_DMA_BYTES) {
+    // A DMA repeat, reading the same byte every time.
+    sram_dma_fill_byte = data;
+    sram_pio_dma(&sram_dma_fill_config, &sram_dma_fill_byte, num_bytes);
+    return;
+  }
+
+  uint32_t fifo_data = ((uint32_t)data) << 24;
+  for (int i = 0; i < num_bytes; ++i) {
+    pio_sm_put_blocking(sram_pio, sram_sm, fifo_data);
+  }
+
+  if (num_bytes & 1) {
+    pio_odd_byte = !pio_odd_byte;
+  }
+}
+
+// Wait for the state machine to finish the last word and go idle.
+static void sram_pio_drain() {
+  if (pio_odd_byte) {
+    // Pad out the last word, as the bit-bang path does.
+    pio_sm_put_blocking(sram_pio, sram_sm, 0);
+    pio_odd_byte = false;
+  }
+
+  while (!pio_sm_is_tx_fifo_empty(sram_pio, sram_sm)) {}
+
+  // The stall flag is set once the state machine is waiting on an empty FIFO
+  // again, after it has finished writing the word.
+  uint32_t stall_mask = 1u << (PIO_FDEBUG_TXSTALL_LSB + sram_sm);
+  sram_pio->fdebug = stall_mask;
+  while (!(sram_pio->fdebug & stall_mask)) {}
+}
+
+void sram_set_pio_enabled(bool enabled) {
+  if (!sram_pio || enabled == pio_enabled) {
+    return;
+  }
+
+  sram_flush_and_release_bank();
+
+  const int pins[] = {
+    SRAM_PIN__ADDR_CLOCK,
+    SRAM_PIN__DATA_NEXT_BIT,
+    SRAM_PIN__DATA_CLOCK,
+    SRAM_PIN__DATA_WRITE,
+  };
+
+  if (enabled) {
+    for (int pin : pins) {
+      pio_gpio_init(sram_pio, pin);
+    }
+    pio_sm_set_enabled(sram_pio, sram_sm, true);
+  } else {
+    pio_sm_set_enabled(sram_pio, sram_sm, false);
+    // Idle states are the same in both paths, so this is glitch-free.
+    FAST_SET(SRAM_PIN__DATA_WRITE);
+    FAST_CLEAR(SRAM_PIN__ADDR_CLOCK);
+    FAST_CLEAR(SRAM_PIN__DATA_NEXT_BIT);
+    FAST_CLEAR(SRAM_PIN__DATA_CLOCK);
+    for (int pin : pins) {
+      gpio_set_function(pin, GPIO_FUNC_SIO);
+    }
+  }
+
+  pio_enabled = enabled;
+}
+#endif
+
 void sram_init() {
   // Set output modes on all SRAM pins.
   pinMode(SRAM_PIN__WRITE_BANK_0, OUTPUT);
@@ -68,6 +265,11 @@ void sram_init() {
   FAST_CLEAR(SRAM_PIN__DATA_CLOCK);
 
   leftover = -1;
+
+#if defined(SRAM_USE_PIO)
+  sram_pio_init();
+  sram_set_pio_enabled(true);
+#endif
 }
 
 void sram_start_bank(int bank) {
@@ -87,6 +289,13 @@ void sram_write(const uint8_t *data, int num_bytes) {
     return;
   }
 
+#if defined(SRAM_USE_PIO)
+  if (pio_enabled) {
+    sram_pio_write(data, num_bytes);
+    return;
+  }
+#endif
+
   int i = 0;
 
   if (leftover >= 0) {
@@ -106,8 +315,46 @@ void sram_write(const uint8_t *data, int num_bytes) {
   }
 }
 
+void sram_fill(uint8_t data, int num_bytes) {
+  if (num_bytes == 0) {
+    return;
+  }
+
+#if defined(SRAM_USE_PIO)
+  if (pio_enabled) {
+    sram_pio_fill(data, num_bytes);
+    return;
+  }
+#endif
+
+  int i = 0;
+
+  if (leftover >= 0) {
+    uint16_t word = MAKE_WORD(leftover, data);
+    sram_write_word(word);
+    i++;
+    leftover = -1;
+  }
+
+  // Every whole word is the same, so build it once.
+  uint16_t word = MAKE_WORD(data, data);
+  for (; i < num_bytes - 1; i += 2) {
+    sram_write_word(word);
+  }
+
+  if (i == num_bytes - 1) {
+    leftover = data;
+  }
+}
+
 void sram_flush_and_release_bank() {
   if (active_bank_pin >= 0) {
+#if defined(SRAM_USE_PIO)
+    if (pio_enabled) {
+      sram_pio_drain();
+    }
+#endif
+
     if (leftover >= 0) {
       uint16_t word = MAKE_WORD(leftover, 0);
       sram_write_word(word);
@@ -12,9 +12,20 @@
 
 #ifndef _KINETOSCOPE_SRAM_H
 
+// Write to SRAM with a PIO state machine fed by DMA.  Comment this out to
+// fall back to bit-banging GPIOs from the CPU.  The host build has no PIO.
+#if defined(ARDUINO_ARCH_RP2040)
+# define SRAM_USE_PIO
+#endif
+
+// Same as in sram-common.h, which only sram.cc can include.
+#define SRAM_BANK_SIZE_BYTES (1 << 20)
+
 void sram_init();
 void sram_start_bank(int bank);
 void sram_write(const uint8_t *data, int num_bytes);
+// Equivalent to writing num_bytes copies of data, but faster.
+void sram_fill(uint8_t data, int num_bytes);
 void sram_flush_and_release_bank();
 
 // Always returns true.  Only returns anything at all because the definition
@@ -22,4 +33,10 @@ void sram_flush_and_release_bank();
 // if the test fails.
 bool sram_march_test(int pass);
 
+#if defined(SRAM_USE_PIO)
+// Switch between the PIO and bit-bang paths at runtime, so that they can be
+// compared in speed tests.  The PIO path is enabled by sram_init().
+void sram_set_pio_enabled(bool enabled);
+#endif
+
 #endif // _KINETOSCOPE_SRAM_H
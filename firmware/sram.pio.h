@@ -0,0 +1,50 @@
+// -------------------------------------------------- //
+// This file is autogenerated by pioasm; do not edit! //
+// -------------------------------------------------- //
+
+#pragma once
+
+#if !PICO_NO_HARDWARE
+#include "hardware/pio.h"
+#endif
+
+// ------------ //
+// sram_shifter //
+// ------------ //
+
+#define sram_shifter_wrap_target 0
+#define sram_shifter_wrap 13
+
+static const uint16_t sram_shifter_program_instructions[] = {
+            //     .wrap_target
+    0xe04f, //  0: set    y, 15
+    0x6021, //  1: out    x, 1
+    0x0027, //  2: jmp    !x, 7
+    0xe102, //  3: set    pins, 2                [1]
+    0xe106, //  4: set    pins, 6                [1]
+    0x0081, //  5: jmp    y--, 1
+    0x000a, //  6: jmp    10
+    0xe100, //  7: set    pins, 0                [1]
+    0xe104, //  8: set    pins, 4                [1]
+    0x0081, //  9: jmp    y--, 1
+    0xf600, // 10: set    pins, 0         side 0 [6]
+    0xb942, // 11: nop                    side 1 [1]
+    0xe101, // 12: set    pins, 1                [1]
+    0xe000, // 13: set    pins, 0
+            //     .wrap
+};
+
+#if !PICO_NO_HARDWARE
+static const struct pio_program sram_shifter_program = {
+    .instructions = sram_shifter_program_instructions,
+    .length = 14,
+    .origin = -1,
+};
+
+static inline pio_sm_config sram_shifter_program_get_default_config(uint offset) {
+    pio_sm_config c = pio_get_default_sm_config();
+    sm_config_set_wrap(&c, offset + sram_shifter_wrap_target, offset + sram_shifter_wrap);
+    sm_config_set_sideset(&c, 2, true, false);
+    return c;
+}
+#endif
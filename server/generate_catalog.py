@@ -10,7 +10,8 @@
 
 Usage: python3 generate_catalog.py *.segavideo
 
-Output will be in catalog.bin, which is the required filename for your server.
+Output will be in catalog.bin and catalog.idx, which are the required filenames
+for your server.
 
 See also ../encoder/encode_sega_video.py
 """
@@ -20,15 +21,59 @@ import sys
 import urllib.parse
 
 
-def get_video_header(path):
+# Renditions are numbered from 1 and stored in one digit by the firmware.
+MAX_RENDITIONS = 9
+
+HEADER_SIZE = 8192
+MAGIC = b"what nintendon't"
+CATALOG_INDEX_FORMAT = 1
+# Titles in the catalog index, including the nul terminator.
+INDEX_TITLE_SIZE = 32
+
+
+def read_header(path):
   with open(path, 'rb') as f:
-    header = f.read(8192)
-  assert len(header) == 8192
+    header = f.read(HEADER_SIZE)
+  assert len(header) == HEADER_SIZE
+  return header
+
+
+def count_renditions(path, header):
+  # Lighter renditions of the same video are stored next to it as path + ".1",
+  # ".2", etc.  To switch between them seamlessly, everything about their
+  # timing and compression must match.
+  count = 0
+  while count < MAX_RENDITIONS:
+    rendition_path = '{}.{}'.format(path, count + 1)
+    if not os.path.exists(rendition_path):
+      break
+
+    rendition_header = read_header(rendition_path)
+    # Format, fps, sample rate, frame count, sample count, chunk size and
+    # chunk count, then compression.
+    if (rendition_header[16:38] != header[16:38] or
+        rendition_header[294:296] != header[294:296]):
+      raise RuntimeError('Rendition {} does not match {}!'.format(
+          rendition_path, path))
+
+    count += 1
+
+  return count
+
+
+def get_video_header(path):
+  header = read_header(path)
 
   # The header parts before and after the relative_url field.
   first_part = header[0:(38+128)]
   last_part = header[(38+128+128):]
 
+  # Record the renditions found next to this video.
+  renditions = count_renditions(path, header)
+  if renditions:
+    print('  with {} rendition(s)'.format(renditions))
+  last_part = last_part[0:2] + renditions.to_bytes(2, 'big') + last_part[4:]
+
   # Compute the relative URL.
   relative_url = os.path.relpath(path)
   if relative_url[0:2] == '..':
@@ -46,19 +91,40 @@ def get_video_header(path):
   return first_part + relative_url + last_part
 
 
+def get_index_entry(header, offset):
+  # The title, truncated with room for a terminator.
+  title = header[38:(38+128)].split(b'\0')[0][0:(INDEX_TITLE_SIZE - 1)]
+  title = (title + bytes(INDEX_TITLE_SIZE))[0:INDEX_TITLE_SIZE]
+
+  sample_rate = int.from_bytes(header[20:22], 'big')
+  total_samples = int.from_bytes(header[26:30], 'big')
+  duration = total_samples // sample_rate if sample_rate else 0
+
+  return title + duration.to_bytes(4, 'big') + offset.to_bytes(4, 'big')
+
+
 def main(paths):
   if len(paths) > 127:
     raise RuntimeError('No more than 127 videos can fit in a catalog.')
 
+  # The index is small enough to build up in memory.
+  index = (MAGIC + CATALOG_INDEX_FORMAT.to_bytes(2, 'big') +
+           len(paths).to_bytes(2, 'big'))
+
   with open('catalog.bin', 'wb') as f:
     for path in paths:
       print('Processing', path)
-      f.write(get_video_header(path))
+      header = get_video_header(path)
+      index += get_index_entry(header, f.tell())
+      f.write(header)
 
     # End the catalog with a blank header.
-    f.write(bytes(8192))
+    f.write(bytes(HEADER_SIZE))
+
+  with open('catalog.idx', 'wb') as f:
+    f.write(index)
 
-  print('Generated catalog.bin')
+  print('Generated catalog.bin and catalog.idx')
 
 
 if __name__ == '__main__':
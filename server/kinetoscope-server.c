@@ -0,0 +1,628 @@
+// Kinetoscope: A Sega Genesis Video Player
+//
+// Copyright (c) 2024 Joey Parrish
+//
+// See MIT License in LICENSE.txt
+
+// A small native video server, tuned for the way the firmware fetches.
+//
+//   kinetoscope-server [-p PORT] [-b BASE_PATH] FOLDER
+//
+// Serves every file under FOLDER at BASE_PATH (default "/") over plain HTTP on
+// PORT (default 8080).  Set BASE_PATH to match VIDEO_SERVER_BASE_PATH in
+// common/video-server.h.
+//
+// Every file is opened and measured once at startup, so each response has its
+// Content-Length without touching the disk, and the body goes straight from
+// the page cache to the socket with sendfile().  A Range request always gets
+// "206 Partial Content", even when the range covers the whole file.  Each
+// connection is kept alive, and pipelined requests are answered in order.
+// Restart the server after adding or replacing files.  A file that grows, as a
+// live video does while it is encoded, is measured again whenever a range
+// reaches past its end, and its modification time is updated with it.
+//
+// Each response carries an ETag and Last-Modified, and a request with a
+// matching If-None-Match or If-Modified-Since gets "304 Not Modified", so the
+// firmware can revalidate what it keeps in flash.
+//
+// Each response and each closed connection is logged with its throughput.
+//
+// Linux only.  Build with "make build" in this folder.
+
+#define _GNU_SOURCE
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/sendfile.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#define DEFAULT_PORT 8080
+#define MAX_PATH 1024
+#define MAX_REQUEST_BYTES 8192
+// Idle keep-alive connections are closed after this long.
+#define IDLE_TIMEOUT_SECONDS 60
+
+typedef struct ServedFile {
+  char url_path[MAX_PATH];
+  int fd;
+  off_t size;
+  time_t mtime;
+} ServedFile;
+
+static ServedFile* files = NULL;
+static int num_files = 0;
+static int files_capacity = 0;
+
+typedef struct Connection {
+  int fd;
+  char peer[64];
+} Connection;
+
+static uint64_t now_us() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static double mbps(uint64_t bytes, uint64_t us) {
+  return us ? bytes * 8.0 / us : 0;
+}
+
+static void add_file(const char* url_path, const char* disk_path) {
+  int fd = open(disk_path, O_RDONLY);
+  struct stat st;
+  if (fd < 0 || fstat(fd, &st)) {
+    perror(disk_path);
+    if (fd >= 0) {
+      close(fd);
+    }
+    return;
+  }
+
+  if (num_files == files_capacity) {
+    files_capacity = files_capacity ? files_capacity * 2 : 64;
+    files = realloc(files, files_capacity * sizeof(ServedFile));
+  }
+
+  ServedFile* file = &files[num_files++];
+  snprintf(file->url_path, sizeof(file->url_path), "%s", url_path);
+  file->fd = fd;
+  file->size = st.st_size;
+  file->mtime = st.st_mtime;
+  // The whole file will be read, in order, by someone.
+  posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+}
+
+static void scan_folder(const char* url_path, const char* disk_path) {
+  DIR* dir = opendir(disk_path);
+  if (!dir) {
+    perror(disk_path);
+    return;
+  }
+
+  struct dirent* entry;
+  while ((entry = readdir(dir)) != NULL) {
+    if (entry->d_name[0] == '.') {
+      continue;
+    }
+
+    char child_url[MAX_PATH];
+    char child_disk[MAX_PATH];
+    snprintf(child_url, sizeof(child_url), "%s%s", url_path, entry->d_name);
+    snprintf(child_disk, sizeof(child_disk), "%s/%s", disk_path,
+             entry->d_name);
+
+    struct stat st;
+    if (stat(child_disk, &st)) {
+      continue;
+    }
+    if (S_ISDIR(st.st_mode)) {
+      strncat(child_url, "/", sizeof(child_url) - strlen(child_url) - 1);
+      scan_folder(child_url, child_disk);
+    } else if (S_ISREG(st.st_mode)) {
+      add_file(child_url, child_disk);
+    }
+  }
+  closedir(dir);
+}
+
+static int compare_files(const void* a, const void* b) {
+  return strcmp(((const ServedFile*)a)->url_path,
+                ((const ServedFile*)b)->url_path);
+}
+
+static ServedFile* find_file(const char* url_path) {
+  ServedFile key;
+  snprintf(key.url_path, sizeof(key.url_path), "%s", url_path);
+  return bsearch(&key, files, num_files, sizeof(ServedFile), compare_files);
+}
+
+// Decodes %XX escapes in place, as in file names with spaces.
+static void url_decode(char* path) {
+  char* out = path;
+  for (char* in = path; *in; ++in) {
+    if (in[0] == '%' && in[1] && in[2]) {
+      char hex[3] = { in[1], in[2], '\0' };
+      *out++ = (char)strtol(hex, NULL, 16);
+      in += 2;
+    } else {
+      *out++ = *in;
+    }
+  }
+  *out = '\0';
+}
+
+static bool send_all(int fd, const char* data, size_t size, int flags) {
+  while (size) {
+    ssize_t sent = send(fd, data, size, MSG_NOSIGNAL | flags);
+    if (sent <= 0) {
+      if (sent < 0 && errno == EINTR) {
+        continue;
+      }
+      return false;
+    }
+    data += sent;
+    size -= sent;
+  }
+  return true;
+}
+
+static bool send_file_range(int fd, const ServedFile* file, off_t start,
+                            off_t size) {
+  off_t offset = start;
+  while (size) {
+    ssize_t sent = sendfile(fd, file->fd, &offset, size);
+    if (sent <= 0) {
+      if (sent < 0 && errno == EINTR) {
+        continue;
+      }
+      return false;
+    }
+    size -= sent;
+  }
+  return true;
+}
+
+// True if value is "bytes=A-B" with B inside a file of file_size.
+static bool range_within(const char* value, off_t file_size) {
+  char* end;
+  if (strncmp(value, "bytes=", 6) || !strchr(value, '-')) {
+    return false;
+  }
+  const char* last = strchr(value, '-') + 1;
+  if (*last < '0' || *last > '9') {
+    return false;
+  }
+  return strtoll(last, &end, 10) < file_size;
+}
+
+// Returns the size of the file, measured again if the range may reach past
+// the end, in case the file has grown since.  Sets *mtime to the modification
+// time from the same measurement, so that the validators match the size.
+static off_t file_size_for_range(ServedFile* file, const char* range,
+                                 time_t* mtime) {
+  off_t size = __atomic_load_n(&file->size, __ATOMIC_RELAXED);
+  *mtime = __atomic_load_n(&file->mtime, __ATOMIC_RELAXED);
+  if (range && !range_within(range, size)) {
+    struct stat st;
+    if (!fstat(file->fd, &st)) {
+      if (st.st_size > size) {
+        size = st.st_size;
+        __atomic_store_n(&file->size, size, __ATOMIC_RELAXED);
+      }
+      if (st.st_mtime != *mtime) {
+        *mtime = st.st_mtime;
+        __atomic_store_n(&file->mtime, *mtime, __ATOMIC_RELAXED);
+      }
+    }
+  }
+  return size;
+}
+
+// Parses "bytes=A-B", "bytes=A-", or "bytes=-N" into an inclusive range within
+// the file.  Returns false if the range can't be satisfied.
+static bool parse_range(const char* value, off_t file_size, off_t* first,
+                        off_t* last) {
+  if (strncmp(value, "bytes=", 6)) {
+    return false;
+  }
+  value += 6;
+
+  char* end;
+  if (*value == '-') {
+    off_t suffix = strtoll(value + 1, &end, 10);
+    if (suffix <= 0 || file_size == 0) {
+      return false;
+    }
+    *first = suffix < file_size ? file_size - suffix : 0;
+    *last = file_size - 1;
+    return true;
+  }
+
+  *first = strtoll(value, &end, 10);
+  if (end == value || *end != '-' || *first >= file_size) {
+    return false;
+  }
+  value = end + 1;
+  if (*value >= '0' && *value <= '9') {
+    *last = strtoll(value, &end, 10);
+    if (*last < *first) {
+      return false;
+    }
+    if (*last >= file_size) {
+      *last = file_size - 1;
+    }
+  } else {
+    *last = file_size - 1;
+  }
+  return true;
+}
+
+// The ETag changes with the size, so a growing file gets a new one.
+static void format_etag(char* etag, size_t etag_size, time_t mtime,
+                        off_t file_size) {
+  snprintf(etag, etag_size, "\"%llx-%llx\"", (long long)mtime,
+           (long long)file_size);
+}
+
+static void format_http_date(char* date, size_t date_size, time_t time) {
+  struct tm tm;
+  gmtime_r(&time, &tm);
+  strftime(date, date_size, "%a, %d %b %Y %H:%M:%S GMT", &tm);
+}
+
+// True if the request's validators say the client's copy is current.  As in
+// RFC 9110, If-Modified-Since only counts without If-None-Match.
+static bool not_modified(const char* if_none_match,
+                         const char* if_modified_since, const char* etag,
+                         time_t mtime) {
+  if (if_none_match) {
+    return !strcmp(if_none_match, "*") || strstr(if_none_match, etag);
+  }
+
+  if (if_modified_since) {
+    struct tm tm;
+    memset(&tm, 0, sizeof(tm));
+    if (strptime(if_modified_since, "%a, %d %b %Y %H:%M:%S GMT", &tm)) {
+      return mtime <= timegm(&tm);
+    }
+  }
+
+  return false;
+}
+
+static bool send_error_response(Connection* connection, int status,
+                                const char* reason, bool keep_alive,
+                                const char* extra_headers) {
+  char headers[512];
+  int length = snprintf(
+      headers, sizeof(headers),
+      "HTTP/1.1 %d %s\r\n"
+      "Content-Length: 0\r\n"
+      "Connection: %s\r\n"
+      "%s"
+      "\r\n",
+      status, reason, keep_alive ? "keep-alive" : "close",
+      extra_headers ? extra_headers : "");
+  printf("%s: %d %s\n", connection->peer, status, reason);
+  return send_all(connection->fd, headers, length, 0);
+}
+
+// Answers one request.  Returns false if the connection should be closed.
+// Adds the body bytes sent to *bytes_sent.
+static bool handle_request(Connection* connection, char* request,
+                           uint64_t* bytes_sent) {
+  // Request line: METHOD PATH VERSION
+  char* line_end = strstr(request, "\r\n");
+  if (!line_end) {
+    return false;
+  }
+  *line_end = '\0';
+
+  char method[8], path[MAX_PATH], version[16];
+  if (sscanf(request, "%7s %1023s %15s", method, path, version) != 3) {
+    send_error_response(connection, 400, "Bad Request", false, NULL);
+    return false;
+  }
+
+  // HTTP/1.1 is keep-alive unless asked otherwise, and 1.0 is the reverse.
+  bool keep_alive = strcmp(version, "HTTP/1.0") != 0;
+  const char* range = NULL;
+  const char* if_none_match = NULL;
+  const char* if_modified_since = NULL;
+  for (char* header = line_end + 2; *header; ) {
+    char* next = strstr(header, "\r\n");
+    if (!next) {
+      break;
+    }
+    *next = '\0';
+
+    if (!strncasecmp(header, "Range:", 6)) {
+      range = header + 6;
+      while (*range == ' ') {
+        range++;
+      }
+    } else if (!strncasecmp(header, "If-None-Match:", 14)) {
+      if_none_match = header + 14;
+      while (*if_none_match == ' ') {
+        if_none_match++;
+      }
+    } else if (!strncasecmp(header, "If-Modified-Since:", 18)) {
+      if_modified_since = header + 18;
+      while (*if_modified_since == ' ') {
+        if_modified_since++;
+      }
+    } else if (!strncasecmp(header, "Connection:", 11)) {
+      const char* value = header + 11;
+      while (*value == ' ') {
+        value++;
+      }
+      if (!strcasecmp(value, "close")) {
+        keep_alive = false;
+      } else if (!strcasecmp(value, "keep-alive")) {
+        keep_alive = true;
+      }
+    }
+    header = next + 2;
+  }
+
+  bool head = !strcmp(method, "HEAD");
+  if (!head && strcmp(method, "GET")) {
+    return send_error_response(connection, 501, "Not Implemented",
+                               keep_alive, NULL) && keep_alive;
+  }
+
+  char* query = strchr(path, '?');
+  if (query) {
+    *query = '\0';
+  }
+  url_decode(path);
+
+  ServedFile* file = find_file(path);
+  if (!file) {
+    return send_error_response(connection, 404, "Not Found",
+                               keep_alive, NULL) && keep_alive;
+  }
+
+  time_t mtime;
+  off_t file_size = file_size_for_range(file, range, &mtime);
+
+  char etag[64];
+  char last_modified[64];
+  format_etag(etag, sizeof(etag), mtime, file_size);
+  format_http_date(last_modified, sizeof(last_modified), mtime);
+  char validators[160];
+  snprintf(validators, sizeof(validators),
+           "ETag: %s\r\nLast-Modified: %s\r\n", etag, last_modified);
+
+  // Validators come before the range, so a ranged request can get a 304.
+  if (not_modified(if_none_match, if_modified_since, etag, mtime)) {
+    return send_error_response(connection, 304, "Not Modified",
+                               keep_alive, validators) && keep_alive;
+  }
+
+  off_t first = 0;
+  off_t last = file_size - 1;
+  if (range && !parse_range(range, file_size, &first, &last)) {
+    char extra[64];
+    snprintf(extra, sizeof(extra), "Content-Range: bytes */%lld\r\n",
+             (long long)file_size);
+    return send_error_response(connection, 416, "Range Not Satisfiable",
+                               keep_alive, extra) && keep_alive;
+  }
+  off_t size = file_size ? last - first + 1 : 0;
+
+  char headers[512];
+  int length;
+  if (range) {
+    length = snprintf(
+        headers, sizeof(headers),
+        "HTTP/1.1 206 Partial Content\r\n"
+        "Content-Type: application/octet-stream\r\n"
+        "Content-Length: %lld\r\n"
+        "Content-Range: bytes %lld-%lld/%lld\r\n"
+        "Accept-Ranges: bytes\r\n"
+        "%s"
+        "Connection: %s\r\n"
+        "\r\n",
+        (long long)size, (long long)first, (long long)last,
+        (long long)file_size, validators,
+        keep_alive ? "keep-alive" : "close");
+  } else {
+    length = snprintf(
+        headers, sizeof(headers),
+        "HTTP/1.1 200 OK\r\n"
+        "Content-Type: application/octet-stream\r\n"
+        "Content-Length: %lld\r\n"
+        "Accept-Ranges: bytes\r\n"
+        "%s"
+        "Connection: %s\r\n"
+        "\r\n",
+        (long long)size, validators, keep_alive ? "keep-alive" : "close");
+  }
+
+  uint64_t start_us = now_us();
+  // MSG_MORE holds the headers back to go out with the start of the body.
+  if (!send_all(connection->fd, headers, length,
+                head || !size ? 0 : MSG_MORE)) {
+    return false;
+  }
+  if (!head && size && !send_file_range(connection->fd, file, first, size)) {
+    return false;
+  }
+  uint64_t elapsed_us = now_us() - start_us;
+
+  if (!head) {
+    *bytes_sent += size;
+  }
+  printf("%s: %s %s bytes %lld-%lld, %lld bytes in %.1f ms, %.1f Mbps\n",
+         connection->peer, method, path, (long long)first, (long long)last,
+         (long long)(head ? 0 : size), elapsed_us / 1000.0,
+         mbps(head ? 0 : size, elapsed_us));
+  return keep_alive;
+}
+
+static void* connection_thread(void* arg) {
+  Connection* connection = (Connection*)arg;
+  uint64_t start_us = now_us();
+  uint64_t bytes_sent = 0;
+  int requests = 0;
+
+  char buffer[MAX_REQUEST_BYTES + 1];
+  int buffered = 0;
+  bool open = true;
+  while (open) {
+    // Answer every complete request already buffered, in order, before
+    // reading more.  This is what makes pipelining work.
+    char* end;
+    buffer[buffered] = '\0';
+    while (open && (end = strstr(buffer, "\r\n\r\n")) != NULL) {
+      int request_length = end + 4 - buffer;
+      end[2] = '\0';
+      open = handle_request(connection, buffer, &bytes_sent);
+      requests++;
+      buffered -= request_length;
+      memmove(buffer, buffer + request_length, buffered);
+      buffer[buffered] = '\0';
+    }
+    if (!open) {
+      break;
+    }
+
+    if (buffered == MAX_REQUEST_BYTES) {
+      send_error_response(connection, 431,
+                          "Request Header Fields Too Large", false, NULL);
+      break;
+    }
+
+    ssize_t received = recv(connection->fd, buffer + buffered,
+                            MAX_REQUEST_BYTES - buffered, 0);
+    if (received < 0 && errno == EINTR) {
+      continue;
+    }
+    if (received <= 0) {
+      break;
+    }
+    buffered += received;
+  }
+
+  uint64_t elapsed_us = now_us() - start_us;
+  printf("%s: closed after %d requests, %llu bytes in %.1f s, %.1f Mbps\n",
+         connection->peer, requests, (unsigned long long)bytes_sent,
+         elapsed_us / 1e6, mbps(bytes_sent, elapsed_us));
+
+  close(connection->fd);
+  free(connection);
+  return NULL;
+}
+
+static void usage(const char* program) {
+  fprintf(stderr, "Usage: %s [-p PORT] [-b BASE_PATH] FOLDER\n", program);
+}
+
+int main(int argc, char** argv) {
+  int port = DEFAULT_PORT;
+  const char* base_path = "/";
+  int opt;
+  while ((opt = getopt(argc, argv, "p:b:")) != -1) {
+    if (opt == 'p') {
+      port = atoi(optarg);
+    } else if (opt == 'b') {
+      base_path = optarg;
+    } else {
+      usage(argv[0]);
+      return 1;
+    }
+  }
+  if (optind != argc - 1) {
+    usage(argv[0]);
+    return 1;
+  }
+
+  // The base path always begins and ends with a slash.
+  char url_base[MAX_PATH];
+  snprintf(url_base, sizeof(url_base), "%s%s", base_path[0] == '/' ? "" : "/",
+           base_path);
+  if (url_base[strlen(url_base) - 1] != '/') {
+    strncat(url_base, "/", sizeof(url_base) - strlen(url_base) - 1);
+  }
+
+  scan_folder(url_base, argv[optind]);
+  if (!num_files) {
+    fprintf(stderr, "No files to serve in %s!\n", argv[optind]);
+    return 1;
+  }
+  qsort(files, num_files, sizeof(ServedFile), compare_files);
+
+  // Log lines, not blocks, so they can be watched live.
+  setvbuf(stdout, NULL, _IOLBF, 0);
+  signal(SIGPIPE, SIG_IGN);
+
+  int server_fd = socket(AF_INET6, SOCK_STREAM, 0);
+  int one = 1;
+  int zero = 0;
+  setsockopt(server_fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+  setsockopt(server_fd, IPPROTO_IPV6, IPV6_V6ONLY, &zero, sizeof(zero));
+
+  struct sockaddr_in6 address;
+  memset(&address, 0, sizeof(address));
+  address.sin6_family = AF_INET6;
+  address.sin6_addr = in6addr_any;
+  address.sin6_port = htons(port);
+  if (bind(server_fd, (struct sockaddr*)&address, sizeof(address)) ||
+      listen(server_fd, 16)) {
+    perror("bind");
+    return 1;
+  }
+
+  printf("Serving %d files from %s at http://localhost:%d%s\n",
+         num_files, argv[optind], port, url_base);
+
+  while (true) {
+    struct sockaddr_in6 peer;
+    socklen_t peer_length = sizeof(peer);
+    int fd = accept(server_fd, (struct sockaddr*)&peer, &peer_length);
+    if (fd < 0) {
+      continue;
+    }
+
+    // Responses are written in as few segments as possible, and should never
+    // wait on an ACK to go out.
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    struct timeval timeout = { IDLE_TIMEOUT_SECONDS, 0 };
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+
+    Connection* connection = malloc(sizeof(Connection));
+    connection->fd = fd;
+    char host[INET6_ADDRSTRLEN];
+    inet_ntop(AF_INET6, &peer.sin6_addr, host, sizeof(host));
+    // Show IPv4 clients without the IPv6 mapping.
+    const char* shown = strncmp(host, "::ffff:", 7) ? host : host + 7;
+    snprintf(connection->peer, sizeof(connection->peer), "%s:%d", shown,
+             ntohs(peer.sin6_port));
+    printf("%s: connected\n", connection->peer);
+
+    pthread_t thread;
+    if (pthread_create(&thread, NULL, connection_thread, connection)) {
+      close(fd);
+      free(connection);
+      continue;
+    }
+    pthread_detach(thread);
+  }
+}
@@ -16,6 +16,15 @@ static void onJoystickEvent(u16 joystick, u16 changed, u16 state) {
     if (state & BUTTON_START) {
       segavideo_togglePause();
     }
+    if (state & BUTTON_B) {
+      segavideo_toggleHud();
+    }
+    if (state & BUTTON_LEFT) {
+      segavideo_seek(-1);
+    }
+    if (state & BUTTON_RIGHT) {
+      segavideo_seek(1);
+    }
   }
 }
 
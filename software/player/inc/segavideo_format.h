@@ -21,6 +21,16 @@
 
 #define SEGAVIDEO_HEADER_MAGIC  "what nintendon't"
 #define SEGAVIDEO_HEADER_FORMAT 0x0003
+// The same, except that frames are SegaVideoDeltaFrame instead of
+// SegaVideoFrame.
+#define SEGAVIDEO_HEADER_FORMAT_DELTA 0x0004
+// The same, except that frames are SegaVideoTilemapFrame instead of
+// SegaVideoFrame.
+#define SEGAVIDEO_HEADER_FORMAT_TILEMAP 0x0005
+// The same, except that frames are SegaVideoRleFrame instead of
+// SegaVideoFrame, behind a table of their offsets.  Only for video embedded in
+// ROM.
+#define SEGAVIDEO_HEADER_FORMAT_RLE 0x0006
 
 // This header appears at the start of the file in both embedded and streaming
 // mode.  Each one is exactly 8kB, so they can form the basis of a catalog
@@ -30,7 +40,7 @@
 // the catalog.
 typedef struct SegaVideoHeader {
   uint8_t magic[16];  // SEGAVIDEO_HEADER_MAGIC
-  uint16_t format;  // SEGAVIDEO_HEADER_FORMAT
+  uint16_t format;  // SEGAVIDEO_HEADER_FORMAT or one of its variants below
   uint16_t frameRate;  // fps
   uint16_t sampleRate;  // Hz
   uint32_t totalFrames;  // num frames
@@ -41,8 +51,12 @@ typedef struct SegaVideoHeader {
   // 38 bytes above.
   char title[128];  // US-ASCII for display with a very simple font
   char relative_url[128];  // relative to catalog, filled in catalog creation
-  uint16_t compression;  // 0 == uncompressed / embedded
-  uint8_t padding[696];  // zeros
+  uint16_t compression;  // 0 == uncompressed / embedded, or flags below
+  // The number of lighter renditions of the same video, served at
+  // relative_url + ".1", ".2", etc., with identical chunk timing.  Filled in
+  // catalog creation.  Only used by the microcontroller.
+  uint16_t renditions;
+  uint8_t padding[694];  // zeros
   // 7200 bytes below.
 
   // A thumbnail for display in the streamer ROM menu. Just like
@@ -52,6 +66,54 @@ typedef struct SegaVideoHeader {
   uint32_t thumbTiles[8 * 16 * 14];  // 16x14 tiles
 } __attribute__((packed)) SegaVideoHeader;
 
+// Bits of SegaVideoHeader.compression.  Any compression comes with the index
+// below.  The Sega never sees compressed data.
+//
+// Chunks are compressed with exactly one of these codecs.
+//
+// Run-length encoded.  See common/rle-common.h.
+#define SEGAVIDEO_COMPRESSION_RLE 0x0001
+// LZ, with back-references to recent output.  See common/lz-common.h.
+#define SEGAVIDEO_COMPRESSION_LZ 0x0004
+#define SEGAVIDEO_COMPRESSION_CODECS \
+    (SEGAVIDEO_COMPRESSION_RLE | SEGAVIDEO_COMPRESSION_LZ)
+//
+// Chunk audio is 4-bit ADPCM, which the microcontroller expands to 8-bit PCM
+// after the codec.  Only used along with a codec.  See common/adpcm-common.h.
+#define SEGAVIDEO_COMPRESSION_ADPCM 0x0002
+//
+// The video is live, and still growing as the encoder appends chunks.  The
+// index is written as they go, and totalChunks and chunkSize are 0.  Only used
+// along with a codec.  See SEGA_CHUNK_OFFSET_LIVE_END.
+#define SEGAVIDEO_COMPRESSION_LIVE 0x0008
+//
+// The index is cut short, after at least totalChunks + 1 entries, and padded
+// with SEGA_CHUNK_OFFSET_EOF to a multiple of 256 bytes.  See
+// segavideo_indexEntries().  Never used along with SEGAVIDEO_COMPRESSION_LIVE.
+#define SEGAVIDEO_COMPRESSION_SHORT_INDEX 0x0010
+
+// The catalog index, catalog.idx, lists the same videos as the catalog, in
+// the same order, without their thumbnails.  The streamer ROM draws its menu
+// from this, and fetches the thumbnail of each video from the catalog only
+// when it is shown, so the menu doesn't have to wait for the entire catalog.
+//
+// The catalog index is:
+//  SegaVideoCatalogIndex header
+//  SegaVideoCatalogEntry entries[header->numEntries]
+#define SEGAVIDEO_CATALOG_INDEX_FORMAT 0x0001
+
+typedef struct SegaVideoCatalogIndex {
+  uint8_t magic[16];  // SEGAVIDEO_HEADER_MAGIC
+  uint16_t format;  // SEGAVIDEO_CATALOG_INDEX_FORMAT
+  uint16_t numEntries;
+} __attribute__((packed)) SegaVideoCatalogIndex;
+
+typedef struct SegaVideoCatalogEntry {
+  char title[32];  // the start of SegaVideoHeader.title, always nul-terminated
+  uint32_t durationSeconds;
+  uint32_t headerOffset;  // bytes, of this video's SegaVideoHeader in catalog
+} __attribute__((packed)) SegaVideoCatalogEntry;
+
 // This header appears after the main header, only when compression != 0.
 // It is not used by the Sega, only by the microcontroller to make requests for
 // compressed chunks.  In streaming, the microcontroller decompresses the
@@ -68,13 +130,42 @@ typedef struct SegaVideoIndex {
 
 #define SEGA_CHUNK_OFFSET_EOF ((uint32_t)0xffffffff)
 
+// In a live video, entries not written yet are SEGA_CHUNK_OFFSET_EOF.  The
+// encoder publishes each chunk by writing the entry after it, which is where
+// the chunk ends.  When the stream is over, the entry after the end of the
+// last chunk is this.
+#define SEGA_CHUNK_OFFSET_LIVE_END ((uint32_t)0xfffffffe)
+
+// Index entries come in blocks of 256 bytes, to keep the audio of chunk 0
+// aligned.
+#define SEGAVIDEO_INDEX_BLOCK_ENTRIES (256 / sizeof(uint32_t))
+#define SEGAVIDEO_INDEX_MAX_ENTRIES \
+    (sizeof(SegaVideoIndex) / sizeof(uint32_t))
+
+// The number of index entries it is safe to read from a video with this
+// compression.  The index may be longer, but every entry a player needs is in
+// these.
+static inline uint32_t segavideo_indexEntries(uint16_t compression,
+                                              uint32_t totalChunks) {
+  if (!compression) {
+    return 0;
+  }
+  if (!(compression & SEGAVIDEO_COMPRESSION_SHORT_INDEX) ||
+      totalChunks + 1 > SEGAVIDEO_INDEX_MAX_ENTRIES) {
+    return SEGAVIDEO_INDEX_MAX_ENTRIES;
+  }
+  uint32_t blocks = (totalChunks + SEGAVIDEO_INDEX_BLOCK_ENTRIES) /
+                    SEGAVIDEO_INDEX_BLOCK_ENTRIES;
+  return blocks * SEGAVIDEO_INDEX_BLOCK_ENTRIES;
+}
+
 // After these headers is a sequence of chunks.
 
 // Each chunk is:
 //  SegaVideoChunkHeader header
 //  uint8_t padding[header->paddingBytes]  // aligns samples to 256 bytes
 //  uint8_t samples[chunkSoundLen]
-//  SegaVideoFrame frames[chunkFrameCount]
+//  SegaVideoFrame frames[chunkFrameCount]  // or a variant, by header format
 
 typedef struct SegaVideoChunkHeader {
   uint32_t samples;  // in audio, each of which is one byte
@@ -100,6 +191,59 @@ typedef struct SegaVideoFrame {
   uint32_t tiles[8 * 32 * 28];  // 32 bytes per tile (8*uint32_t), 32x28 tiles
 } __attribute__((packed)) SegaVideoFrame;
 
+// In SEGAVIDEO_HEADER_FORMAT_DELTA, frames vary in size, and only carry the
+// tiles that differ from what is already in VRAM.  Because the player
+// alternates between two sets of tiles, each frame is relative to the frame
+// two before it, which is the last one loaded into the same set.  The first
+// two frames of each chunk hold every tile, so that playback can start at any
+// chunk.
+//
+// Each delta frame is:
+//  SegaVideoDeltaFrame header
+//  SegaVideoTileRun runs[header->numRuns]
+//  uint32_t tiles[8 * header->numTiles]  // the tiles of each run, in order
+typedef struct SegaVideoDeltaFrame {
+  uint16_t palette[16];  // the whole palette, as in SegaVideoFrame
+  uint16_t numRuns;  // SegaVideoTileRun entries that follow
+  uint16_t numTiles;  // total tiles in all runs
+} __attribute__((packed)) SegaVideoDeltaFrame;
+
+// Consecutive tiles to replace, in the order of trivial_tilemap_0/1.
+typedef struct SegaVideoTileRun {
+  uint16_t firstTile;  // 0-895
+  uint16_t numTiles;
+} __attribute__((packed)) SegaVideoTileRun;
+
+// In SEGAVIDEO_HEADER_FORMAT_TILEMAP, frames vary in size.  Each one has its
+// own tilemap, which can use a tile any number of times, flipped or not, so
+// repeated tiles are only stored once.
+//
+// Each tilemap frame is:
+//  SegaVideoTilemapFrame header
+//  uint32_t tiles[8 * header->numTiles]
+typedef struct SegaVideoTilemapFrame {
+  uint16_t palette[16];  // as in SegaVideoFrame
+  uint16_t numTiles;  // unique tiles that follow, up to 896
+  // Left-to-right, top-to-bottom, 32x28.  Each entry is an index into this
+  // frame's tiles, plus flip bits, as created by the TILE_ATTR_FULL() macro
+  // with palette 0 and no priority.
+  uint16_t tileMap[32 * 28];
+} __attribute__((packed)) SegaVideoTilemapFrame;
+
+// In SEGAVIDEO_HEADER_FORMAT_RLE, each tile of a full frame is compressed on
+// its own, in the RLE format of common/rle-common.h, so that the player can
+// decode any number of tiles at a time.  Frames vary in size, so the frames of
+// each chunk start with a table of offsets:
+//  uint32_t frameOffsets[frames + 1]  // from the table, plus the end of frames
+//  SegaVideoRleFrame frames[frames]  // each padded to an even size
+//
+// Each RLE frame is:
+//  SegaVideoRleFrame header
+//  uint8_t tiles[]  // 896 compressed tiles, in the order of trivial_tilemap_0/1
+typedef struct SegaVideoRleFrame {
+  uint16_t palette[16];  // as in SegaVideoFrame
+} __attribute__((packed)) SegaVideoRleFrame;
+
 // Frames are displayed by alternating between two trivial tilemaps that have
 // no deduplication, no priority, and no flipping.  Each tilemap entry is a
 // uint16_t value as created by the TILE_ATTR_FULL() macro.  These are ordered
@@ -107,5 +251,24 @@ typedef struct SegaVideoFrame {
 // resource file trivial_tilemap.res.
 
 // Streaming hardware will write chunks to alternating 1MB regions of SRAM.
+// Short chunks are packed into each region, back to back, so that a region
+// holds several slots.  The first region also starts with the header when it
+// holds chunk 0.  Only full frames have a fixed chunk size, so delta and
+// tilemap videos always get one chunk per region.  Counting from the chunk
+// that playback started or seeked to, each run of this many chunks fills one
+// region, and the regions alternate.
+#define SEGAVIDEO_MAX_CHUNKS_PER_REGION 4
+
+static inline uint32_t segavideo_chunksPerRegion(uint16_t format,
+                                                 uint32_t regionSize,
+                                                 uint32_t chunkSize) {
+  if (format != SEGAVIDEO_HEADER_FORMAT || !chunkSize ||
+      regionSize < sizeof(SegaVideoHeader) + chunkSize) {
+    return 1;
+  }
+  uint32_t chunks = (regionSize - sizeof(SegaVideoHeader)) / chunkSize;
+  return chunks < SEGAVIDEO_MAX_CHUNKS_PER_REGION ?
+      chunks : SEGAVIDEO_MAX_CHUNKS_PER_REGION;
+}
 
 #endif // _SEGAVIDEO_FORMAT_H
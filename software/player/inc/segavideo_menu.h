@@ -51,6 +51,10 @@ bool segavideo_menu_hasError();
 // Before that time, the state of the error flag is undefined.
 void segavideo_menu_showError();
 
+// Show streaming stats from the hardware below the error.  Only valid while
+// the error is on screen, since this overwrites the menu data.
+void segavideo_menu_showStats();
+
 // Clear the error state and screen.
 // The error is automatically cleared during a successful call to
 // segavideo_menu_checkHardware().
@@ -11,6 +11,41 @@
 
 #include <genesis.h>
 
+// Returns true when the next region of video data is ready to play.
+typedef bool ReadyCallback();
+
+// Called as playback moves on to the next chunk, with the slot it occupies in
+// the ring of streaming regions.  See segavideo_chunksPerRegion().
+typedef void FlipCallback(uint16_t region);
+
+// Moves the source of video data by a signed number of chunks.  Returns false
+// on failure, and may set the Error state to report it.  Either way, playback
+// stops.
+typedef bool SeekCallback(int16_t chunks);
+
+// Playback stats, reset each time a video starts.  Times are in
+// milliseconds, with the resolution of SGDK's getTick() (1/300 s).
+typedef struct SegaVideoPlayerStats {
+  uint32_t framesShown;  // frames fully uploaded and on screen
+  uint32_t framesDropped;  // frames skipped to keep up with the audio
+  uint16_t maxDropRun;  // most frames skipped in a row
+  // Times delta playback fell too far behind the audio, and skipped the rest
+  // of a chunk to catch up.  Those frames count as dropped, too.
+  uint16_t deltaResyncs;
+  // Audio samples played past the start of the frame just started, at the
+  // time it started.  Positive when video is behind audio.
+  int32_t lastLagSamples;
+  int32_t maxLagSamples;
+  // From starting a frame's tile upload to the frame appearing.
+  uint16_t lastUploadMs;
+  uint16_t maxUploadMs;
+  // Chunk switches stalled because the next region wasn't ready yet, and
+  // how long they waited.
+  uint16_t regionWaits;
+  uint32_t lastRegionWaitMs;
+  uint32_t maxRegionWaitMs;
+} SegaVideoPlayerStats;
+
 // Initialize everything needed to play video.  Must be called before any of
 // these other methods.
 void segavideo_init();
@@ -31,6 +66,12 @@ void segavideo_resume();
 // Toggle the paused state.
 void segavideo_togglePause();
 
+// Skips forward (positive) or back (negative) by a number of chunks, from the
+// start of the chunk currently playing.  Stops at the first or last chunk.
+// Skips at most SEGAVIDEO_MAX_SEEK_CHUNKS at a time.
+#define SEGAVIDEO_MAX_SEEK_CHUNKS 127
+void segavideo_seek(int16_t chunks);
+
 // Stops the video. Can be started again with segavideo_start() or
 // segavideo_stream(). Does not require another call to segavideo_init().
 void segavideo_stop();
@@ -38,6 +79,16 @@ void segavideo_stop();
 // True if we are playing something.
 bool segavideo_isPlaying();
 
+// Stats for the video playing now, or the last one played.
+const SegaVideoPlayerStats* segavideo_getStats();
+
+// Show or hide a one-line stats overlay at the top of the screen during
+// playback.  The setting persists across videos.
+void segavideo_setHudEnabled(bool enabled);
+
+// Toggle the stats overlay.
+void segavideo_toggleHud();
+
 // For internal use in the streamer ROM.  Don't use this.
 bool segavideo_validateHeader(const uint8_t* videoData);
 
@@ -47,7 +98,9 @@ bool segavideo_playInternal(const uint8_t* videoData, bool pleaseLoop,
                             uint32_t pleaseRegionMask,
                             VoidCallback* pleaseLoopCallback,
                             VoidCallback* pleaseStopCallback,
-                            VoidCallback* pleaseFlipCallback,
-                            VoidCallback* pleaseEmuHackCallback);
+                            FlipCallback* pleaseFlipCallback,
+                            VoidCallback* pleaseEmuHackCallback,
+                            ReadyCallback* pleaseReadyCallback,
+                            SeekCallback* pleaseSeekCallback);
 
 #endif // _SEGAVIDEO_PLAYER_H
@@ -0,0 +1,50 @@
+// Kinetoscope: A Sega Genesis Video Player
+//
+// Copyright (c) 2024 Joey Parrish
+//
+// See MIT License in LICENSE.txt
+
+// Streaming performance stats.
+// Written to SRAM by the streaming hardware on request, and displayed by the
+// streamer ROM.
+//
+// This can run on the Sega, inside an emulator, or in the firmware of the
+// streaming hardware.  Like the video format, all fields are big-endian.
+
+#ifndef _SEGAVIDEO_STATS_H
+#define _SEGAVIDEO_STATS_H
+
+#if defined(SGDK_GCC)
+# include <genesis.h>
+#else
+# include <stdint.h>
+#endif
+
+// Counters for chunk fetches.  Times are in milliseconds.
+typedef struct SegaVideoChunkStats {
+  uint32_t chunks;  // number of chunks counted here
+  uint32_t bytesFetched;  // bytes from the network
+  uint32_t bytesDecoded;  // bytes written to SRAM after decompression
+  uint32_t headerMs;  // from sending the request to the end of the headers
+  uint32_t bodyMs;  // reading the body from the network
+  uint32_t ringWaitMs;  // network reads stalled waiting on SRAM writes
+  uint32_t sramMs;  // writing to SRAM, including decompression
+  uint32_t shortReads;  // network reads that returned less than requested
+} __attribute__((packed)) SegaVideoChunkStats;
+
+typedef struct SegaVideoStats {
+  SegaVideoChunkStats lastChunk;  // the most recent chunk only
+  SegaVideoChunkStats total;  // all chunks since the video started
+  uint32_t reconnects;  // connections opened after the first
+  uint32_t underflows;  // FLIP_REGION arrived before a fetch completed
+  // How long before FLIP_REGION the previous fetch completed, in ms.
+  // Negative on underflow.
+  int32_t lastMarginMs;
+  int32_t minMarginMs;
+  uint32_t throughput;  // bytes per second, smoothed
+  uint16_t rendition;  // 0 is the full rendition, higher is lighter
+  // The most bytes buffered ahead of SRAM at once, since the video started.
+  uint32_t readAheadHighWater;
+} __attribute__((packed)) SegaVideoStats;
+
+#endif // _SEGAVIDEO_STATS_H
@@ -13,6 +13,7 @@
 #include "segavideo_format.h"
 #include "segavideo_player.h"
 #include "segavideo_state_internal.h"
+#include "segavideo_stats.h"
 
 #include "kinetoscope_logo.h"
 #include "menu_font.h"
@@ -26,6 +27,14 @@ static char **menuLines;
 static int numVideos;
 static int selectedIndex;
 static int max_status_y = 0;
+// Where stats are drawn, below the error message.
+static int stats_y = 0;
+// True while CMD_AWAIT_FILL is outstanding after a fast start.
+static bool fillPending = false;
+// Thumbnails are fetched one at a time, as they are shown.
+static bool thumbPending = false;  // CMD_GET_THUMB is outstanding
+static int thumbRequested = -1;  // the last index sent with CMD_GET_THUMB
+static int thumbShown = -1;  // the index whose thumbnail is on screen
 
 // All offsets and sizes are in tiles, not pixels
 #define MENU_ITEM_X 2
@@ -53,16 +62,23 @@ static int max_status_y = 0;
 #define INSTRUCTIONS_X 0
 #define INSTRUCTIONS_Y 15
 
+#define DURATION_X 1
+#define DURATION_Y 21
+
 // NOTE: The font occupies 96 tiles, 1696 through 1791
 
 #define MAX_CATALOG_SIZE 127
 
 #if defined(SIMULATE_HARDWARE)
 # include "embedded_catalog.h"
+# include "embedded_catalog_index.h"
 # include "embedded_video.h"
 
-# define KINETOSCOPE_MENU_DATA embedded_catalog
+# define KINETOSCOPE_MENU_DATA embedded_catalog_index
+# define KINETOSCOPE_THUMB_DATA(offset) \
+    ((const SegaVideoHeader*)(embedded_catalog + (offset)))
 # define KINETOSCOPE_ERROR_DATA "Error: something went wrong!"
+# define KINETOSCOPE_STATS_DATA NULL
 # define KINETOSCOPE_VIDEO_DATA embedded_video
 # define KINETOSCOPE_VIDEO_REGION_SIZE 0
 # define KINETOSCOPE_VIDEO_REGION_MASK 0xffffffff
@@ -74,7 +90,12 @@ static int max_status_y = 0;
 # define KINETOSCOPE_PORT_ERROR   ((volatile uint16_t*)0xA1300A)  // low 1 bit, clear on write
 # define KINETOSCOPE_DATA          ((volatile uint8_t*)0x200000)
 # define KINETOSCOPE_MENU_DATA        ((const uint8_t*)KINETOSCOPE_DATA)
+// CMD_GET_THUMB writes one header into the second bank, leaving the catalog
+// index in the first.
+# define KINETOSCOPE_THUMB_DATA(offset) \
+    ((const SegaVideoHeader*)(KINETOSCOPE_DATA + 0x100000))
 # define KINETOSCOPE_ERROR_DATA          ((const char*)KINETOSCOPE_DATA)
+# define KINETOSCOPE_STATS_DATA ((const SegaVideoStats*)KINETOSCOPE_DATA)
 
 // Play from two SRAM regions:
 //  - starting at 0x200000 and ending at 0x300000
@@ -91,9 +112,14 @@ static int max_status_y = 0;
 #define CMD_LIST_VIDEOS 0x01  // Writes video list to SRAM
 #define CMD_START_VIDEO 0x02  // Begins streaming to SRAM
 #define CMD_STOP_VIDEO  0x03  // Stops streaming
-#define CMD_FLIP_REGION 0x04  // Switch SRAM banks for streaming
+#define CMD_FLIP_REGION 0x04  // Next chunk, arg is its SRAM slot
 #define CMD_GET_ERROR   0x05  // Load error information into SRAM
 #define CMD_CONNECT_NET 0x06  // Connect to the network
+#define CMD_START_FAST  0x08  // Begins streaming, returns after one region
+#define CMD_AWAIT_FILL  0x09  // Returns when the region being filled is ready
+#define CMD_SEEK        0x0A  // Seeks by a signed number of chunks, refills
+#define CMD_GET_STATS   0x0B  // Load streaming stats into SRAM
+#define CMD_GET_THUMB   0x0C  // Load a catalog header into the second bank
 
 // Token values for async communication.
 #define TOKEN_CONTROL_TO_SEGA     0
@@ -400,33 +426,109 @@ bool segavideo_menu_load() {
     return false;
   }
 
-  const uint8_t* data = KINETOSCOPE_MENU_DATA;
+  const SegaVideoCatalogIndex* index =
+      (const SegaVideoCatalogIndex*)KINETOSCOPE_MENU_DATA;
 
-  // Validate the catalog header.
-  if (!segavideo_validateHeader(data)) {
+  // Validate the catalog index header.  No memcmp in SGDK...
+  bool valid = index->format == SEGAVIDEO_CATALOG_INDEX_FORMAT &&
+               index->numEntries;
+  for (uint16_t i = 0; i < sizeof(index->magic); ++i) {
+    if (index->magic[i] != SEGAVIDEO_HEADER_MAGIC[i]) {
+      valid = false;
+    }
+  }
+  if (!valid) {
     errorMessage("Video catalog is invalid!");
     return false;
   }
 
-  // Count the number of entries in the catalog and copy their titles.
-  const SegaVideoHeader* header = (const SegaVideoHeader*)data;
-  numVideos = 0;
-  while (header->magic[0]) {
-    // This relies on header->title (128 bytes) being larger than menuLines[x]
+  if (index->numEntries > MAX_CATALOG_SIZE) {
+    errorMessage("Video catalog overflow!");
+    return false;
+  }
+
+  // Copy the titles.
+  const SegaVideoCatalogEntry* entry = (const SegaVideoCatalogEntry*)(index + 1);
+  numVideos = index->numEntries;
+  for (int i = 0; i < numVideos; ++i) {
+    // This relies on entry->title (32 bytes) being larger than menuLines[x]
     // and zero-padded.
-    memcpy(menuLines[numVideos], header->title, STATUS_MESSAGE_W);
-    menuLines[numVideos][STATUS_MESSAGE_W] = '\0';  // Allocated byte for this
+    memcpy(menuLines[i], entry[i].title, STATUS_MESSAGE_W);
+    menuLines[i][STATUS_MESSAGE_W] = '\0';  // Allocated byte for this
+  }
+
+  // The thumbnails are fetched as they are shown.
+  thumbShown = -1;
+  return true;
+}
+
+static const SegaVideoCatalogEntry* getCatalogEntry(int index) {
+  const SegaVideoCatalogIndex* catalogIndex =
+      (const SegaVideoCatalogIndex*)KINETOSCOPE_MENU_DATA;
+  const SegaVideoCatalogEntry* entry =
+      (const SegaVideoCatalogEntry*)(catalogIndex + 1);
+  return entry + index;
+}
+
+static void drawThumbnail(int index) {
+  const SegaVideoHeader* header =
+      KINETOSCOPE_THUMB_DATA(getCatalogEntry(index)->headerOffset);
+
+  bool second = index & 1;
+  uint16_t tileIndex = second ? THUMB_TILE_INDEX_2 : THUMB_TILE_INDEX;
+  const uint16_t* tileMap = (const uint16_t*)(trivial_tilemap_half_0);
+  uint16_t palNum = PAL_THUMB;
+
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Waddress-of-packed-member"
+  // Unpacked, raw pointer method used by VDP_loadTileSet
+  VDP_loadTileData(header->thumbTiles, tileIndex, THUMB_TILES, CPU);
 
-    numVideos++;
-    header++;
+  // Unpacked, raw pointer method used by PAL_setPaletteColors
+  PAL_setColors(palNum << 4, header->thumbPalette, /* count= */ 16, CPU);
+#pragma GCC diagnostic pop
+
+  // Unpacked, raw pointer method used by VDP_setTileMapEx
+  VDP_setTileMapDataRectEx(BG_B, tileMap, tileIndex,
+      /* x= */ THUMB_X, /* y= */ THUMB_Y,
+      /* w= */ THUMB_MAP_W, /* h= */ THUMB_MAP_H,
+      /* stride= */ THUMB_MAP_W, CPU);
+}
 
-    if (numVideos > MAX_CATALOG_SIZE) {
-      errorMessage("Video catalog overflow!");
-      return false;
+// Requests the selected thumbnail and draws it when it arrives, without
+// holding up the menu.  If the selection moves on before it arrives, the next
+// one is requested instead.
+static void updateThumbnail() {
+#if defined(SIMULATE_HARDWARE)
+  thumbPending = false;
+  thumbRequested = selectedIndex;
+#else
+  if (thumbPending) {
+    if (!isSegaInControl()) {
+      return;
+    }
+    thumbPending = false;
+
+    if (pendingError()) {
+      // Leave the menu, so the main loop shows the error.
+      segavideo_setState(Idle);
+      return;
     }
   }
+#endif
 
-  return true;
+  if (thumbRequested == selectedIndex) {
+    if (thumbShown != selectedIndex) {
+      drawThumbnail(selectedIndex);
+      thumbShown = selectedIndex;
+    }
+    return;
+  }
+
+  thumbPending = sendCommand(CMD_GET_THUMB, selectedIndex);
+  if (thumbPending) {
+    thumbRequested = selectedIndex;
+  }
 }
 
 static void drawMenuItem(
@@ -449,8 +551,11 @@ void segavideo_menu_draw() {
 
     segavideo_setState(Menu);
     menuChanged = true;
+    thumbShown = -1;
   }
 
+  updateThumbnail();
+
   if (!menuChanged) return;
 
   for (int16_t offset = -1; offset <= 1; ++offset) {
@@ -463,30 +568,14 @@ void segavideo_menu_draw() {
                  /* selected= */ offset == 0);
   }
 
-  // Draw thumbnail
-  const uint8_t* data = KINETOSCOPE_MENU_DATA;
-  const SegaVideoHeader* header = (const SegaVideoHeader*)data;
-  header += selectedIndex;
-
-  bool second = selectedIndex & 1;
-  uint16_t tileIndex = second ? THUMB_TILE_INDEX_2 : THUMB_TILE_INDEX;
-  const uint16_t* tileMap = (const uint16_t*)(trivial_tilemap_half_0);
-  uint16_t palNum = PAL_THUMB;
-
-#pragma GCC diagnostic push
-#pragma GCC diagnostic ignored "-Waddress-of-packed-member"
-  // Unpacked, raw pointer method used by VDP_loadTileSet
-  VDP_loadTileData(header->thumbTiles, tileIndex, THUMB_TILES, CPU);
-
-  // Unpacked, raw pointer method used by PAL_setPaletteColors
-  PAL_setColors(palNum << 4, header->thumbPalette, /* count= */ 16, CPU);
-#pragma GCC diagnostic pop
-
-  // Unpacked, raw pointer method used by VDP_setTileMapEx
-  VDP_setTileMapDataRectEx(BG_B, tileMap, tileIndex,
-      /* x= */ THUMB_X, /* y= */ THUMB_Y,
-      /* w= */ THUMB_MAP_W, /* h= */ THUMB_MAP_H,
-      /* stride= */ THUMB_MAP_W, CPU);
+  // Draw the duration, which comes from the index, so it doesn't wait for
+  // the thumbnail.
+  char line[STATUS_MESSAGE_W + 1];
+  uint32_t seconds = getCatalogEntry(selectedIndex)->durationSeconds;
+  sprintf(line, "%d:%02d", (int)(seconds / 60), (int)(seconds % 60));
+  VDP_clearTextArea(DURATION_X, DURATION_Y, THUMB_X - DURATION_X, 1);
+  VDP_setTextPalette(PAL_WHITE);
+  VDP_drawText(line, DURATION_X, DURATION_Y);
 
   menuChanged = false;
 }
@@ -510,9 +599,11 @@ static void streamingLoopCallback() {
 static void streamingStopCallback() {
   // Playing from special hardware, so we should tell it to stop streaming.
 
-  // We may have just sent CMD_FLIP_REGION without waiting.  Make sure we
-  // have the token before sending a stop command.
-  waitForReply(/* timeout_seconds= */ 1);
+  // We may have just sent CMD_FLIP_REGION or CMD_AWAIT_FILL without waiting.
+  // Make sure we have the token before sending a stop command.  A fill can
+  // take much longer than a flip.
+  waitForReply(/* timeout_seconds= */ fillPending ? 30 : 1);
+  fillPending = false;
 
   uint16_t command_timeout = 30; // seconds
   if (!sendCommandAndWait(CMD_STOP_VIDEO, 0x00, command_timeout)) {
@@ -520,14 +611,46 @@ static void streamingStopCallback() {
   }
 }
 
-static void streamingFlipCallback() {
+static void streamingFlipCallback(uint16_t region) {
   // We send this command without awaiting a response.  Can't get stuck
-  // waiting during playback.
-  if (!sendCommand(CMD_FLIP_REGION, 0x00)) {
+  // waiting during playback.  The streamer refills a region once we have moved
+  // on to the first slot of the other one.
+  if (!sendCommand(CMD_FLIP_REGION, region)) {
     errorMessage("Failed to flip region!");
   }
 }
 
+static bool streamingReadyCallback() {
+  if (!fillPending) {
+    // Regions after the first are filled during playback of the previous one.
+    // If they aren't ready in time, the streamer reports an underflow.
+    return true;
+  }
+
+  // The streamer returns the token when CMD_AWAIT_FILL is done.
+  if (!isSegaInControl()) {
+    return false;
+  }
+
+  fillPending = false;
+  return true;
+}
+
+static bool streamingSeekCallback(int16_t chunks) {
+  // As in streamingStopCallback(), make sure we have the token first.
+  waitForReply(/* timeout_seconds= */ fillPending ? 30 : 1);
+  fillPending = false;
+
+  // The streamer takes the chunk count as a signed byte, and refills both
+  // regions from there before returning control.
+  uint16_t command_timeout = 30; // seconds
+  if (!sendCommandAndWait(CMD_SEEK, chunks & 0xFF, command_timeout)) {
+    errorMessage("Failed to seek!");
+    return false;
+  }
+  return true;
+}
+
 static void streamingEmuHackCallback() {
 #if !defined(SIMULATE_HARDWARE)
   // HACK: Work around emulation issues.  Read the token so that the emulator
@@ -538,12 +661,22 @@ static void streamingEmuHackCallback() {
 }
 
 bool segavideo_menu_select(bool loop) {
+  // Make sure we have the token back from any thumbnail request first.
+  if (thumbPending) {
+    waitForReply(/* timeout_seconds= */ 5);
+    thumbPending = false;
+  }
+
   uint16_t command_timeout = 30; // seconds
   uint16_t video_index = selectedIndex;
-  if (!sendCommandAndWait(CMD_START_VIDEO, video_index, command_timeout)) {
+  // Start playing as soon as the first region is full.  The second region
+  // keeps filling in the background, and the player waits on
+  // streamingReadyCallback() before it needs that.
+  if (!sendCommandAndWait(CMD_START_FAST, video_index, command_timeout)) {
     errorMessage("Failed to start video stream!");
     return false;
   }
+  fillPending = sendCommand(CMD_AWAIT_FILL, 0x00);
 
   if (!segavideo_playInternal(KINETOSCOPE_VIDEO_DATA,
                               loop,
@@ -552,7 +685,9 @@ bool segavideo_menu_select(bool loop) {
                               streamingLoopCallback,
                               streamingStopCallback,
                               streamingFlipCallback,
-                              streamingEmuHackCallback)) {
+                              streamingEmuHackCallback,
+                              streamingReadyCallback,
+                              streamingSeekCallback)) {
     errorMessage("Wrong video format!");
     return false;
   }
@@ -568,7 +703,8 @@ void segavideo_menu_showError() {
     clearScreen();
     drawLogo();
 
-    uint16_t command_timeout = 5; // seconds
+    // The streamer answers this from memory, right away.
+    uint16_t command_timeout = 1; // seconds
     // NOTE: Bypassing errorMessage() here and calling genericMessage and
     // segavideo_setState to ensure we don't get locked out by pendingError()
     // and segavideo_menu_hasError().
@@ -577,10 +713,79 @@ void segavideo_menu_showError() {
     } else {
       genericMessage(PAL_YELLOW, KINETOSCOPE_ERROR_DATA);
     }
+    stats_y = max_status_y + 1;
     segavideo_setState(Error);
   }
 }
 
+// Clamp a stat so that it fits the room left for it in a line of text.
+static int statCount(uint32_t value, uint32_t max) {
+  return value < max ? (int)value : (int)max;
+}
+
+static int statMargin(int32_t ms) {
+  const int32_t max = 999999;
+  return ms > max ? max : (ms < -max ? -max : ms);
+}
+
+void segavideo_menu_showStats() {
+  // The streamer answers this from memory, right away.
+  uint16_t command_timeout = 1; // seconds
+  if (!sendCommandAndWait(CMD_GET_STATS, 0, command_timeout)) {
+    genericMessage(PAL_YELLOW, "Failed to retrieve stats!");
+    return;
+  }
+
+  const SegaVideoStats* stats = KINETOSCOPE_STATS_DATA;
+  if (!stats) {
+    return;
+  }
+
+  char line[STATUS_MESSAGE_W + 1];
+  int y = stats_y;
+  VDP_setTextPalette(PAL_WHITE);
+
+  // SGDK has no snprintf, so all of these must stay within a line.  Each value
+  // is clamped to its room in the line, since after a failure, counters can
+  // be huge and margins deeply negative.
+  const SegaVideoChunkStats* last = &stats->lastChunk;
+  sprintf(line, "Last: %dkB -> %dkB",
+          statCount(last->bytesFetched >> 10, 9999),
+          statCount(last->bytesDecoded >> 10, 9999));
+  VDP_drawText(line, STATUS_MESSAGE_X, y++);
+  sprintf(line, " hdr %d body %d ms",
+          statCount(last->headerMs, 99999), statCount(last->bodyMs, 99999));
+  VDP_drawText(line, STATUS_MESSAGE_X, y++);
+  sprintf(line, " wait %d sram %d ms",
+          statCount(last->ringWaitMs, 99999), statCount(last->sramMs, 99999));
+  VDP_drawText(line, STATUS_MESSAGE_X, y++);
+  sprintf(line, " short reads %d", statCount(last->shortReads, 9999999));
+  VDP_drawText(line, STATUS_MESSAGE_X, y++);
+
+  const SegaVideoChunkStats* total = &stats->total;
+  sprintf(line, "Total: %d chunks, %dkB",
+          statCount(total->chunks, 99999),
+          statCount(total->bytesFetched >> 10, 999999));
+  VDP_drawText(line, STATUS_MESSAGE_X, y++);
+  sprintf(line, " short reads %d", statCount(total->shortReads, 9999999));
+  VDP_drawText(line, STATUS_MESSAGE_X, y++);
+  sprintf(line, "Reconnects %d, underflows %d",
+          statCount(stats->reconnects, 999), statCount(stats->underflows, 999));
+  VDP_drawText(line, STATUS_MESSAGE_X, y++);
+  sprintf(line, "Margin %d, min %d ms",
+          statMargin(stats->lastMarginMs), statMargin(stats->minMarginMs));
+  VDP_drawText(line, STATUS_MESSAGE_X, y++);
+  sprintf(line, "%d kB/s, rendition %d",
+          statCount(stats->throughput >> 10, 99999),
+          statCount(stats->rendition, 99));
+  VDP_drawText(line, STATUS_MESSAGE_X, y++);
+  sprintf(line, "Read-ahead max %dkB",
+          statCount(stats->readAheadHighWater >> 10, 9999));
+  VDP_drawText(line, STATUS_MESSAGE_X, y++);
+
+  max_status_y = y;
+}
+
 void segavideo_menu_clearError() {
   clearPendingError();
   segavideo_setState(Idle);
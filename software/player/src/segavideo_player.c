@@ -21,6 +21,17 @@
 
 #define AUDIO_DRIVER AUDIO_XGM2
 
+#define TILE_TRANSFER_CPU  1
+#define TILE_TRANSFER_DMA  2
+
+// TILE_TRANSFER_DMA frees the 68000 during uploads, but a full frame takes 6
+// VBlanks of slices, right at the edge of 10 fps on NTSC, and its worst case
+// hasn't been measured on hardware yet.  Until it has, the CPU copy is the
+// default.  Build with -DTILE_TRANSFER=2 to try DMA.
+#if !defined(TILE_TRANSFER)
+# define TILE_TRANSFER TILE_TRANSFER_CPU
+#endif
+
 typedef struct ChunkInfo {
   const uint8_t* start;
   const uint8_t* audioStart;
@@ -42,10 +53,19 @@ static int totalChunks;
 static ChunkInfo nextChunk;
 static uint32_t regionSize;
 static uint32_t regionMask;
+// In streaming, each region holds this many chunks, counting from
+// originChunkNum.  See segavideo_chunksPerRegion().
+static uint32_t chunkSize;
+static int chunksPerRegion;
+static int originChunkNum;
 static VoidCallback* loopCallback;
 static VoidCallback* stopCallback;
-static VoidCallback* flipCallback;
+static FlipCallback* flipCallback;
 static VoidCallback* emuHackCallback;
+static ReadyCallback* readyCallback;
+static SeekCallback* seekCallback;
+// True if playback is stalled waiting on readyCallback.
+static bool waitingForRegion;
 
 // Audio
 static uint16_t sampleRate;
@@ -54,7 +74,19 @@ static uint32_t audioResumeSamples;
 
 // Video
 static uint16_t frameRate;
+static uint16_t videoFormat;  // SEGAVIDEO_HEADER_FORMAT or a variant
 static uint32_t nextFrameNum;
+// True if the tiles and palette on screen are the second set.
+static bool secondOnScreen;
+// Delta frames can't be dropped on their own, so delta playback falls behind
+// the audio instead.  Past this many frames behind, it skips the rest of the
+// chunk, since the first two frames of the next one hold every tile.
+#define DELTA_MAX_LAG_FRAMES 10
+// True while skipping delta frames until the next chunk.
+static bool deltaResync;
+// True once the audio driver has been pointed at the next chunk, so that it
+// plays on into it at the end of this one.
+static bool nextAudioQueued;
 
 // Hard-coded for now.  Fullscreen video only.
 #define MAP_W 32
@@ -62,6 +94,82 @@ static uint32_t nextFrameNum;
 #define NUM_TILES (32 * 28)  // 896
 #define FRAME_TILE_INDEX 0  // Overwrites 16 system tiles, but we need space
 
+// Stats
+static SegaVideoPlayerStats stats;
+static uint32_t uploadStartTick;
+static uint32_t regionWaitStartTick;
+// Frames skipped since the last one loaded.
+static uint16_t dropRun;
+
+// The stats HUD is drawn on the window plane, over the top row of the video.
+// Two full frames of tiles fill VRAM up to 0xE000, where the planes are.  The
+// window moves to the 2kB after them, which is otherwise unused, and only its
+// first row is ever shown.  The rest of that space holds the font for the
+// HUD, characters 0x20 (space) through 0x5A (Z).
+#define HUD_WINDOW_ADDR 0xE800
+#define HUD_FONT_INDEX ((HUD_WINDOW_ADDR + MAP_W * 2) / 32)  // 1858
+#define HUD_FONT_FIRST 0x20
+#define HUD_FONT_CHARS 59
+#define HUD_PAL PAL2  // Video uses PAL0 and PAL1
+static bool hudEnabled;
+static bool hudVisible;
+static uint32_t hudDrawTick;
+static uint16_t hudMap[MAP_W];
+
+// A frame to load, in any format.
+typedef struct FrameInfo {
+  const uint16_t* palette;
+  // Runs of tiles to load, and the data for them, in the same order.
+  const SegaVideoTileRun* runs;
+  uint16_t numRuns;
+  const uint32_t* tiles;
+  // If not NULL, the tiles are RLE-compressed here instead, one at a time, and
+  // are decoded into RAM before they are loaded.
+  const uint8_t* rleTiles;
+  // The tilemap that shows them, and the value added to each of its entries.
+  const uint16_t* tileMap;
+  uint16_t mapBase;
+} FrameInfo;
+
+// For frames that load all their tiles in one run.
+static SegaVideoTileRun allTilesRun;
+
+#if TILE_TRANSFER == TILE_TRANSFER_DMA
+// With TILE_TRANSFER_DMA, each frame's tiles are queued for DMA straight from
+// the cartridge in slices, one per VBlank, into the half of VRAM that is not
+// on screen.  The palette and tilemap that show them are queued together in
+// the VBlank after the last slice, so the frame appears all at once.  150
+// tiles (4800 bytes) plus the palette and tilemap (1824 bytes) stays under
+// SGDK's default NTSC transfer limit of 7200 bytes per VBlank, and 896 tiles
+// take 6 VBlanks, so 10 fps fits in NTSC.  RLE tiles are decoded into RAM one
+// slice at a time, and sent from there.  Delta frames may have many short
+// runs of tiles, each of which is a separate DMA, so the runs per slice are
+// limited, too, to stay well within the DMA queue.
+# define DMA_TILES_PER_SLICE 150
+# define DMA_RUNS_PER_SLICE 32
+
+// The frame being uploaded, if uploading.  upload.tiles (or upload.rleTiles)
+// is the next tile to send.
+static bool uploading;
+static FrameInfo upload;
+static uint16_t uploadPalNum;
+static uint16_t uploadTileIndex;
+static uint16_t uploadRun;  // the run being sent
+static uint16_t uploadRunTilesSent;  // tiles of that run already sent
+// True if the chunk ended with this frame.  The switch waits for the upload,
+// since the region can't be handed back while we're still reading from it.
+static bool uploadSwitchChunks;
+
+// Each slice of RLE tiles is decoded whole.  The queue is flushed in the
+// VBlank before the next slice reuses the buffer.
+# define RLE_BUFFER_TILES DMA_TILES_PER_SLICE
+#else
+# define RLE_BUFFER_TILES 150
+#endif
+
+// RLE tiles are decoded here before they are sent to VRAM.
+static uint32_t rleTileBuffer[8 * RLE_BUFFER_TILES];
+
 // NOTE: We use the XGM2 driver.  With the PCM-specific drivers, I found audio
 // got "bubbly"-sounding during full-screen VDP tile transfers.  The XGM2
 // driver does not suffer from this.  I noticed while reading its source that
@@ -139,7 +247,10 @@ bool segavideo_validateHeader(const uint8_t* videoData) {
     }
   }
 
-  if (header->format != SEGAVIDEO_HEADER_FORMAT) {
+  if (header->format != SEGAVIDEO_HEADER_FORMAT &&
+      header->format != SEGAVIDEO_HEADER_FORMAT_DELTA &&
+      header->format != SEGAVIDEO_HEADER_FORMAT_TILEMAP &&
+      header->format != SEGAVIDEO_HEADER_FORMAT_RLE) {
     kprintf("Header format does not match!  New revision?\n");
     return false;
   }
@@ -147,6 +258,40 @@ bool segavideo_validateHeader(const uint8_t* videoData) {
   return true;
 }
 
+// Only valid for formats with variable-size frames.
+static uint32_t frameSize(const uint8_t* frameData) {
+  if (videoFormat == SEGAVIDEO_HEADER_FORMAT_DELTA) {
+    const SegaVideoDeltaFrame* frame = (const SegaVideoDeltaFrame*)frameData;
+    return sizeof(SegaVideoDeltaFrame) +
+           sizeof(SegaVideoTileRun) * frame->numRuns +
+           8 * sizeof(uint32_t) * frame->numTiles;
+  } else {
+    const SegaVideoTilemapFrame* frame =
+        (const SegaVideoTilemapFrame*)frameData;
+    return sizeof(SegaVideoTilemapFrame) +
+           8 * sizeof(uint32_t) * frame->numTiles;
+  }
+}
+
+// Delta and tilemap frames vary in size, so we walk them.  There are only a
+// few dozen in a chunk.  RLE frames come with a table of offsets instead.
+static const uint8_t* findFrame(const ChunkInfo* chunkInfo,
+                                uint32_t frameNum) {
+  if (videoFormat == SEGAVIDEO_HEADER_FORMAT) {
+    return chunkInfo->frameStart + sizeof(SegaVideoFrame) * frameNum;
+  }
+  if (videoFormat == SEGAVIDEO_HEADER_FORMAT_RLE) {
+    const uint32_t* frameOffsets = (const uint32_t*)chunkInfo->frameStart;
+    return chunkInfo->frameStart + frameOffsets[frameNum];
+  }
+
+  const uint8_t* frame = chunkInfo->frameStart;
+  for (uint32_t i = 0; i < frameNum; ++i) {
+    frame += frameSize(frame);
+  }
+  return frame;
+}
+
 static void parseChunk(const uint8_t* chunkStart,
                        ChunkInfo* chunkInfo) {
   const SegaVideoChunkHeader* chunkHeader =
@@ -158,23 +303,62 @@ static void parseChunk(const uint8_t* chunkStart,
   chunkInfo->frameStart = chunkInfo->audioStart + chunkInfo->audioSamples;
   chunkInfo->numFrames = chunkHeader->frames;
   chunkInfo->end =
-      chunkInfo->frameStart + sizeof(SegaVideoFrame) * chunkInfo->numFrames +
+      findFrame(chunkInfo, chunkInfo->numFrames) +
       chunkHeader->postPaddingBytes;
 }
 
+// The slot a chunk occupies in the ring of streaming regions, counting
+// chunksPerRegion slots per region.  This is what we send on each flip.
+static uint16_t regionSlot(int chunkNum) {
+  return (chunkNum - originChunkNum) % (2 * chunksPerRegion);
+}
+
+static const uint8_t* findChunk(int chunkNum) {
+  // The first chunk always follows the header.
+  const uint8_t* chunkStart = loopVideoData + sizeof(SegaVideoHeader);
+
+  if (regionSize) {
+    // Streaming: runs of chunksPerRegion chunks alternate between the two
+    // regions, back to back within each.  Only chunk 0 shares a region with
+    // the header.
+    uint16_t slot = regionSlot(chunkNum);
+    const uint8_t* regionStart = (slot < chunksPerRegion) ?
+        (const uint8_t*)MASK(loopVideoData, regionMask) :
+        NEXT_POINTER(loopVideoData, regionMask, regionSize);
+    if (originChunkNum == 0 && chunkNum < chunksPerRegion) {
+      regionStart += sizeof(SegaVideoHeader);
+    }
+    chunkStart = regionStart + (slot % chunksPerRegion) * chunkSize;
+  } else {
+    // In ROM, the chunks are back to back.  Walk the chunk headers to find it.
+    for (int i = 0; i < chunkNum; ++i) {
+      ChunkInfo chunkInfo;
+      parseChunk(chunkStart, &chunkInfo);
+      chunkStart = chunkInfo.end;
+    }
+  }
+
+  return chunkStart;
+}
+
 static void prepNextChunk(const ChunkInfo* currentChunk,
-                          ChunkInfo* nextChunk,
-                          uint32_t regionMask,
-                          uint32_t regionSize) {
+                          ChunkInfo* nextChunk) {
   if (currentChunkNum == totalChunks - 1) {
     kprintf("No more chunks!\n");
     memset(nextChunk, 0, sizeof(*nextChunk));
   } else {
-    // Compute chunk placement
-    const uint8_t* chunkStart = NEXT_POINTER(
-        currentChunk->end, regionMask, regionSize);
+    // Compute chunk placement.  In ROM, the next chunk follows this one.
+    const uint8_t* chunkStart = regionSize ?
+        findChunk(currentChunkNum + 1) : currentChunk->end;
     parseChunk(chunkStart, nextChunk);
-    kprintf("Next chunk: %p => %p\n", nextChunk->start, nextChunk->end);
+    if (!nextChunk->numFrames && !nextChunk->audioSamples) {
+      // The streamer ends a live video, whose length we were never told,
+      // with an empty chunk.  Treat it just like the end of any other video.
+      kprintf("Empty chunk!  No more chunks!\n");
+      memset(nextChunk, 0, sizeof(*nextChunk));
+    } else {
+      kprintf("Next chunk: %p => %p\n", nextChunk->start, nextChunk->end);
+    }
   }
 }
 
@@ -331,6 +515,251 @@ static void stopAudio() {
 #endif
 }
 
+static void queueNextChunkAudio() {
+  prepNextChunk(&currentChunk, &nextChunk);
+  kprintf("Next audio buffer: %p (%d)\n",
+          nextChunk.audioStart, (int)nextChunk.audioSamples);
+  overwriteAudioAddress(nextChunk.audioStart, nextChunk.audioSamples);
+  nextAudioQueued = true;
+}
+
+static uint32_t ticksToMs(uint32_t ticks) {
+  return ticks * 1000 / TICKPERSECOND;
+}
+
+static void frameShown() {
+  stats.framesShown++;
+  uint32_t ms = ticksToMs(getTick() - uploadStartTick);
+  stats.lastUploadMs = ms;
+  if (ms > stats.maxUploadMs) {
+    stats.maxUploadMs = ms;
+  }
+}
+
+static void switchToNextChunk() {
+  nextFrameNum = 0;
+  deltaResync = false;
+  nextAudioQueued = false;
+  currentChunk = nextChunk;
+  currentChunkNum++;
+  kprintf("Now playing chunk %d\n", currentChunkNum);
+  flipCallback(regionSlot(currentChunkNum));
+}
+
+// NOTE: We know our structures and their members are properly aligned in
+// reality, so we ignore this GCC warning in the frame loading functions below.
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Waddress-of-packed-member"
+
+// Decodes numTiles RLE tiles (see common/rle-common.h) into tiles, and returns
+// the compressed data that follows them.  Each tile is compressed on its own,
+// so its commands end with its 32 bytes.
+static const uint8_t* decodeRleTiles(const uint8_t* rle, uint32_t* tiles,
+                                     uint16_t numTiles) {
+  uint8_t* output = (uint8_t*)tiles;
+  uint8_t* end = output + numTiles * 8 * sizeof(uint32_t);
+  while (output < end) {
+    uint8_t control = *rle++;
+    uint8_t size = control & 0x7f;
+    if (control & 0x80) {
+      memset(output, *rle++, size);
+    } else {
+      memcpy(output, rle, size);
+      rle += size;
+    }
+    output += size;
+  }
+  return rle;
+}
+
+// Fills in a FrameInfo for any format.  trivialTileMap and tileIndex are for
+// the tile set this frame will be loaded into.
+static void parseFrame(const uint8_t* frameData,
+                       const uint16_t* trivialTileMap,
+                       uint16_t palNum, uint16_t tileIndex,
+                       FrameInfo* info) {
+  if (videoFormat == SEGAVIDEO_HEADER_FORMAT_DELTA) {
+    const SegaVideoDeltaFrame* frame = (const SegaVideoDeltaFrame*)frameData;
+    info->palette = frame->palette;
+    info->runs = (const SegaVideoTileRun*)(frame + 1);
+    info->numRuns = frame->numRuns;
+    info->tiles = (const uint32_t*)(info->runs + frame->numRuns);
+    info->rleTiles = NULL;
+    info->tileMap = trivialTileMap;
+    info->mapBase = tileIndex;
+  } else if (videoFormat == SEGAVIDEO_HEADER_FORMAT_TILEMAP) {
+    const SegaVideoTilemapFrame* frame =
+        (const SegaVideoTilemapFrame*)frameData;
+    allTilesRun.firstTile = 0;
+    allTilesRun.numTiles = frame->numTiles;
+    info->palette = frame->palette;
+    info->runs = &allTilesRun;
+    info->numRuns = 1;
+    info->tiles = (const uint32_t*)(frame + 1);
+    info->rleTiles = NULL;
+    // The frame's tilemap has no palette or base index.
+    info->tileMap = frame->tileMap;
+    info->mapBase = TILE_ATTR_FULL(palNum, FALSE, FALSE, FALSE, tileIndex);
+  } else if (videoFormat == SEGAVIDEO_HEADER_FORMAT_RLE) {
+    const SegaVideoRleFrame* frame = (const SegaVideoRleFrame*)frameData;
+    allTilesRun.firstTile = 0;
+    allTilesRun.numTiles = NUM_TILES;
+    info->palette = frame->palette;
+    info->runs = &allTilesRun;
+    info->numRuns = 1;
+    info->tiles = NULL;
+    info->rleTiles = (const uint8_t*)(frame + 1);
+    info->tileMap = trivialTileMap;
+    info->mapBase = tileIndex;
+  } else {
+    const SegaVideoFrame* frame = (const SegaVideoFrame*)frameData;
+    allTilesRun.firstTile = 0;
+    allTilesRun.numTiles = NUM_TILES;
+    info->palette = frame->palette;
+    info->runs = &allTilesRun;
+    info->numRuns = 1;
+    info->tiles = frame->tiles;
+    info->rleTiles = NULL;
+    // The trivial tilemaps include the palette already.
+    info->tileMap = trivialTileMap;
+    info->mapBase = tileIndex;
+  }
+}
+
+#if TILE_TRANSFER == TILE_TRANSFER_DMA
+// Queues the next slice of the frame, or once all the tiles are in VRAM, the
+// palette and tilemap.  Returns true when the frame is complete.
+static bool continueFrameUpload() {
+  if (uploadRun < upload.numRuns) {
+    uint16_t tilesLeft = DMA_TILES_PER_SLICE;
+    uint16_t runsLeft = DMA_RUNS_PER_SLICE;
+    while (uploadRun < upload.numRuns && tilesLeft && runsLeft) {
+      const SegaVideoTileRun* run = &upload.runs[uploadRun];
+      uint16_t tiles = run->numTiles - uploadRunTilesSent;
+      if (tiles > tilesLeft) {
+        tiles = tilesLeft;
+      }
+
+      const uint32_t* source = upload.tiles;
+      if (upload.rleTiles) {
+        // Each run in the slice gets its own part of the buffer.
+        uint32_t* buffer =
+            rleTileBuffer + (DMA_TILES_PER_SLICE - tilesLeft) * 8;
+        upload.rleTiles = decodeRleTiles(upload.rleTiles, buffer, tiles);
+        source = buffer;
+      } else {
+        // Each tile is 8 uint32_t.
+        upload.tiles += tiles * 8;
+      }
+
+      VDP_loadTileData(source,
+                       uploadTileIndex + run->firstTile + uploadRunTilesSent,
+                       tiles, DMA_QUEUE);
+      tilesLeft -= tiles;
+      runsLeft--;
+
+      uploadRunTilesSent += tiles;
+      if (uploadRunTilesSent == run->numTiles) {
+        uploadRun++;
+        uploadRunTilesSent = 0;
+      }
+    }
+    return false;
+  }
+
+  // The last slice went out in the previous VBlank.  In the same order as the
+  // CPU path: colors, then map.  Both are copied to RAM by SGDK as they are
+  // queued, since the region may be handed back before the next VBlank.  A
+  // tilemap frame's map is in the region, and with a mapBase of 0, SGDK would
+  // otherwise queue it straight from there.
+  PAL_setColors(uploadPalNum << 4, upload.palette, /* count= */ 16,
+                DMA_QUEUE_COPY);
+  VDP_setTileMapDataRectEx(BG_B, upload.tileMap, upload.mapBase,
+      /* x= */ 0, /* y= */ 0,
+      /* w= */ MAP_W, /* h= */ MAP_H,
+      /* stride= */ MAP_W, DMA_QUEUE_COPY);
+  secondOnScreen = uploadTileIndex != FRAME_TILE_INDEX;
+  uploading = false;
+  frameShown();
+
+  if (uploadSwitchChunks) {
+    switchToNextChunk();
+  }
+  return true;
+}
+#endif
+
+static void cancelFrameUpload() {
+#if TILE_TRANSFER == TILE_TRANSFER_DMA
+  // Drop any transfers still queued, which may point to data that is about to
+  // change, or draw a frame over whatever comes next.
+  DMA_clearQueue();
+  uploading = false;
+  uploadSwitchChunks = false;
+#endif
+}
+
+// Starts loading a frame into the tile set at tileIndex.  Returns true if the
+// whole frame is already on screen, and false if the rest will be loaded by
+// continueFrameUpload().
+static bool loadFrame(const FrameInfo* info, uint16_t palNum,
+                      uint16_t tileIndex) {
+  uploadStartTick = getTick();
+
+#if TILE_TRANSFER == TILE_TRANSFER_DMA
+  uploading = true;
+  upload = *info;
+  uploadPalNum = palNum;
+  uploadTileIndex = tileIndex;
+  uploadRun = 0;
+  uploadRunTilesSent = 0;
+  uploadSwitchChunks = false;
+  return continueFrameUpload();
+#elif TILE_TRANSFER == TILE_TRANSFER_CPU
+  // The order of loading things here matters, but it took some experimentation
+  // to get it right.  Tiles, colors, then map gives us clean frames that look
+  // good.  Tiles, map, then colors gives us some cruft on the first frame and
+  // at potentially transitions.  Other orderings were super bad and crazy.
+
+  // Unpacked, raw pointer method used by VDP_loadTileSet
+  const uint32_t* tiles = info->tiles;
+  const uint8_t* rleTiles = info->rleTiles;
+  for (uint16_t i = 0; i < info->numRuns; ++i) {
+    const SegaVideoTileRun* run = &info->runs[i];
+    if (rleTiles) {
+      // Decoded into RAM as many at a time as the buffer holds.
+      for (uint16_t sent = 0; sent < run->numTiles; sent += RLE_BUFFER_TILES) {
+        uint16_t count = run->numTiles - sent;
+        if (count > RLE_BUFFER_TILES) {
+          count = RLE_BUFFER_TILES;
+        }
+        rleTiles = decodeRleTiles(rleTiles, rleTileBuffer, count);
+        VDP_loadTileData(rleTileBuffer, tileIndex + run->firstTile + sent,
+                         count, CPU);
+      }
+    } else {
+      VDP_loadTileData(tiles, tileIndex + run->firstTile, run->numTiles, CPU);
+      // Each tile is 8 uint32_t.
+      tiles += run->numTiles * 8;
+    }
+  }
+
+  // Unpacked, raw pointer method used by PAL_setPaletteColors
+  PAL_setColors(palNum << 4, info->palette, /* count= */ 16, CPU);
+
+  // Unpacked, raw pointer method used by VDP_setTileMapEx
+  VDP_setTileMapDataRectEx(BG_B, info->tileMap, info->mapBase,
+      /* x= */ 0, /* y= */ 0,
+      /* w= */ MAP_W, /* h= */ MAP_H,
+      /* stride= */ MAP_W, CPU);
+  secondOnScreen = tileIndex != FRAME_TILE_INDEX;
+  frameShown();
+  return true;
+#endif
+}
+
+#pragma GCC diagnostic pop
+
 static bool nextVideoFrame() {
   // Get the current audio address to sync video frames against.
   uint32_t currentSample = getCurrentAudioAddress();
@@ -341,6 +770,13 @@ static bool nextVideoFrame() {
     return false;
   }
 
+#if TILE_TRANSFER == TILE_TRANSFER_DMA
+  // Finish the frame in progress before starting another.
+  if (uploading && !continueFrameUpload()) {
+    return true;
+  }
+#endif
+
   // No more frames, but we let the audio finish playing, so return true.
   if (!currentChunk.numFrames) return true;
   if (currentChunkNum >= totalChunks) return true;
@@ -356,22 +792,103 @@ static bool nextVideoFrame() {
   // be less than 1<<32 to avoid overflow.  At a frameRate of 10 fps and a
   // sample rate of 13312 Hz, this overflows after 538 minutes, which is nearly
   // 9 hours.
-  uint32_t currentFrameNum = samplesPlayed * frameRate / sampleRate;
+  //
+  // This is where the audio is, which video can lag behind.  See below.
+  uint32_t audioFrameNum = samplesPlayed * frameRate / sampleRate;
+
+  if (samplesPlayed >= currentChunk.audioSamples) {
+    // The audio isn't in this chunk.  Before the handoff below, it is still
+    // finishing the chunk before, so wait for it.
+    if (!nextAudioQueued) return true;
+
+    // After the handoff, it has moved on to the next chunk without us.  Skip
+    // the rest of this one to catch up.  The first frames of each chunk are
+    // complete, even in delta videos.
+    uint32_t dropped = currentChunk.numFrames - nextFrameNum;
+    kprintf("WARNING: %d FRAMES DROPPED AT END OF CHUNK\n", (int)dropped);
+    stats.framesDropped += dropped;
+    dropRun += dropped;
+    if (dropRun > stats.maxDropRun) {
+      stats.maxDropRun = dropRun;
+    }
+    switchToNextChunk();
+    return true;
+  }
+
+  // Two frames before the end of the chunk, change the audio address.  When
+  // the audio driver "loops", it will play the next chunk.  If we wait until
+  // the last frame, it's too late, and the audio driver has already looped.
+  // This goes by the audio, since the video may be behind it.
+  if (!nextAudioQueued && audioFrameNum + 3 >= currentChunk.numFrames) {
+    if (currentChunkNum != totalChunks - 1 && !readyCallback()) {
+      // The next chunk isn't in SRAM yet.  Hold playback here until it is,
+      // rather than let the audio driver loop into garbage.  See
+      // segavideo_processFrames().
+      kprintf("Waiting for next region.\n");
+      segavideo_pause();
+      waitingForRegion = true;
+      stats.regionWaits++;
+      regionWaitStartTick = getTick();
+      return true;
+    }
+    queueNextChunkAudio();
+  }
 
   // Not yet time for a new frame.
+  uint32_t currentFrameNum = audioFrameNum;
   if (currentFrameNum < nextFrameNum) return true;
 
   // Debug dropped frames:
+  uint32_t dropped = 0;
   if (currentFrameNum != nextFrameNum) {
     kprintf("WARNING: FRAME DROPPED %d => %d\n",
         (int)nextFrameNum, (int)currentFrameNum);
+
+    // Each delta frame builds on the one two before it, so none can be
+    // skipped on its own.  Fall behind instead, and catch up later.  Too far
+    // behind, skip the rest of the chunk.
+    if (videoFormat == SEGAVIDEO_HEADER_FORMAT_DELTA && !deltaResync) {
+      if (currentFrameNum - nextFrameNum > DELTA_MAX_LAG_FRAMES) {
+        kprintf("Skipping to the next chunk to catch up.\n");
+        deltaResync = true;
+        stats.deltaResyncs++;
+      } else {
+        currentFrameNum = nextFrameNum;
+      }
+    }
+
+    // Never skip past the last frame, so that the chunk switch below happens.
+    if (currentFrameNum >= currentChunk.numFrames) {
+      currentFrameNum = currentChunk.numFrames - 1;
+    }
+    dropped = currentFrameNum - nextFrameNum;
+  }
+  if (deltaResync) {
+    // This one isn't loaded, either.
+    dropped++;
+  }
+  if (dropped) {
+    stats.framesDropped += dropped;
+    dropRun += dropped;
+    if (dropRun > stats.maxDropRun) {
+      stats.maxDropRun = dropRun;
+    }
   }
 
-  const SegaVideoFrame* frame = (const SegaVideoFrame*)
-      (currentChunk.frameStart + (sizeof(SegaVideoFrame) * currentFrameNum));
+  // This can't overflow either, for the same reasons as above.
+  stats.lastLagSamples =
+      samplesPlayed - currentFrameNum * sampleRate / frameRate;
+  if (stats.lastLagSamples > stats.maxLagSamples) {
+    stats.maxLagSamples = stats.lastLagSamples;
+  }
 
-  // We alternate tile and palette indexes every frame.
-  bool second = currentFrameNum & 1;
+  // We alternate tile and palette indexes every frame.  Going by what's on
+  // screen rather than the frame number keeps a dropped frame from loading
+  // into the half we're showing.  Delta frames are only skipped up to the end
+  // of a chunk, so each one lands in the set of the frame two before it,
+  // which it was encoded against.  That holds across chunks, too, even after
+  // an odd number of frames, where the frame number's parity would not.
+  bool second = !secondOnScreen;
   const uint16_t* tileMap = (const uint16_t*)(
       second ? trivial_tilemap_1 : trivial_tilemap_0);
   uint16_t palNum =
@@ -380,62 +897,89 @@ static bool nextVideoFrame() {
   // User tiles start at index 256, and the max index is 1425.
   uint16_t tileIndex = FRAME_TILE_INDEX + (second ? NUM_TILES : 0);
 
-  // The order of loading things here matters, but it took some experimentation
-  // to get it right.  Tiles, colors, then map gives us clean frames that look
-  // good.  Tiles, map, then colors gives us some cruft on the first frame and
-  // at potentially transitions.  Other orderings were super bad and crazy.
+  // While skipping to the next chunk, nothing is loaded, and the chunk
+  // transitions below go on as usual.
+  bool frameLoaded = true;
+  if (!deltaResync) {
+    const uint8_t* frame = findFrame(&currentChunk, currentFrameNum);
+    FrameInfo info;
+    parseFrame(frame, tileMap, palNum, tileIndex, &info);
+    frameLoaded = loadFrame(&info, palNum, tileIndex);
+    dropRun = 0;
+  }
 
-  // NOTE: We know our structures and their members are properly aligned in
-  // reality, so we ignore this GCC warning here.
-#pragma GCC diagnostic push
-#pragma GCC diagnostic ignored "-Waddress-of-packed-member"
-  // Unpacked, raw pointer method used by VDP_loadTileSet
-  VDP_loadTileData(frame->tiles, tileIndex, NUM_TILES, CPU);
+  nextFrameNum = currentFrameNum + 1;
 
-  // Unpacked, raw pointer method used by PAL_setPaletteColors
-  PAL_setColors(palNum << 4, frame->palette, /* count= */ 16, CPU);
-#pragma GCC diagnostic pop
+  emuHackCallback();
 
-  // Unpacked, raw pointer method used by VDP_setTileMapEx
-  VDP_setTileMapDataRectEx(BG_B, tileMap, tileIndex,
-      /* x= */ 0, /* y= */ 0,
-      /* w= */ MAP_W, /* h= */ MAP_H,
-      /* stride= */ MAP_W, CPU);
+  // After showing the last frame, change addresses to the next chunk.  The
+  // audio handoff above comes first, so this always follows it.
+  if (nextAudioQueued && nextFrameNum >= currentChunk.numFrames) {
+    if (frameLoaded) {
+      switchToNextChunk();
+    } else {
+#if TILE_TRANSFER == TILE_TRANSFER_DMA
+      uploadSwitchChunks = true;
+#endif
+    }
+  }
 
-  nextFrameNum = currentFrameNum + 1;
+  return true;
+}
 
-  emuHackCallback();
+// Appends text to the HUD at *x.  Anything past the edge is cut off.
+static void hudText(uint16_t* x, const char* text) {
+  while (*text && *x < MAP_W) {
+    hudMap[(*x)++] = TILE_ATTR_FULL(HUD_PAL, TRUE, FALSE, FALSE,
+        HUD_FONT_INDEX + *text++ - HUD_FONT_FIRST);
+  }
+}
 
-  // The logic here manages some tricky chunk transitions.  Note that if we
-  // have a serious issue with frame-dropping, this whole thing falls apart.
+static void hudNumber(uint16_t* x, const char* label, int32_t value) {
+  char str[12];
+  intToStr(value, str, /* minsize= */ 1);
+  hudText(x, label);
+  hudText(x, str);
+  hudText(x, " ");
+}
 
-  // Two frames before the end of the chunk, change the audio address.  When
-  // the audio driver "loops", it will play the next chunk.  If we wait until
-  // the last frame, it's too late, and the audio driver has already looped.
-  bool changeAudioAddress =
-      (nextFrameNum == currentChunk.numFrames - 2) ||
-      (currentChunk.numFrames <= 2);
-
-  // After showing the last frame, change addresses to the next chunk.
-  bool switchChunks = (nextFrameNum == currentChunk.numFrames);
-
-  if (changeAudioAddress) {
-    prepNextChunk(&currentChunk,
-                  &nextChunk,
-                  regionMask,
-                  regionSize);
-    kprintf("Next audio buffer: %p (%d)\n",
-            nextChunk.audioStart, (int)nextChunk.audioSamples);
-    overwriteAudioAddress(nextChunk.audioStart, nextChunk.audioSamples);
-  } else if (switchChunks) {
-    nextFrameNum = 0;
-    currentChunk = nextChunk;
-    currentChunkNum++;
-    kprintf("Now playing chunk %d\n", currentChunkNum);
-    flipCallback();
+static void drawHud() {
+  uint16_t x = 0;
+  hudNumber(&x, "F", stats.framesShown);
+  hudNumber(&x, "D", stats.framesDropped);
+  hudNumber(&x, "R", stats.maxDropRun);
+  hudNumber(&x, "L", stats.lastLagSamples);
+  hudNumber(&x, "U", stats.maxUploadMs);
+  hudNumber(&x, "W", stats.maxRegionWaitMs);
+  while (x < MAP_W) {
+    hudText(&x, " ");
   }
 
-  return true;
+  VDP_setTileMapDataRectEx(WINDOW, hudMap, /* basetile= */ 0,
+      /* x= */ 0, /* y= */ 0,
+      /* w= */ MAP_W, /* h= */ 1,
+      /* stride= */ MAP_W, CPU);
+  hudDrawTick = getTick();
+}
+
+static void showHud() {
+  if (hudVisible) return;
+
+  // The font is one color, in index 1, like the menu's.
+  PAL_setColor(HUD_PAL * 16 + 1, RGB24_TO_VDPCOLOR(0xffffff));
+  VDP_loadTileData(font_default.tiles, HUD_FONT_INDEX, HUD_FONT_CHARS, CPU);
+  VDP_setWindowAddress(HUD_WINDOW_ADDR);
+  drawHud();
+  VDP_setWindowVPos(/* down= */ FALSE, /* pos= */ 1);
+  hudVisible = true;
+}
+
+static void hideHud() {
+  if (!hudVisible) return;
+
+  VDP_setWindowVPos(/* down= */ FALSE, /* pos= */ 0);
+  VDP_setWindowAddress(0xE000);
+  hudVisible = false;
 }
 
 void segavideo_init() {
@@ -461,6 +1005,8 @@ void segavideo_init() {
   playing = false;
   loop = false;
   loopVideoData = NULL;
+  hudEnabled = false;
+  hudVisible = false;
   segavideo_setState(Idle);
 }
 
@@ -469,14 +1015,21 @@ bool segavideo_playInternal(const uint8_t* videoData, bool pleaseLoop,
                             uint32_t pleaseRegionMask,
                             VoidCallback* pleaseLoopCallback,
                             VoidCallback* pleaseStopCallback,
-                            VoidCallback* pleaseFlipCallback,
-                            VoidCallback* pleaseEmuHackCallback) {
+                            FlipCallback* pleaseFlipCallback,
+                            VoidCallback* pleaseEmuHackCallback,
+                            ReadyCallback* pleaseReadyCallback,
+                            SeekCallback* pleaseSeekCallback) {
   regionSize = pleaseRegionSize;
   regionMask = pleaseRegionMask;
   loopCallback = pleaseLoopCallback;
   stopCallback = pleaseStopCallback;
   flipCallback = pleaseFlipCallback;
   emuHackCallback = pleaseEmuHackCallback;
+  readyCallback = pleaseReadyCallback;
+  seekCallback = pleaseSeekCallback;
+  waitingForRegion = false;
+  cancelFrameUpload();
+  memset(&stats, 0, sizeof(stats));
   segavideo_setState(Player);
 
   if (!segavideo_validateHeader(videoData)) {
@@ -502,9 +1055,17 @@ bool segavideo_playInternal(const uint8_t* videoData, bool pleaseLoop,
 
   // Video
   frameRate = header->frameRate;
+  videoFormat = header->format;
   nextFrameNum = 0;
+  deltaResync = false;
+  nextAudioQueued = false;
+  dropRun = 0;
   currentChunkNum = 0;
   totalChunks = header->totalChunks;
+  chunkSize = header->chunkSize;
+  chunksPerRegion = segavideo_chunksPerRegion(
+      videoFormat, regionSize, chunkSize);
+  originChunkNum = 0;
   kprintf("Now playing chunk %d\n", currentChunkNum);
 
   // Parse chunk header
@@ -514,6 +1075,9 @@ bool segavideo_playInternal(const uint8_t* videoData, bool pleaseLoop,
 
   // Clear anything that might have been on screen before.
   clearScreen();
+  if (hudEnabled) {
+    showHud();
+  }
 
   // Start audio
   if (currentChunk.audioSamples) {
@@ -530,6 +1094,20 @@ static void doNothingCallback() {
   // Do nothing.
 }
 
+static void doNothingFlipCallback(uint16_t region) {
+  // Do nothing.
+}
+
+static bool alwaysReadyCallback() {
+  // Everything is in ROM.
+  return true;
+}
+
+static bool romSeekCallback(int16_t chunks) {
+  // Everything is in ROM, so findChunk() can find it.
+  return true;
+}
+
 static void simpleLoopCallback() {
   // Only works to call it again after segavideo_stop().
   // This is the version for content built into a ROM.
@@ -537,8 +1115,10 @@ static void simpleLoopCallback() {
                          /* region size */ 0, /* region mask */ 0xffffffff,
                          simpleLoopCallback,
                          doNothingCallback,
+                         doNothingFlipCallback,
                          doNothingCallback,
-                         doNothingCallback);
+                         alwaysReadyCallback,
+                         romSeekCallback);
 }
 
 void segavideo_play(const uint8_t* videoData, bool loop) {
@@ -547,13 +1127,34 @@ void segavideo_play(const uint8_t* videoData, bool loop) {
                          /* region size */ 0, /* region mask */ 0xffffffff,
                          simpleLoopCallback,
                          doNothingCallback,
+                         doNothingFlipCallback,
                          doNothingCallback,
-                         doNothingCallback);
+                         alwaysReadyCallback,
+                         romSeekCallback);
 }
 
 void segavideo_processFrames() {
   updateAudioDriver();
 
+  if (hudVisible && getTick() - hudDrawTick >= TICKPERSECOND) {
+    drawHud();
+  }
+
+  if (playing && waitingForRegion) {
+    if (!readyCallback()) return;
+
+    // Pick up where nextVideoFrame() left off.
+    kprintf("Next region ready.\n");
+    waitingForRegion = false;
+    uint32_t ms = ticksToMs(getTick() - regionWaitStartTick);
+    stats.lastRegionWaitMs = ms;
+    if (ms > stats.maxRegionWaitMs) {
+      stats.maxRegionWaitMs = ms;
+    }
+    segavideo_resume();
+    queueNextChunkAudio();
+  }
+
   if (!playing || paused) return;
 
   bool stillPlaying = nextVideoFrame();
@@ -595,7 +1196,7 @@ void segavideo_pause() {
 void segavideo_resume() {
   kprintf("segavideo_resume\n");
 
-  if (!playing || !paused) {
+  if (!playing || !paused || waitingForRegion) {
     return;
   }
 
@@ -621,12 +1222,78 @@ void segavideo_togglePause() {
   }
 }
 
+void segavideo_seek(int16_t chunks) {
+  kprintf("segavideo_seek %d\n", (int)chunks);
+
+  // While waiting on a region, the streamer is still busy filling it.
+  if (!playing || waitingForRegion) {
+    return;
+  }
+
+  if (chunks > SEGAVIDEO_MAX_SEEK_CHUNKS) {
+    chunks = SEGAVIDEO_MAX_SEEK_CHUNKS;
+  } else if (chunks < -SEGAVIDEO_MAX_SEEK_CHUNKS) {
+    chunks = -SEGAVIDEO_MAX_SEEK_CHUNKS;
+  }
+
+  // The streamer clamps the same way, so we agree on where we land.
+  int target = currentChunkNum + chunks;
+  if (target < 0) {
+    target = 0;
+  }
+  if (target > totalChunks - 1) {
+    target = totalChunks - 1;
+  }
+
+  // Stop the audio before the data under it changes.  If paused, this was
+  // already done.
+  if (!paused) {
+    stopAudio();
+  }
+  cancelFrameUpload();
+
+  if (!seekCallback(target - currentChunkNum)) {
+    // We don't know what the source left in its regions, so we can't resume.
+    // If the callback reported an error, the error path stops playback.
+    // Otherwise, stop here, as at the end of a video.
+    if (segavideo_getState() != Error) {
+      segavideo_stop();
+    }
+    return;
+  }
+
+  // The streamer refills both regions starting from the target, so the slots
+  // count from there now.
+  currentChunkNum = target;
+  originChunkNum = target;
+  parseChunk(findChunk(currentChunkNum), &currentChunk);
+  nextFrameNum = 0;
+  deltaResync = false;
+  nextAudioQueued = false;
+  kprintf("Now playing chunk %d\n", currentChunkNum);
+
+  if (paused) {
+    // Resume from the start of the new chunk.
+    audioResumeAddr = (uint32_t)currentChunk.audioStart;
+    audioResumeSamples = currentChunk.audioSamples;
+  } else if (currentChunk.audioSamples) {
+    // As in segavideo_playInternal(), the driver loops back to the start of
+    // this chunk until nextVideoFrame() queues the next one.
+    loadAudioDriver();
+    startAudio(currentChunk.audioStart, currentChunk.audioSamples,
+               /*loop=*/ true);
+    waitForAudioDriver();
+  }
+}
+
 void segavideo_stop() {
   kprintf("segavideo_stop\n");
 
   if (playing) {
     stopAudio();
   }
+  cancelFrameUpload();
+  hideHud();
 
   // When we stop the video, clear the screen and load the default font, which
   // may have been overwritten by video playback.
@@ -643,3 +1310,21 @@ void segavideo_stop() {
 bool segavideo_isPlaying() {
   return segavideo_getState() == Player && playing;
 }
+
+const SegaVideoPlayerStats* segavideo_getStats() {
+  return &stats;
+}
+
+void segavideo_setHudEnabled(bool enabled) {
+  hudEnabled = enabled;
+
+  if (!enabled) {
+    hideHud();
+  } else if (segavideo_isPlaying()) {
+    showHud();
+  }
+}
+
+void segavideo_toggleHud() {
+  segavideo_setHudEnabled(!hudEnabled);
+}
@@ -0,0 +1 @@
+../../player/inc/segavideo_stats.h
\ No newline at end of file
@@ -0,0 +1 @@
+BIN embedded_catalog_index embedded_catalog_index.bin 4
@@ -13,25 +13,45 @@
 #include "segavideo_player.h"
 #include "segavideo_state.h"
 
+// How far left/right skip during playback.
+#define SEEK_CHUNKS 10
+
 static void onJoystickEvent(u16 joystick, u16 changed, u16 state) {
   if (segavideo_getState() == Error) {
-    // Error: press start|A to continue.
+    // Error: press start|A to continue, B for streaming stats.
     if (state & (BUTTON_START | BUTTON_A)) {
       segavideo_menu_clearError();
     }
+    if (state & BUTTON_B) {
+      segavideo_menu_showStats();
+    }
   } else if (segavideo_getState() == Player) {
-    // Playing: press start to pause, C to stop.
+    // Playing: press start to pause, C to stop, left/right to skip, B for the
+    // stats overlay.
     if (state & BUTTON_START) {
       segavideo_togglePause();
     }
+    if (state & BUTTON_B) {
+      segavideo_toggleHud();
+    }
+    if (state & BUTTON_LEFT) {
+      segavideo_seek(-SEEK_CHUNKS);
+    }
+    if (state & BUTTON_RIGHT) {
+      segavideo_seek(SEEK_CHUNKS);
+    }
     if (state & BUTTON_C) {
       segavideo_stop();
     }
   } else if (segavideo_getState() == Menu) {
-    // Menu: press start|A to choose, up/down to navigate.
+    // Menu: press start|A to choose, up/down to navigate, B to turn the stats
+    // overlay on or off for playback.
     if (state & (BUTTON_START | BUTTON_A)) {
       segavideo_menu_select(/* loop= */ false);
     }
+    if (state & BUTTON_B) {
+      segavideo_toggleHud();
+    }
     if (state & BUTTON_UP) {
       segavideo_menu_previousItem();
     }